@@ -22,6 +22,9 @@
 #include <fstream>
 #include <cstring>
 #include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include <iostream>
 #include <cassert>
 #include <iomanip>
@@ -66,7 +69,8 @@ const uint8_t reverseb[] = {
   0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
 };
 
-void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols);
+void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols, int first_row = 0);
+void bit_transpose(uint8_t const *inp, uint8_t *out, int nrows, int ncols);
 
 class BitMatrix
 {
@@ -205,7 +209,7 @@ public:
   BitMatrix *transpose()
   {
     uint8_t *mt = new uint8_t[_nb * _m];
-    __sse_trans(matrix, mt, _nb, _mb);
+    bit_transpose(matrix, mt, _nb, _mb);
     return new BitMatrix(mt, _mb, _n, !_le);
   }
 
@@ -231,7 +235,8 @@ private:
 };
 
 // from https://mischasan.wordpress.com/2011/10/03/the-full-sse2-bit-matrix-transpose-routine/
-inline void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols)
+// rows before first_row are left untouched, see __avx2_trans
+inline void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols, int first_row)
 {
 #   define INP(x, y) inp[(x)*ncols/8 + (y)/8]
 #   define OUT(x, y) out[(y)*nrows/8 + (x)/8]
@@ -244,7 +249,7 @@ inline void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols)
   assert(nrows % 8 == 0 && ncols % 8 == 0);
 
   // Do the main body in 16x8 blocks:
-  for ( rr = 0; rr <= nrows - 16; rr += 16 )
+  for ( rr = first_row; rr <= nrows - 16; rr += 16 )
   {
     for ( cc = 0; cc < ncols; cc += 8 )
     {
@@ -255,9 +260,9 @@ inline void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols)
     }
   }
 
-  if ( nrows % 16 == 0 )
+  if ( (nrows - first_row) % 16 == 0 )
     return;
-  rr = nrows - nrows % 16;
+  rr = nrows - (nrows - first_row) % 16;
 
   // The remainder is a block of 8x(16n+8) bits (n may be 0).
   //  Do a PAIR of 8x8 blocks in each step:
@@ -284,4 +289,41 @@ inline void __sse_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols)
     OUT(rr, cc + i) = _mm_movemask_epi8(tmp.x);
 }
 
+#ifdef __AVX2__
+// Same as __sse_trans with 32x8 blocks, the remaining rows are done by __sse_trans.
+inline void __avx2_trans(uint8_t const *inp, uint8_t *out, int nrows, int ncols)
+{
+  ssize_t rr, cc, i;
+  union
+  {
+    __m256i x;
+    uint8_t b[32];
+  } tmp;
+  assert(nrows % 8 == 0 && ncols % 8 == 0);
+
+  for ( rr = 0; rr <= nrows - 32; rr += 32 )
+  {
+    for ( cc = 0; cc < ncols; cc += 8 )
+    {
+      for ( i = 0; i < 32; ++i )
+        tmp.b[i] = INP(rr + i, cc);
+      for ( i = 8; --i >= 0; tmp.x = _mm256_slli_epi64(tmp.x, 1))
+        *(uint32_t *) &OUT(rr, cc + i) = _mm256_movemask_epi8(tmp.x);
+    }
+  }
+
+  if ( rr < nrows )
+    __sse_trans(inp, out, nrows, ncols, rr);
+}
+#endif
+
+inline void bit_transpose(uint8_t const *inp, uint8_t *out, int nrows, int ncols)
+{
+#ifdef __AVX2__
+  __avx2_trans(inp, out, nrows, ncols);
+#else
+  __sse_trans(inp, out, nrows, ncols);
+#endif
+}
+
 }; // end of namespace km
\ No newline at end of file
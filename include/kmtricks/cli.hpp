@@ -41,6 +41,7 @@
 #include <kmtricks/cli/index.hpp>
 #include <kmtricks/cli/query.hpp>
 #include <kmtricks/cli/combine.hpp>
+#include <kmtricks/cli/mquery.hpp>
 
 namespace km
 {
@@ -72,6 +73,7 @@ private:
   index_options_t index_opt {nullptr};
   query_options_t query_opt {nullptr};
   combine_options_t combine_opt {nullptr};
+  mquery_options_t mquery_opt {nullptr};
 };
 
 };  // namespace km
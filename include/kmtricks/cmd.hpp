@@ -32,6 +32,7 @@
 #include <kmtricks/cmd/index.hpp>
 #include <kmtricks/cmd/query.hpp>
 #include <kmtricks/cmd/combine.hpp>
+#include <kmtricks/cmd/mquery.hpp>
 
 #include <kmtricks/io.hpp>
 #include <kmtricks/utils.hpp>
@@ -43,6 +44,7 @@
 #include <kmtricks/progress.hpp>
 #include <kmtricks/signals.hpp>
 #include <kmtricks/matrix.hpp>
+#include <kmtricks/matrix_query.hpp>
 
 #ifdef WITH_PLUGIN
 #include <kmtricks/plugin_manager.hpp>
@@ -68,6 +70,7 @@ struct main_all
     opt->sanity_check();
     KmDir::get().init(opt->dir, opt->fof, true);
     opt->dump(KmDir::get().m_options);
+    lz4_stream::set_async(opt->lz4_async);
 
 #ifdef WITH_PLUGIN
     if (opt->use_plugin)
@@ -96,7 +99,7 @@ struct main_repart
                                           opt->nb_parts);
     ConfigTask<MAX_K> config_task(opt->fof, props, opt->bloom_size, opt->nb_parts);
     config_task.exec();
-    RepartTask<MAX_K> repart_task(opt->fof); repart_task.exec(); repart_task.postprocess();
+    RepartTask<MAX_K> repart_task(opt->fof, "", opt->balance, opt->nb_threads); repart_task.exec(); repart_task.postprocess();
 
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
     LOCAL(config_storage);
@@ -137,7 +140,10 @@ struct main_superk
                                         p, config._nb_partitions));
     }
 
-    SuperKTask<MAX_K> superk_task(opt->id, opt->lz4, opt->restrict_to_list); superk_task.exec();
+    // the current thread reads, the others compute super-k-mers
+    size_t nb_workers = opt->nb_threads > 1 ? opt->nb_threads - 1 : 0;
+    SuperKTask<MAX_K> superk_task(opt->id, opt->lz4, opt->restrict_to_list, nb_workers);
+    superk_task.exec();
   }
 };
 
@@ -149,6 +155,7 @@ struct main_count
     spdlog::info("Run with {} implementation", Kmer<MAX_K>::name());
     count_options_t opt = std::static_pointer_cast<struct count_options>(options);
     spdlog::debug(opt->display());
+    lz4_stream::set_async(opt->lz4_async);
     KmDir::get().init(opt->dir, "", false);
 
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
@@ -231,6 +238,7 @@ struct main_merge
     spdlog::info("Run with {} implementation", Kmer<MAX_K>::name());
     merge_options_t opt = std::static_pointer_cast<struct merge_options>(options);
     spdlog::debug(opt->display());
+    lz4_stream::set_async(opt->lz4_async);
     KmDir::get().init(opt->dir, "", false);
     opt->init_vector();
 
@@ -343,7 +351,18 @@ struct main_dump
 
     KM_FILE km_file = get_km_file_type(opt->input);
 
-    if (km_file == KM_FILE::KMER)
+    if (km_file == KM_FILE::KMER && is_mappable<KmerFileHeader>(opt->input))
+    {
+      KmerMmapReader kr(opt->input);
+      if (opt->output == "stdout")
+        kr.template write_as_text<MAX_K, DMAX_C>(std::cout);
+      else
+      {
+        std::ofstream out(opt->output); check_fstream_good(opt->output, out);
+        kr.template write_as_text<MAX_K, DMAX_C>(out);
+      }
+    }
+    else if (km_file == KM_FILE::KMER)
     {
       KmerReader kr(opt->input);
       if (opt->output == "stdout")
@@ -354,6 +373,17 @@ struct main_dump
         kr.template write_as_text<MAX_K, DMAX_C>(out);
       }
     }
+    else if (km_file == KM_FILE::HASH && is_mappable<HashFileHeader>(opt->input))
+    {
+      HashMmapReader<DMAX_C> hr(opt->input);
+      if (opt->output == "stdout")
+        hr.write_as_text(std::cout);
+      else
+      {
+        std::ofstream out(opt->output); check_fstream_good(opt->output, out);
+        hr.write_as_text(out);
+      }
+    }
     else if (km_file == KM_FILE::HASH)
     {
       HashReader<DMAX_C, 32768> hr(opt->input);
@@ -409,6 +439,17 @@ struct main_dump
         phr.write_as_text(out);
       }
     }
+    else if (km_file == KM_FILE::BLOCKMATRIX)
+    {
+      BlockMatrixReader bmr(opt->input);
+      if (opt->output == "stdout")
+        bmr.write_as_text(std::cout);
+      else
+      {
+        std::ofstream out(opt->output); check_fstream_good(opt->output, out);
+        bmr.write_as_text(out);
+      }
+    }
     else if (km_file == KM_FILE::HIST)
     {
       HistReader hr(opt->input);
@@ -497,6 +538,110 @@ struct main_combine
   }
 };
 
+template<size_t MAX_K>
+struct main_mquery
+{
+  void operator()(km_options_t options)
+  {
+    spdlog::info("Run with {} implementation", Kmer<MAX_K>::name());
+    mquery_options_t opt = std::static_pointer_cast<struct mquery_options>(options);
+    spdlog::debug(opt->display());
+
+    KmDir::get().init(opt->dir, "", false);
+    Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
+    LOCAL(config_storage);
+    Configuration config = Configuration();
+    config.load(config_storage->getGroup("gatb"));
+
+    // k-mers are routed with lexicographic minimizers, see matrix_query_hashes
+    if (config._minimizerType != 0)
+      throw InputError("'kmtricks mquery' requires a run with --minimizer-type 0.");
+
+    HashWindow hw(KmDir::get().m_hash_win);
+    Repartition repart(fmt::format("{}_gatb/repartition.minimRepart", KmDir::get().m_repart_storage));
+
+    Timer timer;
+
+    bool transposed = false;
+    std::vector<std::string> paths = KmDir::get().get_matrix_paths(
+      config._nb_partitions, MODE::BF, FORMAT::BLK, COUNT_FORMAT::HASH, false);
+    for (bool cpr : {false, true})
+    {
+      if (paths.empty())
+        paths = KmDir::get().get_matrix_paths(
+          config._nb_partitions, MODE::BF, FORMAT::BIN, COUNT_FORMAT::HASH, cpr);
+    }
+    if (paths.empty())
+    {
+      paths = KmDir::get().get_matrix_paths(
+        config._nb_partitions, MODE::BFT, FORMAT::BIN, COUNT_FORMAT::HASH, false);
+      transposed = true;
+    }
+    if (paths.empty())
+      throw InputError("No Bloom matrix found, 'kmtricks mquery' requires a hash:bf, hash:bf:blk or hash:bft run.");
+
+    spdlog::info("Load {} partition(s)...", paths.size());
+    BloomMatrix matrix(paths, hw.get_window_size_bits(), transposed, opt->cache_blocks);
+    if (matrix.nb_samples() != KmDir::get().m_fof.size())
+      throw InputError(fmt::format("Matrices have {} columns for {} samples, not a hash:bf run.",
+                                   matrix.nb_samples(), KmDir::get().m_fof.size()));
+
+    std::vector<std::string> ids;
+    for (size_t i=0; i<KmDir::get().m_fof.size(); i++)
+      ids.push_back(KmDir::get().m_fof.get_id(i));
+
+    std::vector<std::pair<std::string, std::string>> queries;
+    {
+      IBank* bank = Bank::open(opt->query); LOCAL(bank);
+      Iterator<Sequence>* it = bank->iterator(); LOCAL(it);
+      for (it->first(); !it->isDone(); it->next())
+        queries.emplace_back(it->item().getComment(), it->item().toString());
+    }
+
+    spdlog::info("Query {} sequence(s)...", queries.size());
+    std::vector<std::string> results(queries.size());
+    std::atomic<size_t> next {0};
+    auto worker = [&]() {
+      MatrixQuery<MAX_K> mq(matrix, hw, repart, config._kmerSize);
+      std::vector<uint32_t> hits;
+      for (size_t i = next++; i < queries.size(); i = next++)
+      {
+        uint64_t n = mq.query(queries[i].second, hits);
+        std::stringstream ss;
+        ss << "* [" << queries[i].first << "]\n";
+        for (size_t s=0; s<hits.size() && n > 0; s++)
+        {
+          double ratio = static_cast<double>(hits[s]) / n;
+          if (ratio >= opt->threshold)
+            ss << ids[s] << " " << hits[s] << "/" << n << " " << ratio << "\n";
+        }
+        results[i] = ss.str();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    size_t nb_threads = std::max<size_t>(1, std::min<size_t>(opt->nb_threads, queries.size()));
+    for (size_t t=0; t<nb_threads; t++)
+      threads.emplace_back(worker);
+    for (auto& t : threads)
+      t.join();
+
+    if (opt->output == "stdout")
+    {
+      for (auto& r : results)
+        std::cout << r;
+    }
+    else
+    {
+      std::ofstream out(opt->output, std::ios::out); check_fstream_good(opt->output, out);
+      for (auto& r : results)
+        out << r;
+    }
+
+    spdlog::info("Done in {}.", timer.formatted());
+  }
+};
+
 
 template<size_t MAX_K>
 struct main_agg
@@ -663,6 +808,18 @@ struct main_agg
       else
         phmfa.write_as_bin(opt->output, opt->lz4);
     }
+    else if (opt->pa_matrix == "blk")
+    {
+      std::vector<std::string> paths = KmDir::get().get_matrix_paths(config._nb_partitions,
+                                                                    MODE::BF, FORMAT::BLK,
+                                                                    COUNT_FORMAT::HASH, false);
+      paths = check_paths(paths);
+      BlockMatrixFileAggregator bmfa(paths);
+      if (opt->format == "text")
+        opt->output == "stdout" ? bmfa.write_as_text(std::cout) : bmfa.write_as_text(opt->output);
+      else
+        bmfa.write_as_bin(opt->output, opt->lz4);
+    }
   }
 };
 
@@ -820,6 +977,14 @@ struct main_index
 
     if (opt->cullsd > 0)
       howde_index_str += fmt::format(" --cull={}sd", opt->cullsd);
+
+    howde_index_str += fmt::format(" --threads={}", opt->nb_threads);
+    if (opt->neighbors > 0)
+    {
+      howde_index_str += fmt::format(" --neighbors={}", opt->neighbors);
+      if (opt->sketch > 0)
+        howde_index_str += fmt::format(" --sketch={}", opt->sketch);
+    }
     std::vector<std::string> howde_index = bc::utils::split(howde_index_str, ' ');
 
     char** arr = new char*[howde_index.size()+1];
@@ -847,6 +1012,8 @@ struct main_index
     if (opt->uncompressed) ss << "--uncompressed ";
     if (opt->rrr) ss << "--rrr ";
     if (opt->roar) ss << "--roar ";
+    ss << "--threads=" << opt->nb_threads << " ";
+    if (opt->build_mem > 0) ss << "--memory=" << opt->build_mem << "M ";
     std::string howde_build_str = ss.str();
     std::vector<std::string> howde_build = bc::utils::split(howde_build_str, ' ');
 
@@ -873,6 +1040,12 @@ template<size_t MAX_K>
 struct main_query
 {
   void operator()(km_options_t options)
+  {
+    (*this)(options, nullptr);
+  }
+
+  // results are written to out instead of opt->output if out is not null
+  void operator()(km_options_t options, std::ostream* out)
   {
     spdlog::info("Run with {} implementation", Kmer<MAX_K>::name());
     query_options_t opt = std::static_pointer_cast<struct query_options>(options);
@@ -900,17 +1073,27 @@ struct main_query
     if (opt->output != "stdout")
       opt->output = fs::absolute(fs::path(opt->output));
 
-    opt->query = fs::absolute(fs::path(opt->query));
+    if (opt->serve.empty() && opt->query.empty())
+      throw IOError("A query file is required, unless --serve is used.");
+
+    if (!opt->query.empty())
+      opt->query = fs::absolute(fs::path(opt->query));
+    if (!opt->serve.empty() && opt->serve != "-")
+      opt->serve = fs::absolute(fs::path(opt->serve));
 
     std::stringstream ss;
     ss << "queryKm ";
     ss << "--tree=" << index_path << " ";
-    ss << opt->query << " ";
+    if (!opt->serve.empty())
+      ss << "--serve=" << opt->serve << " ";
+    else
+      ss << opt->query << " ";
     ss << "--repart=" << fmt::format("{}_gatb/repartition.minimRepart", KmDir::get().m_repart_storage) << " ";
     ss << "--win=" << KmDir::get().m_hash_win << " ";
     ss << "--z=" << opt->z << " ";
     ss << "--threshold=" << opt->threshold << " ";
     ss << "--threshold-shared-positions=" << opt->threshold_shared_positions << " ";
+    ss << "--threads=" << opt->nb_threads << " ";
     if (opt->check) ss << "--consistencycheck ";
     if (opt->nodetail) ss << "--no-detail ";
     if (opt->output != "stdout") ss << "--out=" << opt->output;
@@ -925,6 +1108,7 @@ struct main_query
 
     QueryCommand query_cmd("queryKm");
     query_cmd.parse(howde_query.size(), arr);
+    query_cmd.matchesStream = out;
     auto path = fs::current_path();
 
     fs::current_path(KmDir::get().m_index_storage);
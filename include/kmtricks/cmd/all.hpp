@@ -47,11 +47,13 @@ struct all_options : km_options
   uint32_t minim_size {0};
   uint32_t repart_type {0};
   uint32_t nb_parts {0};
+  bool repart_balance {false};
 
   uint64_t bloom_size {0};
 
   bool keep_tmp {false};
   bool lz4 {false};
+  bool lz4_async {false};
   bool kff {false};
   bool skip_merge {false};
   bool hist {false};
@@ -59,11 +61,14 @@ struct all_options : km_options
   uint32_t bwidth {0};
 
   uint32_t max_memory {8000};
+  uint64_t max_disk {0};
+  bool plan {false};
   double restrict_to;
   std::vector<uint32_t> restrict_to_list;
   std::vector<uint32_t> m_ab_min_vec;
 
   double focus {1.0};
+  uint64_t stream_mem {0};
 
   std::string from;
 
@@ -95,14 +100,20 @@ struct all_options : km_options
     RECORD(ss, minim_size);
     RECORD(ss, minim_type);
     RECORD(ss, repart_type);
+    RECORD(ss, repart_balance);
     RECORD(ss, nb_parts);
     RECORD(ss, bloom_size);
     RECORD(ss, keep_tmp);
     RECORD(ss, lz4);
+    RECORD(ss, lz4_async);
     RECORD(ss, kff);
     RECORD(ss, skip_merge);
     RECORD(ss, hist);
     RECORD(ss, focus);
+    RECORD(ss, stream_mem);
+    RECORD(ss, plan);
+    RECORD(ss, max_memory);
+    RECORD(ss, max_disk);
     RECORD(ss, restrict_to);
     RECORD(ss, bwidth);
 #ifdef WITH_PLUGIN
@@ -135,6 +146,14 @@ struct all_options : km_options
         throw PipelineError("--skip-merge available only with --mode hash:bft:bin");
       }
     }
+    if (stream_mem > 0)
+    {
+      if ((count_format != COUNT_FORMAT::HASH) || skip_merge || (until == COMMAND::REPART) ||
+          (until == COMMAND::SUPERK) || (until == COMMAND::COUNT))
+      {
+        throw PipelineError("--stream-mem available only in hash mode, with the merge step.");
+      }
+    }
     if ((mode == MODE::BFT || mode == MODE::BF))
     {
       if ((restrict_to != 1.0) || !restrict_to_list.empty())
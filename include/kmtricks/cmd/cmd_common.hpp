@@ -46,6 +46,7 @@ enum class COMMAND
   SOCKS_BUILD,
   SOCKS_LOOKUP,
   COMBINE,
+  MQUERY,
   UNKNOWN
 };
 
@@ -77,6 +78,8 @@ inline COMMAND str_to_cmd(const std::string& s)
     return COMMAND::SOCKS_LOOKUP;
   else if (s == "combine")
     return COMMAND::COMBINE;
+  else if (s == "mquery")
+    return COMMAND::MQUERY;
   else
     return COMMAND::ALL;
 }
@@ -109,6 +112,8 @@ inline std::string cmd_to_str(COMMAND cmd)
     return "socks-lookup";
   else if (cmd == COMMAND::COMBINE)
     return "combine";
+  else if (cmd == COMMAND::MQUERY)
+    return "mquery";
   else
     return "all";
 }
@@ -248,6 +253,7 @@ enum class FORMAT
 {
   BIN,
   TEXT,
+  BLK,
   UNKNOWN
 };
 
@@ -257,6 +263,8 @@ inline FORMAT str_to_format2(const std::string& s)
     return FORMAT::TEXT;
   else if (s == "bin")
     return FORMAT::BIN;
+  else if (s == "blk")
+    return FORMAT::BLK;
   else
     return FORMAT::UNKNOWN;
 }
@@ -267,6 +275,8 @@ inline std::string format_to_str2(FORMAT format)
     return "text";
   else if (format == FORMAT::BIN)
     return "bin";
+  else if (format == FORMAT::BLK)
+    return "blk";
   else
     return "unknown";
 }
@@ -38,6 +38,7 @@ struct count_options : km_options
 
   bool clear;
   bool lz4;
+  bool lz4_async;
   bool kff;
   bool hist;
 
@@ -53,6 +54,7 @@ struct count_options : km_options
     RECORD(ss, format);
     RECORD(ss, clear);
     RECORD(ss, lz4);
+    RECORD(ss, lz4_async);
     RECORD(ss, kff);
     RECORD(ss, hist);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
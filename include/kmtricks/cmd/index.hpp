@@ -44,6 +44,9 @@ struct index_options : km_options
   size_t upper;
   bool cull2;
   double cullsd;
+  uint32_t neighbors;
+  uint64_t sketch;
+  uint64_t build_mem;
 
   std::string display()
   {
@@ -63,6 +66,9 @@ struct index_options : km_options
     RECORD(ss, upper);
     RECORD(ss, cull2);
     RECORD(ss, cullsd);
+    RECORD(ss, neighbors);
+    RECORD(ss, sketch);
+    RECORD(ss, build_mem);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
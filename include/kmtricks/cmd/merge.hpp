@@ -42,6 +42,7 @@ struct merge_options : km_options
 
   bool clear;
   bool lz4;
+  bool lz4_async;
 
   MODE mode;
   FORMAT format;
@@ -58,6 +59,7 @@ struct merge_options : km_options
     RECORD(ss, save_if);
     RECORD(ss, clear);
     RECORD(ss, lz4);
+    RECORD(ss, lz4_async);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
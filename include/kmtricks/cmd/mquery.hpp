@@ -0,0 +1,50 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <memory>
+#include <string>
+
+#include <kmtricks/cli/cli_common.hpp>
+#include <kmtricks/cmd/cmd_common.hpp>
+
+namespace km {
+
+struct mquery_options : km_options
+{
+  std::string query;
+  std::string output;
+  double threshold;
+  size_t cache_blocks {64};
+
+  std::string display()
+  {
+    std::stringstream ss;
+    ss << this->global_display();
+    RECORD(ss, query);
+    RECORD(ss, output);
+    RECORD(ss, threshold);
+    RECORD(ss, cache_blocks);
+    std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
+    return ret;
+  }
+};
+
+using mquery_options_t = std::shared_ptr<struct mquery_options>;
+
+};
@@ -32,6 +32,7 @@ struct query_options : km_options
 {
   std::string query;
   std::string output;
+  std::string serve;
   double threshold;
   double threshold_shared_positions;
   bool nodetail;
@@ -43,6 +44,7 @@ struct query_options : km_options
     ss << this->global_display();
     RECORD(ss, query);
     RECORD(ss, output);
+    RECORD(ss, serve);
     RECORD(ss, threshold);
     RECORD(ss, threshold_shared_positions);
     RECORD(ss, nodetail);
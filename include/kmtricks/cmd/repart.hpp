@@ -38,6 +38,7 @@ struct repart_options : km_options
   uint32_t repart_type;
   uint32_t nb_parts;
   uint64_t bloom_size;
+  bool balance {false};
 
   std::string display()
   {
@@ -49,6 +50,7 @@ struct repart_options : km_options
     RECORD(ss, minim_type);
     RECORD(ss, repart_type);
     RECORD(ss, nb_parts);
+    RECORD(ss, balance);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
@@ -0,0 +1,372 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <array>
+#include <vector>
+#include <string>
+#include <numeric>
+#include <cstring>
+#include <algorithm>
+#include <fmt/format.h>
+#include <kmtricks/kmer.hpp>
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+// Operations on 2-bit k-mers stored in W 64-bit words, least significant word first, with
+// the same layout as Kmer<MAX_K>::get_data64(). W = 1 and W = 2 use plain integers, W = 0
+// works on any number of words given at runtime.
+template<size_t W>
+struct KmerWords
+{
+  static void shift_in(uint64_t* data, size_t words, size_t kmer_size, uint8_t nt)
+  {
+    for (size_t i=words-1; i>0; i--)
+      data[i] = (data[i] << 2) | (data[i-1] >> 62);
+    data[0] = (data[0] << 2) | nt;
+    size_t top = 2 * (kmer_size - 32 * (words - 1));
+    if (top < 64)
+      data[words-1] &= (uint64_t{1} << top) - 1;
+  }
+
+  static void rev_comp(const uint64_t* in, uint64_t* out, size_t words, size_t kmer_size)
+  {
+    for (size_t i=0; i<words; i++)
+    {
+      uint64_t w = in[words-1-i];
+      const uint8_t* b = reinterpret_cast<const uint8_t*>(&w);
+      uint8_t* r = reinterpret_cast<uint8_t*>(out + i);
+      for (size_t j=0; j<8; j++)
+        r[7-j] = rev_table[b[j]];
+    }
+    size_t shift = 2 * (32 * words - kmer_size);
+    size_t lshift = shift / 64, sshift = shift % 64;
+    for (size_t i=0; i<words; i++)
+    {
+      uint64_t lo = i + lshift < words ? out[i + lshift] : 0;
+      uint64_t hi = i + lshift + 1 < words ? out[i + lshift + 1] : 0;
+      out[i] = sshift ? (lo >> sshift) | (hi << (64 - sshift)) : lo;
+    }
+  }
+
+  static bool less(const uint64_t* a, const uint64_t* b, size_t words)
+  {
+    for (size_t i=words; i-- > 0;)
+      if (a[i] != b[i])
+        return a[i] < b[i];
+    return false;
+  }
+};
+
+template<>
+struct KmerWords<1>
+{
+  static void shift_in(uint64_t* data, size_t, size_t kmer_size, uint8_t nt)
+  {
+    uint64_t mask = kmer_size == 32 ? ~uint64_t{0} : (uint64_t{1} << (2 * kmer_size)) - 1;
+    data[0] = ((data[0] << 2) | nt) & mask;
+  }
+
+  static void rev_comp(const uint64_t* in, uint64_t* out, size_t, size_t kmer_size)
+  {
+    out[0] = revcomp64(in[0], kmer_size);
+  }
+
+  static bool less(const uint64_t* a, const uint64_t* b, size_t)
+  {
+    return a[0] < b[0];
+  }
+};
+
+#ifdef __SIZEOF_INT128__
+template<>
+struct KmerWords<2>
+{
+  static __uint128_t get(const uint64_t* data)
+  {
+    return (static_cast<__uint128_t>(data[1]) << 64) | data[0];
+  }
+
+  static void set(uint64_t* data, __uint128_t value)
+  {
+    data[0] = static_cast<uint64_t>(value);
+    data[1] = static_cast<uint64_t>(value >> 64);
+  }
+
+  static void shift_in(uint64_t* data, size_t, size_t kmer_size, uint8_t nt)
+  {
+    __uint128_t mask = kmer_size == 64 ? ~__uint128_t{0} : (__uint128_t{1} << (2 * kmer_size)) - 1;
+    set(data, ((get(data) << 2) | nt) & mask);
+  }
+
+  static void rev_comp(const uint64_t* in, uint64_t* out, size_t, size_t kmer_size)
+  {
+    // the 128 bits are reversed as two words, then shifted back to kmer_size
+    __uint128_t r = (static_cast<__uint128_t>(revcomp64(in[0], 32)) << 64) | revcomp64(in[1], 32);
+    set(out, r >> (2 * (64 - kmer_size)));
+  }
+
+  static bool less(const uint64_t* a, const uint64_t* b, size_t)
+  {
+    return a[1] != b[1] ? a[1] < b[1] : a[0] < b[0];
+  }
+};
+#else
+template<>
+struct KmerWords<2> : KmerWords<0> {};
+#endif
+
+// Calls f with the KmerWords of a k-mer of this number of words.
+template<typename F>
+inline auto dispatch_words(size_t words, F&& f)
+{
+  switch (words)
+  {
+    case 1: return f(KmerWords<1>{});
+    case 2: return f(KmerWords<2>{});
+    default: return f(KmerWords<0>{});
+  }
+}
+
+// K-mer whose size is set at runtime, for each instance, unlike Kmer<MAX_K> which shares
+// its size between all the k-mers of a specialization. Sizes up to 32 and 64 use the same
+// integer paths as Kmer<32> and Kmer<64>. See DynKmerVector to store many k-mers of the
+// same size without the per-instance overhead.
+class DynKmer
+{
+public:
+  static constexpr size_t max_k = 256;
+  static constexpr size_t max_words = max_k / 32;
+
+  DynKmer() {}
+
+  explicit DynKmer(size_t kmer_size)
+  {
+    set_k(kmer_size);
+  }
+
+  explicit DynKmer(const std::string& str)
+  {
+    set_polynom(str);
+  }
+
+  template<size_t MAX_K>
+  explicit DynKmer(const Kmer<MAX_K>& kmer)
+  {
+    set_k(Kmer<MAX_K>::m_kmer_size);
+    std::copy(kmer.get_data64(), kmer.get_data64() + m_words, m_data.begin());
+  }
+
+  DynKmer(const uint64_t* data, size_t kmer_size)
+  {
+    set_k(kmer_size);
+    std::copy(data, data + m_words, m_data.begin());
+  }
+
+  void set_k(size_t kmer_size)
+  {
+    if (kmer_size == 0 || kmer_size > max_k)
+      throw KSizeError(fmt::format("DynKmer supports k-mers of size 1 to {}, not {}.", max_k, kmer_size));
+    m_kmer_size = kmer_size;
+    m_words = (kmer_size + 31) / 32;
+    m_data.fill(0);
+  }
+
+  void set_polynom(const std::string& str)
+  {
+    set_k(str.size());
+    for (char c : str)
+      push(NToB[static_cast<uint8_t>(c)]);
+  }
+
+  // Appends a 2-bit base, the first one goes out.
+  void push(uint8_t nt)
+  {
+    dispatch_words(m_words, [&](auto ops) {
+      ops.shift_in(m_data.data(), m_words, m_kmer_size, nt);
+    });
+  }
+
+  template<size_t MAX_K>
+  Kmer<MAX_K> to_kmer() const
+  {
+    if (m_kmer_size > MAX_K)
+      throw KSizeError(fmt::format("{}-mer does not fit in Kmer<{}>.", m_kmer_size, MAX_K));
+    Kmer<MAX_K> kmer; kmer.set_k(m_kmer_size);
+    kmer.set64_p(m_data.data());
+    return kmer;
+  }
+
+  size_t size() const { return m_kmer_size; }
+  size_t words() const { return m_words; }
+  const uint64_t* data() const { return m_data.data(); }
+
+  uint8_t operator[](size_t i) const { return (m_data[i / 32] >> (2 * (i % 32))) & 3; }
+  char at(size_t i) const { return bToN[(*this)[m_kmer_size - i - 1]]; }
+
+  bool operator<(const DynKmer& k) const
+  {
+    if (m_kmer_size != k.m_kmer_size)
+      return m_kmer_size < k.m_kmer_size;
+    return dispatch_words(m_words, [&](auto ops) {
+      return ops.less(m_data.data(), k.m_data.data(), m_words);
+    });
+  }
+
+  bool operator==(const DynKmer& k) const
+  {
+    return m_kmer_size == k.m_kmer_size &&
+           std::equal(m_data.begin(), m_data.begin() + m_words, k.m_data.begin());
+  }
+
+  bool operator!=(const DynKmer& k) const { return !(*this == k); }
+
+  DynKmer rev_comp() const
+  {
+    DynKmer res(m_kmer_size);
+    dispatch_words(m_words, [&](auto ops) {
+      ops.rev_comp(m_data.data(), res.m_data.data(), m_words, m_kmer_size);
+    });
+    return res;
+  }
+
+  DynKmer canonical() const
+  {
+    DynKmer rev = rev_comp();
+    return rev < *this ? rev : *this;
+  }
+
+  // Same value as Kmer::minimizer(size), the m-mers are rolled instead of re-encoded.
+  uint32_t minimizer(uint8_t size) const
+  {
+    uint64_t mask = (uint64_t{1} << (2 * size)) - 1;
+    uint32_t def = static_cast<uint32_t>(mask);
+    uint32_t minim = std::numeric_limits<uint32_t>::max();
+    uint64_t fwd = 0, rev = 0;
+    for (size_t i=0; i<m_kmer_size; i++)
+    {
+      uint8_t nt = (*this)[m_kmer_size - i - 1];
+      fwd = ((fwd << 2) | nt) & mask;
+      rev = (rev >> 2) | (static_cast<uint64_t>(revB[nt]) << (2 * (size - 1)));
+      if (i + 1 < size)
+        continue;
+      uint32_t value = static_cast<uint32_t>(std::min(fwd, rev));
+      minim = std::min(minim, is_valid_minimizer(value, size) ? value : def);
+    }
+    return minim;
+  }
+
+  std::string to_string() const
+  {
+    std::string str(m_kmer_size, 'A');
+    for (size_t i=0; i<m_kmer_size; i++)
+      str[m_kmer_size - i - 1] = bToN[(*this)[i]];
+    return str;
+  }
+
+private:
+  uint16_t m_kmer_size {0};
+  uint16_t m_words {0};
+  std::array<uint64_t, max_words> m_data {};
+};
+
+// K-mers of one size, chosen at runtime, stored as contiguous words.
+class DynKmerVector
+{
+public:
+  DynKmerVector(size_t kmer_size)
+    : m_kmer_size(kmer_size), m_words((kmer_size + 31) / 32)
+  {
+    if (kmer_size == 0 || kmer_size > DynKmer::max_k)
+      throw KSizeError(fmt::format("DynKmerVector supports k-mers of size 1 to {}, not {}.",
+                                   DynKmer::max_k, kmer_size));
+  }
+
+  size_t kmer_size() const { return m_kmer_size; }
+  size_t words() const { return m_words; }
+  size_t size() const { return m_data.size() / m_words; }
+  bool empty() const { return m_data.empty(); }
+
+  void reserve(size_t n) { m_data.reserve(n * m_words); }
+  void clear() { m_data.clear(); }
+
+  void push_back(const DynKmer& kmer)
+  {
+    if (kmer.size() != m_kmer_size)
+      throw KSizeError(fmt::format("{}-mer pushed in a vector of {}-mers.", kmer.size(), m_kmer_size));
+    m_data.insert(m_data.end(), kmer.data(), kmer.data() + m_words);
+  }
+
+  void push_back(const uint64_t* data)
+  {
+    m_data.insert(m_data.end(), data, data + m_words);
+  }
+
+  DynKmer operator[](size_t i) const
+  {
+    return DynKmer(data(i), m_kmer_size);
+  }
+
+  const uint64_t* data(size_t i) const { return m_data.data() + i * m_words; }
+
+  void sort()
+  {
+    switch (m_words)
+    {
+      case 1: std::sort(m_data.begin(), m_data.end()); break;
+      case 2: sort_fixed<2>(); break;
+      case 3: sort_fixed<3>(); break;
+      case 4: sort_fixed<4>(); break;
+      default: sort_indirect(); break;
+    }
+  }
+
+private:
+  template<size_t W>
+  void sort_fixed()
+  {
+    using block_t = std::array<uint64_t, W>;
+    std::vector<block_t> blocks(size());
+    std::memcpy(blocks.data(), m_data.data(), m_data.size() * sizeof(uint64_t));
+    std::sort(blocks.begin(), blocks.end(), [](const block_t& a, const block_t& b) {
+      return KmerWords<W == 2 ? 2 : 0>::less(a.data(), b.data(), W);
+    });
+    std::memcpy(m_data.data(), blocks.data(), m_data.size() * sizeof(uint64_t));
+  }
+
+  void sort_indirect()
+  {
+    std::vector<size_t> order(size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      return KmerWords<0>::less(data(a), data(b), m_words);
+    });
+    std::vector<uint64_t> sorted; sorted.reserve(m_data.size());
+    for (auto& i : order)
+      sorted.insert(sorted.end(), data(i), data(i) + m_words);
+    m_data.swap(sorted);
+  }
+
+private:
+  size_t m_kmer_size;
+  size_t m_words;
+  std::vector<uint64_t> m_data;
+};
+
+};
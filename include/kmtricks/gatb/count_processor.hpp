@@ -20,8 +20,10 @@
 #include <gatb/gatb_core.hpp>
 #include <kmtricks/io/kmer_file.hpp>
 #include <kmtricks/io/hash_file.hpp>
+#include <kmtricks/io/run_store.hpp>
 #include <kmtricks/io/vector_file.hpp>
 #include <kmtricks/io/kff_file.hpp>
+#include <kmtricks/kmer_compactor.hpp>
 #include <kmtricks/utils.hpp>
 #include <kmtricks/histogram.hpp>
 
@@ -46,7 +48,8 @@ public:
   virtual ~ICountProcessor() {}
 };
 
-template<size_t span, size_t MAX_C, size_t buf_size = 32768>
+template<size_t span, size_t MAX_C, size_t buf_size = 32768,
+         typename Writer = HashWriter<MAX_C, buf_size>>
 class HashCountProcessor : public IHashProcessor<span>
 {
 public:
@@ -54,7 +57,7 @@ public:
   using Type = typename ::Kmer<span>::Type;
   using km_count_type = typename selectC<DMAX_C>::type;
 
-  HashCountProcessor(uint32_t kmer_size, uint32_t abundance_min, hw_t<MAX_C, buf_size> writer, hist_t hist)
+  HashCountProcessor(uint32_t kmer_size, uint32_t abundance_min, std::shared_ptr<Writer> writer, hist_t hist)
     : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist)
   {}
 
@@ -74,7 +77,7 @@ public:
 private:
   uint32_t m_kmer_size;
   uint32_t m_abundance_min;
-  hw_t<MAX_C, buf_size> m_writer;
+  std::shared_ptr<Writer> m_writer;
   hist_t m_hist;
   typename ::Kmer<span>::ModelCanonical m_model {m_kmer_size};
   km_count_type m_count;
@@ -163,10 +166,16 @@ public:
   using Type = typename ::Kmer<span>::Type;
   using km_count_type = typename selectC<MAX_C>::type;
 
+  // With minim_size, the k-mers are kept until finish() and written as super-k-mers.
   KffCountProcessor(uint32_t kmer_size,
-                    uint32_t abundance_min, kff_w_t<MAX_C> writer, hist_t hist)
-    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist)
-  {}
+                    uint32_t abundance_min, kff_w_t<MAX_C> writer, hist_t hist,
+                    uint32_t minim_size = 0)
+    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist),
+      m_minim_size(minim_size)
+  {
+    if (minim_size)
+      m_compactor = std::make_unique<KmerCompactor<span, km_count_type>>(kmer_size, minim_size, max_kmers);
+  }
 
   bool process(size_t partId, const Type &kmer, uint32_t count) override
   {
@@ -175,19 +184,46 @@ public:
     {
       Kmer<span> kmkmer(m_model.toString(kmer));
       m_count = count >= m_max_c ? m_max_c : static_cast<km_count_type>(count);
-      m_writer->template write<span>(kmkmer, m_count);
+      if (m_compactor)
+        m_compactor->add(kmkmer, m_count);
+      else
+        m_writer->template write<span>(kmkmer, m_count);
     }
     return true;
   }
 
+  // The k-mers kept for compaction are stored in buffer, see KmerCompactor::use_buffer().
+  void use_buffer(void* buffer, size_t capacity)
+  {
+    if (m_compactor)
+      m_compactor->use_buffer(buffer, capacity);
+  }
+
+  void finish() override
+  {
+    if (!m_compactor)
+      return;
+    m_compactor->compact([this](const auto& s) {
+      if (s.has_minimizer)
+        m_writer->write_superk(s.seq, s.seq.substr(s.minim_pos, m_minim_size), s.minim_pos, s.counts.data());
+      else
+        m_writer->write_compacted(s.seq, s.counts.data());
+    });
+  }
+
+  static constexpr size_t max_kmers = 255;
+  static constexpr size_t bytes_per_kmer = KmerCompactor<span, km_count_type>::bytes_per_kmer;
+
 private:
   uint32_t m_kmer_size;
   uint32_t m_abundance_min;
   kff_w_t<MAX_C> m_writer;
   hist_t m_hist;
+  uint32_t m_minim_size;
   typename::Kmer<span>::ModelCanonical m_model {m_kmer_size};
   km_count_type m_count;
   uint32_t m_max_c {std::numeric_limits<km_count_type>::max()};
+  std::unique_ptr<KmerCompactor<span, km_count_type>> m_compactor {nullptr};
 };
 
 };
\ No newline at end of file
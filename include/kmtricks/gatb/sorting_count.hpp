@@ -25,6 +25,8 @@
 
 #include <kmtricks/gatb/count_processor.hpp>
 #include <kmtricks/superk.hpp>
+#include <kmtricks/radix_sort.hpp>
+#include <kmtricks/task_pool.hpp>
 
 #include <sabuhash.h>
 
@@ -512,21 +514,21 @@ class KmerSort
 {
 public:
   typedef typename ::Kmer<span>::Type Type;
-  KmerSort(Type **kmer_vector, int begin, int end, uint64_t* radix_size)
-    : begin(begin), end(end), m_kmer_vector(kmer_vector), m_radix_size(radix_size)
+  KmerSort(Type **kmer_vector, int begin, int end, uint64_t* radix_size, size_t nb_threads = 1)
+    : begin(begin), end(end), m_kmer_vector(kmer_vector), m_radix_size(radix_size),
+      m_nb_threads(nb_threads)
   {
   }
 
   void execute()
   {
+    RadixSort<Type> sorter;
     for (int ii = begin; ii <= end; ii++)
     {
       if (m_radix_size[ii] > 0)
-      {
-        Type *kmers = m_kmer_vector[ii];
-        std::sort(&kmers[0], &kmers[m_radix_size[ii]]);
-      }
+        sorter.add(m_kmer_vector[ii], m_radix_size[ii]);
     }
+    sorter.sort(m_nb_threads);
   }
 
 private:
@@ -534,24 +536,26 @@ private:
   int end;
   Type **m_kmer_vector;
   uint64_t* m_radix_size;
+  size_t m_nb_threads;
 };
 
 class HashSort
 {
 public:
-  HashSort(uint64_t* hash_vector, size_t array_size)
-      : m_hash_vector(hash_vector), m_size(array_size)
+  HashSort(uint64_t* hash_vector, size_t array_size, size_t nb_threads = 1)
+      : m_hash_vector(hash_vector), m_size(array_size), m_nb_threads(nb_threads)
   {
   }
 
   void execute()
   {
-    std::sort(&m_hash_vector[0], &m_hash_vector[m_size]);
+    RadixSort<uint64_t>::sort(m_hash_vector, m_size, m_nb_threads);
   }
 
 private:
   uint64_t* m_hash_vector;
   size_t m_size;
+  size_t m_nb_threads;
 };
 
 template <size_t span>
@@ -706,11 +710,11 @@ private:
 
   void executeSort()
   {
-    for (size_t xx = 0; xx < (KX + 1); xx++)
-    {
-      KmerSort<span> sort_cmd(radix_kmers + IX(xx, 0), 0, 255, radix_sizes + IX(xx, 0));
-      sort_cmd.execute();
-    }
+    // All the radix buckets of the partition are sorted together, idle workers of the pool
+    // help on large partitions
+    TaskPool::Reservation helpers;
+    KmerSort<span> sort_cmd(radix_kmers, 0, IX(KX, 255), radix_sizes, 1 + helpers.size());
+    sort_cmd.execute();
   }
 
   void executeDump()
@@ -986,7 +990,8 @@ private:
 
   void executeSort()
   {
-    HashSort sort_cmd(array, *r_idx);
+    TaskPool::Reservation helpers;
+    HashSort sort_cmd(array, *r_idx, 1 + helpers.size());
     sort_cmd.execute();
   }
 
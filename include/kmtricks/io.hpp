@@ -19,10 +19,13 @@
 #pragma once
 
 #include <kmtricks/io/lz4_stream.hpp>
+#include <kmtricks/io/key_index.hpp>
 #include <kmtricks/io/hash_file.hpp>
 #include <kmtricks/io/kmer_file.hpp>
 #include <kmtricks/io/matrix_file.hpp>
 #include <kmtricks/io/pa_matrix_file.hpp>
 #include <kmtricks/io/vector_file.hpp>
 #include <kmtricks/io/vector_matrix_file.hpp>
-#include <kmtricks/io/hist_file.hpp>
\ No newline at end of file
+#include <kmtricks/io/block_matrix_file.hpp>
+#include <kmtricks/io/hist_file.hpp>
+#include <kmtricks/io/mmap_file.hpp>
\ No newline at end of file
@@ -0,0 +1,340 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <lz4.h>
+
+#include <kmtricks/io/io_common.hpp>
+#include <kmtricks/io/pa_matrix_file.hpp>
+#include <kmtricks/utils.hpp>
+
+namespace km {
+
+// Bloom matrix (hash:bf) stored as independently compressed blocks of rows, followed by
+// the offsets of the blocks. A row can be fetched by decompressing only its block.
+class BlockMatrixFileHeader : public KmHeader
+{
+public:
+  BlockMatrixFileHeader() {};
+
+  void serialize(std::ostream* stream)
+  {
+    _serialize(stream);
+    stream->write(reinterpret_cast<char*>(&matrix_magic), sizeof(matrix_magic));
+    stream->write(reinterpret_cast<char*>(&bits), sizeof(bits));
+    stream->write(reinterpret_cast<char*>(&first), sizeof(first));
+    stream->write(reinterpret_cast<char*>(&window), sizeof(window));
+    stream->write(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->write(reinterpret_cast<char*>(&partition), sizeof(partition));
+    stream->write(reinterpret_cast<char*>(&block_rows), sizeof(block_rows));
+    stream->write(reinterpret_cast<char*>(&nb_blocks), sizeof(nb_blocks));
+    stream->write(reinterpret_cast<char*>(&index), sizeof(index));
+  }
+
+  void deserialize(std::istream* stream)
+  {
+    _deserialize(stream);
+    stream->read(reinterpret_cast<char*>(&matrix_magic), sizeof(matrix_magic));
+    stream->read(reinterpret_cast<char*>(&bits), sizeof(bits));
+    stream->read(reinterpret_cast<char*>(&first), sizeof(first));
+    stream->read(reinterpret_cast<char*>(&window), sizeof(window));
+    stream->read(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->read(reinterpret_cast<char*>(&partition), sizeof(partition));
+    stream->read(reinterpret_cast<char*>(&block_rows), sizeof(block_rows));
+    stream->read(reinterpret_cast<char*>(&nb_blocks), sizeof(nb_blocks));
+    stream->read(reinterpret_cast<char*>(&index), sizeof(index));
+  }
+
+  void sanity_check()
+  {
+    _sanity_check();
+    if (matrix_magic != MAGICS.at(KM_FILE::BLOCKMATRIX))
+      throw IOError("Invalid file format.");
+  }
+
+public:
+  uint64_t matrix_magic {MAGICS.at(KM_FILE::BLOCKMATRIX)};
+  uint32_t bits;
+  uint32_t id;
+  uint32_t partition;
+  uint64_t first;
+  uint64_t window;
+  uint32_t block_rows {0};
+  uint64_t nb_blocks {0};
+  uint64_t index {0}; // position of the block offsets, written on close()
+};
+
+// Same interface as VectorMatrixWriter, rows are lz4 compressed by blocks of about block_bytes.
+template<size_t buf_size = 8192>
+class BlockMatrixWriter : public IFile<BlockMatrixFileHeader, std::ostream, buf_size>
+{
+public:
+  BlockMatrixWriter(const std::string& path,
+                    uint32_t bits,
+                    uint32_t id,
+                    uint32_t partition,
+                    uint64_t first,
+                    uint64_t window,
+                    size_t block_bytes = (1 << 16))
+    : IFile<BlockMatrixFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary),
+      m_row_bytes(NBYTES(bits))
+  {
+    this->m_header.compressed = true;
+    this->m_header.bits = bits;
+    this->m_header.first = first;
+    this->m_header.window = window;
+    this->m_header.id = id;
+    this->m_header.partition = partition;
+    this->m_header.block_rows = std::max<size_t>(1, block_bytes / std::max<size_t>(m_row_bytes, 1));
+
+    this->m_header.serialize(this->m_first_layer.get());
+
+    m_block.reserve(this->m_header.block_rows * m_row_bytes);
+    m_cblock.resize(LZ4_compressBound(this->m_header.block_rows * m_row_bytes));
+    m_offsets.push_back(static_cast<uint64_t>(this->m_first_layer->tellp()));
+  }
+
+  ~BlockMatrixWriter()
+  {
+    close();
+  }
+
+  void write(const std::vector<uint8_t>& bits)
+  {
+    m_block.insert(m_block.end(), bits.begin(), bits.begin() + m_row_bytes);
+    if (m_block.size() == this->m_header.block_rows * m_row_bytes)
+      flush_block();
+  }
+
+  void close()
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+    if (!m_block.empty())
+      flush_block();
+
+    this->m_header.nb_blocks = m_offsets.size() - 1;
+    this->m_header.index = m_offsets.back();
+    this->m_first_layer->write(reinterpret_cast<char*>(m_offsets.data()),
+                               m_offsets.size() * sizeof(uint64_t));
+    this->m_first_layer->seekp(0);
+    this->m_header.serialize(this->m_first_layer.get());
+    this->m_first_layer->flush();
+  }
+
+private:
+  void flush_block()
+  {
+    int size = LZ4_compress_default(reinterpret_cast<const char*>(m_block.data()),
+                                    reinterpret_cast<char*>(m_cblock.data()),
+                                    m_block.size(), m_cblock.size());
+    if (size <= 0)
+      throw IOError(fmt::format("Unable to compress block {} of {}.", m_offsets.size() - 1, this->m_path));
+    this->m_first_layer->write(reinterpret_cast<char*>(m_cblock.data()), size);
+    m_offsets.push_back(m_offsets.back() + size);
+    m_block.clear();
+  }
+
+private:
+  size_t m_row_bytes {0};
+  bool m_closed {false};
+  std::vector<uint8_t> m_block;
+  std::vector<uint8_t> m_cblock;
+  std::vector<uint64_t> m_offsets;
+};
+
+// Random access to the rows of a block matrix. Decompressed blocks are kept in a LRU cache of
+// cache_blocks blocks, so sequential reads and queries with locality decompress each block once.
+// Not thread-safe.
+template<size_t buf_size = 8192>
+class BlockMatrixReader : public IFile<BlockMatrixFileHeader, std::istream, buf_size>
+{
+  using lru_t = std::list<uint64_t>;
+  struct block
+  {
+    lru_t::iterator pos;
+    std::vector<uint8_t> data;
+  };
+
+public:
+  BlockMatrixReader(const std::string& path, size_t cache_blocks = 64)
+    : IFile<BlockMatrixFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary),
+      m_capacity(std::max<size_t>(cache_blocks, 1))
+  {
+    this->m_header.deserialize(this->m_first_layer.get());
+    this->m_header.sanity_check();
+    m_row_bytes = NBYTES(this->m_header.bits);
+
+    m_offsets.resize(this->m_header.nb_blocks + 1);
+    this->m_first_layer->seekg(this->m_header.index);
+    this->m_first_layer->read(reinterpret_cast<char*>(m_offsets.data()),
+                              m_offsets.size() * sizeof(uint64_t));
+    if (!this->m_header.index || !this->m_first_layer->good())
+      throw IOError(fmt::format("{} is truncated.", path));
+  }
+
+  // Presence bits of the i-th row of the partition, i.e. hash first + i, nullptr if i is
+  // outside the window. Valid until the next call.
+  const uint8_t* row(uint64_t i)
+  {
+    if (i >= this->m_header.window)
+      return nullptr;
+    uint64_t b = i / this->m_header.block_rows;
+    return get_block(b).data() + (i % this->m_header.block_rows) * m_row_bytes;
+  }
+
+  bool read(std::vector<uint8_t>& bits)
+  {
+    const uint8_t* r = row(m_next);
+    if (!r)
+      return false;
+    std::copy(r, r + m_row_bytes, bits.begin());
+    m_next++;
+    return true;
+  }
+
+  // Same as PAHashMatrixReader, hashes in no sample are skipped.
+  void write_as_text(std::ostream& stream)
+  {
+    std::vector<uint8_t> vec(m_row_bytes);
+    for (uint64_t i=0; read(vec); i++)
+    {
+      if (std::all_of(vec.begin(), vec.end(), [](uint8_t b){ return b == 0; }))
+        continue;
+      stream << std::to_string(this->m_header.first + i);
+      for (uint32_t s=0; s<this->m_header.bits; s++)
+        stream << " " << (BITCHECK(vec, s) ? '1' : '0');
+      stream << "\n";
+    }
+  }
+
+  size_t row_bytes() const
+  {
+    return m_row_bytes;
+  }
+
+  uint64_t decoded() const
+  {
+    return m_decoded;
+  }
+
+private:
+  const std::vector<uint8_t>& get_block(uint64_t b)
+  {
+    auto it = m_cache.find(b);
+    if (it != m_cache.end())
+    {
+      m_lru.splice(m_lru.begin(), m_lru, it->second.pos);
+      return it->second.data;
+    }
+
+    std::vector<uint8_t> data;
+    if (m_cache.size() >= m_capacity)
+    {
+      auto last = m_cache.find(m_lru.back());
+      data = std::move(last->second.data);
+      m_cache.erase(last);
+      m_lru.pop_back();
+    }
+
+    uint64_t nb_rows = std::min<uint64_t>(this->m_header.block_rows,
+                                          this->m_header.window - b * this->m_header.block_rows);
+    data.resize(nb_rows * m_row_bytes);
+
+    uint64_t size = m_offsets[b + 1] - m_offsets[b];
+    m_cblock.resize(size);
+    this->m_first_layer->seekg(m_offsets[b]);
+    this->m_first_layer->read(reinterpret_cast<char*>(m_cblock.data()), size);
+
+    int ret = LZ4_decompress_safe(reinterpret_cast<const char*>(m_cblock.data()),
+                                  reinterpret_cast<char*>(data.data()), size, data.size());
+    if (ret < 0 || static_cast<size_t>(ret) != data.size())
+      throw IOError(fmt::format("Block {} of {} is corrupted.", b, this->m_path));
+    m_decoded++;
+
+    m_lru.push_front(b);
+    block& blk = m_cache[b];
+    blk.pos = m_lru.begin();
+    blk.data = std::move(data);
+    return blk.data;
+  }
+
+private:
+  size_t m_capacity {0};
+  size_t m_row_bytes {0};
+  uint64_t m_next {0};
+  uint64_t m_decoded {0};
+  std::vector<uint64_t> m_offsets;
+  std::vector<uint8_t> m_cblock;
+  lru_t m_lru;
+  std::unordered_map<uint64_t, block> m_cache;
+};
+
+template<size_t buf_size = 8192>
+using bmr_t = std::shared_ptr<BlockMatrixReader<buf_size>>;
+
+// Concatenates the partitions of a block matrix, as a hash pa matrix (see PAHashMatrixFileAggregator).
+class BlockMatrixFileAggregator
+{
+public:
+  BlockMatrixFileAggregator(const std::vector<std::string>& paths)
+    : m_paths(paths)
+  {
+
+  }
+
+  void write_as_bin(const std::string& path, bool compressed)
+  {
+    size_t size = BlockMatrixReader<8192>(m_paths[0]).infos().bits;
+    PAHashMatrixWriter<8192> kw(
+      path, size, 0, -1, compressed);
+    std::vector<uint8_t> bits(NBYTES(size));
+    for (auto& p : m_paths)
+    {
+      BlockMatrixReader<8192> kr(p);
+      for (uint64_t hash = kr.infos().first; kr.read(bits); hash++)
+      {
+        if (std::any_of(bits.begin(), bits.end(), [](uint8_t b){ return b != 0; }))
+          kw.write(hash, bits);
+      }
+    }
+  }
+
+  void write_as_text(std::ostream& out)
+  {
+    for (auto& p : m_paths)
+    {
+      BlockMatrixReader<8192> kr(p);
+      kr.write_as_text(out);
+    }
+  }
+
+  void write_as_text(const std::string& path)
+  {
+    std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
+    write_as_text(out);
+  }
+
+private:
+  std::vector<std::string> m_paths;
+};
+
+};
@@ -0,0 +1,162 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+
+#include <kmtricks/io/gz_reader.hpp>
+
+namespace km {
+
+// Sequences of a list of FASTA/FASTQ files, read through GzReader.
+// Records are split the way GATB's BankFasta does, so both readers give the same
+// sequences: empty lines are skipped, a line starting with '>' or '@' starts a new
+// record, '+' starts the qualities of a FASTQ record.
+class FastxReader
+{
+public:
+  FastxReader(const std::vector<std::string>& paths, size_t nb_threads = 1)
+    : m_paths(paths), m_nb_threads(nb_threads) {}
+
+  // Sequence of the next record, false when all the files are read.
+  bool next(std::string& seq)
+  {
+    seq.clear();
+
+    // go to the next header
+    while (true)
+    {
+      int c = peek();
+      if (c == -1)
+      {
+        if (!next_file())
+          return false;
+        continue;
+      }
+      skip_line();
+      if (c == '>' || c == '@')
+        break;
+    }
+
+    while (true)
+    {
+      int c = peek();
+      if (c == -1 || c == '>' || c == '@' || c == '+')
+        break;
+      if (c == '\n')
+        skip_line();
+      else
+        append_line(seq);
+    }
+
+    if (peek() == '+')
+    {
+      skip_line();
+      int64_t qual = 0;
+      int64_t len;
+      while (qual < static_cast<int64_t>(seq.size()) && (len = skip_line()) >= 0)
+        qual += len;
+    }
+    return true;
+  }
+
+private:
+  bool next_file()
+  {
+    m_gz = nullptr;
+    if (m_index == m_paths.size())
+      return false;
+    m_gz = std::make_unique<GzReader>(m_paths[m_index++], m_nb_threads);
+    return true;
+  }
+
+  bool fill()
+  {
+    while (m_pos == m_chunk.size())
+    {
+      m_pos = 0;
+      m_chunk.clear();
+      if (!m_gz || !m_gz->read(m_chunk))
+        return false;
+    }
+    return true;
+  }
+
+  int peek()
+  {
+    if (!fill())
+      return -1;
+    return static_cast<unsigned char>(m_chunk[m_pos]);
+  }
+
+  // Reads up to the next '\n' (excluded), calls f(begin, size) on each piece of the line.
+  template<typename F>
+  bool line(F&& f)
+  {
+    if (!fill())
+      return false;
+    while (fill())
+    {
+      const char* begin = m_chunk.data() + m_pos;
+      size_t avail = m_chunk.size() - m_pos;
+      const char* end = static_cast<const char*>(std::memchr(begin, '\n', avail));
+      if (end)
+      {
+        f(begin, static_cast<size_t>(end - begin));
+        m_pos += end - begin + 1;
+        return true;
+      }
+      f(begin, avail);
+      m_pos += avail;
+    }
+    return true;
+  }
+
+  void append_line(std::string& out)
+  {
+    line([&out](const char* s, size_t n){ out.append(s, n); });
+    if (!out.empty() && out.back() == '\r')
+      out.pop_back();
+  }
+
+  // Returns the size of the line without '\r', -1 at the end of the file.
+  int64_t skip_line()
+  {
+    int64_t size = 0;
+    char last = 0;
+    bool ok = line([&](const char* s, size_t n){
+      if (n) { size += n; last = s[n-1]; }
+    });
+    if (!ok)
+      return -1;
+    return last == '\r' ? size - 1 : size;
+  }
+
+private:
+  std::vector<std::string> m_paths;
+  size_t m_nb_threads {1};
+  size_t m_index {0};
+  std::unique_ptr<GzReader> m_gz {nullptr};
+  std::string m_chunk;
+  size_t m_pos {0};
+};
+
+};
@@ -0,0 +1,296 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <future>
+#include <fstream>
+#include <cstring>
+
+#include <zlib.h>
+#ifdef KM_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include <kmtricks/utils.hpp>
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+inline bool is_gzip(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  unsigned char magic[2] = {0, 0};
+  in.read(reinterpret_cast<char*>(magic), 2);
+  return in.gcount() == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+// BGZF: a series of gzip members of at most 64KB, each one storing its compressed size
+// in a 'BC' extra subfield, so blocks can be located without inflating them.
+// Returns the size of the block starting with header (at least 18 bytes), 0 if it is not a BGZF block.
+inline size_t bgzf_block_size(const unsigned char* header)
+{
+  if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || !(header[3] & 4))
+    return 0;
+  uint16_t xlen = header[10] | (header[11] << 8);
+  if (xlen != 6 || header[12] != 'B' || header[13] != 'C' || header[14] != 2 || header[15] != 0)
+    return 0;
+  return (header[16] | (header[17] << 8)) + 1;
+}
+
+inline bool is_bgzf(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  unsigned char header[18];
+  in.read(reinterpret_cast<char*>(header), 18);
+  return in.gcount() == 18 && bgzf_block_size(header) > 0;
+}
+
+// Reads a gzip file by chunks of inflated data, inflation runs ahead on other threads.
+// BGZF blocks are inflated in parallel by nb_threads threads. Other files are inflated
+// by a single read-ahead thread, zlib also reads multi-member and uncompressed files.
+class GzReader
+{
+  using chunk_t = std::future<std::string>;
+
+  struct job
+  {
+    std::string raw;
+    std::vector<size_t> blocks; // offsets in raw
+    std::promise<std::string> inflated;
+  };
+
+public:
+  GzReader(const std::string& path, size_t nb_threads = 1)
+    : m_path(path), m_chunks(2 * std::max<size_t>(nb_threads, 1) + 2)
+  {
+    if (!fs::exists(path))
+      throw FileNotFoundError(fmt::format("{} not found.", path));
+
+    if (km::is_bgzf(path))
+    {
+      m_bgzf = true;
+      m_jobs = std::make_unique<BoundedQueue<job>>(2 * std::max<size_t>(nb_threads, 1) + 2);
+      for (size_t i=0; i<std::max<size_t>(nb_threads, 1); i++)
+        m_workers.emplace_back(&GzReader::inflate_worker, this);
+      m_reader = std::thread(&GzReader::read_bgzf, this);
+    }
+    else
+    {
+      m_reader = std::thread(&GzReader::read_gzip, this);
+    }
+  }
+
+  ~GzReader()
+  {
+    m_chunks.close();
+    if (m_jobs)
+      m_jobs->close();
+    if (m_reader.joinable())
+      m_reader.join();
+    for (auto& t : m_workers)
+      t.join();
+  }
+
+  // Next chunk of inflated data, false at the end of the file.
+  bool read(std::string& chunk)
+  {
+    chunk_t next;
+    if (!m_chunks.pop(next))
+      return false;
+    chunk = next.get();
+    return true;
+  }
+
+  bool is_bgzf() const
+  {
+    return m_bgzf;
+  }
+
+private:
+  void push_error(std::exception_ptr e)
+  {
+    std::promise<std::string> error;
+    error.set_exception(e);
+    m_chunks.push(error.get_future());
+  }
+
+  void read_gzip()
+  {
+    try
+    {
+      gzFile file = gzopen(m_path.c_str(), "rb");
+      if (file == nullptr)
+        throw IOError(fmt::format("Unable to read at {}.", m_path));
+      gzbuffer(file, s_chunk_size);
+
+      bool open = true;
+      while (open)
+      {
+        std::string chunk(s_chunk_size, '\0');
+        int n = gzread(file, chunk.data(), s_chunk_size);
+        if (n < 0)
+        {
+          int err;
+          std::string msg = gzerror(file, &err);
+          gzclose(file);
+          throw IOError(fmt::format("Unable to inflate {}: {}.", m_path, msg));
+        }
+        if (n == 0)
+          break;
+        chunk.resize(n);
+        std::promise<std::string> inflated;
+        inflated.set_value(std::move(chunk));
+        open = m_chunks.push(inflated.get_future());
+      }
+      gzclose(file);
+    }
+    catch (...)
+    {
+      push_error(std::current_exception());
+    }
+    m_chunks.close();
+  }
+
+  // Splits the file into jobs of consecutive blocks. The chunks are queued in file
+  // order before the jobs, so they are read in order whatever the worker which inflates them.
+  void read_bgzf()
+  {
+    try
+    {
+      std::ifstream in(m_path, std::ios::binary);
+      check_fstream_good(m_path, in);
+
+      job j;
+      bool open = true;
+      unsigned char header[18];
+      while (open)
+      {
+        in.read(reinterpret_cast<char*>(header), 18);
+        bool eof = in.gcount() == 0;
+        if (!eof)
+        {
+          size_t size = in.gcount() == 18 ? bgzf_block_size(header) : 0;
+          if (size < 26)
+            throw IOError(fmt::format("{} is not a valid BGZF file.", m_path));
+          size_t offset = j.raw.size();
+          j.raw.resize(offset + size);
+          std::memcpy(j.raw.data() + offset, header, 18);
+          in.read(j.raw.data() + offset + 18, size - 18);
+          if (static_cast<size_t>(in.gcount()) != size - 18)
+            throw IOError(fmt::format("{}: truncated BGZF block.", m_path));
+          j.blocks.push_back(offset);
+        }
+
+        if ((eof && !j.blocks.empty()) || j.raw.size() >= s_chunk_size)
+        {
+          open = m_chunks.push(j.inflated.get_future()) && m_jobs->push(std::move(j));
+          j = job();
+        }
+        if (eof)
+          break;
+      }
+    }
+    catch (...)
+    {
+      push_error(std::current_exception());
+    }
+    m_chunks.close();
+    m_jobs->close();
+  }
+
+  void inflate_worker()
+  {
+#ifdef KM_LIBDEFLATE
+    libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
+#endif
+    job j;
+    while (m_jobs->pop(j))
+    {
+      try
+      {
+        std::string inflated;
+        for (size_t i=0; i<j.blocks.size(); i++)
+        {
+          size_t begin = j.blocks[i];
+          size_t end = i + 1 < j.blocks.size() ? j.blocks[i+1] : j.raw.size();
+          const unsigned char* block = reinterpret_cast<const unsigned char*>(j.raw.data() + begin);
+          size_t size = end - begin;
+          uint32_t crc = load_u32(block + size - 8);
+          uint32_t isize = load_u32(block + size - 4);
+
+          size_t offset = inflated.size();
+          inflated.resize(offset + isize);
+          unsigned char* out = reinterpret_cast<unsigned char*>(inflated.data() + offset);
+#ifdef KM_LIBDEFLATE
+          bool ok = libdeflate_deflate_decompress(decompressor, block + 18, size - 26, out, isize,
+                                                  nullptr) == LIBDEFLATE_SUCCESS;
+          ok = ok && libdeflate_crc32(0, out, isize) == crc;
+#else
+          bool ok = inflate_raw(block + 18, size - 26, out, isize);
+          ok = ok && ::crc32(0, out, isize) == crc;
+#endif
+          if (!ok)
+            throw IOError(fmt::format("{}: corrupted BGZF block.", m_path));
+        }
+        j.inflated.set_value(std::move(inflated));
+      }
+      catch (...)
+      {
+        j.inflated.set_exception(std::current_exception());
+      }
+    }
+#ifdef KM_LIBDEFLATE
+    libdeflate_free_decompressor(decompressor);
+#endif
+  }
+
+  static bool inflate_raw(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size)
+  {
+    z_stream strm {};
+    if (inflateInit2(&strm, -15) != Z_OK)
+      return false;
+    strm.next_in = const_cast<unsigned char*>(in);
+    strm.avail_in = in_size;
+    strm.next_out = out;
+    strm.avail_out = out_size;
+    int ret = inflate(&strm, Z_FINISH);
+    bool ok = ret == Z_STREAM_END && strm.total_out == out_size;
+    inflateEnd(&strm);
+    return ok;
+  }
+
+  static uint32_t load_u32(const unsigned char* p)
+  {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+  }
+
+private:
+  std::string m_path;
+  bool m_bgzf {false};
+  BoundedQueue<chunk_t> m_chunks;
+  std::unique_ptr<BoundedQueue<job>> m_jobs {nullptr};
+  std::thread m_reader;
+  std::vector<std::thread> m_workers;
+
+  static constexpr size_t s_chunk_size = 1 << 20;
+};
+
+};
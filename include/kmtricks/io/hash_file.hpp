@@ -18,6 +18,7 @@
 
 #pragma once
 #include <kmtricks/io/io_common.hpp>
+#include <kmtricks/io/key_index.hpp>
 #include <kmtricks/utils.hpp>
 #include <ic.h>
 
@@ -84,8 +85,14 @@ public:
 
   ~HashWriter()
   {
-    if (m_index != 0)
-      flush();
+    close();
+  }
+
+  // Writes a sparse index of the hashes after the records, one entry per block.
+  // Must be called before the first write.
+  void enable_index()
+  {
+    m_indexed = true;
   }
 
   void write(uint64_t hash, count_type count)
@@ -102,6 +109,10 @@ public:
     if (!m_index)
       return;
 
+    if (m_indexed)
+      m_key_index.add(&m_src[0], this->m_second_layer->tellp(), m_nb_records);
+    m_nb_records += m_index;
+
     if (this->m_header.compressed)
     {
       size_t n = m_index;
@@ -130,6 +141,17 @@ public:
     m_index = 0;
   }
 
+  void close()
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+
+    flush();
+    if (m_indexed)
+      m_key_index.serialize(this->m_second_layer.get(), this->m_second_layer->tellp(), m_nb_records);
+  }
+
 private:
   std::array<uint64_t, buf_size / sizeof(uint64_t)> m_src;
   std::array<unsigned char, buf_size> m_dest;
@@ -138,6 +160,10 @@ private:
   size_t m_index {0};
   size_t m_in_buffer {0};
   size_t m_capacity {m_src.size()};
+  uint64_t m_nb_records {0};
+  bool m_indexed {false};
+  bool m_closed {false};
+  KeyIndex m_key_index;
 };
 
 template<size_t MAX_C, size_t buf_size = 32768>
@@ -157,10 +183,17 @@ public:
     this->m_header.sanity_check();
 
     this->template set_second_layer<icstream>(false);
+
+    if (m_key_index.load(path))
+      m_data_end = m_key_index.data_end();
   }
 
   bool load()
   {
+    // blocks are followed by the index, if any
+    if (m_data_end && static_cast<uint64_t>(this->m_second_layer->tellg()) >= m_data_end)
+      return false;
+
     this->m_second_layer->read(reinterpret_cast<char*>(&m_in_buffer), sizeof(m_in_buffer));
     if (!this->m_second_layer->gcount())
       return false;
@@ -196,9 +229,16 @@ public:
   bool read(uint64_t& hash, count_type& count)
   {
     if (m_in_buffer == 0)
-      if (!load())
+      if (m_done || !load())
         return false;
 
+    if (m_limited && m_dest[m_index] >= m_limit)
+    {
+      m_in_buffer = 0;
+      m_done = true;
+      return false;
+    }
+
     hash = m_dest[m_index];
     count = m_dest_c[m_index];
 
@@ -208,6 +248,51 @@ public:
     return true;
   }
 
+  // Positions the reader on the first hash not lower than hash, from the block given by the
+  // index, or by skipping the hashes from the current position if the file has no index.
+  void seek_to(uint64_t hash)
+  {
+    if (!m_key_index.empty())
+    {
+      size_t entry = m_key_index.floor(&hash);
+      this->m_second_layer->clear();
+      this->m_second_layer->seekg(m_key_index.offset(entry == KeyIndex::npos ? 0 : entry));
+      m_in_buffer = 0;
+    }
+
+    while (m_in_buffer || load())
+    {
+      while (m_in_buffer && m_dest[m_index] < hash)
+      {
+        m_in_buffer--;
+        m_index++;
+      }
+      if (m_in_buffer)
+        return;
+    }
+  }
+
+  // Stops the reader before the first hash not lower than hash.
+  void limit(uint64_t hash)
+  {
+    m_limit = hash;
+    m_limited = true;
+  }
+
+  // The first hash of each block. Returns false if the file has no index.
+  bool sample(std::vector<uint64_t>& hashes) const
+  {
+    for (size_t i=0; i<m_key_index.size(); i++)
+      hashes.push_back(*m_key_index.key(i));
+    return !m_key_index.empty();
+  }
+
+  // Number of records, known only if the file has an index.
+  uint64_t nb_records() const
+  {
+    return m_key_index.nb_records();
+  }
+
   void write_as_text(std::ostream& stream)
   {
     uint64_t hash = 0;
@@ -226,6 +311,11 @@ private:
   size_t m_index {0};
   size_t m_in_buffer {0};
   size_t m_capacity {m_dest.size()};
+  KeyIndex m_key_index;
+  uint64_t m_data_end {0};
+  uint64_t m_limit {0};
+  bool m_limited {false};
+  bool m_done {false};
 };
 
 template<size_t MAX_C, size_t buf_size = 32768>
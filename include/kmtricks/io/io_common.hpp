@@ -42,6 +42,7 @@ enum class KM_FILE
   PAMATRIX_HASH,
   VECTOR,
   BITMATRIX,
+  BLOCKMATRIX,
   KFF,
   HIST,
   SUPERK
@@ -55,6 +56,7 @@ const std::map<KM_FILE, uint64_t> MAGICS = {
   {KM_FILE::PAMATRIX, 0x6b5f74616d6170},
   {KM_FILE::VECTOR, 0x726f74636576},
   {KM_FILE::BITMATRIX, 0x74616d746962},
+  {KM_FILE::BLOCKMATRIX, 0x6b6c62746962},
   {KM_FILE::HIST, 0x747369686b},
   {KM_FILE::SUPERK, 0x6b7265707573},
   {KM_FILE::MATRIX_HASH, 0x685f78697274616d},
@@ -88,6 +90,8 @@ inline KM_FILE get_km_file_type(const std::string& path)
     return KM_FILE::VECTOR;
   else if (km_file == MAGICS.at(KM_FILE::BITMATRIX))
     return KM_FILE::BITMATRIX;
+  else if (km_file == MAGICS.at(KM_FILE::BLOCKMATRIX))
+    return KM_FILE::BLOCKMATRIX;
   else if (km_file == MAGICS.at(KM_FILE::HIST))
     return KM_FILE::HIST;
   else if (km_file == MAGICS.at(KM_FILE::SUPERK))
@@ -114,6 +118,8 @@ inline std::string km_file_to_str(KM_FILE f)
     return "bit vector";
   else if (f == KM_FILE::BITMATRIX)
     return "bit matrix";
+  else if (f == KM_FILE::BLOCKMATRIX)
+    return "block bit matrix";
   else if (f == KM_FILE::HIST)
     return "histogram";
   else if (f == KM_FILE::SUPERK)
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <kmtricks/io/io_common.hpp>
+
+namespace km {
+
+constexpr uint64_t KEY_INDEX_MAGIC = 0x7865646e69796b;
+
+// Keys are stored as 64-bit words, least significant word first, as in Kmer.
+inline bool key_less(const uint64_t* a, const uint64_t* b, size_t words)
+{
+  for (size_t i=words; i-- > 0;)
+    if (a[i] != b[i])
+      return a[i] < b[i];
+  return false;
+}
+
+// Sparse index of the keys of a sorted kmer or hash file, optionally written after the records:
+//   [key, offset, record] * nb_entries | data_end | nb_records | nb_entries | key_words | magic
+// offset is the position in the file from which the record of rank record, whose key is key,
+// can be read: a record of an uncompressed file, a block of a hash file or a lz4 frame.
+// Files without footer end with their records, readers must stop at data_end otherwise.
+class KeyIndex
+{
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  KeyIndex(uint32_t key_words = 1) : m_key_words(key_words) {}
+
+  void add(const uint64_t* key, uint64_t offset, uint64_t record)
+  {
+    m_keys.insert(m_keys.end(), key, key + m_key_words);
+    m_offsets.push_back(offset);
+    m_records.push_back(record);
+  }
+
+  void serialize(std::ostream* stream, uint64_t data_end, uint64_t nb_records)
+  {
+    m_data_end = data_end;
+    m_nb_records = nb_records;
+    uint64_t nb_entries = size();
+    uint64_t key_words = m_key_words;
+    for (size_t i=0; i<nb_entries; i++)
+    {
+      stream->write(reinterpret_cast<const char*>(key(i)), m_key_words * sizeof(uint64_t));
+      stream->write(reinterpret_cast<const char*>(&m_offsets[i]), sizeof(uint64_t));
+      stream->write(reinterpret_cast<const char*>(&m_records[i]), sizeof(uint64_t));
+    }
+    stream->write(reinterpret_cast<const char*>(&m_data_end), sizeof(m_data_end));
+    stream->write(reinterpret_cast<const char*>(&m_nb_records), sizeof(m_nb_records));
+    stream->write(reinterpret_cast<const char*>(&nb_entries), sizeof(nb_entries));
+    stream->write(reinterpret_cast<const char*>(&key_words), sizeof(key_words));
+    stream->write(reinterpret_cast<const char*>(&KEY_INDEX_MAGIC), sizeof(KEY_INDEX_MAGIC));
+  }
+
+  // Size of the footer written by serialize().
+  uint64_t serialized_size() const
+  {
+    return size() * (m_key_words + 2) * sizeof(uint64_t) + 5 * sizeof(uint64_t);
+  }
+
+  // Returns false if the file has no index, which is not an error.
+  bool load(const std::string& path)
+  {
+    constexpr size_t trailer = 5 * sizeof(uint64_t);
+    uint64_t file_size = fs::file_size(path);
+    if (file_size < trailer)
+      return false;
+
+    std::ifstream in(path, std::ios::in | std::ios::binary); check_fstream_good(path, in);
+    in.seekg(file_size - trailer);
+    uint64_t data_end = 0, nb_records = 0, nb_entries = 0, key_words = 0, magic = 0;
+    in.read(reinterpret_cast<char*>(&data_end), sizeof(data_end));
+    in.read(reinterpret_cast<char*>(&nb_records), sizeof(nb_records));
+    in.read(reinterpret_cast<char*>(&nb_entries), sizeof(nb_entries));
+    in.read(reinterpret_cast<char*>(&key_words), sizeof(key_words));
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+
+    // the last bytes of a file without index can match the magic, the sizes must match too
+    if (magic != KEY_INDEX_MAGIC || key_words == 0 || key_words > 64 || data_end > file_size ||
+        (file_size - trailer - data_end) != nb_entries * (key_words + 2) * sizeof(uint64_t))
+      return false;
+
+    m_key_words = key_words;
+    m_data_end = data_end;
+    m_nb_records = nb_records;
+    m_keys.resize(nb_entries * key_words);
+    m_offsets.resize(nb_entries);
+    m_records.resize(nb_entries);
+
+    in.seekg(data_end);
+    for (size_t i=0; i<nb_entries; i++)
+    {
+      in.read(reinterpret_cast<char*>(&m_keys[i * key_words]), key_words * sizeof(uint64_t));
+      in.read(reinterpret_cast<char*>(&m_offsets[i]), sizeof(uint64_t));
+      in.read(reinterpret_cast<char*>(&m_records[i]), sizeof(uint64_t));
+    }
+    if (!in.good())
+      throw IOError(fmt::format("Unable to read the index of {}.", path));
+    return true;
+  }
+
+  // Last entry whose key is lower than or equal to key, npos if there is none.
+  size_t floor(const uint64_t* key) const
+  {
+    size_t lo = 0, hi = size();
+    while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (key_less(key, this->key(mid), m_key_words))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    return lo ? lo - 1 : npos;
+  }
+
+  size_t size() const { return m_offsets.size(); }
+  bool empty() const { return m_offsets.empty(); }
+  uint32_t key_words() const { return m_key_words; }
+  const uint64_t* key(size_t i) const { return &m_keys[i * m_key_words]; }
+  uint64_t offset(size_t i) const { return m_offsets[i]; }
+  uint64_t record(size_t i) const { return m_records[i]; }
+  uint64_t data_end() const { return m_data_end; }
+  uint64_t nb_records() const { return m_nb_records; }
+
+private:
+  uint32_t m_key_words {1};
+  uint64_t m_data_end {0};
+  uint64_t m_nb_records {0};
+  std::vector<uint64_t> m_keys;
+  std::vector<uint64_t> m_offsets;
+  std::vector<uint64_t> m_records;
+};
+
+};
@@ -21,12 +21,14 @@
 #include <string>
 #include <memory>
 #include <optional>
+#include <vector>
 
 // ext
 #include <kff_io.hpp>
 
 // int
 #include <kmtricks/kmer.hpp>
+#include <kmtricks/exceptions.hpp>
 
 namespace km {
 
@@ -34,11 +36,15 @@ using kff_t = std::unique_ptr<Kff_file>;
 using kff_raw_t = std::unique_ptr<Section_Raw>;
 using kff_min_t = std::unique_ptr<Section_Minimizer>;
 
+// One raw section entry per k-mer with write(), or super-k-mers of up to max_kmers k-mers
+// with write_superk() (minimizer sections) and write_compacted() (raw section), see
+// KmerCompactor. Raw entries are written in a single section, after the minimizer ones.
 template<size_t MAX_C>
 class KffWriter
 {
+  using count_type = typename selectC<MAX_C>::type;
 public:
-  KffWriter(const std::string& path, size_t kmer_size)
+  KffWriter(const std::string& path, size_t kmer_size, size_t minim_size = 0, size_t max_kmers = 1)
     : m_kmer_size(kmer_size)
   {
     m_kff_file = std::make_unique<Kff_file>(path, "w");
@@ -47,10 +53,42 @@ public:
 
     Section_GV sgv(m_kff_file.get());
     sgv.write_var("k", m_kmer_size);
-    sgv.write_var("max", 1);
-    sgv.write_var("data_size", sizeof(typename selectC<MAX_C>::type));
+    if (minim_size)
+      sgv.write_var("m", minim_size);
+    sgv.write_var("max", max_kmers);
+    sgv.write_var("data_size", sizeof(count_type));
     sgv.close();
-    m_kff_sec = std::make_unique<Section_Raw>(m_kff_file.get());
+  }
+
+  // seq contains minimizer at minim_pos, counts holds one count per k-mer.
+  void write_superk(const std::string& seq, const std::string& minimizer, size_t minim_pos,
+                    const count_type* counts)
+  {
+    if (m_kff_sec)
+      throw IOError("KffWriter: minimizer sections must be written before raw entries.");
+    if (!m_min_sec || minimizer != m_minimizer)
+    {
+      if (m_min_sec)
+        m_min_sec->close();
+      m_min_sec = std::make_unique<Section_Minimizer>(m_kff_file.get());
+      m_encoded.resize(minimizer.size() / 4 + 1);
+      encode_sequence(minimizer, m_encoded.data());
+      m_min_sec->write_minimizer(m_encoded.data());
+      m_minimizer = minimizer;
+    }
+    encode_counts(counts, seq.size() - m_kmer_size + 1);
+    m_encoded.resize(seq.size() / 4 + 1);
+    encode_sequence(seq, m_encoded.data());
+    m_min_sec->write_compacted_sequence(m_encoded.data(), seq.size(), minim_pos, m_counts.data());
+  }
+
+  void write_compacted(const std::string& seq, const count_type* counts)
+  {
+    raw_section();
+    encode_counts(counts, seq.size() - m_kmer_size + 1);
+    m_encoded.resize(seq.size() / 4 + 1);
+    encode_sequence(seq, m_encoded.data());
+    m_kff_sec->write_compacted_sequence(m_encoded.data(), seq.size(), m_counts.data());
   }
 
   template<size_t MAX_K>
@@ -67,12 +105,19 @@ public:
 
     m_kmer = kmer.to_string();
     encode_sequence(encoded);
+    raw_section();
     m_kff_sec->write_compacted_sequence(encoded, m_kmer_size, counts);
   }
 
   void close()
   {
-    m_kff_sec->close();
+    if (m_closed)
+      return;
+    m_closed = true;
+    if (m_min_sec)
+      m_min_sec->close();
+    if (m_kff_sec)
+      m_kff_sec->close();
     m_kff_file->close();
   }
 
@@ -90,22 +135,53 @@ public:
 
   void encode_sequence(uint8_t* encoded)
   {
-    size_t size = m_kmer.length();
+    encode_sequence(m_kmer, encoded);
+  }
+
+  void encode_sequence(const std::string& seq, uint8_t* encoded)
+  {
+    size_t size = seq.length();
     size_t remnant = size % 4;
     if (remnant > 0)
     {
-      encoded[0] = uint8_packing(m_kmer.substr(0, remnant));
+      encoded[0] = uint8_packing(seq.substr(0, remnant));
       encoded += 1;
     }
 
     size_t nb_uint_needed = size / 4;
     for (size_t i = 0; i < nb_uint_needed; i++)
     {
-      encoded[i] = uint8_packing(m_kmer.substr(remnant + 4 * i, 4));
+      encoded[i] = uint8_packing(seq.substr(remnant + 4 * i, 4));
     }
   }
 
 private:
+  void raw_section()
+  {
+    if (m_kff_sec)
+      return;
+    if (m_min_sec)
+    {
+      m_min_sec->close();
+      m_min_sec = nullptr;
+    }
+    m_kff_sec = std::make_unique<Section_Raw>(m_kff_file.get());
+  }
+
+  void encode_counts(const count_type* counts, size_t n)
+  {
+    m_counts.resize(n * sizeof(count_type));
+    for (size_t i=0; i<n; i++)
+    {
+      if constexpr(sizeof(count_type) == 1)
+        m_counts[i] = counts[i];
+      else if constexpr(sizeof(count_type) == 2)
+        u8from16(&m_counts[2 * i], counts[i]);
+      else
+        u8from32(&m_counts[4 * i], counts[i]);
+    }
+  }
+
   void u8from32(uint8_t b[4], uint32_t u32)
   {
     b[3] = (uint8_t)u32;
@@ -116,15 +192,20 @@ private:
 
   void u8from16(uint8_t b[2], uint16_t u16)
   {
-    b[1] = (uint8_t)(u16>>=8);
+    b[1] = (uint8_t)u16;
     b[0] = (uint8_t)(u16>>=8);
   }
 
 private:
   kff_t m_kff_file {nullptr};
   kff_raw_t m_kff_sec {nullptr};
+  kff_min_t m_min_sec {nullptr};
   size_t m_kmer_size;
   std::string m_kmer;
+  std::string m_minimizer;
+  bool m_closed {false};
+  std::vector<uint8_t> m_encoded;
+  std::vector<uint8_t> m_counts;
 };
 
 template<size_t MAX_C>
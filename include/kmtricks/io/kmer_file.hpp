@@ -18,6 +18,7 @@
 
 #pragma once
 #include <kmtricks/io/io_common.hpp>
+#include <kmtricks/io/key_index.hpp>
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/utils.hpp>
 
@@ -87,13 +88,29 @@ public:
     this->m_header.partition = partition;
 
     this->m_header.serialize(this->m_first_layer.get());
+    m_data_begin = this->m_first_layer->tellp();
 
     this->template set_second_layer<ocstream>(this->m_header.compressed);
   }
 
+  ~KmerWriter()
+  {
+    close();
+  }
+
+  // Writes a sparse index of the k-mers after the records, one entry every step records.
+  // Must be called before the first write. With lz4, a new frame starts at each entry
+  // and the index is stored in a skippable frame, invisible to the decompression.
+  void enable_index(uint32_t step = 4096)
+  {
+    m_step = step;
+    m_key_index = KeyIndex(this->m_header.kmer_slots);
+  }
+
   template<size_t MAX_K, size_t MAX_C>
   void write(const Kmer<MAX_K>& kmer, const typename selectC<MAX_C>::type count)
   {
+    index(kmer.get_data64());
     this->m_second_layer->write(reinterpret_cast<const char*>(kmer.get_data64()),
                                 this->m_header.kmer_slots*8);
     this->m_second_layer->write(reinterpret_cast<const char*>(&count), sizeof(count));
@@ -102,10 +119,49 @@ public:
   template<size_t MAX_C>
   void write_raw(const uint64_t* data, const typename selectC<MAX_C>::type count)
   {
+    index(data);
     this->m_second_layer->write(reinterpret_cast<const char*>(data),
                                 this->m_header.kmer_slots*8);
     this->m_second_layer->write(reinterpret_cast<const char*>(&count), sizeof(count));
   }
+
+  void close()
+  {
+    if (m_closed || !m_step)
+      return;
+    m_closed = true;
+
+    std::ostream* out = this->m_second_layer.get();
+    if (this->m_header.compressed)
+    {
+      static_cast<ocstream*>(this->m_second_layer.get())->close();
+      out = this->m_first_layer.get();
+      lz4_stream::write_skippable_header(*out, m_key_index.serialized_size());
+    }
+    m_key_index.serialize(out, out->tellp(), m_nb_records);
+  }
+
+private:
+  void index(const uint64_t* data)
+  {
+    if (m_step && m_nb_records % m_step == 0)
+    {
+      uint64_t offset = m_data_begin +
+        m_nb_records * (this->m_header.kmer_slots * 8 + this->m_header.count_slots);
+      if (this->m_header.compressed)
+        offset = m_nb_records ? static_cast<uint64_t>(
+          static_cast<ocstream*>(this->m_second_layer.get())->restart()) : m_data_begin;
+      m_key_index.add(data, offset, m_nb_records);
+    }
+    m_nb_records++;
+  }
+
+private:
+  uint64_t m_data_begin {0};
+  uint64_t m_nb_records {0};
+  uint32_t m_step {0};
+  bool m_closed {false};
+  KeyIndex m_key_index;
 };
 
 template<size_t buf_size>
@@ -122,20 +178,102 @@ public:
     this->m_header.deserialize(this->m_first_layer.get());
     this->m_header.sanity_check();
     this->template set_second_layer<icstream>(this->m_header.compressed);
+
+    m_record.resize(this->m_header.kmer_slots + (this->m_header.count_slots + 7) / 8);
+    m_key_index = KeyIndex(this->m_header.kmer_slots);
+    if (m_key_index.load(path))
+      m_remaining = m_key_index.nb_records();
   }
 
   template<size_t MAX_K, size_t MAX_C>
   bool read(Kmer<MAX_K>& kmer, typename selectC<MAX_C>::type& count)
   {
-    this->m_second_layer->read(reinterpret_cast<char*>(kmer.get_data64_unsafe()),
-                               this->m_header.kmer_slots*8);
-    this->m_second_layer->read(reinterpret_cast<char*>(&count), this->m_header.count_slots);
+    if (!m_remaining)
+      return false;
 
-    if (!this->m_second_layer->gcount())
+    if (m_peeked)
+    {
+      std::memcpy(kmer.get_data64_unsafe(), m_record.data(), this->m_header.kmer_slots*8);
+      std::memcpy(&count, m_record.data() + this->m_header.kmer_slots, this->m_header.count_slots);
+      m_peeked = false;
+    }
+    else
+    {
+      this->m_second_layer->read(reinterpret_cast<char*>(kmer.get_data64_unsafe()),
+                                 this->m_header.kmer_slots*8);
+      this->m_second_layer->read(reinterpret_cast<char*>(&count), this->m_header.count_slots);
+
+      if (!this->m_second_layer->gcount())
+        return false;
+    }
+
+    if (m_limited && !key_less(kmer.get_data64(), m_limit.data(), this->m_header.kmer_slots))
+    {
+      m_remaining = 0;
       return false;
+    }
+    m_remaining--;
     return true;
   }
 
+  // Positions the reader on the first k-mer not lower than kmer, from the closest index entry,
+  // or by skipping the records from the current position if the file has no index.
+  template<size_t MAX_K>
+  void seek_to(const Kmer<MAX_K>& kmer)
+  {
+    const uint64_t* key = kmer.get_data64();
+    if (!m_key_index.empty())
+    {
+      size_t entry = m_key_index.floor(key);
+      jump(entry == KeyIndex::npos ? 0 : entry);
+    }
+
+    while (m_remaining)
+    {
+      if (!m_peeked)
+      {
+        this->m_second_layer->read(reinterpret_cast<char*>(m_record.data()),
+                                   this->m_header.kmer_slots*8 + this->m_header.count_slots);
+        if (!this->m_second_layer->gcount())
+          return;
+        m_peeked = true;
+      }
+      if (!key_less(m_record.data(), key, this->m_header.kmer_slots))
+        return;
+      m_peeked = false;
+      m_remaining--;
+    }
+  }
+
+  // Stops the reader before the first k-mer not lower than kmer.
+  template<size_t MAX_K>
+  void limit(const Kmer<MAX_K>& kmer)
+  {
+    m_limit.assign(kmer.get_data64(), kmer.get_data64() + this->m_header.kmer_slots);
+    m_limited = true;
+  }
+
+  // The k-mers of n index entries, evenly spaced. Returns false if the file has no index.
+  template<size_t MAX_K>
+  bool sample(size_t n, std::vector<Kmer<MAX_K>>& kmers) const
+  {
+    n = std::min(n, m_key_index.size());
+    for (size_t i=0; i<n; i++)
+    {
+      Kmer<MAX_K> kmer; kmer.set_k(this->m_header.kmer_size);
+      std::memcpy(kmer.get_data64_unsafe(), m_key_index.key(i * m_key_index.size() / n),
+                  this->m_header.kmer_slots*8);
+      kmers.push_back(kmer);
+    }
+    return !m_key_index.empty();
+  }
+
+  // Number of records, known only if the file has an index.
+  uint64_t nb_records() const
+  {
+    return m_key_index.nb_records();
+  }
+
   template<size_t MAX_K, size_t MAX_C>
   void write_as_text(std::ostream& stream)
   {
@@ -157,6 +295,34 @@ public:
       stream << kmer.to_string() << '\n';
     }
   }
+
+private:
+  void jump(size_t entry)
+  {
+    m_peeked = false;
+    m_remaining = m_key_index.nb_records() - m_key_index.record(entry);
+    if (this->m_header.compressed)
+    {
+      // decompression restarts at the beginning of a frame
+      this->m_second_layer.reset();
+      this->m_first_layer->clear();
+      this->m_first_layer->seekg(m_key_index.offset(entry));
+      this->template set_second_layer<icstream>(true);
+    }
+    else
+    {
+      this->m_second_layer->clear();
+      this->m_second_layer->seekg(m_key_index.offset(entry));
+    }
+  }
+
+private:
+  KeyIndex m_key_index;
+  uint64_t m_remaining {std::numeric_limits<uint64_t>::max()};
+  std::vector<uint64_t> m_record;
+  bool m_peeked {false};
+  std::vector<uint64_t> m_limit;
+  bool m_limited {false};
 };
 
 template<size_t buf_size>
@@ -19,6 +19,12 @@
 #include <string>
 #include <cstring>
 #include <fstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
 
 /** \defgroup Stream
  *
@@ -31,6 +37,42 @@ using namespace std;
  *  lz4_stream namespace
  */
 namespace lz4_stream {
+
+/**
+ * @brief Default mode of the streams created afterwards.
+ *
+ * In asynchronous mode, an output stream compresses block N on a helper thread
+ * while block N+1 is filled, and an input stream decompresses the next block on a
+ * helper thread while the current one is consumed. The LZ4 frames are the same.
+ * Each stream owns one helper thread.
+ */
+inline std::atomic<bool>& async_default() {
+  static std::atomic<bool> async {false};
+  return async;
+}
+
+inline void set_async(bool async) {
+  async_default() = async;
+}
+
+// Size of the blocks handed to the helper thread
+constexpr size_t async_block_size = 1 << 16;
+
+/**
+ * @brief Writes the header of a LZ4 skippable frame of size bytes, the caller writes the
+ * content. Decoders skip these frames, so raw data (e.g. an index) can follow the frames
+ * of a stream without being decoded by a reader which decompresses ahead.
+ */
+inline void write_skippable_header(std::ostream& sink, uint32_t size) {
+  const uint32_t magic = 0x184D2A50U;
+  unsigned char header[8];
+  for (size_t i = 0; i < 4; i++) {
+    header[i] = (magic >> (8 * i)) & 0xff;
+    header[4 + i] = (size >> (8 * i)) & 0xff;
+  }
+  sink.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
 /**
  * @brief An output stream that will LZ4 compress the input data.
  * \ingroup Stream
@@ -47,9 +89,10 @@ public:
    * @brief Constructs an LZ4 compression output stream
    *
    * @param sink The stream to write compressed data to
+   * @param async Compress on a helper thread, see set_async()
    */
-  explicit basic_ostream(std::ostream& sink)
-    : std::ostream(new output_buffer(sink)),
+  explicit basic_ostream(std::ostream& sink, bool async = async_default())
+    : std::ostream(new output_buffer(sink, async)),
       buffer_(dynamic_cast<output_buffer*>(rdbuf())) {
     assert(buffer_);
   }
@@ -71,20 +114,35 @@ public:
     buffer_->close();
   }
 
+  /**
+   * @brief Ends the current LZ4 frame and starts a new one.
+   *
+   * The data written afterwards can be decompressed from the returned position of the sink,
+   * without the previous frames.
+   */
+  std::streampos restart() {
+    return buffer_->restart();
+  }
+
 private:
   class output_buffer : public std::streambuf {
   public:
     output_buffer(const output_buffer &) = delete;
     output_buffer& operator= (const output_buffer &) = delete;
 
-    explicit output_buffer(std::ostream &sink)
+    explicit output_buffer(std::ostream &sink, bool async)
       : sink_(sink),
+        src_size_(async ? std::max(SrcBufSize, async_block_size) : SrcBufSize),
       // original author has a todo here: "No need to recalculate the dest_buf_ size on each construction"
-        dest_buf_(LZ4F_compressBound(src_buf_.size(), nullptr)),
+        dest_buf_(LZ4F_compressBound(src_size_, nullptr)),
         ctx_(nullptr),
-        closed_(false) {
-      char* base = &src_buf_.front();
-      setp(base, base + src_buf_.size() - 1);
+        closed_(false),
+        async_(async) {
+      src_buf_[0].resize(src_size_);
+      if (async_)
+        src_buf_[1].resize(src_size_);
+      char* base = &src_buf_[0].front();
+      setp(base, base + src_size_ - 1);
 
       size_t ret = LZ4F_createCompressionContext(&ctx_, LZ4F_VERSION);
       if (LZ4F_isError(ret) != 0) {
@@ -92,6 +150,9 @@ private:
                                  + LZ4F_getErrorName(ret));
       }
       write_header();
+
+      if (async_)
+        worker_ = std::thread(&output_buffer::compress_worker, this);
     }
 
     ~output_buffer() {
@@ -103,11 +164,20 @@ private:
         return;
       }
       sync();
+      stop_worker();
       write_footer();
       LZ4F_freeCompressionContext(ctx_);
       closed_ = true;
     }
 
+    std::streampos restart() {
+      sync();
+      write_footer();
+      std::streampos pos = sink_.tellp();
+      write_header();
+      return pos;
+    }
+
   private:
     int_type overflow(int_type ch) override {
       assert(std::less_equal<char*>()(pptr(), epptr()));
@@ -121,6 +191,8 @@ private:
 
     int_type sync() override {
       compress_and_write();
+      if (async_)
+        wait_worker();
       return 0;
     }
 
@@ -129,8 +201,29 @@ private:
       assert(!closed_);
       int orig_size = static_cast<int>(pptr() - pbase());
       pbump(-orig_size);
+      if (!async_) {
+        compress(pbase(), orig_size);
+        return;
+      }
+      if (orig_size == 0)
+        return;
+
+      // hand the filled block to the worker, and fill the other one meanwhile
+      wait_worker();
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_ = current_;
+        pending_size_ = orig_size;
+      }
+      cv_.notify_all();
+      current_ ^= 1;
+      char* base = &src_buf_[current_].front();
+      setp(base, base + src_size_ - 1);
+    }
+
+    void compress(const char* src, size_t size) {
       size_t ret = LZ4F_compressUpdate(ctx_, &dest_buf_.front(), dest_buf_.capacity(),
-                                       pbase(), orig_size, nullptr);
+                                       src, size, nullptr);
       if (LZ4F_isError(ret) != 0) {
         throw std::runtime_error(std::string("LZ4 compression failed: ")
                                  + LZ4F_getErrorName(ret));
@@ -138,6 +231,46 @@ private:
       sink_.write(&dest_buf_.front(), ret);
     }
 
+    void compress_worker() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        cv_.wait(lock, [this]{ return pending_ != -1 || stop_; });
+        if (pending_ == -1)
+          return;
+        lock.unlock();
+        try {
+          compress(&src_buf_[pending_].front(), pending_size_);
+        } catch (...) {
+          error_ = std::current_exception();
+        }
+        lock.lock();
+        pending_ = -1;
+        cv_.notify_all();
+      }
+    }
+
+    // waits until the worker is done with the pending block
+    void wait_worker() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]{ return pending_ == -1; });
+      if (error_) {
+        std::exception_ptr e = error_;
+        error_ = nullptr;
+        std::rethrow_exception(e);
+      }
+    }
+
+    void stop_worker() {
+      if (!worker_.joinable())
+        return;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      cv_.notify_all();
+      worker_.join();
+    }
+
     void write_header() {
       // original author has a todo here: "Throw exception instead or set badbit"
       assert(!closed_);
@@ -160,10 +293,22 @@ private:
     }
 
     std::ostream& sink_;
-    std::array<char, SrcBufSize> src_buf_;
+    size_t src_size_;
+    std::array<std::vector<char>, 2> src_buf_;
     std::vector<char> dest_buf_;
     LZ4F_compressionContext_t ctx_;
     bool closed_;
+
+    // async mode, the worker compresses src_buf_[pending_] while src_buf_[current_] is filled
+    bool async_;
+    int current_ {0};
+    int pending_ {-1};
+    size_t pending_size_ {0};
+    bool stop_ {false};
+    std::exception_ptr error_ {nullptr};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread worker_;
   };
 
   output_buffer* buffer_;
@@ -184,19 +329,24 @@ public:
    * @brief Constructs an LZ4 decompression input stream
    *
    * @param source The stream to read LZ4 compressed data from
+   * @param async Decompress ahead on a helper thread, see set_async()
    */
-  explicit basic_istream(std::istream& source, bool uncompressed = false)
-    : std::istream(new input_buffer(source, uncompressed)),
+  explicit basic_istream(std::istream& source, bool uncompressed = false,
+                         bool async = async_default())
+    : std::istream(new input_buffer(source, uncompressed, async)),
       buffer_(dynamic_cast<input_buffer*>(rdbuf())) {
     assert(buffer_);
+    // decoding errors are rethrown to the reader instead of ending the stream
+    exceptions(std::ios::badbit);
   }
 
   /* same but takes a filename as input
    */
   explicit basic_istream(const string& filename)
-    : std::istream(new input_buffer(filename, determine_uncompressed(filename))),
+    : std::istream(new input_buffer(filename, determine_uncompressed(filename), async_default())),
       buffer_(dynamic_cast<input_buffer*>(rdbuf())) {
     assert(buffer_);
+    exceptions(std::ios::badbit);
   }
 
   static bool determine_uncompressed(string filename)
@@ -214,24 +364,26 @@ public:
 private:
   class input_buffer : public std::streambuf {
   public:
-    input_buffer(std::istream &source, bool uncompressed)
+    input_buffer(std::istream &source, bool uncompressed, bool async)
       : stream_(nullptr),
         source_(source),
         offset_(0),
         src_buf_size_(0),
         ctx_(nullptr),
-        uncompressed_(uncompressed)
+        uncompressed_(uncompressed),
+        async_(async)
     {
       init_input_buffer();
     }
 
-    input_buffer(const string& filename, bool uncompressed)
+    input_buffer(const string& filename, bool uncompressed, bool async)
       : stream_(new ifstream(filename, ios::in|ios::binary)),
         source_(*stream_),
         offset_(0),
         src_buf_size_(0),
         ctx_(nullptr),
-        uncompressed_(uncompressed)
+        uncompressed_(uncompressed),
+        async_(async)
     {
       assert(source_.good());
       init_input_buffer();
@@ -245,15 +397,35 @@ private:
                                  + LZ4F_getErrorName(ret));
       }
       setg(&src_buf_.front(), &src_buf_.front(), &src_buf_.front());
+
+      if (async_) {
+        for (auto& block : blocks_)
+          block.resize(std::max(DestBufSize, async_block_size));
+        worker_ = std::thread(&input_buffer::decompress_worker, this);
+      }
     }
 
     ~input_buffer() {
+      stop_worker();
       LZ4F_freeDecompressionContext(ctx_);
       if (stream_)
         delete stream_;
     }
 
     int_type underflow() override {
+      if (async_)
+        return next_block();
+
+      size_t written_size = decompress(&dest_buf_.front(), dest_buf_.size());
+      if (written_size == 0) {
+        return traits_type::eof();
+      }
+      setg(&dest_buf_.front(), &dest_buf_.front(), &dest_buf_.front() + written_size);
+      return traits_type::to_int_type(*gptr());
+    }
+
+    // decompresses up to capacity bytes into dest, returns 0 at the end of the source
+    size_t decompress(char* dest, size_t capacity) {
       size_t written_size = 0;
       while (written_size == 0) {
         if (offset_ == src_buf_size_) {
@@ -263,19 +435,20 @@ private:
         }
 
         if (src_buf_size_ == 0) {
-          return traits_type::eof();
+          return 0;
         }
 
         size_t src_size = src_buf_size_ - offset_;
-        size_t dest_size = dest_buf_.size();
+        size_t dest_size = capacity;
         if (uncompressed_)
         {
-          memcpy(&dest_buf_.front(), &src_buf_.front() + offset_, src_size);
+          src_size = std::min(src_size, capacity);
+          memcpy(dest, &src_buf_.front() + offset_, src_size);
           dest_size = src_size;
         }
         else
         {
-          size_t ret = LZ4F_decompress(ctx_, &dest_buf_.front(), &dest_size,
+          size_t ret = LZ4F_decompress(ctx_, dest, &dest_size,
                                        &src_buf_.front() + offset_, &src_size, nullptr);
           if (LZ4F_isError(ret) != 0) {
             throw std::runtime_error(std::string("LZ4 decompression failed: ")
@@ -285,10 +458,78 @@ private:
         written_size = dest_size;
         offset_ += src_size;
       }
-      setg(&dest_buf_.front(), &dest_buf_.front(), &dest_buf_.front() + written_size);
+      return written_size;
+    }
+
+    void decompress_worker() {
+      size_t current = 0;
+      while (true) {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          cv_.wait(lock, [this]{ return ready_ < blocks_.size() || stop_; });
+          if (stop_)
+            return;
+        }
+
+        // fill the block, an empty block marks the end of the stream. On error, the
+        // data decoded so far is kept and the error is raised once it is consumed
+        std::vector<char>& block = blocks_[current];
+        size_t size = 0;
+        std::exception_ptr error = nullptr;
+        try {
+          for (size_t n = 1; n > 0 && size < block.size(); size += n)
+            n = decompress(&block[size], block.size() - size);
+        } catch (...) {
+          error = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        sizes_[current] = size;
+        errors_[current] = error;
+        ready_++;
+        cv_.notify_all();
+        if (size == 0 || error)
+          return;
+        current ^= 1;
+      }
+    }
+
+    int_type next_block() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (consuming_) {
+        // the current block is consumed, give it back to the worker
+        if (errors_[current_])
+          std::rethrow_exception(errors_[current_]);
+        if (sizes_[current_] == 0)
+          return traits_type::eof();
+        consuming_ = false;
+        ready_--;
+        current_ ^= 1;
+        cv_.notify_all();
+      }
+      cv_.wait(lock, [this]{ return ready_ > 0; });
+      consuming_ = true;
+      if (sizes_[current_] == 0) {
+        if (errors_[current_])
+          std::rethrow_exception(errors_[current_]);
+        return traits_type::eof();
+      }
+      char* base = &blocks_[current_].front();
+      setg(base, base, base + sizes_[current_]);
       return traits_type::to_int_type(*gptr());
     }
 
+    void stop_worker() {
+      if (!worker_.joinable())
+        return;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      cv_.notify_all();
+      worker_.join();
+    }
+
     input_buffer(const input_buffer&) = delete;
     input_buffer& operator= (const input_buffer&) = delete;
   private:
@@ -300,6 +541,20 @@ private:
     size_t src_buf_size_;
     LZ4F_decompressionContext_t ctx_;
     bool uncompressed_;
+
+    // async mode, the worker fills blocks_ alternately, ready_ counts the filled blocks
+    // including the one being consumed
+    bool async_;
+    std::array<std::vector<char>, 2> blocks_;
+    std::array<size_t, 2> sizes_ {{0, 0}};
+    std::array<std::exception_ptr, 2> errors_ {{nullptr, nullptr}};
+    size_t ready_ {0};
+    size_t current_ {0};
+    bool consuming_ {false};
+    bool stop_ {false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread worker_;
   };
 
   input_buffer* buffer_;
@@ -0,0 +1,511 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <kmtricks/io/kmer_file.hpp>
+#include <kmtricks/io/hash_file.hpp>
+#include <kmtricks/io/matrix_file.hpp>
+#include <kmtricks/io/pa_matrix_file.hpp>
+#include <kmtricks/io/vector_matrix_file.hpp>
+#include <kmtricks/exceptions.hpp>
+#include <kmtricks/utils.hpp>
+
+#define KM_MMAP_PREFETCH 512
+
+namespace km {
+
+template<typename header_t>
+inline bool is_mappable(const std::string& path)
+{
+  std::ifstream in(path, std::ios::in | std::ios::binary); check_fstream_good(path, in);
+  header_t header;
+  header.deserialize(&in);
+  return !header.compressed;
+}
+
+// Read-only mapping of an uncompressed kmtricks file. The header is parsed as usual,
+// records are then accessed in place, without going through a stream.
+// Records are not aligned, use memcpy to load them.
+template<typename header_t>
+class MmapFile
+{
+public:
+  template<typename... Args>
+  MmapFile(const std::string& path, Args&&... args)
+    : m_path(path)
+  {
+    std::ifstream in(path, std::ios::in | std::ios::binary); check_fstream_good(path, in);
+    m_header.deserialize(&in, std::forward<Args>(args)...);
+    m_header.sanity_check();
+    if (m_header.compressed)
+      throw IOError(fmt::format("{} is compressed and cannot be mapped.", path));
+    size_t offset = in.tellg();
+    in.close();
+    map(offset);
+  }
+
+  MmapFile(MmapFile const &) = delete;
+  MmapFile& operator= (MmapFile const &) = delete;
+  MmapFile(MmapFile&&) = delete;
+  MmapFile& operator= (MmapFile&&) = delete;
+
+  virtual ~MmapFile()
+  {
+    if (m_data)
+      munmap(const_cast<char*>(m_data), m_size);
+  }
+
+  const header_t& infos() const
+  {
+    return m_header;
+  }
+
+  // Fixed-stride view of the records, stride is 0 for block-based formats.
+  const char* begin() const
+  {
+    return m_begin;
+  }
+
+  const char* end() const
+  {
+    return m_end;
+  }
+
+  size_t stride() const
+  {
+    return m_stride;
+  }
+
+  size_t size() const
+  {
+    return m_stride ? (m_end - m_begin) / m_stride : 0;
+  }
+
+  const char* record(size_t i) const
+  {
+    return m_begin + i * m_stride;
+  }
+
+  void rewind()
+  {
+    m_pos = m_begin;
+  }
+
+  // Access pattern hint for the whole mapping, e.g. MADV_RANDOM for lookups.
+  void advise(int advice)
+  {
+    madvise(const_cast<char*>(m_data), m_size, advice);
+  }
+
+protected:
+  const char* next_record()
+  {
+    if (static_cast<size_t>(m_end - m_pos) < m_stride)
+      return nullptr;
+    const char* record = m_pos;
+    m_pos += m_stride;
+    __builtin_prefetch(m_pos + KM_MMAP_PREFETCH);
+    return record;
+  }
+
+private:
+  void map(size_t offset)
+  {
+    int fd = ::open(m_path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw IOError(fmt::format("Unable to read at {}.", m_path));
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < offset)
+    {
+      ::close(fd);
+      throw IOError(fmt::format("Unable to read at {}.", m_path));
+    }
+    m_size = st.st_size;
+
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+      throw IOError(fmt::format("Unable to map {}.", m_path));
+    madvise(data, m_size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<const char*>(data);
+    m_begin = m_pos = m_data + offset;
+    m_end = m_data + m_size;
+  }
+
+protected:
+  header_t    m_header;
+  std::string m_path;
+  const char* m_data  {nullptr};
+  const char* m_begin {nullptr};
+  const char* m_end   {nullptr};
+  const char* m_pos   {nullptr};
+  size_t      m_size  {0};
+  size_t      m_stride {0};
+};
+
+// Same interface as KmerReader.
+class KmerMmapReader : public MmapFile<KmerFileHeader>
+{
+public:
+  KmerMmapReader(const std::string& path)
+    : MmapFile<KmerFileHeader>(path)
+  {
+    m_stride = m_header.kmer_slots * 8 + m_header.count_slots;
+    KeyIndex index(m_header.kmer_slots);
+    if (index.load(path))
+      m_end = m_data + index.data_end();
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, typename selectC<MAX_C>::type& count)
+  {
+    const char* record = next_record();
+    if (!record)
+      return false;
+    std::memcpy(kmer.get_data64_unsafe(), record, m_header.kmer_slots * 8);
+    std::memcpy(&count, record + m_header.kmer_slots * 8, m_header.count_slots);
+    return true;
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  void write_as_text(std::ostream& stream)
+  {
+    Kmer<MAX_K> kmer; kmer.set_k(m_header.kmer_size);
+    typename selectC<MAX_C>::type count = 0;
+    while (read<MAX_K, MAX_C>(kmer, count))
+    {
+      stream << kmer.to_string() << " " << std::to_string(count) << "\n";
+    }
+  }
+
+  // Sparse index of the file: the k-mers of n evenly spaced records.
+  template<size_t MAX_K>
+  bool sample(size_t n, std::vector<Kmer<MAX_K>>& kmers) const
+  {
+    size_t nb_records = (m_end - m_pos) / m_stride;
+    n = std::min(n, nb_records);
+    for (size_t i=0; i<n; i++)
+      kmers.push_back(kmer_at<MAX_K>(m_pos + (i * nb_records / n) * m_stride));
+    return true;
+  }
+
+  uint64_t nb_records() const
+  {
+    return size();
+  }
+
+  // Skips the k-mers lower than kmer.
+  template<size_t MAX_K>
+  void seek_to(const Kmer<MAX_K>& kmer)
+  {
+    m_pos = lower_bound(kmer);
+  }
+
+  // Stops before the first k-mer greater or equal to kmer.
+  template<size_t MAX_K>
+  void limit(const Kmer<MAX_K>& kmer)
+  {
+    m_end = lower_bound(kmer);
+  }
+
+private:
+  template<size_t MAX_K>
+  Kmer<MAX_K> kmer_at(const char* record) const
+  {
+    Kmer<MAX_K> kmer; kmer.set_k(m_header.kmer_size);
+    std::memcpy(kmer.get_data64_unsafe(), record, m_header.kmer_slots * 8);
+    return kmer;
+  }
+
+  template<size_t MAX_K>
+  const char* lower_bound(const Kmer<MAX_K>& kmer) const
+  {
+    size_t lo = 0;
+    size_t hi = (m_end - m_pos) / m_stride;
+    while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (kmer_at<MAX_K>(m_pos + mid * m_stride) < kmer)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return m_pos + lo * m_stride;
+  }
+};
+
+// Same interface as HashReader. Hash files are a sequence of blocks
+// [n][n hashes][n counts], next_block() exposes them in place.
+template<size_t MAX_C>
+class HashMmapReader : public MmapFile<HashFileHeader>
+{
+  using count_type = typename selectC<MAX_C>::type;
+public:
+  HashMmapReader(const std::string& path)
+    : MmapFile<HashFileHeader>(path)
+  {
+    // with an index, blocks are known without walking the file
+    KeyIndex index;
+    if (index.load(path))
+    {
+      m_end = m_data + index.data_end();
+      for (size_t i=0; i<index.size(); i++)
+        m_blocks.push_back(m_data + index.offset(i));
+      m_indexed = true;
+    }
+  }
+
+  bool next_block(const char*& hashes, const char*& counts, size_t& n)
+  {
+    if (static_cast<size_t>(m_end - m_pos) < sizeof(size_t))
+      return false;
+    std::memcpy(&n, m_pos, sizeof(size_t));
+    hashes = m_pos + sizeof(size_t);
+    counts = hashes + n * sizeof(uint64_t);
+    if (counts + n * sizeof(count_type) > m_end)
+      throw IOError(fmt::format("{} is truncated.", m_path));
+    m_pos = counts + n * sizeof(count_type);
+    prefetch_block();
+    return true;
+  }
+
+  bool read(uint64_t& hash, count_type& count)
+  {
+    if (m_in_block == 0)
+    {
+      if (!next_block(m_hashes, m_counts, m_in_block))
+        return false;
+      if (m_in_block == 0)
+        return read(hash, count);
+    }
+
+    std::memcpy(&hash, m_hashes, sizeof(uint64_t));
+    if (m_limited && hash >= m_limit)
+    {
+      m_in_block = 0;
+      m_pos = m_end;
+      return false;
+    }
+    std::memcpy(&count, m_counts, sizeof(count_type));
+    m_hashes += sizeof(uint64_t);
+    m_counts += sizeof(count_type);
+    m_in_block--;
+    return true;
+  }
+
+  // Sparse index of the file: the first hash of each block.
+  bool sample(std::vector<uint64_t>& hashes)
+  {
+    index();
+    for (auto& b : m_blocks)
+      hashes.push_back(first_hash(b));
+    return true;
+  }
+
+  uint64_t nb_records()
+  {
+    index();
+    uint64_t nb_records = 0;
+    for (auto& b : m_blocks)
+    {
+      size_t n;
+      std::memcpy(&n, b, sizeof(size_t));
+      nb_records += n;
+    }
+    return nb_records;
+  }
+
+  // Skips the hashes lower than hash, only before the first read.
+  void seek_to(uint64_t hash)
+  {
+    index();
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), hash,
+                               [this](uint64_t h, const char* b) { return h < first_hash(b); });
+    if (it == m_blocks.begin())
+      return;
+    const char* block = *(--it);
+
+    size_t n;
+    std::memcpy(&n, block, sizeof(size_t));
+    const char* hashes = block + sizeof(size_t);
+    size_t lo = 0, hi = n;
+    while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      uint64_t h;
+      std::memcpy(&h, hashes + mid * sizeof(uint64_t), sizeof(uint64_t));
+      if (h < hash)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    m_hashes = hashes + lo * sizeof(uint64_t);
+    m_counts = hashes + n * sizeof(uint64_t) + lo * sizeof(count_type);
+    m_in_block = n - lo;
+    m_pos = hashes + n * (sizeof(uint64_t) + sizeof(count_type));
+  }
+
+  // Stops before the first hash greater or equal to hash.
+  void limit(uint64_t hash)
+  {
+    m_limit = hash;
+    m_limited = true;
+  }
+
+  void write_as_text(std::ostream& stream)
+  {
+    uint64_t hash = 0;
+    count_type count = 0;
+    while (read(hash, count))
+    {
+      stream << std::to_string(hash) << " " << std::to_string(count) << "\n";
+    }
+  }
+
+private:
+  void prefetch_block()
+  {
+    __builtin_prefetch(m_pos);
+    __builtin_prefetch(m_pos + KM_MMAP_PREFETCH);
+  }
+
+  // Positions of the non-empty blocks, from the current position.
+  void index()
+  {
+    if (m_indexed)
+      return;
+    m_indexed = true;
+    for (const char* b = m_pos; static_cast<size_t>(m_end - b) >= sizeof(size_t);)
+    {
+      size_t n;
+      std::memcpy(&n, b, sizeof(size_t));
+      size_t bytes = n * (sizeof(uint64_t) + sizeof(count_type));
+      if (static_cast<size_t>(m_end - b) - sizeof(size_t) < bytes)
+        break; // truncated, reported by next_block()
+      if (n)
+        m_blocks.push_back(b);
+      b += sizeof(size_t) + bytes;
+    }
+  }
+
+  uint64_t first_hash(const char* block) const
+  {
+    uint64_t h;
+    std::memcpy(&h, block + sizeof(size_t), sizeof(uint64_t));
+    return h;
+  }
+
+private:
+  const char* m_hashes {nullptr};
+  const char* m_counts {nullptr};
+  size_t m_in_block {0};
+  bool m_indexed {false};
+  bool m_limited {false};
+  uint64_t m_limit {0};
+  std::vector<const char*> m_blocks;
+};
+
+// Same interface as MatrixReader.
+class MatrixMmapReader : public MmapFile<MatrixFileHeader>
+{
+public:
+  MatrixMmapReader(const std::string& path, bool kasm = false)
+    : MmapFile<MatrixFileHeader>(path, kasm)
+  {
+    m_stride = m_header.kmer_slots * 8 + m_header.nb_counts * m_header.count_slots;
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    return read<MAX_K, MAX_C>(kmer, counts, counts.size());
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts, std::size_t n)
+  {
+    const char* record = next_record();
+    if (!record)
+      return false;
+    std::memcpy(kmer.get_data64_unsafe(), record, m_header.kmer_slots * 8);
+    std::memcpy(counts.data(), record + m_header.kmer_slots * 8, n * (requiredC<MAX_C>::value / 8));
+    return true;
+  }
+};
+
+// Same interface as PAMatrixReader.
+class PAMatrixMmapReader : public MmapFile<PAMatrixFileHeader>
+{
+public:
+  PAMatrixMmapReader(const std::string& path)
+    : MmapFile<PAMatrixFileHeader>(path)
+  {
+    m_stride = m_header.kmer_slots * 8 + m_header.bytes;
+  }
+
+  template<size_t MAX_K>
+  bool read(Kmer<MAX_K>& kmer, std::vector<uint8_t>& vec)
+  {
+    const char* record = next_record();
+    if (!record)
+      return false;
+    std::memcpy(kmer.get_data64_unsafe(), record, m_header.kmer_slots * 8);
+    std::memcpy(vec.data(), record + m_header.kmer_slots * 8, vec.size());
+    return true;
+  }
+};
+
+// Bloom matrix of a partition (hash:bf, hash:bft), see VectorMatrixWriter.
+// Rows are NBYTES(bits) bytes, one per hash of the window. If transposed
+// (TransposedVectorMatrixWriter), rows are NBYTES(window) bytes, one per sample.
+class VectorMatrixMmapReader : public MmapFile<VectorMatrixFileHeader>
+{
+public:
+  VectorMatrixMmapReader(const std::string& path, bool transposed = false)
+    : MmapFile<VectorMatrixFileHeader>(path)
+  {
+    size_t nb_rows = transposed ? NBYTES(m_header.bits) * 8 : m_header.window;
+    m_stride = transposed ? NBYTES(m_header.window) : NBYTES(m_header.bits);
+    if (size() < nb_rows)
+      throw IOError(fmt::format("{} is truncated.", m_path));
+  }
+
+  bool read(std::vector<uint8_t>& bits)
+  {
+    const char* record = next_record();
+    if (!record)
+      return false;
+    std::memcpy(bits.data(), record, m_stride);
+    return true;
+  }
+};
+
+};
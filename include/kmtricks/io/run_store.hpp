@@ -0,0 +1,316 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <kmtricks/io/hash_file.hpp>
+#include <kmtricks/utils.hpp>
+
+namespace km {
+
+// Counted runs kept in memory between count and merge (streaming pipeline).
+// Runs are indexed by the path of the file they replace, so count and merge tasks
+// keep using KmDir paths. Writers reserve the budget while they buffer a run, a run
+// that does not fit is spilled to its path as a regular hash file.
+class RunStore
+{
+public:
+  struct run
+  {
+    uint32_t id {0};
+    uint32_t partition {0};
+    std::vector<uint64_t> hashes;
+    std::vector<uint8_t> counts;
+
+    uint64_t bytes() const
+    {
+      return hashes.size() * sizeof(uint64_t) + counts.size();
+    }
+  };
+
+public:
+  static RunStore& get()
+  {
+    static RunStore singleton;
+    return singleton;
+  }
+
+  void set_budget(uint64_t bytes)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+  }
+
+  uint64_t budget() const
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_budget;
+  }
+
+  uint64_t used() const
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_used;
+  }
+
+  uint64_t spilled() const
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_spilled;
+  }
+
+  // Reserves up to max bytes of the budget, as much as is left. Returns the reserved bytes,
+  // 0 if less than min bytes are left, in which case the caller spills its run to disk.
+  uint64_t reserve(uint64_t min, uint64_t max)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t left = m_budget > m_used ? m_budget - m_used : 0;
+    if (left < min)
+    {
+      m_spilled++;
+      return 0;
+    }
+    uint64_t bytes = std::min(left, max);
+    m_used += bytes;
+    return bytes;
+  }
+
+  // The memory of the run must be reserved, see reserve().
+  void put(const std::string& path, run&& r)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_runs[path] = std::move(r);
+  }
+
+  // Moves the run out of the store. The memory is accounted until release() is called.
+  bool take(const std::string& path, run& r)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_runs.find(path);
+    if (it == m_runs.end())
+      return false;
+    r = std::move(it->second);
+    m_runs.erase(it);
+    return true;
+  }
+
+  void release(uint64_t bytes)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_used -= std::min(bytes, m_used);
+  }
+
+  bool contains(const std::string& path)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_runs.find(path) != m_runs.end();
+  }
+
+private:
+  RunStore() {}
+
+private:
+  mutable std::mutex m_mutex;
+  std::unordered_map<std::string, run> m_runs;
+  uint64_t m_budget {0};
+  uint64_t m_used {0};
+  uint64_t m_spilled {0};
+};
+
+// Same interface as HashWriter, the run is committed to the RunStore on close. The buffers
+// grow by reserving the budget first, when it is exhausted the records are written at path
+// and the next ones follow them.
+template<size_t MAX_C, size_t buf_size = 32768>
+class HashRunWriter
+{
+  using count_type = typename selectC<MAX_C>::type;
+  using writer_t = HashWriter<MAX_C, buf_size>;
+  static constexpr uint64_t s_record_bytes = sizeof(uint64_t) + sizeof(count_type);
+  static constexpr size_t s_min_records = 4096;
+public:
+  HashRunWriter(const std::string& path,
+                uint32_t count_size,
+                uint32_t id,
+                uint32_t partition,
+                bool compress)
+    : m_path(path), m_count_size(count_size), m_compress(compress)
+  {
+    m_run.id = id;
+    m_run.partition = partition;
+  }
+
+  ~HashRunWriter()
+  {
+    close();
+  }
+
+  void write(uint64_t hash, count_type count)
+  {
+    if (m_file)
+    {
+      m_file->write(hash, count);
+      return;
+    }
+    if (m_run.hashes.size() == m_capacity && !grow())
+    {
+      spill();
+      m_file->write(hash, count);
+      return;
+    }
+    m_run.hashes.push_back(hash);
+    const uint8_t* c = reinterpret_cast<const uint8_t*>(&count);
+    m_run.counts.insert(m_run.counts.end(), c, c + sizeof(count_type));
+  }
+
+  void flush() {}
+
+  // Only used if the run is spilled, see HashWriter::enable_index().
+  void enable_index()
+  {
+    m_indexed = true;
+  }
+
+  void close()
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+
+    if (m_file)
+    {
+      m_file->close();
+      m_file = nullptr;
+      return;
+    }
+
+    // the unused part of the reservation goes back to the budget
+    m_run.hashes.shrink_to_fit();
+    m_run.counts.shrink_to_fit();
+    RunStore::get().release(m_reserved - m_run.bytes());
+    RunStore::get().put(m_path, std::move(m_run));
+  }
+
+private:
+  using run_t = RunStore::run;
+
+  // Doubles the capacity of the buffers, or less if the budget is almost exhausted.
+  bool grow()
+  {
+    size_t records = std::max(m_capacity, s_min_records);
+    uint64_t bytes = RunStore::get().reserve(s_record_bytes, records * s_record_bytes);
+    if (bytes == 0)
+      return false;
+    m_reserved += bytes;
+    m_capacity += bytes / s_record_bytes;
+    m_run.hashes.reserve(m_capacity);
+    m_run.counts.reserve(m_capacity * sizeof(count_type));
+    return true;
+  }
+
+  void spill()
+  {
+    m_file = std::make_unique<writer_t>(m_path, m_count_size, m_run.id, m_run.partition, m_compress);
+    if (m_indexed)
+      m_file->enable_index();
+    const count_type* counts = reinterpret_cast<const count_type*>(m_run.counts.data());
+    for (size_t i=0; i<m_run.hashes.size(); i++)
+      m_file->write(m_run.hashes[i], counts[i]);
+    m_run = run_t{};
+    RunStore::get().release(m_reserved);
+    m_reserved = 0;
+  }
+
+private:
+  std::string m_path;
+  uint32_t m_count_size {0};
+  bool m_compress {false};
+  bool m_indexed {false};
+  bool m_closed {false};
+  run_t m_run;
+  size_t m_capacity {0};
+  uint64_t m_reserved {0};
+  std::unique_ptr<writer_t> m_file {nullptr};
+};
+
+template<size_t MAX_C, size_t buf_size = 32768>
+using hrw_t = std::shared_ptr<HashRunWriter<MAX_C, buf_size>>;
+
+// Same interface as HashReader, reads the run from the RunStore if present, from path otherwise.
+template<size_t MAX_C, size_t buf_size = 32768>
+class HashRunReader
+{
+  using count_type = typename selectC<MAX_C>::type;
+public:
+  HashRunReader(const std::string& path)
+  {
+    if (RunStore::get().take(path, m_run))
+    {
+      m_header.compressed = false;
+      m_header.count_slots = sizeof(count_type);
+      m_header.id = m_run.id;
+      m_header.partition = m_run.partition;
+      m_counts = reinterpret_cast<const count_type*>(m_run.counts.data());
+      m_in_memory = true;
+    }
+    else
+    {
+      m_file = std::make_unique<HashReader<MAX_C, buf_size>>(path);
+    }
+  }
+
+  ~HashRunReader()
+  {
+    if (m_in_memory)
+      RunStore::get().release(m_run.bytes());
+  }
+
+  const HashFileHeader& infos() const
+  {
+    return m_file ? m_file->infos() : m_header;
+  }
+
+  bool read(uint64_t& hash, count_type& count)
+  {
+    if (!m_in_memory)
+      return m_file->read(hash, count);
+
+    if (m_index == m_run.hashes.size())
+      return false;
+
+    hash = m_run.hashes[m_index];
+    count = m_counts[m_index];
+    m_index++;
+    return true;
+  }
+
+private:
+  RunStore::run m_run;
+  HashFileHeader m_header;
+  const count_type* m_counts {nullptr};
+  size_t m_index {0};
+  bool m_in_memory {false};
+  std::unique_ptr<HashReader<MAX_C, buf_size>> m_file {nullptr};
+};
+
+};
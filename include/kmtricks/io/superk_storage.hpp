@@ -183,15 +183,17 @@ public:
     m_files.resize(m_nb_files, nullptr);
     m_synchros.resize(m_nb_files, nullptr);
     openFiles();
+    initBuffers();
+  }
 
-    m_capacity = 32768;
-    m_max_superk_size = 255;
-    m_buffers.resize(m_nb_files);
-    m_buffers_idx.resize(m_nb_files, 0);
-    for (unsigned int ii=0; ii<m_buffers.size(); ii++)
-    {
-      m_buffers[ii] = reinterpret_cast<uint8_t*>(MALLOC(sizeof(uint8_t) * m_capacity));
-    }
+  SuperKStorageWriter(const SuperKStorageWriter&) = delete;
+  SuperKStorageWriter& operator=(const SuperKStorageWriter&) = delete;
+
+  // Per-thread cache of this writer: super-k-mers are buffered in the cache and full
+  // blocks are written to the files of this writer, under its per-file locks.
+  std::unique_ptr<SuperKStorageWriter> make_cache()
+  {
+    return std::unique_ptr<SuperKStorageWriter>(new SuperKStorageWriter(this));
   }
 
   void flushAllCache()
@@ -300,6 +302,11 @@ public:
   {
     if (!m_restricted.count(file_id))
       return;
+    if (m_shared)
+    {
+      m_shared->writeBlock(block, block_size, file_id, nbkmers);
+      return;
+    }
     m_synchros[file_id]->lock();
     m_nbk_per_file[file_id] += nbkmers;
     m_file_size[file_id] += block_size + sizeof(block_size);
@@ -338,6 +345,30 @@ public:
       info << m_file_size[i] << "\n";
     }
   }
+private:
+  explicit SuperKStorageWriter(SuperKStorageWriter* shared)
+    : m_base(shared->m_base), m_path(shared->m_path), m_restricted(shared->m_restricted),
+      m_nb_files(shared->m_nb_files), m_lz4(shared->m_lz4), m_shared(shared)
+  {
+    m_nbk_per_file.resize(m_nb_files, 0);
+    m_file_size.resize(m_nb_files, 0);
+    m_files.resize(m_nb_files, nullptr);
+    m_synchros.resize(m_nb_files, nullptr);
+    initBuffers();
+  }
+
+  void initBuffers()
+  {
+    m_capacity = 32768;
+    m_max_superk_size = 255;
+    m_buffers.resize(m_nb_files);
+    m_buffers_idx.resize(m_nb_files, 0);
+    for (unsigned int ii=0; ii<m_buffers.size(); ii++)
+    {
+      m_buffers[ii] = reinterpret_cast<uint8_t*>(MALLOC(sizeof(uint8_t) * m_capacity));
+    }
+  }
+
 private:
   std::string m_base;
   std::string m_path;
@@ -353,6 +384,8 @@ private:
   size_t m_capacity;
   std::vector<uint8_t*> m_buffers;
   std::vector<int> m_buffers_idx;
+
+  SuperKStorageWriter* m_shared {nullptr};
 };
 
 };
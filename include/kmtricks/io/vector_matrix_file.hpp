@@ -104,6 +104,116 @@ public:
   }
 };
 
+// Writes the transpose of a bit matrix given row by row, without holding the whole matrix.
+// Exactly window rows of NBYTES(bits) bytes are expected.
+// Rows are buffered in tiles of tile_rows rows, each tile is transposed and its columns are
+// written at their offsets in the output rows. With lz4, the output cannot be written out of
+// order, so the transposed matrix is kept in memory until close().
+template<size_t buf_size = 8192>
+class TransposedVectorMatrixWriter : public IFile<VectorMatrixFileHeader, std::ostream, buf_size>
+{
+  using ocstream = lz4_stream::basic_ostream<buf_size>;
+public:
+  TransposedVectorMatrixWriter(const std::string& path,
+                               uint32_t bits,
+                               uint32_t id,
+                               uint32_t partition,
+                               uint64_t first,
+                               uint64_t window,
+                               bool lz4,
+                               size_t tile_bytes = (1 << 23))
+    : IFile<VectorMatrixFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary),
+      m_in_bytes(NBYTES(bits)),
+      m_out_rows(m_in_bytes * 8),
+      m_out_bytes(NBYTES(window))
+  {
+    this->m_header.compressed = lz4;
+    this->m_header.bits = bits;
+    this->m_header.first = first;
+    this->m_header.window = window;
+    this->m_header.id = id;
+    this->m_header.partition = partition;
+
+    this->m_header.serialize(this->m_first_layer.get());
+    m_body = this->m_first_layer->tellp();
+
+    this->template set_second_layer<ocstream>(this->m_header.compressed);
+
+    // multiple of 32 rows to use the widest transpose kernel
+    m_tile_rows = std::max<size_t>(32, (tile_bytes / std::max<size_t>(m_in_bytes, 1)) / 32 * 32);
+    m_tile_rows = std::min<size_t>(m_tile_rows, ((window + 31) / 32) * 32);
+    m_tile.resize(m_tile_rows * m_in_bytes, 0);
+    m_ttile.resize(m_tile_rows * m_in_bytes, 0);
+
+    if (lz4)
+      m_out.resize(m_out_rows * m_out_bytes, 0);
+  }
+
+  ~TransposedVectorMatrixWriter()
+  {
+    close();
+  }
+
+  void write(const std::vector<uint8_t>& bits)
+  {
+    std::copy(bits.begin(), bits.end(), m_tile.begin() + m_filled * m_in_bytes);
+    if (++m_filled == m_tile_rows)
+      flush_tile();
+  }
+
+  void close()
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+    if (m_filled)
+      flush_tile();
+
+    if (this->m_header.compressed)
+      this->m_second_layer->write(reinterpret_cast<char*>(m_out.data()), m_out.size());
+    this->m_second_layer->flush();
+  }
+
+private:
+  void flush_tile()
+  {
+    size_t nrows = ((m_filled + 7) / 8) * 8;
+    std::fill(m_tile.begin() + m_filled * m_in_bytes, m_tile.begin() + nrows * m_in_bytes, 0);
+    bit_transpose(m_tile.data(), m_ttile.data(), nrows, m_out_rows);
+
+    size_t chunk = nrows / 8;
+    size_t offset = m_first_row / 8;
+    for (size_t r=0; r<m_out_rows; r++)
+    {
+      const uint8_t* src = m_ttile.data() + r * chunk;
+      if (this->m_header.compressed)
+      {
+        std::copy(src, src + chunk, m_out.begin() + r * m_out_bytes + offset);
+      }
+      else
+      {
+        this->m_second_layer->seekp(m_body + static_cast<std::streamoff>(r * m_out_bytes + offset));
+        this->m_second_layer->write(reinterpret_cast<const char*>(src), chunk);
+      }
+    }
+    m_first_row += nrows;
+    m_filled = 0;
+  }
+
+private:
+  size_t m_in_bytes {0};
+  size_t m_out_rows {0};
+  size_t m_out_bytes {0};
+  size_t m_tile_rows {0};
+  size_t m_filled {0};
+  size_t m_first_row {0};
+  std::streampos m_body {0};
+  bool m_closed {false};
+  std::vector<uint8_t> m_tile;
+  std::vector<uint8_t> m_ttile;
+  std::vector<uint8_t> m_out;
+};
+
 template<size_t buf_size = 8192>
 class VectorMatrixReader : public IFile<VectorMatrixFileHeader, std::istream, buf_size>
 {
@@ -20,11 +20,17 @@
 #include <functional>
 #include <cstdint>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 namespace km {
 
+class TaskPool;
+
 class ITask
 {
+  friend class TaskPool;
 public:
   ITask (uint32_t level, bool clear = false) : m_priority_level(level), m_clear(clear) {}
 
@@ -92,6 +98,13 @@ protected:
   bool m_running {false};
   bool m_in_queue {false};
   std::function<void()> m_callback {nullptr};
+
+private:
+  // Dependency bookkeeping, managed by TaskPool
+  std::mutex m_deps_mutex;
+  std::vector<std::shared_ptr<ITask>> m_dependents;
+  std::atomic<uint32_t> m_pending {0};
+  bool m_done {false};
 };
 
 using task_t = std::shared_ptr<ITask>;
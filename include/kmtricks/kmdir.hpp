@@ -45,7 +45,8 @@ public:
     return fmt::format("{}/{}", m_superk_storage, sample_id);
   }
 
-  std::vector<std::string> get_files_to_merge(uint32_t part_id, bool compressed, KM_FILE km_file)
+  std::vector<std::string> get_files_to_merge(uint32_t part_id, bool compressed, KM_FILE km_file,
+                                              bool check = true)
   {
     std::string ext;
 
@@ -66,7 +67,7 @@ public:
     for (auto s : fof)
     {
       paths.push_back(fmt::format(m_part_template, m_counts_storage, part_id, std::get<0>(s), ext));
-      if (!fs::exists(paths.front()))
+      if (check && !fs::exists(paths.front()))
         throw FileNotFoundError(fmt::format("{} is missing.", paths.front()));
     }
     return paths;
@@ -128,8 +129,10 @@ public:
 
     if (FORMAT::TEXT == format)
       ext += ".txt";
+    else if (FORMAT::BLK == format)
+      ext += ".blk";
 
-    if (compressed && (mode != MODE::BFT) && format != FORMAT::TEXT)
+    if (compressed && (mode != MODE::BFT) && format == FORMAT::BIN)
       ext += ".lz4";
 
     return fmt::format(m_matrix_template, m_matrix_storage, part_id, ext);
@@ -185,6 +188,16 @@ public:
     return fmt::format("{}/merge_amin.txt", m_root);
   }
 
+  std::string get_repart_sizes_path()
+  {
+    return fmt::format("{}/partition_sizes.txt", m_root);
+  }
+
+  std::string get_plan_path()
+  {
+    return fmt::format("{}/plan.txt", m_root);
+  }
+
   std::vector<std::string> get_minim_paths(uint32_t nb_parts)
   {
     fs::create_directory(m_minimizer_storage);
@@ -0,0 +1,271 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/format.h>
+#include <kmtricks/kmer.hpp>
+#include <kmtricks/rolling_kmer.hpp>
+
+namespace km {
+
+// Counted k-mers compacted into super-k-mers: maximal runs of overlapping k-mers are built
+// greedily from the canonical k-mers, then cut where the minimizer changes, or where its
+// occurrence leaves the window. Each super-k-mer is oriented so that its minimizer appears
+// as is, at minim_pos, as required by KFF minimizer sections.
+// The k-mers are kept until compact(), sorted and looked up by binary search, i.e. the
+// compactor holds bytes_per_kmer bytes per k-mer. They are stored in the heap, or in a
+// buffer given by the caller, see use_buffer().
+template<size_t MAX_K, typename count_type>
+class KmerCompactor
+{
+public:
+  struct entry
+  {
+    Kmer<MAX_K> kmer;
+    count_type count;
+
+    bool operator<(const entry& e) const { return kmer < e.kmer; }
+  };
+
+  static constexpr size_t bytes_per_kmer = sizeof(entry);
+
+  struct superk
+  {
+    std::string seq;
+    uint32_t minimizer {0};
+    size_t minim_pos {0};
+    bool has_minimizer {false};  // false if no m-mer of the k-mers is a valid minimizer
+    std::vector<count_type> counts;
+  };
+
+  KmerCompactor(size_t kmer_size, size_t minim_size, size_t max_kmers = 255)
+    : m_kmer_size(kmer_size), m_minim_size(minim_size), m_max_kmers(max_kmers)
+  {
+    m_mask.set_k(kmer_size);
+    for (uint64_t c = 0; c < 4; c++)
+    {
+      m_low[c].set_k(kmer_size);
+      m_low[c].set64(c);
+    }
+    // built by steps of one nucleotide, see RollingKmer
+    m_high = m_low;
+    for (size_t i = 1; i < kmer_size; i++)
+      for (auto& h : m_high)
+        h = h << 2;
+    for (size_t i = 0; i < kmer_size; i++)
+      m_mask = (m_mask << 2) | m_low[3];
+  }
+
+  // Stores the k-mers in buffer, which holds up to capacity k-mers (capacity * bytes_per_kmer
+  // bytes), instead of the heap. Must be called before add().
+  void use_buffer(void* buffer, size_t capacity)
+  {
+    m_buffer = static_cast<entry*>(buffer);
+    m_capacity = capacity;
+  }
+
+  // kmer must be canonical.
+  void add(const Kmer<MAX_K>& kmer, count_type count)
+  {
+    if (!m_buffer)
+    {
+      m_entries.push_back(entry{kmer, count});
+      m_size++;
+      return;
+    }
+    if (m_size == m_capacity)
+      throw std::length_error(fmt::format("KmerCompactor: more than {} k-mers.", m_capacity));
+    new (m_buffer + m_size++) entry{kmer, count};
+  }
+
+  size_t size() const { return m_size; }
+
+  // Calls f(const superk&) for each super-k-mer, grouped by minimizer, the ones without
+  // minimizer last. The k-mers are released.
+  template<typename F>
+  void compact(F&& f)
+  {
+    m_data = m_buffer ? m_buffer : m_entries.data();
+    std::sort(m_data, m_data + m_size);
+
+    std::vector<superk> superks;
+    std::vector<bool> used(m_size, false);
+    for (size_t i=0; i<m_size; i++)
+    {
+      if (used[i])
+        continue;
+      used[i] = true;
+      std::string seq; std::vector<count_type> counts;
+      extend(i, used, seq, counts);
+      split(seq, counts, superks);
+    }
+
+    std::stable_sort(superks.begin(), superks.end(), [](const superk& a, const superk& b) {
+      if (a.has_minimizer != b.has_minimizer)
+        return a.has_minimizer;
+      return a.minimizer < b.minimizer;
+    });
+    for (auto& s : superks)
+      f(s);
+
+    m_entries.clear(); m_entries.shrink_to_fit();
+    m_size = 0;
+  }
+
+private:
+  Kmer<MAX_K> canonical(const Kmer<MAX_K>& kmer) const
+  {
+    Kmer<MAX_K> rev = kmer.rev_comp();
+    return rev < kmer ? rev : kmer;
+  }
+
+  // Unused k-mer adjacent to kmer, 1: on the right, 0: on the left.
+  bool next(Kmer<MAX_K>& kmer, bool right, std::vector<bool>& used, uint8_t& nt, size_t& idx) const
+  {
+    for (uint8_t c=0; c<4; c++)
+    {
+      Kmer<MAX_K> candidate = right ? ((kmer << 2) & m_mask) | m_low[c] : (kmer >> 2) | m_high[c];
+      entry key {canonical(candidate), 0};
+      entry* it = std::lower_bound(m_data, m_data + m_size, key);
+      size_t i = it - m_data;
+      if (i < m_size && it->kmer == key.kmer && !used[i])
+      {
+        used[i] = true;
+        kmer = candidate;
+        nt = c;
+        idx = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void extend(size_t seed, std::vector<bool>& used, std::string& seq, std::vector<count_type>& counts) const
+  {
+    std::string left; std::vector<count_type> left_counts;
+    uint8_t nt; size_t idx;
+
+    Kmer<MAX_K> kmer = m_data[seed].kmer;
+    while (next(kmer, false, used, nt, idx))
+    {
+      left.push_back(bToN[nt]);
+      left_counts.push_back(m_data[idx].count);
+    }
+
+    seq.assign(left.rbegin(), left.rend());
+    counts.assign(left_counts.rbegin(), left_counts.rend());
+    seq += m_data[seed].kmer.to_string();
+    counts.push_back(m_data[seed].count);
+
+    kmer = m_data[seed].kmer;
+    while (next(kmer, true, used, nt, idx))
+    {
+      seq.push_back(bToN[nt]);
+      counts.push_back(m_data[idx].count);
+    }
+  }
+
+  void split(const std::string& seq, const std::vector<count_type>& counts, std::vector<superk>& superks) const
+  {
+    size_t nb_kmers = counts.size();
+    size_t nb_mmers = seq.size() - m_minim_size + 1;
+
+    // minimizer of each k-mer, and canonical value of each valid m-mer (invalid ones can't match)
+    std::vector<uint32_t> minims; minims.reserve(nb_kmers);
+    RollingKmer<MAX_K> roll(m_kmer_size, m_minim_size);
+    for (char c : seq)
+      if (roll.push(c))
+        minims.push_back(roll.minimizer());
+
+    uint64_t mmask = (uint64_t{1} << (2 * m_minim_size)) - 1;
+    std::vector<uint32_t> fwd(nb_mmers), cano(nb_mmers);
+    std::vector<bool> valid(nb_mmers);
+    uint64_t f = 0, r = 0;
+    for (size_t i=0; i<seq.size(); i++)
+    {
+      uint8_t b = NToB[static_cast<uint8_t>(seq[i])];
+      f = ((f << 2) | b) & mmask;
+      r = (r >> 2) | (static_cast<uint64_t>(revB[b]) << (2 * (m_minim_size - 1)));
+      if (i + 1 < m_minim_size)
+        continue;
+      size_t p = i + 1 - m_minim_size;
+      fwd[p] = f;
+      cano[p] = std::min(f, r);
+      valid[p] = is_valid_minimizer(cano[p], m_minim_size);
+    }
+
+    size_t span = m_kmer_size - m_minim_size;
+    for (size_t i=0; i<nb_kmers;)
+    {
+      uint32_t v = minims[i];
+      size_t pos = nb_mmers;
+      for (size_t p=i+span+1; p-- > i;)
+      {
+        if (valid[p] && cano[p] == v)
+        {
+          pos = p;
+          break;
+        }
+      }
+
+      size_t j = i + 1;
+      while (j < nb_kmers && j - i < m_max_kmers && minims[j] == v && (pos == nb_mmers || pos >= j))
+        j++;
+
+      superk s;
+      s.seq = seq.substr(i, j - i + m_kmer_size - 1);
+      s.counts.assign(counts.begin() + i, counts.begin() + j);
+      s.minimizer = v;
+      s.has_minimizer = pos != nb_mmers;
+      if (s.has_minimizer)
+      {
+        s.minim_pos = pos - i;
+        if (fwd[pos] != v)
+        {
+          s.seq = str_rev_comp(s.seq);
+          std::reverse(s.counts.begin(), s.counts.end());
+          s.minim_pos = s.seq.size() - m_minim_size - s.minim_pos;
+        }
+      }
+      superks.push_back(std::move(s));
+      i = j;
+    }
+  }
+
+private:
+  size_t m_kmer_size;
+  size_t m_minim_size;
+  size_t m_max_kmers;
+
+  Kmer<MAX_K> m_mask;
+  std::array<Kmer<MAX_K>, 4> m_low;
+  std::array<Kmer<MAX_K>, 4> m_high;
+
+  std::vector<entry> m_entries;
+  entry* m_buffer {nullptr};
+  size_t m_capacity {0};
+  entry* m_data {nullptr};
+  size_t m_size {0};
+};
+
+};
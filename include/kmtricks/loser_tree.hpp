@@ -0,0 +1,112 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+namespace km {
+
+// Tournament tree of losers over n sources, used for k-way merges.
+// Compare(a, b) must return true if the head of source a is strictly lower than
+// the head of source b, exhausted sources being greater than everything else.
+// After a source advances, replay(source) restores the winner in O(log n).
+template<typename Compare>
+class LoserTree
+{
+public:
+  LoserTree() {}
+
+  LoserTree(size_t size, Compare cmp)
+  {
+    init(size, cmp);
+  }
+
+  void init(size_t size, Compare cmp)
+  {
+    m_size = size;
+    m_cmp = cmp;
+    m_cap = 1;
+    while (m_cap < m_size)
+      m_cap <<= 1;
+    m_nodes.assign(m_cap, 0);
+    m_nodes[0] = build(1);
+  }
+
+  size_t top() const
+  {
+    return m_nodes[0];
+  }
+
+  bool valid(size_t source) const
+  {
+    return source < m_size;
+  }
+
+  void replay(size_t source)
+  {
+    size_t winner = source;
+    for (size_t node = (source + m_cap) >> 1; node > 0; node >>= 1)
+    {
+      if (less(m_nodes[node], winner))
+        std::swap(m_nodes[node], winner);
+    }
+    m_nodes[0] = winner;
+  }
+
+  size_t size() const
+  {
+    return m_size;
+  }
+
+private:
+  bool less(size_t a, size_t b) const
+  {
+    if (a >= m_size)
+      return false;
+    if (b >= m_size)
+      return true;
+    return m_cmp(a, b);
+  }
+
+  size_t build(size_t node)
+  {
+    if (node >= m_cap)
+      return node - m_cap;
+
+    size_t left = build(node << 1);
+    size_t right = build((node << 1) + 1);
+
+    if (less(right, left))
+    {
+      m_nodes[node] = left;
+      return right;
+    }
+    m_nodes[node] = right;
+    return left;
+  }
+
+private:
+  size_t m_size {0};
+  size_t m_cap {1};
+  std::vector<size_t> m_nodes;
+  Compare m_cmp;
+};
+
+};
@@ -0,0 +1,322 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+
+#ifndef WITH_XXHASH
+#define WITH_XXHASH
+#endif
+
+#include <kmtricks/hash.hpp>
+#include <kmtricks/repartition.hpp>
+#include <kmtricks/rolling_kmer.hpp>
+#include <kmtricks/kmer_hash.hpp>
+#include <kmtricks/io/mmap_file.hpp>
+#include <kmtricks/io/block_matrix_file.hpp>
+#include <kmtricks/exceptions.hpp>
+#include <kmtricks/utils.hpp>
+
+namespace km {
+
+// Hash values of the k-mers of a sequence, routed as in the pipeline: the minimizer gives
+// the partition, then the k-mer is hashed in the window of this partition. Minimizers are
+// lexicographic, i.e. the run must use --minimizer-type 0.
+template<size_t MAX_K>
+void matrix_query_hashes(const std::string& seq,
+                         size_t kmer_size,
+                         const HashWindow& hw,
+                         const Repartition& repart,
+                         std::vector<uint64_t>& hashes)
+{
+  hashes.clear();
+  if (seq.size() < kmer_size)
+    return;
+  hashes.reserve(seq.size() - kmer_size + 1);
+
+  RollingKmer<MAX_K> roll(kmer_size, hw.minim_size());
+  uint64_t w = hw.get_window_size_bits();
+  for (char c : seq)
+  {
+    if (!roll.push(c))
+      continue;
+    uint32_t part = repart.get_partition(roll.minimizer());
+    hashes.push_back(typename KmerHashers<1>::template WinHasher<MAX_K>(part, w)(roll.canonical()));
+  }
+}
+
+// Per-sample counters stored bit-sliced: plane j holds the bit j of all the counters.
+// Adding a row of presence bits is a ripple carry over whole words, which the compiler
+// vectorizes, and touches two planes per row on average.
+class SlicedCounters
+{
+public:
+  SlicedCounters(size_t nb_samples)
+    : m_nb_samples(nb_samples), m_words((nb_samples + 63) / 64), m_carry(m_words, 0) {}
+
+  void clear()
+  {
+    m_planes.clear();
+    m_nb_planes = 0;
+  }
+
+  // row holds NBYTES(nb_samples) bytes, sample i is bit i.
+  void add(const uint8_t* row)
+  {
+    std::memcpy(m_carry.data(), row, NBYTES(m_nb_samples));
+    uint64_t* carry = m_carry.data();
+
+    for (size_t j=0; ; j++)
+    {
+      if (j == m_nb_planes)
+      {
+        m_planes.resize((++m_nb_planes) * m_words, 0);
+      }
+      uint64_t* plane = m_planes.data() + j * m_words;
+      uint64_t any = 0;
+      for (size_t w=0; w<m_words; w++)
+      {
+        uint64_t t = plane[w] & carry[w];
+        plane[w] ^= carry[w];
+        carry[w] = t;
+        any |= t;
+      }
+      if (!any)
+        break;
+    }
+  }
+
+  void counts(std::vector<uint32_t>& out) const
+  {
+    out.assign(m_nb_samples, 0);
+    for (size_t j=0; j<m_nb_planes; j++)
+    {
+      const uint64_t* plane = m_planes.data() + j * m_words;
+      for (size_t w=0; w<m_words; w++)
+      {
+        for (uint64_t bits = plane[w]; bits; bits &= bits - 1)
+          out[w * 64 + __builtin_ctzll(bits)] |= (1U << j);
+      }
+    }
+  }
+
+  size_t nb_samples() const
+  {
+    return m_nb_samples;
+  }
+
+private:
+  size_t m_nb_samples {0};
+  size_t m_words {0};
+  size_t m_nb_planes {0};
+  std::vector<uint64_t> m_planes;
+  std::vector<uint64_t> m_carry;
+};
+
+// Partitioned Bloom matrix of a hash:bf (or hash:bft if transposed) run, one file per
+// partition. Uncompressed files are mapped, lz4 files are loaded in memory, and hash:bf:blk
+// files are decompressed by blocks on demand, keeping cache_blocks blocks per partition.
+// row(hash) gives the presence bits of the samples for a hash value of the whole filter.
+class BloomMatrix
+{
+  struct part
+  {
+    std::unique_ptr<VectorMatrixMmapReader> map {nullptr};
+    std::unique_ptr<BlockMatrixReader<>> blk {nullptr};
+    std::unique_ptr<std::mutex> blk_mutex {nullptr};
+    std::vector<uint8_t> data;
+    const uint8_t* rows {nullptr};
+    uint64_t first {0};
+    uint64_t window {0};
+    size_t stride {0};
+  };
+
+public:
+  BloomMatrix(const std::vector<std::string>& paths, uint64_t window_bits, bool transposed,
+              size_t cache_blocks = 64)
+    : m_window_bits(window_bits), m_transposed(transposed)
+  {
+    for (auto& path : paths)
+    {
+      part p;
+      uint32_t partition = 0;
+      uint32_t bits = 0;
+      if (get_km_file_type(path) == KM_FILE::BLOCKMATRIX)
+      {
+        if (transposed)
+          throw IOError(fmt::format("{} is a block matrix, which cannot be transposed.", path));
+        p.blk = std::make_unique<BlockMatrixReader<>>(path, cache_blocks);
+        p.blk_mutex = std::make_unique<std::mutex>();
+        p.first = p.blk->infos().first;
+        p.window = p.blk->infos().window;
+        partition = p.blk->infos().partition;
+        bits = p.blk->infos().bits;
+      }
+      else if (is_mappable<VectorMatrixFileHeader>(path))
+      {
+        p.map = std::make_unique<VectorMatrixMmapReader>(path, transposed);
+        p.map->advise(MADV_RANDOM);
+        p.rows = reinterpret_cast<const uint8_t*>(p.map->begin());
+        p.stride = p.map->stride();
+        p.first = p.map->infos().first;
+        p.window = p.map->infos().window;
+        partition = p.map->infos().partition;
+        bits = p.map->infos().bits;
+      }
+      else
+      {
+        VectorMatrixReader<> reader(path);
+        const auto& h = reader.infos();
+        p.stride = transposed ? NBYTES(h.window) : NBYTES(h.bits);
+        size_t nb_rows = transposed ? NBYTES(h.bits) * 8 : h.window;
+        p.data.resize(nb_rows * p.stride);
+        if (!p.data.empty() && !reader.read(reinterpret_cast<char*>(p.data.data()), p.data.size()))
+          throw IOError(fmt::format("{} is truncated.", path));
+        p.rows = p.data.data();
+        p.first = h.first;
+        p.window = h.window;
+        partition = h.partition;
+        bits = h.bits;
+      }
+
+      if (m_parts.empty())
+        m_nb_samples = bits;
+      else if (bits != m_nb_samples)
+        throw IOError(fmt::format("{} has {} samples, expected {}.", path, bits, m_nb_samples));
+
+      if (partition >= m_parts.size())
+        m_parts.resize(partition + 1);
+      m_parts[partition] = std::move(p);
+    }
+    m_row_bytes = NBYTES(m_nb_samples);
+  }
+
+  size_t nb_samples() const
+  {
+    return m_nb_samples;
+  }
+
+  size_t row_bytes() const
+  {
+    return m_row_bytes;
+  }
+
+  // Presence bits of the samples for hash, nullptr if the hash is outside the matrix.
+  // buffer (row_bytes() bytes) is only used for transposed and block matrices.
+  const uint8_t* row(uint64_t hash, std::vector<uint8_t>& buffer) const
+  {
+    const part* p = find(hash);
+    if (!p)
+      return nullptr;
+    uint64_t col = hash - p->first;
+    if (p->blk)
+    {
+      std::unique_lock<std::mutex> lock(*p->blk_mutex);
+      const uint8_t* r = p->blk->row(col);
+      std::copy(r, r + m_row_bytes, buffer.begin());
+      return buffer.data();
+    }
+    if (!m_transposed)
+      return p->rows + col * p->stride;
+
+    std::fill(buffer.begin(), buffer.end(), 0);
+    const uint8_t* bits = p->rows + BITSLOT(col);
+    for (size_t s=0; s<m_nb_samples; s++, bits += p->stride)
+    {
+      if (*bits & BITMASK(col))
+        BITSET(buffer, s);
+    }
+    return buffer.data();
+  }
+
+  void prefetch(uint64_t hash) const
+  {
+    const part* p = find(hash);
+    if (p && p->rows && !m_transposed)
+      __builtin_prefetch(p->rows + (hash - p->first) * p->stride);
+  }
+
+private:
+  const part* find(uint64_t hash) const
+  {
+    uint64_t partition = hash / m_window_bits;
+    if (partition >= m_parts.size() || (!m_parts[partition].rows && !m_parts[partition].blk))
+      return nullptr;
+    const part* p = &m_parts[partition];
+    if (hash < p->first || hash - p->first >= p->window)
+      return nullptr;
+    return p;
+  }
+
+private:
+  uint64_t m_window_bits {0};
+  bool m_transposed {false};
+  size_t m_nb_samples {0};
+  size_t m_row_bytes {0};
+  std::vector<part> m_parts;
+};
+
+// Queries a BloomMatrix without index (COBS/BIGSI style): the rows of the query's k-mers
+// are accumulated in SlicedCounters, giving the number of k-mers found in each sample.
+// Not thread-safe, use one instance per thread.
+template<size_t MAX_K>
+class MatrixQuery
+{
+public:
+  MatrixQuery(const BloomMatrix& matrix,
+              const HashWindow& hw,
+              const Repartition& repart,
+              size_t kmer_size)
+    : m_matrix(matrix), m_hw(hw), m_repart(repart), m_kmer_size(kmer_size),
+      m_counters(matrix.nb_samples()), m_buffer(matrix.row_bytes(), 0) {}
+
+  // Returns the number of k-mers of seq, hits[i] is the number of them found in sample i.
+  uint64_t query(const std::string& seq, std::vector<uint32_t>& hits)
+  {
+    matrix_query_hashes<MAX_K>(seq, m_kmer_size, m_hw, m_repart, m_hashes);
+    m_counters.clear();
+
+    const size_t ahead = 8;
+    for (size_t i=0; i<m_hashes.size(); i++)
+    {
+      if (i + ahead < m_hashes.size())
+        m_matrix.prefetch(m_hashes[i + ahead]);
+      const uint8_t* row = m_matrix.row(m_hashes[i], m_buffer);
+      if (row)
+        m_counters.add(row);
+    }
+    m_counters.counts(hits);
+    return m_hashes.size();
+  }
+
+private:
+  const BloomMatrix& m_matrix;
+  const HashWindow& m_hw;
+  const Repartition& m_repart;
+  size_t m_kmer_size {0};
+  SlicedCounters m_counters;
+  std::vector<uint8_t> m_buffer;
+  std::vector<uint64_t> m_hashes;
+};
+
+};
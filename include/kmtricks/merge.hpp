@@ -18,14 +18,23 @@
 
 #pragma once
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <type_traits>
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/utils.hpp>
 #include <kmtricks/io/matrix_file.hpp>
 #include <kmtricks/io/pa_matrix_file.hpp>
 #include <kmtricks/io/kmer_file.hpp>
 #include <kmtricks/io/hash_file.hpp>
+#include <kmtricks/io/mmap_file.hpp>
 #include <kmtricks/io/vector_matrix_file.hpp>
+#include <kmtricks/io/block_matrix_file.hpp>
 #include <kmtricks/packc.hpp>
+#include <kmtricks/loser_tree.hpp>
 
 #ifdef WITH_PLUGIN
 #include <kmtricks/plugin_manager.hpp>
@@ -34,6 +43,14 @@
 
 namespace km {
 
+// LINEAR scans all the inputs for each row, O(n) comparisons per row.
+// TREE uses a loser tree, O(log n) comparisons per input that contains the row.
+enum class MergeEngine
+{
+  LINEAR,
+  TREE
+};
+
 template<size_t MAX_K, size_t MAX_C>
 class IMergeObserver
 {
@@ -69,6 +86,20 @@ public:
   void inc_two(uint32_t i, count_type c) { m_total_wo_rescue[i] += c; m_total_w_rescue[i] += c; }
   void inc_tw(uint32_t i, count_type c) { m_total_w_rescue[i] += c; }
 
+  // Adds the statistics of another merger on the same files, e.g. on another key range.
+  void add(const MergeStatistics& other)
+  {
+    for (size_t i=0; i<m_nb_files; i++)
+    {
+      m_non_solid[i] += other.m_non_solid[i];
+      m_rescued[i] += other.m_rescued[i];
+      m_uniq_wo_rescue[i] += other.m_uniq_wo_rescue[i];
+      m_uniq_w_rescue[i] += other.m_uniq_w_rescue[i];
+      m_total_wo_rescue[i] += other.m_total_wo_rescue[i];
+      m_total_w_rescue[i] += other.m_total_w_rescue[i];
+    }
+  }
+
   void serialize(const std::string& path)
   {
     std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
@@ -99,7 +130,99 @@ private:
   std::vector<uint64_t> m_total_w_rescue;
 };
 
-template<size_t MAX_K, size_t MAX_C>
+// Intra-partition parallel merge: the key space of a partition is split into ranges holding
+// about the same number of records, according to a sparse sample of the inputs. Each range is
+// merged independently, then the outputs are concatenated in key order, which gives the same
+// output as a single merger.
+
+// Half-open k-mer range [lower, upper), an unset bound is unbounded.
+template<size_t MAX_K>
+struct KmerRange
+{
+  Kmer<MAX_K> lower;
+  Kmer<MAX_K> upper;
+  bool has_lower {false};
+  bool has_upper {false};
+};
+
+// At most nb_ranges - 1 distinct split keys, in increasing order, taken at the quantiles of samples.
+template<typename Key>
+std::vector<Key> split_points(std::vector<Key>& samples, size_t nb_ranges)
+{
+  std::vector<Key> points;
+  if (samples.empty())
+    return points;
+  std::sort(samples.begin(), samples.end());
+  for (size_t i=1; i<nb_ranges; i++)
+  {
+    const Key& key = samples[i * samples.size() / nb_ranges];
+    if (points.empty() || points.back() < key)
+      points.push_back(key);
+  }
+  return points;
+}
+
+// Runs f(i) for each range i on nb_threads threads, the calling thread included.
+// The first exception thrown by f is rethrown once all threads are done.
+template<typename F>
+void merge_ranges(size_t nb_ranges, size_t nb_threads, F&& f)
+{
+  std::atomic<size_t> next {0};
+  std::exception_ptr error {nullptr};
+  std::mutex error_mutex;
+  auto worker = [&]() {
+    for (size_t i = next++; i < nb_ranges; i = next++)
+    {
+      try
+      {
+        f(i);
+      }
+      catch (...)
+      {
+        std::unique_lock<std::mutex> lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i=1; i<std::min(nb_threads, nb_ranges); i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// Concatenates the outputs of range merges into path. The first output is kept as is, the
+// records of the next ones are appended, without their header_t header (void for text outputs).
+template<typename header_t>
+void concat_range_outputs(const std::string& path, const std::vector<std::string>& range_paths)
+{
+  fs::rename(range_paths[0], path);
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::app);
+  check_fstream_good(path, out);
+  for (size_t i=1; i<range_paths.size(); i++)
+  {
+    {
+      std::ifstream in(range_paths[i], std::ios::in | std::ios::binary);
+      check_fstream_good(range_paths[i], in);
+      if constexpr (!std::is_void_v<header_t>)
+      {
+        header_t header;
+        header.deserialize(&in);
+      }
+      if (in.peek() != std::ifstream::traits_type::eof())
+        out << in.rdbuf();
+    }
+    fs::remove(range_paths[i]);
+  }
+}
+
+template<size_t MAX_K, size_t MAX_C, typename Reader = KmerReader<8192>>
 class KmerMerger
 {
   using count_type = typename selectC<MAX_C>::type;
@@ -111,19 +234,56 @@ public:
     bool is_set {false};
   };
 
+  struct element_less
+  {
+    const element* elements {nullptr};
+
+    bool operator()(size_t a, size_t b) const
+    {
+      if (!elements[a].is_set)
+        return false;
+      if (!elements[b].is_set)
+        return true;
+      return elements[a].value < elements[b].value;
+    }
+  };
+
 public:
   KmerMerger(std::vector<std::string>& paths,
          std::vector<uint32_t>& abundance_min_vec,
          uint32_t kmer_size,
          uint32_t recurrence_min,
-         uint32_t save_if)
+         uint32_t save_if,
+         MergeEngine engine = MergeEngine::TREE)
     : m_paths(paths), m_a_min_vec(abundance_min_vec), m_kmer_size(kmer_size),
-      m_r_min(recurrence_min), m_save_if(save_if)
+      m_r_min(recurrence_min), m_save_if(save_if), m_engine(engine)
   {
     init_stream();
     init_state();
   }
 
+  // Merges only the k-mers of range, Reader must support seek_to() and limit().
+  KmerMerger(std::vector<std::string>& paths,
+         std::vector<uint32_t>& abundance_min_vec,
+         uint32_t kmer_size,
+         uint32_t recurrence_min,
+         uint32_t save_if,
+         const KmerRange<MAX_K>& range,
+         MergeEngine engine = MergeEngine::TREE)
+    : m_paths(paths), m_a_min_vec(abundance_min_vec), m_kmer_size(kmer_size),
+      m_r_min(recurrence_min), m_save_if(save_if), m_engine(engine)
+  {
+    init_stream();
+    for (auto& stream : m_input_streams)
+    {
+      if (range.has_lower)
+        stream->seek_to(range.lower);
+      if (range.has_upper)
+        stream->limit(range.upper);
+    }
+    init_state();
+  }
+
   const Kmer<MAX_K>& current() const
   {
     return m_current;
@@ -142,7 +302,7 @@ public:
   void init_stream()
   {
     for (auto& path: m_paths)
-      m_input_streams.push_back(std::make_shared<KmerReader<8192>>(path));
+      m_input_streams.push_back(std::make_shared<Reader>(path));
     m_size = m_paths.size();
     m_kmer_size = m_input_streams[0]->infos().kmer_size;
   }
@@ -165,6 +325,9 @@ public:
     }
     m_counts.resize(m_size, 0);
     m_infos = std::make_unique<MergeStatistics<MAX_C>>(m_size);
+
+    if (m_engine == MergeEngine::TREE)
+      m_tree.init(m_size, element_less{m_elements.data()});
   }
 
 
@@ -182,81 +345,9 @@ public:
 
   bool next()
   {
-    m_keep = false;
-    m_finish = true;
-    m_next_set = false;
-
-    uint32_t recurrence = 0;
-    uint32_t solid_in = 0;
-    m_current = m_next;
-    m_need_check.clear();
-    for (size_t i=0; i<m_size; i++)
-    {
-      if (m_elements[i].is_set && m_elements[i].value == m_current)
-      {
-        m_finish = false;
-        m_counts[i] = m_elements[i].count;
-        if (m_counts[i] >= m_a_min_vec[i])
-        {
-          recurrence++;
-          solid_in++;
-
-          if (m_infos)
-          {
-            m_infos->inc_two(i, m_counts[i]);
-            m_infos->inc_uwo(i);
-          }
-        }
-        else
-        {
-          if (m_infos)
-            m_infos->inc_ns(i);
-          if (m_save_if)
-            m_need_check.push_back(i);
-          else
-            m_counts[i] = 0;
-        }
-        if (!read_next(i))
-          m_elements[i].is_set = false;
-      }
-      else
-      {
-        m_counts[i] = 0;
-      }
-
-      if (m_elements[i].is_set && (!m_next_set || m_elements[i].value < m_next))
-      {
-        m_next = m_elements[i].value;
-        m_next_set = true;
-      }
-    }
-
-    for (auto& f : m_need_check)
-    {
-      if (!(solid_in >= m_save_if))
-        m_counts[f] = 0;
-      else
-      {
-        if (m_infos)
-        {
-          m_infos->inc_rd(f);
-          m_infos->inc_uw(f);
-          m_infos->inc_tw(f, m_counts[f]);
-        }
-      }
-    }
-
-    if (recurrence >= m_r_min)
-      m_keep = true;
-
-#ifdef WITH_PLUGIN
-    if (m_plugin)
-    {
-      m_keep = m_plugin->process_kmer(m_current.get_data64(), m_counts);
-    }
-#endif
-
-    return !m_finish;
+    if (m_engine == MergeEngine::TREE)
+      return next_tree();
+    return next_linear();
   }
 
   void write_as_bin(const std::string& path, bool compressed)
@@ -323,6 +414,121 @@ public:
   }
 
 private:
+  bool next_linear()
+  {
+    m_keep = false;
+    m_finish = true;
+    m_next_set = false;
+
+    uint32_t solid_in = 0;
+    m_current = m_next;
+    m_need_check.clear();
+    for (size_t i=0; i<m_size; i++)
+    {
+      if (m_elements[i].is_set && m_elements[i].value == m_current)
+      {
+        m_finish = false;
+        solid_in += visit(i);
+        if (!read_next(i))
+          m_elements[i].is_set = false;
+      }
+      else
+      {
+        m_counts[i] = 0;
+      }
+
+      if (m_elements[i].is_set && (!m_next_set || m_elements[i].value < m_next))
+      {
+        m_next = m_elements[i].value;
+        m_next_set = true;
+      }
+    }
+
+    end_row(solid_in);
+    return !m_finish;
+  }
+
+  bool next_tree()
+  {
+    m_keep = false;
+    m_need_check.clear();
+
+    // Only the inputs that contained the previous row have a non-zero count
+    for (auto& i : m_touched)
+      m_counts[i] = 0;
+    m_touched.clear();
+
+    size_t top = m_tree.top();
+    m_finish = !(m_tree.valid(top) && m_elements[top].is_set);
+    if (m_finish)
+      return false;
+
+    uint32_t solid_in = 0;
+    m_current = m_elements[top].value;
+    do
+    {
+      m_touched.push_back(top);
+      solid_in += visit(top);
+      if (!read_next(top))
+        m_elements[top].is_set = false;
+      m_tree.replay(top);
+      top = m_tree.top();
+    } while (m_tree.valid(top) && m_elements[top].is_set && m_elements[top].value == m_current);
+
+    end_row(solid_in);
+    return true;
+  }
+
+  bool visit(size_t i)
+  {
+    m_counts[i] = m_elements[i].count;
+    if (m_counts[i] >= m_a_min_vec[i])
+    {
+      if (m_infos)
+      {
+        m_infos->inc_two(i, m_counts[i]);
+        m_infos->inc_uwo(i);
+      }
+      return true;
+    }
+
+    if (m_infos)
+      m_infos->inc_ns(i);
+    if (m_save_if)
+      m_need_check.push_back(i);
+    else
+      m_counts[i] = 0;
+    return false;
+  }
+
+  void end_row(uint32_t solid_in)
+  {
+    for (auto& f : m_need_check)
+    {
+      if (!(solid_in >= m_save_if))
+        m_counts[f] = 0;
+      else
+      {
+        if (m_infos)
+        {
+          m_infos->inc_rd(f);
+          m_infos->inc_uw(f);
+          m_infos->inc_tw(f, m_counts[f]);
+        }
+      }
+    }
+
+    if (solid_in >= m_r_min)
+      m_keep = true;
+
+#ifdef WITH_PLUGIN
+    if (m_plugin)
+    {
+      m_keep = m_plugin->process_kmer(m_current.get_data64(), m_counts);
+    }
+#endif
+  }
+
   bool read_next(size_t i)
   {
     return m_input_streams[i]->template read<MAX_K, MAX_C>(m_elements[i].value,
@@ -336,9 +542,13 @@ private:
   uint32_t m_save_if;
   uint32_t m_partition;
 
-  std::vector<kr_t<8192>> m_input_streams;
+  std::vector<std::shared_ptr<Reader>> m_input_streams;
   std::vector<element> m_elements;
   std::vector<size_t> m_need_check;
+  std::vector<size_t> m_touched;
+
+  MergeEngine m_engine {MergeEngine::TREE};
+  LoserTree<element_less> m_tree;
 
   uint32_t m_size;
   uint32_t m_kmer_size;
@@ -372,18 +582,53 @@ public:
     bool is_set {false};
   };
 
+  struct element_less
+  {
+    const element* elements {nullptr};
+
+    bool operator()(size_t a, size_t b) const
+    {
+      if (!elements[a].is_set)
+        return false;
+      if (!elements[b].is_set)
+        return true;
+      return elements[a].value < elements[b].value;
+    }
+  };
+
 public:
   HashMerger(std::vector<std::string>& paths,
          std::vector<uint32_t>& abundance_min_vec,
          uint32_t recurrence_min,
-         uint32_t save_if)
+         uint32_t save_if,
+         MergeEngine engine = MergeEngine::TREE)
     : m_paths(paths), m_a_min_vec(abundance_min_vec),
-      m_r_min(recurrence_min), m_save_if(save_if)
+      m_r_min(recurrence_min), m_save_if(save_if), m_engine(engine)
   {
     init_stream();
     init_state();
   }
 
+  // Merges only the hashes in [lower, upper), Reader must support seek_to() and limit().
+  HashMerger(std::vector<std::string>& paths,
+         std::vector<uint32_t>& abundance_min_vec,
+         uint32_t recurrence_min,
+         uint32_t save_if,
+         uint64_t lower,
+         uint64_t upper,
+         MergeEngine engine = MergeEngine::TREE)
+    : m_paths(paths), m_a_min_vec(abundance_min_vec),
+      m_r_min(recurrence_min), m_save_if(save_if), m_engine(engine)
+  {
+    init_stream();
+    for (auto& stream : m_input_streams)
+    {
+      stream->seek_to(lower);
+      stream->limit(upper);
+    }
+    init_state();
+  }
+
   uint64_t current() const
   {
     return m_current;
@@ -424,6 +669,9 @@ public:
     }
     m_counts.resize(m_size, 0);
     m_infos = std::make_unique<MergeStatistics<MAX_C>>(m_size);
+
+    if (m_engine == MergeEngine::TREE)
+      m_tree.init(m_size, element_less{m_elements.data()});
   }
 
 #ifdef WITH_PLUGIN
@@ -440,80 +688,9 @@ public:
 
   bool next()
   {
-    m_keep = false;
-    m_finish = true;
-    m_next_set = false;
-
-    uint32_t recurrence = 0;
-    uint32_t solid_in = 0;
-    m_need_check.clear();
-    m_current = m_next;
-    for (size_t i=0; i<m_size; i++)
-    {
-      if (m_elements[i].is_set && m_elements[i].value == m_current)
-      {
-        m_finish = false;
-        m_counts[i] = m_elements[i].count;
-
-        if (m_counts[i] >= m_a_min_vec[i])
-        {
-          recurrence++;
-          solid_in++;
-
-          if (m_infos)
-          {
-            m_infos->inc_two(i, m_counts[i]);
-            m_infos->inc_uwo(i);
-          }
-        }
-        else
-        {
-          if (m_infos)
-            m_infos->inc_ns(i);
-          if (m_save_if)
-            m_need_check.push_back(i);
-          else
-            m_counts[i] = 0;
-        }
-        if (!read_next(i))
-          m_elements[i].is_set = false;
-      }
-      else
-      {
-        m_counts[i] = 0;
-      }
-
-      if (m_elements[i].is_set && (!m_next_set || m_elements[i].value < m_next))
-      {
-        m_next = m_elements[i].value;
-        m_next_set = true;
-      }
-    }
-    for (auto& f : m_need_check)
-    {
-      if (!(solid_in >= m_save_if))
-        m_counts[f] = 0;
-      else
-      {
-        if (m_infos)
-        {
-          m_infos->inc_rd(f);
-          m_infos->inc_uw(f);
-          m_infos->inc_tw(f, m_counts[f]);
-        }
-      }
-    }
-    if (recurrence >= m_r_min)
-      m_keep = true;
-
-#ifdef WITH_PLUGIN
-    if (m_plugin)
-    {
-      m_keep = m_plugin->process_hash(m_current, m_counts);
-    }
-#endif
-
-    return !m_finish;
+    if (m_engine == MergeEngine::TREE)
+      return next_tree();
+    return next_linear();
   }
 
   void write_as_bin(const std::string& path, bool compressed)
@@ -574,10 +751,24 @@ public:
 
   void write_as_bf(const std::string& path, uint64_t lower, uint64_t upper, bool compressed)
   {
-    std::vector<uint8_t> bit_vec(NBYTES(m_size), 0);
-    std::vector<uint8_t> empty_vec(NBYTES(m_size), 0);
-    uint64_t current = lower;
     VectorMatrixWriter<8192> vmw(path, m_size, 0, m_partition, lower, upper-lower+1, compressed);
+    write_bf_rows(vmw, lower, upper);
+  }
+
+  void write_as_bf_blk(const std::string& path, uint64_t lower, uint64_t upper)
+  {
+    BlockMatrixWriter<8192> bmw(path, m_size, 0, m_partition, lower, upper-lower+1);
+    write_bf_rows(bmw, lower, upper);
+  }
+
+  void write_as_bfc(const std::string& path, uint64_t lower, uint64_t upper, int w, bool compressed)
+  {
+    std::vector<uint8_t> cbit_vec(byte_count_pack(m_size, w), 0);
+    std::vector<uint8_t> empty_vec(byte_count_pack(m_size, w), 0);
+    uint64_t current = lower;
+
+    VectorMatrixWriter<8192> vmw(path, m_size * w, 0, m_partition, lower, upper-lower+1, compressed);
+
     while (next())
     {
       while (m_current > current)
@@ -587,8 +778,8 @@ public:
       }
       if (m_keep)
       {
-        set_bit_vector(bit_vec, m_counts);
-        vmw.write(bit_vec);
+        pack_v(m_counts, cbit_vec, w);
+        vmw.write(cbit_vec);
         current = m_current + 1;
       }
     }
@@ -599,51 +790,177 @@ public:
     }
   }
 
-  void write_as_bfc(const std::string& path, uint64_t lower, uint64_t upper, int w, bool compressed)
+  void write_as_bft(const std::string& path, uint64_t lower, uint64_t upper, bool compressed)
   {
-    std::vector<uint8_t> cbit_vec(byte_count_pack(m_size, w), 0);
-    std::vector<uint8_t> empty_vec(byte_count_pack(m_size, w), 0);
+    std::vector<uint8_t> bit_vec(NBYTES(m_size), 0);
+    std::vector<uint8_t> empty_vec(NBYTES(m_size), 0);
     uint64_t current = lower;
+    TransposedVectorMatrixWriter<8192> tvmw(path, m_size, 0, m_partition, lower, upper-lower+1, compressed);
+    while (next())
+    {
+      while (m_current > current)
+      {
+        tvmw.write(empty_vec);
+        current++;
+      }
+      if (m_keep)
+      {
+        set_bit_vector(bit_vec, m_counts);
+        tvmw.write(bit_vec);
+        current = m_current + 1;
+      }
+    }
+    while (current <= upper)
+    {
+      tvmw.write(empty_vec);
+      current++;
+    }
+  }
 
-    VectorMatrixWriter<8192> vmw(path, m_size * w, 0, m_partition, lower, upper-lower+1, compressed);
-
+private:
+  // One bit vector per hash in [lower, upper], empty for hashes not kept.
+  template<typename Writer>
+  void write_bf_rows(Writer& writer, uint64_t lower, uint64_t upper)
+  {
+    std::vector<uint8_t> bit_vec(NBYTES(m_size), 0);
+    std::vector<uint8_t> empty_vec(NBYTES(m_size), 0);
+    uint64_t current = lower;
     while (next())
     {
       while (m_current > current)
       {
-        vmw.write(empty_vec);
+        writer.write(empty_vec);
         current++;
       }
       if (m_keep)
       {
-        pack_v(m_counts, cbit_vec, w);
-        vmw.write(cbit_vec);
+        set_bit_vector(bit_vec, m_counts);
+        writer.write(bit_vec);
         current = m_current + 1;
       }
     }
     while (current <= upper)
     {
-      vmw.write(empty_vec);
+      writer.write(empty_vec);
       current++;
     }
   }
 
-  void write_as_bft(const std::string& path, uint64_t lower, uint64_t upper, bool compressed)
+  bool next_linear()
   {
-    write_as_bf(path+".tmp", lower, upper, compressed);
-    BitMatrix mat(ROUND_UP(upper-lower+1, 8), ROUND_UP(m_size, 8)/8, true);
+    m_keep = false;
+    m_finish = true;
+    m_next_set = false;
+
+    uint32_t solid_in = 0;
+    m_current = m_next;
+    m_need_check.clear();
+    for (size_t i=0; i<m_size; i++)
     {
-      VectorMatrixReader vmr(path+".tmp");
-      vmr.load(mat);
+      if (m_elements[i].is_set && m_elements[i].value == m_current)
+      {
+        m_finish = false;
+        solid_in += visit(i);
+        if (!read_next(i))
+          m_elements[i].is_set = false;
+      }
+      else
+      {
+        m_counts[i] = 0;
+      }
+
+      if (m_elements[i].is_set && (!m_next_set || m_elements[i].value < m_next))
+      {
+        m_next = m_elements[i].value;
+        m_next_set = true;
+      }
     }
-    std::remove(std::string(path+".tmp").c_str());
-    BitMatrix *trp = mat.transpose();
-    VectorMatrixWriter<8192> vmw(path, m_size, 0, m_partition, lower, upper-lower+1, compressed);
-    vmw.dump(*trp);
-    delete trp;
+
+    end_row(solid_in);
+    return !m_finish;
+  }
+
+  bool next_tree()
+  {
+    m_keep = false;
+    m_need_check.clear();
+
+    // Only the inputs that contained the previous row have a non-zero count
+    for (auto& i : m_touched)
+      m_counts[i] = 0;
+    m_touched.clear();
+
+    size_t top = m_tree.top();
+    m_finish = !(m_tree.valid(top) && m_elements[top].is_set);
+    if (m_finish)
+      return false;
+
+    uint32_t solid_in = 0;
+    m_current = m_elements[top].value;
+    do
+    {
+      m_touched.push_back(top);
+      solid_in += visit(top);
+      if (!read_next(top))
+        m_elements[top].is_set = false;
+      m_tree.replay(top);
+      top = m_tree.top();
+    } while (m_tree.valid(top) && m_elements[top].is_set && m_elements[top].value == m_current);
+
+    end_row(solid_in);
+    return true;
+  }
+
+  bool visit(size_t i)
+  {
+    m_counts[i] = m_elements[i].count;
+    if (m_counts[i] >= m_a_min_vec[i])
+    {
+      if (m_infos)
+      {
+        m_infos->inc_two(i, m_counts[i]);
+        m_infos->inc_uwo(i);
+      }
+      return true;
+    }
+
+    if (m_infos)
+      m_infos->inc_ns(i);
+    if (m_save_if)
+      m_need_check.push_back(i);
+    else
+      m_counts[i] = 0;
+    return false;
+  }
+
+  void end_row(uint32_t solid_in)
+  {
+    for (auto& f : m_need_check)
+    {
+      if (!(solid_in >= m_save_if))
+        m_counts[f] = 0;
+      else
+      {
+        if (m_infos)
+        {
+          m_infos->inc_rd(f);
+          m_infos->inc_uw(f);
+          m_infos->inc_tw(f, m_counts[f]);
+        }
+      }
+    }
+
+    if (solid_in >= m_r_min)
+      m_keep = true;
+
+#ifdef WITH_PLUGIN
+    if (m_plugin)
+    {
+      m_keep = m_plugin->process_hash(m_current, m_counts);
+    }
+#endif
   }
 
-private:
   bool read_next(size_t i)
   {
     if constexpr(std::is_same_v<Reader, HashReader<buf_size>>)
@@ -664,6 +981,10 @@ private:
   std::vector<std::shared_ptr<Reader>> m_input_streams;
   std::vector<element> m_elements;
   std::vector<size_t> m_need_check;
+  std::vector<size_t> m_touched;
+
+  MergeEngine m_engine {MergeEngine::TREE};
+  LoserTree<element_less> m_tree;
 
   uint32_t m_size;
   std::vector<uint32_t>& m_a_min_vec;
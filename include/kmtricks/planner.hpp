@@ -0,0 +1,144 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fmt/format.h>
+#include <kmtricks/repartition.hpp>
+
+namespace km {
+
+// Sizes of a sample, extrapolated from the k-mers read during planning.
+struct SampleEstimate
+{
+  uint64_t bases {0};
+  uint64_t kmers {0};
+  uint64_t distinct {0};
+};
+
+struct Plan
+{
+  uint32_t nb_partitions {0};
+  uint32_t nb_threads {0};
+  double focus {0};
+
+  double max_share {0};       // fraction of the k-mers in the largest partition
+  uint64_t task_memory {0};   // per count task
+  uint64_t peak_memory {0};   // nb_threads count tasks
+  uint64_t peak_disk {0};     // count files + super-k-mers of the samples in flight
+
+  bool fits_memory {false};
+  bool fits_disk {false};
+
+  std::string to_string() const
+  {
+    return fmt::format(
+      "partitions={}, threads={}, focus={:.2f}, largest partition={:.2f}%, "
+      "memory={} MB ({} MB per count task), disk={} MB{}{}",
+      nb_partitions, nb_threads, focus, max_share * 100,
+      peak_memory >> 20, task_memory >> 20, peak_disk >> 20,
+      fits_memory ? "" : ", exceeds the memory budget",
+      fits_disk ? "" : ", exceeds the disk budget");
+  }
+};
+
+// Chooses the number of partitions, threads and the focus of a run from sampled minimizer
+// weights, see MinimizerSampler. The k-mers of each sample are assumed to follow the
+// repartition of the whole collection.
+//  - memory: nb_threads count tasks, each one on the largest partition of the largest sample,
+//    the fewest partitions that fit are used.
+//  - files: each running SuperKTask keeps one file per partition open.
+//  - disk: all count files, and the super-k-mers (2 bits per base) of the samples in flight,
+//    the highest focus that fits is used.
+class Planner
+{
+public:
+  Planner(const std::vector<SampleEstimate>& samples,
+          const std::vector<double>& weights,
+          bool ordered)
+    : m_samples(samples), m_weights(weights), m_ordered(ordered)
+  {}
+
+  // kmer_bytes: memory per k-mer in a count task. record_bytes: disk per counted k-mer.
+  // max_disk = 0 means no disk budget.
+  Plan plan(uint64_t max_memory, uint64_t max_disk, uint32_t max_threads, uint32_t max_files,
+            uint64_t kmer_bytes, uint64_t record_bytes) const
+  {
+    uint64_t max_kmers = 0, max_superk = 0, counts = 0;
+    for (auto& s : m_samples)
+    {
+      max_kmers = std::max(max_kmers, s.kmers);
+      max_superk = std::max(max_superk, s.bases / 4);
+      counts += s.distinct * record_bytes;
+    }
+
+    max_threads = std::max<uint32_t>(max_threads, 1);
+    uint32_t max_parts = std::max<uint32_t>(std::min<uint64_t>(max_files, m_weights.size()), s_min_parts);
+
+    Plan plan;
+    for (uint32_t p = s_min_parts; ; p = std::min(max_parts, p + std::max<uint32_t>(1, p / 4)))
+    {
+      plan.nb_partitions = p;
+      plan.max_share = max_share(p);
+      plan.task_memory = static_cast<uint64_t>(max_kmers * plan.max_share) * kmer_bytes + 8192;
+      plan.nb_threads = std::clamp<uint32_t>(max_files / p, 1, max_threads);
+      if (plan.nb_threads * plan.task_memory <= max_memory || p == max_parts)
+        break;
+    }
+
+    // not enough memory for all threads, even with max_parts partitions
+    if (plan.nb_threads * plan.task_memory > max_memory)
+      plan.nb_threads = std::max<uint64_t>(1, max_memory / plan.task_memory);
+
+    plan.peak_memory = plan.nb_threads * plan.task_memory;
+    plan.fits_memory = plan.peak_memory <= max_memory;
+
+    for (double f : {1.0, 0.75, 0.5, 0.25, 0.0})
+    {
+      plan.focus = f;
+      uint64_t running = std::max<uint64_t>(1, std::floor(plan.nb_threads * f));
+      plan.peak_disk = counts + running * max_superk;
+      plan.fits_disk = max_disk == 0 || plan.peak_disk <= max_disk;
+      if (plan.fits_disk)
+        break;
+    }
+    return plan;
+  }
+
+private:
+  double max_share(uint32_t nb_parts) const
+  {
+    std::vector<double> loads;
+    balance_minimizers(m_weights, nb_parts, m_ordered, loads);
+    double sum = 0, max = 0;
+    for (auto& l : loads) { sum += l; max = std::max(max, l); }
+    return sum > 0 ? max / sum : 1.0 / nb_parts;
+  }
+
+private:
+  static constexpr uint32_t s_min_parts = 4;
+
+  std::vector<SampleEstimate> m_samples;
+  std::vector<double> m_weights;
+  bool m_ordered {false};
+};
+
+};
@@ -20,6 +20,7 @@
 
 #define KMTRICKS_PUBLIC
 #include <kmtricks/kmer.hpp>
+#include <kmtricks/dyn_kmer.hpp>
 #include <kmtricks/minimizer.hpp>
 #include <kmtricks/repartition.hpp>
 #include <kmtricks/histogram.hpp>
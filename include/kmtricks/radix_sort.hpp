@@ -0,0 +1,225 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace km {
+
+// Byte access for radix sorting. The generic version works with gatb LargeInt
+// through its public operators, uint64_t is specialized.
+template<typename T>
+struct radix_traits
+{
+  static constexpr int bytes = sizeof(T);
+
+  static uint8_t digit(const T& x, int byte)
+  {
+    return (x >> (8 * byte)).getVal() & 0xff;
+  }
+};
+
+template<>
+struct radix_traits<uint64_t>
+{
+  static constexpr int bytes = sizeof(uint64_t);
+
+  static uint8_t digit(uint64_t x, int byte)
+  {
+    return (x >> (8 * byte)) & 0xff;
+  }
+};
+
+// In-place MSD radix sort (American flag sort), no extra memory is allocated.
+// Ranges are registered with add(), then sorted with sort(nb_threads). With several threads,
+// large ranges are first split on their leading bytes so that one large range can be shared
+// between threads, then sub-ranges are dispatched largest first.
+template<typename T>
+class RadixSort
+{
+  using traits = radix_traits<T>;
+  using bounds_t = std::array<size_t, 257>;
+
+  static constexpr size_t small_size = 64;
+  static constexpr size_t min_grain = 1 << 16;
+
+  struct range
+  {
+    T* data;
+    size_t size;
+    int byte;
+  };
+
+public:
+  void add(T* data, size_t size)
+  {
+    if (size > 1)
+      m_ranges.push_back(range{data, size, top_byte(data, size)});
+  }
+
+  void sort(size_t nb_threads = 1)
+  {
+    if (nb_threads > 1)
+      split(nb_threads);
+
+    if (nb_threads <= 1 || m_ranges.size() == 1)
+    {
+      for (auto& r : m_ranges)
+        msd(r.data, r.size, r.byte);
+    }
+    else
+    {
+      std::sort(m_ranges.begin(), m_ranges.end(), [](const range& a, const range& b) {
+        return a.size > b.size;
+      });
+
+      std::atomic<size_t> next {0};
+      auto worker = [this, &next]() {
+        for (size_t i = next++; i < m_ranges.size(); i = next++)
+          msd(m_ranges[i].data, m_ranges[i].size, m_ranges[i].byte);
+      };
+
+      std::vector<std::thread> threads;
+      for (size_t i = 1; i < std::min(nb_threads, m_ranges.size()); i++)
+        threads.emplace_back(worker);
+      worker();
+      for (auto& t : threads)
+        t.join();
+    }
+    m_ranges.clear();
+  }
+
+  static void sort(T* data, size_t size, size_t nb_threads = 1)
+  {
+    RadixSort<T> sorter;
+    sorter.add(data, size);
+    sorter.sort(nb_threads);
+  }
+
+private:
+  // Splits ranges larger than the grain on their leading byte, the other ones are left as is.
+  void split(size_t nb_threads)
+  {
+    size_t total = 0;
+    for (auto& r : m_ranges)
+      total += r.size;
+    size_t grain = std::max(total / (nb_threads * 8), min_grain);
+
+    std::vector<range> ranges;
+    std::vector<range> stack(m_ranges.begin(), m_ranges.end());
+    while (!stack.empty())
+    {
+      range r = stack.back(); stack.pop_back();
+      if (r.size <= grain || r.byte < 0)
+      {
+        ranges.push_back(r);
+        continue;
+      }
+
+      bounds_t bounds;
+      partition(r.data, r.size, r.byte, bounds);
+      for (size_t b = 0; b < 256; b++)
+      {
+        size_t size = bounds[b + 1] - bounds[b];
+        if (size > 1)
+          stack.push_back(range{r.data + bounds[b], size, r.byte - 1});
+      }
+    }
+    m_ranges.swap(ranges);
+  }
+
+  static int top_byte(const T* data, size_t size)
+  {
+    T acc = data[0];
+    for (size_t i = 1; i < size; i++)
+      acc = acc | data[i];
+    for (int byte = traits::bytes - 1; byte >= 0; byte--)
+      if (traits::digit(acc, byte))
+        return byte;
+    return -1;
+  }
+
+  // Distributes the range into 256 buckets according to the digit at byte.
+  // Returns false if all elements fall into the same bucket, in which case nothing is moved.
+  static bool partition(T* data, size_t size, int byte, bounds_t& bounds)
+  {
+    std::array<size_t, 256> count {};
+    for (size_t i = 0; i < size; i++)
+      count[traits::digit(data[i], byte)]++;
+
+    bounds[0] = 0;
+    for (size_t b = 0; b < 256; b++)
+    {
+      if (count[b] == size)
+      {
+        std::fill(bounds.begin(), bounds.begin() + b + 1, 0);
+        std::fill(bounds.begin() + b + 1, bounds.end(), size);
+        return false;
+      }
+      bounds[b + 1] = bounds[b] + count[b];
+    }
+
+    std::array<size_t, 256> heads;
+    std::copy(bounds.begin(), bounds.end() - 1, heads.begin());
+    for (size_t b = 0; b < 256; b++)
+    {
+      while (heads[b] < bounds[b + 1])
+      {
+        T value = data[heads[b]];
+        uint8_t d = traits::digit(value, byte);
+        while (d != b)
+        {
+          std::swap(value, data[heads[d]++]);
+          d = traits::digit(value, byte);
+        }
+        data[heads[b]++] = value;
+      }
+    }
+    return true;
+  }
+
+  static void msd(T* data, size_t size, int byte)
+  {
+    while (size > small_size && byte >= 0)
+    {
+      bounds_t bounds;
+      if (!partition(data, size, byte, bounds))
+      {
+        byte--;
+        continue;
+      }
+      for (size_t b = 0; b < 256; b++)
+        msd(data + bounds[b], bounds[b + 1] - bounds[b], byte - 1);
+      return;
+    }
+
+    // byte < 0: all the elements are equal
+    if (byte >= 0 && size > 1)
+      std::sort(data, data + size);
+  }
+
+private:
+  std::vector<range> m_ranges;
+};
+
+};
@@ -19,7 +19,12 @@
 #pragma once
 #include <fstream>
 #include <string>
+#include <vector>
+#include <queue>
+#include <unordered_set>
 #include <kmtricks/minimizer.hpp>
+#include <kmtricks/rolling_kmer.hpp>
+#include <kmtricks/kmer_hash.hpp>
 #include <kmtricks/utils.hpp>
 
 namespace km {
@@ -96,6 +101,33 @@ public:
     return m_repart_table;
   }
 
+  // Replaces the minimizer table, the other fields are kept as loaded.
+  void set_table(const std::vector<uint16_t>& table)
+  {
+    if (table.size() != m_nb_minims)
+      throw InputError("Repartition table of size " + std::to_string(table.size()) +
+                       " instead of " + std::to_string(m_nb_minims) + ".");
+    m_repart_table = table;
+  }
+
+  uint16_t get_nb_partitions() const
+  {
+    return m_nb_part;
+  }
+
+  // Same format as the GATB Repartitor, which loads it during superk.
+  void save(const std::string& path) const
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::out); check_fstream_good(path, out);
+    out.write((char*)&m_nb_part, sizeof(m_nb_part));
+    out.write((char*)&m_nb_minims, sizeof(m_nb_minims));
+    out.write((char*)&m_nb_pass, sizeof(m_nb_pass));
+    out.write((char*)m_repart_table.data(), sizeof(uint16_t)*m_nb_minims);
+    out.write((char*)&m_has_freq, sizeof(m_has_freq));
+    uint32_t magic = s_gatb_magic;
+    out.write((char*)&magic, sizeof(magic));
+  }
+
 private:
   std::string m_path;
   std::string m_fpath;
@@ -109,4 +141,114 @@ private:
   std::vector<uint32_t> m_freq_table;
 };
 
+// Estimated number of distinct k-mers per minimizer in the first k-mers of a sample.
+// Only the canonical k-mers whose hash is a multiple of 2^rate_bits are kept, and
+// deduplicated, each one accounts for rate() = 2^rate_bits distinct k-mers. Sampled k-mers
+// are counted on 32 bits, the table has 4^minim_size entries.
+template<size_t MAX_K>
+class MinimizerSampler
+{
+public:
+  MinimizerSampler(uint32_t kmer_size, uint32_t minim_size, uint64_t max_kmers,
+                   uint32_t rate_bits = 4)
+    : m_roll(kmer_size, minim_size), m_max_kmers(max_kmers),
+      m_rate_mask((uint64_t{1} << rate_bits) - 1), m_rate(uint64_t{1} << rate_bits),
+      m_counts(uint64_t{1} << (2 * minim_size), 0)
+  {}
+
+  // Returns false once max_kmers k-mers have been seen, the remaining ones are ignored.
+  bool push(const char* seq, size_t size)
+  {
+    m_roll.reset();
+    for (size_t i=0; i<size && m_nb_kmers < m_max_kmers; i++)
+    {
+      m_nb_bases++;
+      if (!m_roll.push(seq[i]))
+        continue;
+      m_nb_kmers++;
+      uint64_t h = m_hasher(m_roll.canonical());
+      if ((h & m_rate_mask) == 0 && m_seen.insert(h).second)
+        m_counts[m_roll.minimizer()]++;
+    }
+    return m_nb_kmers < m_max_kmers;
+  }
+
+  const std::vector<uint32_t>& counts() const { return m_counts; }
+  uint64_t rate() const { return m_rate; }
+  uint64_t nb_bases() const { return m_nb_bases; }
+  uint64_t nb_kmers() const { return m_nb_kmers; }
+
+private:
+  RollingKmer<MAX_K> m_roll;
+  typename KmerHashers<0>::template Hasher<MAX_K> m_hasher;
+  uint64_t m_max_kmers;
+  uint64_t m_rate_mask;
+  uint64_t m_rate;
+  uint64_t m_nb_kmers {0};
+  uint64_t m_nb_bases {0};
+  std::unordered_set<uint64_t> m_seen;
+  std::vector<uint32_t> m_counts;
+};
+
+// Minimizer table from the weight of each minimizer, the predicted load of each partition
+// is returned in loads. Unordered: heaviest minimizers first, each one to the lightest
+// partition. Ordered: minimizers stay sorted, partitions are contiguous ranges of about the
+// same weight.
+inline std::vector<uint16_t> balance_minimizers(const std::vector<double>& weights,
+                                                uint32_t nb_parts,
+                                                bool ordered,
+                                                std::vector<double>& loads)
+{
+  std::vector<uint16_t> table(weights.size(), 0);
+  loads.assign(nb_parts, 0);
+
+  if (ordered)
+  {
+    double total = 0;
+    for (auto& w : weights)
+      total += w;
+    uint32_t p = 0;
+    double acc = 0;
+    for (size_t i=0; i<weights.size(); i++)
+    {
+      // move to the next partition when its share is reached, keeping one per remaining range
+      while (p + 1 < nb_parts && (acc >= total * (p + 1) / nb_parts ||
+             weights.size() - i <= nb_parts - 1 - p))
+        p++;
+      table[i] = p;
+      loads[p] += weights[i];
+      acc += weights[i];
+    }
+    return table;
+  }
+
+  std::vector<uint32_t> order(weights.size());
+  for (size_t i=0; i<order.size(); i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&weights](uint32_t a, uint32_t b) { return weights[a] > weights[b]; });
+
+  // (load, partition), lightest first, ties broken by partition id for stable tables
+  using entry_t = std::pair<double, uint32_t>;
+  std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> heap;
+  for (uint32_t p=0; p<nb_parts; p++)
+    heap.push({0, p});
+
+  size_t unseen = 0;
+  for (auto& m : order)
+  {
+    if (weights[m] == 0)
+    {
+      // not sampled, spread evenly
+      table[m] = unseen++ % nb_parts;
+      continue;
+    }
+    auto [load, p] = heap.top(); heap.pop();
+    table[m] = p;
+    loads[p] = load + weights[m];
+    heap.push({loads[p], p});
+  }
+  return table;
+}
+
 };
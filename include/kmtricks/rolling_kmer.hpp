@@ -0,0 +1,240 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <array>
+#include <vector>
+#include <utility>
+#include <kmtricks/kmer.hpp>
+
+namespace km {
+
+inline bool is_acgt(char c)
+{
+  switch (c)
+  {
+    case 'A': case 'C': case 'G': case 'T':
+    case 'a': case 'c': case 'g': case 't':
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Streaming 2-bit encoder over a sequence. Forward and reverse complement k-mers are
+// updated in O(1) per base and the minimizer is maintained with a monotone deque over the
+// canonical m-mers of the window. canonical() and minimizer() give the same values as
+// Kmer::canonical() and Kmer::minimizer() on each k-mer, without re-encoding it.
+// Non-ACGT characters restart the encoding.
+template<size_t MAX_K>
+class RollingKmer
+{
+public:
+  RollingKmer(size_t kmer_size, size_t minim_size)
+    : m_kmer_size(kmer_size), m_minim_size(minim_size),
+      m_mmer_mask((uint64_t{1} << (2 * minim_size)) - 1),
+      m_default(static_cast<uint32_t>(m_mmer_mask)),
+      m_window(kmer_size - minim_size + 1)
+  {
+    m_fwd.set_k(m_kmer_size);
+    m_rev.set_k(m_kmer_size);
+    m_mask.set_k(m_kmer_size);
+    for (uint64_t c = 0; c < 4; c++)
+    {
+      m_low[c].set_k(m_kmer_size);
+      m_low[c].set64(c);
+    }
+    // built by steps of one nucleotide, Kmer shifts are only valid below 64 bits
+    m_high = m_low;
+    for (size_t i = 1; i < m_kmer_size; i++)
+      for (auto& h : m_high)
+        h = h << 2;
+    for (size_t i = 0; i < m_kmer_size; i++)
+      m_mask = (m_mask << 2) | m_low[3];
+
+    m_deque.resize(m_window + 2);
+  }
+
+  void reset()
+  {
+    m_len = 0;
+    m_head = m_tail = 0;
+  }
+
+  // Returns true if the last kmer_size characters form a valid k-mer.
+  bool push(char c)
+  {
+    return push_code(is_acgt(c) ? NToB[static_cast<uint8_t>(c)] : 4);
+  }
+
+  // Same as push() on a 2-bit code (see NToB), codes above 3 restart the encoding.
+  bool push_code(uint8_t nt)
+  {
+    if (nt > 3)
+    {
+      reset();
+      return false;
+    }
+
+    m_fwd = ((m_fwd << 2) & m_mask) | m_low[nt];
+    m_rev = (m_rev >> 2) | m_high[revB[nt]];
+
+    m_mfwd = ((m_mfwd << 2) | nt) & m_mmer_mask;
+    m_mrev = (m_mrev >> 2) | (static_cast<uint64_t>(revB[nt]) << (2 * (m_minim_size - 1)));
+
+    m_len++;
+    if (m_len >= m_minim_size)
+      push_mmer();
+    return m_len >= m_kmer_size;
+  }
+
+  const Kmer<MAX_K>& forward() const { return m_fwd; }
+  const Kmer<MAX_K>& reverse() const { return m_rev; }
+  const Kmer<MAX_K>& canonical() const { return m_rev < m_fwd ? m_rev : m_fwd; }
+
+  uint32_t minimizer() const
+  {
+    return m_deque[m_head].second;
+  }
+
+private:
+  void push_mmer()
+  {
+    uint32_t value = static_cast<uint32_t>(std::min(m_mfwd, m_mrev));
+    if (!is_valid_minimizer(value, m_minim_size))
+      value = m_default;
+
+    // m-mers are indexed by the position of their last base
+    size_t pos = m_len;
+    while (m_tail != m_head && m_deque[prev(m_tail)].second > value)
+      m_tail = prev(m_tail);
+    m_deque[m_tail] = {pos, value};
+    m_tail = next(m_tail);
+
+    while (m_deque[m_head].first + m_window <= pos)
+      m_head = next(m_head);
+  }
+
+  size_t next(size_t i) const { return i + 1 == m_deque.size() ? 0 : i + 1; }
+  size_t prev(size_t i) const { return i == 0 ? m_deque.size() - 1 : i - 1; }
+
+private:
+  size_t m_kmer_size;
+  size_t m_minim_size;
+  uint64_t m_mmer_mask;
+  uint32_t m_default;
+  size_t m_window;
+
+  Kmer<MAX_K> m_fwd;
+  Kmer<MAX_K> m_rev;
+  Kmer<MAX_K> m_mask;
+  std::array<Kmer<MAX_K>, 4> m_low;
+  std::array<Kmer<MAX_K>, 4> m_high;
+
+  uint64_t m_mfwd {0};
+  uint64_t m_mrev {0};
+  size_t m_len {0};
+
+  std::vector<std::pair<size_t, uint32_t>> m_deque;
+  size_t m_head {0};
+  size_t m_tail {0};
+};
+
+// 2-bit codes of a sequence, one per byte, non-ACGT characters are encoded as 4.
+inline void encode_sequence(const char* seq, size_t size, std::vector<uint8_t>& codes)
+{
+  codes.resize(size);
+  for (size_t i=0; i<size; i++)
+    codes[i] = is_acgt(seq[i]) ? NToB[static_cast<uint8_t>(seq[i])] : 4;
+}
+
+// Valid k-mers of a sequence, one entry per k-mer in each array.
+template<size_t MAX_K>
+struct KmerRoutes
+{
+  std::vector<uint32_t> positions;   // position of the first base
+  std::vector<Kmer<MAX_K>> kmers;    // canonical
+  std::vector<uint32_t> minimizers;
+  std::vector<uint16_t> partitions;  // only with a repartition table
+
+  size_t size() const { return positions.size(); }
+
+  void clear()
+  {
+    positions.clear();
+    kmers.clear();
+    minimizers.clear();
+    partitions.clear();
+  }
+};
+
+// Canonical k-mers of a sequence with their minimizers and partitions, in one pass over the
+// sequence with a RollingKmer, instead of Kmer::minimizer() and Repartition::get_partition()
+// on each k-mer. The table is Repartition::table(), partitions are skipped if it is empty.
+template<size_t MAX_K>
+class KmerRouter
+{
+public:
+  KmerRouter(size_t kmer_size, size_t minim_size,
+             const std::vector<uint16_t>& table = {})
+    : m_roll(kmer_size, minim_size), m_kmer_size(kmer_size), m_table(table)
+  {}
+
+  void route(const uint8_t* codes, size_t size, KmerRoutes<MAX_K>& out)
+  {
+    out.clear();
+    m_roll.reset();
+    if (size < m_kmer_size)
+      return;
+
+    size_t max_kmers = size - m_kmer_size + 1;
+    out.positions.reserve(max_kmers);
+    out.kmers.reserve(max_kmers);
+    out.minimizers.reserve(max_kmers);
+
+    for (size_t i=0; i<size; i++)
+    {
+      if (!m_roll.push_code(codes[i]))
+        continue;
+      out.positions.push_back(i + 1 - m_kmer_size);
+      out.kmers.push_back(m_roll.canonical());
+      out.minimizers.push_back(m_roll.minimizer());
+    }
+
+    if (!m_table.empty())
+    {
+      out.partitions.resize(out.size());
+      for (size_t i=0; i<out.size(); i++)
+        out.partitions[i] = m_table[out.minimizers[i]];
+    }
+  }
+
+  void route(const std::string& seq, KmerRoutes<MAX_K>& out)
+  {
+    encode_sequence(seq.data(), seq.size(), m_codes);
+    route(m_codes.data(), m_codes.size(), out);
+  }
+
+private:
+  RollingKmer<MAX_K> m_roll;
+  size_t m_kmer_size;
+  std::vector<uint16_t> m_table;
+  std::vector<uint8_t> m_codes;
+};
+
+};
@@ -93,15 +93,14 @@ struct main_lookup
     lookup_options_t opt = std::static_pointer_cast<struct lookup_options>(options);
     query_options_t query_opt = std::make_shared<struct query_options>(query_options{});
 
-    KmDir::get().init(opt->dir, "", false);
-    std::string tmp = fmt::format("{}/tmp_query_res", KmDir::get().m_index_storage);
     query_opt->dir = opt->dir;
     query_opt->query = opt->query;
     query_opt->threshold = opt->threshold;
-    query_opt->output = tmp;
+    query_opt->output = "stdout";
 
+    std::stringstream results;
     KmDir::get().init(opt->dir, "", false);
-    main_query<MAX_K>()(query_opt);
+    main_query<MAX_K>()(query_opt, &results);
 
     std::vector<std::string> query_idx;
     {
@@ -115,11 +114,11 @@ struct main_lookup
 
     if (opt->out_type == "vector")
     {
-      format_result_vector(tmp, std::cout, query_idx, KmDir::get().m_fof);
+      format_result_vector(results, std::cout, query_idx, KmDir::get().m_fof);
     }
     else
     {
-      format_result_list(tmp, std::cout, query_idx, KmDir::get().m_fof);
+      format_result_list(results, std::cout, query_idx, KmDir::get().m_fof);
     }
   }
 };
@@ -26,11 +26,11 @@
 
 namespace km {
 
-void format_result_vector(const std::string& path,
+void format_result_vector(std::istream& in,
                           std::ostream& stream,
                           std::vector<std::string>& query_idx,
                           Fof& fof);
-void format_result_list(const std::string& path,
+void format_result_list(std::istream& in,
                         std::ostream& stream,
                         std::vector<std::string>& query_idx,
                         Fof& fof);
@@ -21,6 +21,9 @@
 #include <cmath>
 #include <functional>
 #include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 #include <gatb/gatb_core.hpp>
 #include <gatb/kmer/impl/RepartitionAlgorithm.hpp>
@@ -28,6 +31,7 @@
 #include <gatb/kmer/impl/SortingCountAlgorithm.cpp>
 
 #include <kmtricks/io/fof.hpp>
+#include <kmtricks/io/fastx_reader.hpp>
 #include <kmtricks/kmdir.hpp>
 #include <kmtricks/gatb/count_processor.hpp>
 #include <kmtricks/gatb/sorting_count.hpp>
@@ -38,6 +42,7 @@
 #include <kmtricks/gatb/gatb_utils.hpp>
 #include <kmtricks/itask.hpp>
 #include <kmtricks/repartition.hpp>
+#include <kmtricks/planner.hpp>
 
 #ifdef WITH_PLUGIN
 #include <kmtricks/plugin_manager.hpp>
@@ -48,6 +53,63 @@ namespace km {
 namespace fs = std::filesystem;
 using parti_info_t = std::shared_ptr<PartiInfo<5>>;
 
+// Minimizer weights (estimated distinct k-mers) summed over all the samples of the fof, read on
+// nb_threads threads. Each sample is read up to max_kmers k-mers and extrapolated to the size
+// estimated by its bank.
+template<size_t span>
+std::vector<double> sample_minimizers(uint32_t kmer_size,
+                                      uint32_t minim_size,
+                                      uint32_t nb_threads,
+                                      uint64_t max_kmers,
+                                      std::vector<SampleEstimate>* estimates = nullptr)
+{
+  Fof& fof = KmDir::get().m_fof;
+  std::vector<double> total(1ULL << (2 * minim_size), 0);
+  if (estimates)
+    estimates->assign(fof.size(), SampleEstimate{});
+  std::mutex mutex;
+  std::atomic<size_t> next {0};
+
+  auto worker = [&]() {
+    for (size_t i = next++; i < fof.size(); i = next++)
+    {
+      MinimizerSampler<span> sampler(kmer_size, minim_size, max_kmers);
+      IBank* bank = Bank::open(fof.get_files(fof.get_id(i))); LOCAL(bank);
+      {
+        Iterator<Sequence>* it = bank->iterator(); LOCAL(it);
+        for (it->first(); !it->isDone(); it->next())
+          if (!sampler.push(it->item().getDataBuffer(), it->item().getDataSize()))
+            break;
+      }
+
+      u_int64_t nb_seqs = 0, nb_bases = 0, max_size = 0;
+      bank->estimate(nb_seqs, nb_bases, max_size);
+      double ratio = sampler.nb_bases() ? std::max(1.0, static_cast<double>(nb_bases) / sampler.nb_bases()) : 1.0;
+
+      double distinct = 0;
+      double weight = sampler.rate() * ratio;
+      std::unique_lock<std::mutex> lock(mutex);
+      const std::vector<uint32_t>& counts = sampler.counts();
+      for (size_t m=0; m<counts.size(); m++)
+      {
+        total[m] += counts[m] * weight;
+        distinct += counts[m] * weight;
+      }
+      if (estimates)
+        (*estimates)[i] = SampleEstimate{std::max<uint64_t>(nb_bases, sampler.nb_bases()),
+                                         static_cast<uint64_t>(sampler.nb_kmers() * ratio),
+                                         static_cast<uint64_t>(distinct)};
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint32_t t=0; t<std::max<uint32_t>(1, std::min<uint32_t>(nb_threads, fof.size())); t++)
+    threads.emplace_back(worker);
+  for (auto& t : threads)
+    t.join();
+  return total;
+}
+
 template<size_t span>
 class ConfigTask : public ITask
 {
@@ -110,8 +172,9 @@ template<size_t span>
 class RepartTask : public ITask
 {
 public:
-  RepartTask(const std::string& path, const std::string& from = "")
-    : ITask(1), m_path(path), m_from(from) {}
+  RepartTask(const std::string& path, const std::string& from = "",
+             bool balance = false, uint32_t nb_threads = 1)
+    : ITask(1), m_path(path), m_from(from), m_balance(balance), m_nb_threads(nb_threads) {}
 
   void preprocess() {}
   void postprocess()
@@ -166,23 +229,144 @@ public:
         fs::copy_options::recursive | fs::copy_options::overwrite_existing);
     }
 
+    if (m_balance && m_from.empty())
+      balance(config);
+
     spdlog::debug("[done] - RepartTask");
   }
 
 private:
+  // Replaces the GATB table, which is computed from super-k-mer counts on the first reads,
+  // by a table balanced on distinct k-mers sampled from every sample of the fof.
+  void balance(const Configuration& config)
+  {
+    if (m_minim_size > 12)
+    {
+      spdlog::warn("Balanced repartition requires --minimizer-size <= 12, keep the GATB one.");
+      return;
+    }
+    // the sampler computes lexicographic minimizers
+    if (config._minimizerType != 0)
+    {
+      spdlog::warn("Balanced repartition requires --minimizer-type 0, keep the GATB one.");
+      return;
+    }
+
+    std::vector<double> total = sample_minimizers<span>(
+      config._kmerSize, m_minim_size, m_nb_threads, s_sample_kmers);
+
+    std::string path = fmt::format("{}_gatb/repartition.minimRepart", KmDir::get().m_repart_storage);
+    Repartition repart(path);
+    std::vector<double> loads;
+    repart.set_table(balance_minimizers(total, repart.get_nb_partitions(),
+                                        config._repartitionType == 1, loads));
+    repart.save(path);
+
+    double sum = 0, max = 0;
+    for (auto& l : loads) { sum += l; max = std::max(max, l); }
+
+    std::ofstream out(KmDir::get().get_repart_sizes_path(), std::ios::out);
+    check_fstream_good(KmDir::get().get_repart_sizes_path(), out);
+    out << "# partition\testimated_kmers\tshare\n";
+    for (size_t p=0; p<loads.size(); p++)
+      out << p << "\t" << static_cast<uint64_t>(loads[p]) << "\t" << (sum > 0 ? loads[p] / sum : 0) << "\n";
+
+    spdlog::info("Balanced repartition: ~{} distinct k-mers per partition, max/mean = {:.2f}",
+                 static_cast<uint64_t>(sum / loads.size()), sum > 0 ? max * loads.size() / sum : 0);
+  }
+
+private:
+  // k-mers read per sample, enough to see most minimizers
+  static constexpr uint64_t s_sample_kmers = 20000000;
+
   std::string m_path;
   std::string m_from;
+  bool m_balance {false};
+  uint32_t m_nb_threads {1};
   int m_cores;
   uint32_t m_nb_parts {0};
   uint32_t m_minim_size {0};
 };
 
+// Chooses the number of partitions, threads and focus before the configuration, see Planner.
+template<size_t span>
+class PlanTask : public ITask
+{
+public:
+  PlanTask(uint32_t kmer_size, uint32_t minim_size, bool ordered, uint32_t nb_threads,
+           uint64_t max_memory, uint64_t max_disk, uint64_t kmer_bytes, uint64_t record_bytes)
+    : ITask(0), m_kmer_size(kmer_size), m_minim_size(minim_size), m_ordered(ordered),
+      m_nb_threads(nb_threads), m_max_memory(max_memory), m_max_disk(max_disk),
+      m_kmer_bytes(kmer_bytes), m_record_bytes(record_bytes) {}
+
+  void preprocess() {}
+  void postprocess() {}
+
+  void exec()
+  {
+    spdlog::debug("[exec] - PlanTask");
+
+    // shares of the partitions are close enough with 4^10 minimizers, and the tables stay small
+    uint32_t minim_size = std::min(m_minim_size, s_max_minim_size);
+    if (minim_size < m_minim_size)
+      spdlog::info("Plan: minimizers sampled with m={} instead of {}, the size of the largest "
+                   "partition may be overestimated.", minim_size, m_minim_size);
+    std::vector<SampleEstimate> samples;
+    std::vector<double> weights = sample_minimizers<span>(
+      m_kmer_size, minim_size, m_nb_threads, s_sample_kmers, &samples);
+
+    auto [nofile, _] = get_prlimit_nofile();
+    uint32_t max_files = nofile > 64 ? nofile - 64 : 1;
+
+    Planner planner(samples, weights, m_ordered);
+    m_plan = planner.plan(m_max_memory, m_max_disk, m_nb_threads, max_files,
+                          m_kmer_bytes, m_record_bytes);
+
+    std::ofstream out(KmDir::get().get_plan_path(), std::ios::out);
+    check_fstream_good(KmDir::get().get_plan_path(), out);
+    out << "# id\tbases\tkmers\tdistinct_kmers\n";
+    for (size_t i=0; i<samples.size(); i++)
+      out << KmDir::get().m_fof.get_id(i) << "\t" << samples[i].bases << "\t"
+          << samples[i].kmers << "\t" << samples[i].distinct << "\n";
+    out << "# " << m_plan.to_string() << "\n";
+
+    spdlog::info("Plan: {}", m_plan.to_string());
+    if (!m_plan.fits_memory || !m_plan.fits_disk)
+      spdlog::warn("The plan does not fit the budget, see {}.", KmDir::get().get_plan_path());
+
+    spdlog::debug("[done] - PlanTask");
+  }
+
+  const Plan& plan() const
+  {
+    return m_plan;
+  }
+
+private:
+  static constexpr uint64_t s_sample_kmers = 5000000;
+  static constexpr uint32_t s_max_minim_size = 10;
+
+  uint32_t m_kmer_size {0};
+  uint32_t m_minim_size {0};
+  bool m_ordered {false};
+  uint32_t m_nb_threads {1};
+  uint64_t m_max_memory {0};
+  uint64_t m_max_disk {0};
+  uint64_t m_kmer_bytes {0};
+  uint64_t m_record_bytes {0};
+  Plan m_plan;
+};
+
 template<size_t span>
 class SuperKTask : public ITask
 {
 public:
-  SuperKTask(const std::string& sample_id, bool lz4, std::vector<uint32_t>& partitions)
-    : ITask(2), m_sample_id(sample_id), m_lz4(lz4), m_partitions(partitions) {}
+  // nb_workers: number of super-k-mer threads fed by the reader, 0 borrows the idle
+  // workers of the pool, see fill_pipelined().
+  SuperKTask(const std::string& sample_id, bool lz4, std::vector<uint32_t>& partitions,
+             size_t nb_workers = 0)
+    : ITask(2), m_sample_id(sample_id), m_lz4(lz4), m_partitions(partitions),
+      m_nb_workers(nb_workers) {}
 
   void preprocess() {}
 
@@ -198,7 +382,6 @@ public:
     spdlog::debug("[exec] - SuperKTask - S={}", m_sample_id);
     this->m_running = true;
 
-    IBank* bank = Bank::open(KmDir::get().m_fof.get_files(m_sample_id)); LOCAL(bank);
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
     Storage* repart_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_repart_storage);
     LOCAL(config_storage); LOCAL(repart_storage);
@@ -223,7 +406,6 @@ public:
     Model model(config._kmerSize, config._minim_size,
                 typename ::Kmer<span>::ComparatorMinimizerFrequencyOrLex(), freq_order);
 
-    Iterator<Sequence>* itSeq = bank->iterator(); LOCAL(itSeq);
     BankStats bank_stats;
     PartiInfo<5> pinfo (config._nb_partitions, config._minim_size);
 
@@ -232,22 +414,82 @@ public:
                                System::thread().newSynchronizer()));
     LOCAL(progress);
     progress->init();
+
+    // Without a fixed number of workers, idle workers of the pool are borrowed
+    TaskPool::Reservation helpers(m_nb_workers ? 0 : std::numeric_limits<size_t>::max());
+    size_t nb_workers = m_nb_workers ? m_nb_workers : helpers.size();
+    const std::vector<std::string>& files = KmDir::get().m_fof.get_file_list(m_sample_id);
+
+    if (std::all_of(files.begin(), files.end(), [](const std::string& f){ return is_gzip(f); }))
     {
-      auto fill_partitions = KmFillPartitions<span>(model,
-                                                        1,
-                                                        0,
-                                                        config._nb_partitions,
-                                                        config._nb_cached_items_per_core_per_part,
-                                                        progress,
-                                                        bank_stats,
-                                                        nullptr,
-                                                        repartitor,
-                                                        pinfo,
-                                                        superk_storage);
-
-      for (itSeq->first(); !itSeq->isDone(); itSeq->next())
+      // Gzipped inputs are inflated ahead on other threads, BGZF blocks in parallel. A quarter
+      // of the workers are given to the inflaters.
+      size_t nb_inflaters = nb_workers / 4;
+      nb_workers -= nb_inflaters;
+      FastxReader reader(files, std::max<size_t>(1, nb_inflaters));
+      auto next_read = [&reader](std::string& read) { return reader.next(read); };
+
+      if (nb_workers > 0)
+      {
+        fill_pipelined(next_read, model, config, progress, repartitor, pinfo, superk_storage, nb_workers);
+      }
+      else
+      {
+        auto fill_partitions = KmFillPartitions<span>(model,
+                                                      1,
+                                                      0,
+                                                      config._nb_partitions,
+                                                      config._nb_cached_items_per_core_per_part,
+                                                      progress,
+                                                      bank_stats,
+                                                      nullptr,
+                                                      repartitor,
+                                                      pinfo,
+                                                      superk_storage);
+        Sequence seq(Data::ASCII);
+        std::string read;
+        while (reader.next(read))
+        {
+          seq.getData().setRef(read.data(), read.size());
+          fill_partitions(seq);
+        }
+      }
+    }
+    else
+    {
+      IBank* bank = Bank::open(KmDir::get().m_fof.get_files(m_sample_id)); LOCAL(bank);
+      Iterator<Sequence>* itSeq = bank->iterator(); LOCAL(itSeq);
+
+      if (nb_workers > 0)
       {
-        fill_partitions(itSeq->item());
+        itSeq->first();
+        auto next_read = [itSeq](std::string& read) {
+          if (itSeq->isDone())
+            return false;
+          read.assign(itSeq->item().getDataBuffer(), itSeq->item().getDataSize());
+          itSeq->next();
+          return true;
+        };
+        fill_pipelined(next_read, model, config, progress, repartitor, pinfo, superk_storage, nb_workers);
+      }
+      else
+      {
+        auto fill_partitions = KmFillPartitions<span>(model,
+                                                      1,
+                                                      0,
+                                                      config._nb_partitions,
+                                                      config._nb_cached_items_per_core_per_part,
+                                                      progress,
+                                                      bank_stats,
+                                                      nullptr,
+                                                      repartitor,
+                                                      pinfo,
+                                                      superk_storage);
+
+        for (itSeq->first(); !itSeq->isDone(); itSeq->next())
+        {
+          fill_partitions(itSeq->item());
+        }
       }
       itSeq->finalize();
     }
@@ -260,10 +502,94 @@ public:
     spdlog::debug("[done] - SuperKTask - S={}", m_sample_id);
   }
 
+private:
+  // The current thread gets the reads from next_read and dispatches them by batches
+  // to nb_workers threads. Each worker owns a KmFillPartitions, i.e. its own PartiInfo,
+  // merged into pinfo with add_sync on destruction, and its own super-k-mer buffers,
+  // whose blocks are written to the files of superk_storage.
+  template<typename Reader, typename Model>
+  void fill_pipelined(Reader&& next_read,
+                      Model& model,
+                      Configuration& config,
+                      IteratorListener* progress,
+                      Repartitor& repartitor,
+                      PartiInfo<5>& pinfo,
+                      SuperKStorageWriter* superk_storage,
+                      size_t nb_workers)
+  {
+    using batch_t = std::vector<std::string>;
+    BoundedQueue<batch_t> queue(2 * nb_workers);
+
+    auto worker = [&]() {
+      BankStats bank_stats;
+      std::unique_ptr<SuperKStorageWriter> cache = superk_storage->make_cache();
+      auto fill_partitions = KmFillPartitions<span>(model,
+                                                    1,
+                                                    0,
+                                                    config._nb_partitions,
+                                                    config._nb_cached_items_per_core_per_part,
+                                                    progress,
+                                                    bank_stats,
+                                                    nullptr,
+                                                    repartitor,
+                                                    pinfo,
+                                                    cache.get());
+      Sequence seq(Data::ASCII);
+      batch_t batch;
+      while (queue.pop(batch))
+      {
+        for (auto& read : batch)
+        {
+          seq.getData().setRef(read.data(), read.size());
+          fill_partitions(seq);
+        }
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i=0; i<nb_workers; i++)
+      workers.emplace_back(worker);
+
+    std::exception_ptr error = nullptr;
+    try
+    {
+      batch_t batch;
+      std::string read;
+      size_t batch_bytes = 0;
+      while (next_read(read))
+      {
+        batch_bytes += read.size();
+        batch.push_back(std::move(read));
+        if (batch_bytes >= s_batch_bytes)
+        {
+          queue.push(std::move(batch));
+          batch = batch_t();
+          batch_bytes = 0;
+        }
+      }
+      if (!batch.empty())
+        queue.push(std::move(batch));
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+    queue.close();
+
+    for (auto& t : workers)
+      t.join();
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+
 private:
   std::string m_sample_id;
   bool m_lz4;
   std::vector<uint32_t>& m_partitions;
+  size_t m_nb_workers {0};
+
+  static constexpr size_t s_batch_bytes = 1 << 20;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -317,6 +643,8 @@ public:
                                                            m_sample_id,
                                                            m_part_id,
                                                            m_lz4);
+    // sparse index of the k-mers, used to split the merge of the partition
+    writer->enable_index();
 
     KmerCountProcessor<span, MAX_C>* processor(new KmerCountProcessor<span, MAX_C>(m_kmer_size,
                                                                                     m_ab_min,
@@ -357,7 +685,7 @@ public:
                 parti_info_t pinfo,
                 uint32_t part_id, uint32_t sample_id, uint64_t window,
                 uint32_t kmer_size, uint32_t abundance_min, bool lz4,
-                hist_t hist = nullptr, bool clear = false)
+                hist_t hist = nullptr, bool clear = false, bool stream = false)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -369,7 +697,8 @@ public:
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
       m_lz4(lz4),
-      m_hist(hist)
+      m_hist(hist),
+      m_stream(stream)
    {
    }
 
@@ -389,20 +718,31 @@ public:
   {
     spdlog::debug("[exec] - HashCountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
 
+    if (m_stream)
+      count<HashRunWriter<MAX_C, 32768>>();
+    else
+      count<HashWriter<MAX_C, 32768>>();
+
+    spdlog::debug("[done] - HashCountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
+  }
+
+private:
+  template<typename Writer>
+  void count()
+  {
     size_t nbk = m_pinfo->getNbKmer(m_part_id);
 
     uint64_t req_mem = get_required_memory_hash<span>(nbk);
 
-    hw_t<MAX_C, 32768> writer = std::make_shared<HashWriter<MAX_C, 32768>>(m_path,
-                                                                             requiredC<MAX_C>::value/8,
-                                                                             m_sample_id,
-                                                                             m_part_id,
-                                                                             m_lz4);
+    std::shared_ptr<Writer> writer = std::make_shared<Writer>(m_path,
+                                                              requiredC<MAX_C>::value/8,
+                                                              m_sample_id,
+                                                              m_part_id,
+                                                              m_lz4);
+    writer->enable_index();
 
-    HashCountProcessor<span, MAX_C, 32768>* processor(new HashCountProcessor<span, MAX_C, 32768>(m_kmer_size,
-                                                                                                 m_ab_min,
-                                                                                                 writer,
-                                                                                                 m_hist));
+    using processor_t = HashCountProcessor<span, MAX_C, 32768, Writer>;
+    processor_t* processor(new processor_t(m_kmer_size, m_ab_min, writer, m_hist));
 
     if (nbk > 0)
     {
@@ -417,8 +757,6 @@ public:
     }
 
     delete processor;
-
-    spdlog::debug("[done] - HashCountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
   }
 
 private:
@@ -433,6 +771,7 @@ private:
   uint32_t m_ab_min;
   hist_t m_hist;
   bool m_lz4;
+  bool m_stream;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -566,19 +905,24 @@ public:
   {
     spdlog::debug("[exec] - KffCountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
 
+    // counted k-mers are written as super-k-mers in minimizer sections, they are kept until
+    // the end of the count, in the pool
+    using processor_t = KffCountProcessor<span, MAX_C>;
+    size_t nb_kmers = m_pinfo->getNbKmer(m_part_id);
     MemAllocator pool(1);
-    pool.reserve(get_required_memory<span>(m_pinfo->getNbKmer(m_part_id)));
-    kff_w_t<DMAX_C> writer = std::make_shared<KffWriter<MAX_C>>(m_path, m_kmer_size);
+    pool.reserve(get_required_memory<span>(nb_kmers) + nb_kmers * processor_t::bytes_per_kmer);
+    kff_w_t<DMAX_C> writer = std::make_shared<KffWriter<MAX_C>>(
+      m_path, m_kmer_size, m_config._minim_size, processor_t::max_kmers);
 
-    KffCountProcessor<span, DMAX_C>* processor(new KffCountProcessor<span, MAX_C>(m_kmer_size,
-                                                                                  m_ab_min,
-                                                                                  writer,
-                                                                                  m_hist));
+    processor_t* processor(new processor_t(m_kmer_size, m_ab_min, writer, m_hist, m_config._minim_size));
+    processor->use_buffer(pool.pool_malloc(nb_kmers * processor_t::bytes_per_kmer, "kff"), nb_kmers);
 
     KmerPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
                                                      pool, m_superk_storage.get());
 
     partition_counter.execute();
+    processor->finish();
+    writer->close();
     pool.free_all();
     delete processor;
 
@@ -637,7 +981,28 @@ public:
                                                                      KM_FILE::KMER);
     std::string out_path = KmDir::get().get_matrix_path(m_part_id, m_mode, m_format,
                                                         COUNT_FORMAT::KMER, m_lz4);
-    KmerMerger<span, MAX_C> merger(paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if);
+
+    // Uncompressed partitions are mapped, records are read in place. Idle workers of the pool
+    // help to merge large partitions, by key ranges.
+    TaskPool::Reservation helpers;
+    size_t nb_threads = 1 + helpers.size();
+    bool split = nb_threads > 1 && splittable();
+    if (m_lz4)
+    {
+      if (!split || !merge_by_range<KmerReader<8192>>(paths, out_path, nb_threads))
+        merge<KmerReader<8192>>(paths, out_path);
+    }
+    else if (!split || !merge_by_range<KmerMmapReader>(paths, out_path, nb_threads))
+      merge<KmerMmapReader>(paths, out_path);
+
+    spdlog::debug("[done] - KmerMergeTask - P={}", m_part_id);
+  }
+
+private:
+  template<typename Reader>
+  void merge(std::vector<std::string>& paths, const std::string& out_path)
+  {
+    KmerMerger<span, MAX_C, Reader> merger(paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if);
 
 #ifdef WITH_PLUGIN
     IMergePlugin* plugin = nullptr;
@@ -653,6 +1018,25 @@ public:
     }
 #endif
 
+    write(merger, out_path);
+
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
+    {
+      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+    }
+    else
+    {
+      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    }
+#endif
+
+    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+  }
+
+  template<typename Merger>
+  void write(Merger& merger, const std::string& out_path)
+  {
     if (m_mode == MODE::COUNT)
     {
       if (m_format == FORMAT::TEXT)
@@ -667,24 +1051,72 @@ public:
       else if (m_format == FORMAT::BIN)
         merger.write_as_pa(out_path, m_lz4);
     }
+  }
 
+  bool splittable() const
+  {
 #ifdef WITH_PLUGIN
+    // plugins see the whole partition
     if (PluginManager<IMergePlugin>::get().use_plugin())
+      return false;
+#endif
+    return m_mode == MODE::COUNT || m_mode == MODE::PA;
+  }
+
+  // Returns false if the partition is too small to be split, or if the files have no index.
+  template<typename Reader>
+  bool merge_by_range(std::vector<std::string>& paths, const std::string& out_path, size_t nb_threads)
+  {
+    size_t nb_records = 0;
+    for (auto& path : paths)
+      nb_records += Reader(path).nb_records();
+    size_t nb_ranges = std::min(nb_threads * 2, nb_records / min_range_records);
+    if (nb_ranges <= 1)
+      return false;
+
+    std::vector<Kmer<span>> samples;
+    for (auto& path : paths)
+      if (!Reader(path).template sample<span>(nb_ranges * 64, samples))
+        return false;
+    std::vector<Kmer<span>> points = split_points(samples, nb_ranges);
+
+    std::vector<KmerRange<span>> ranges(points.size() + 1);
+    for (size_t i=0; i<points.size(); i++)
     {
-      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
-    }
-    else
-    {
-      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+      ranges[i].upper = points[i]; ranges[i].has_upper = true;
+      ranges[i+1].lower = points[i]; ranges[i+1].has_lower = true;
     }
-#endif
 
-    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    std::vector<std::string> range_paths;
+    for (size_t i=0; i<ranges.size(); i++)
+      range_paths.push_back(fmt::format("{}.{}", out_path, i));
+    std::vector<MergeStatistics<MAX_C>> infos(ranges.size(), MergeStatistics<MAX_C>(paths.size()));
+
+    spdlog::debug("[exec] - KmerMergeTask - P={} - {} ranges", m_part_id, ranges.size());
+    merge_ranges(ranges.size(), nb_threads, [&](size_t i) {
+      KmerMerger<span, MAX_C, Reader> merger(
+        paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if, ranges[i]);
+      write(merger, range_paths[i]);
+      infos[i] = *merger.get_infos();
+    });
+
+    if (m_format == FORMAT::TEXT)
+      concat_range_outputs<void>(out_path, range_paths);
+    else if (m_mode == MODE::COUNT)
+      concat_range_outputs<MatrixFileHeader>(out_path, range_paths);
+    else
+      concat_range_outputs<PAMatrixFileHeader>(out_path, range_paths);
 
-    spdlog::debug("[done] - KmerMergeTask - P={}", m_part_id);
+    for (size_t i=1; i<infos.size(); i++)
+      infos[0].add(infos[i]);
+    infos[0].serialize(KmDir::get().get_merge_info_path(m_part_id));
+    return true;
   }
 
 private:
+  // Minimum number of input records per range, below the split is not worth it
+  static constexpr size_t min_range_records = 1 << 20;
+
   uint32_t m_part_id;
   std::vector<uint32_t>& m_ab_vec;
   uint32_t m_kmer_size;
@@ -708,16 +1140,18 @@ public:
                 FORMAT format,
                 HashWindow& win,
                 bool clear,
-                int32_t bw)
+                int32_t bw,
+                bool stream = false)
   : ITask(4, clear), m_part_id(partition_id), m_ab_vec(ab_vec), m_rec_min(recurrence_min),
-    m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format), m_win(win), m_bw(bw) {}
+    m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format), m_win(win), m_bw(bw),
+    m_stream(stream) {}
 
   void preprocess() {}
   void postprocess()
   {
     if (this->m_clear)
     {
-      for (auto& f : KmDir::get().get_files_to_merge(m_part_id, m_lz4, KM_FILE::HASH))
+      for (auto& f : KmDir::get().get_files_to_merge(m_part_id, m_lz4, KM_FILE::HASH, !m_stream))
       {
         Eraser::get().erase(f);
       }
@@ -730,13 +1164,36 @@ public:
   {
     spdlog::debug("[exec] - HashMergeTask - P={}", m_part_id);
 
+    // With streaming, runs are in memory and only spilled ones exist on disk
     std::vector<std::string> paths = KmDir::get().get_files_to_merge(m_part_id,
                                                                      m_lz4,
-                                                                     KM_FILE::HASH);
+                                                                     KM_FILE::HASH,
+                                                                     !m_stream);
     std::string out_path = KmDir::get().get_matrix_path(m_part_id, m_mode, m_format,
                                                         COUNT_FORMAT::HASH, false);
 
-    HashMerger<MAX_C, 32768, HashReader<MAX_C, 32768>> merger(paths, m_ab_vec, m_rec_min, m_save_if);
+    // Idle workers of the pool help to merge large partitions, by hash ranges.
+    TaskPool::Reservation helpers;
+    size_t nb_threads = 1 + helpers.size();
+    bool split = nb_threads > 1 && splittable();
+    if (m_stream)
+      merge<HashRunReader<MAX_C, 32768>>(paths, out_path);
+    else if (m_lz4)
+    {
+      if (!split || !merge_by_range<HashReader<MAX_C, 32768>>(paths, out_path, nb_threads))
+        merge<HashReader<MAX_C, 32768>>(paths, out_path);
+    }
+    else if (!split || !merge_by_range<HashMmapReader<MAX_C>>(paths, out_path, nb_threads))
+      merge<HashMmapReader<MAX_C>>(paths, out_path);
+
+    spdlog::debug("[done] - HashMergeTask - P={}", m_part_id);
+  }
+
+private:
+  template<typename Reader>
+  void merge(std::vector<std::string>& paths, const std::string& out_path)
+  {
+    HashMerger<MAX_C, 32768, Reader> merger(paths, m_ab_vec, m_rec_min, m_save_if);
 
 #ifdef WITH_PLUGIN
     IMergePlugin* plugin = nullptr;
@@ -752,6 +1209,24 @@ public:
     }
 #endif
 
+    write(merger, out_path, m_win.get_lower(m_part_id), m_win.get_upper(m_part_id));
+
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
+    {
+      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+    }
+    else
+    {
+      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    }
+#endif
+    write_infos(*merger.get_infos());
+  }
+
+  template<typename Merger>
+  void write(Merger& merger, const std::string& out_path, uint64_t lower, uint64_t upper)
+  {
     if (m_mode == MODE::COUNT)
     {
       if (m_format == FORMAT::TEXT)
@@ -768,31 +1243,24 @@ public:
     }
     else if (m_mode == MODE::BF)
     {
-        merger.write_as_bf(out_path, m_win.get_lower(m_part_id),
-                           m_win.get_upper(m_part_id), false);
+      if (m_format == FORMAT::BLK)
+        merger.write_as_bf_blk(out_path, lower, upper);
+      else
+        merger.write_as_bf(out_path, lower, upper, false);
     }
     else if (m_mode == MODE::BFT)
     {
-        merger.write_as_bft(out_path, m_win.get_lower(m_part_id),
-                            m_win.get_upper(m_part_id), false);
+        merger.write_as_bft(out_path, lower, upper, false);
     }
     else if (m_mode == MODE::BFC)
     {
-        merger.write_as_bfc(out_path, m_win.get_lower(m_part_id),
-                            m_win.get_upper(m_part_id), m_bw, false);
+        merger.write_as_bfc(out_path, lower, upper, m_bw, false);
     }
+  }
 
-#ifdef WITH_PLUGIN
-    if (PluginManager<IMergePlugin>::get().use_plugin())
-    {
-      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
-    }
-    else
-    {
-      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
-    }
-#endif
-    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+  void write_infos(MergeStatistics<MAX_C>& infos)
+  {
+    infos.serialize(KmDir::get().get_merge_info_path(m_part_id));
 
     if (m_mode == MODE::BF || m_mode == MODE::BFT)
     {
@@ -800,17 +1268,96 @@ public:
       std::ofstream fp(fpr_path, std::ios::out); check_fstream_good(fpr_path, fp);
 
       size_t m = m_win.get_window_size_bits();
-      for (auto& n : merger.get_infos()->get_unique_w_rescue())
+      for (auto& n : infos.get_unique_w_rescue())
       {
         double fpr = bloom_fp(m, n);
         fp << std::fixed << fpr << "\n";
       }
     }
+  }
 
-    spdlog::debug("[done] - HashMergeTask - P={}", m_part_id);
+  // Row-wise outputs only, a transposed or block-compressed matrix cannot be concatenated.
+  bool splittable() const
+  {
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
+      return false;
+#endif
+    return m_mode == MODE::COUNT || m_mode == MODE::PA || m_mode == MODE::BFC ||
+           (m_mode == MODE::BF && m_format != FORMAT::BLK);
+  }
+
+  // Returns false if the partition is too small to be split, or if the files have no index.
+  template<typename Reader>
+  bool merge_by_range(std::vector<std::string>& paths, const std::string& out_path, size_t nb_threads)
+  {
+    uint64_t lower = m_win.get_lower(m_part_id);
+    uint64_t upper = m_win.get_upper(m_part_id);
+
+    size_t nb_records = 0;
+    std::vector<uint64_t> samples;
+    for (auto& path : paths)
+    {
+      Reader reader(path);
+      if (!reader.sample(samples))
+        return false;
+      nb_records += reader.nb_records();
+    }
+    size_t nb_ranges = std::min(nb_threads * 2, nb_records / min_range_records);
+    if (nb_ranges <= 1)
+      return false;
+
+    // Ranges are [bounds[i], bounds[i+1]), within the window of the partition
+    std::vector<uint64_t> bounds {lower};
+    for (auto& p : split_points(samples, nb_ranges))
+      if (p > lower && p <= upper)
+        bounds.push_back(p);
+    if (bounds.size() == 1)
+      return false;
+    bounds.push_back(upper + 1);
+    size_t nb = bounds.size() - 1;
+
+    std::vector<std::string> range_paths;
+    for (size_t i=0; i<nb; i++)
+      range_paths.push_back(fmt::format("{}.{}", out_path, i));
+    std::vector<MergeStatistics<MAX_C>> infos(nb, MergeStatistics<MAX_C>(paths.size()));
+
+    spdlog::debug("[exec] - HashMergeTask - P={} - {} ranges", m_part_id, nb);
+    merge_ranges(nb, nb_threads, [&](size_t i) {
+      HashMerger<MAX_C, 32768, Reader> merger(
+        paths, m_ab_vec, m_rec_min, m_save_if, bounds[i], bounds[i+1]);
+      write(merger, range_paths[i], bounds[i], bounds[i+1] - 1);
+      infos[i] = *merger.get_infos();
+    });
+
+    if (m_format == FORMAT::TEXT)
+      concat_range_outputs<void>(out_path, range_paths);
+    else if (m_mode == MODE::COUNT)
+      concat_range_outputs<MatrixHashFileHeader>(out_path, range_paths);
+    else if (m_mode == MODE::PA)
+      concat_range_outputs<PAHashMatrixFileHeader>(out_path, range_paths);
+    else
+    {
+      concat_range_outputs<VectorMatrixFileHeader>(out_path, range_paths);
+      // the header of the first range covers its own rows only
+      std::fstream f(out_path, std::ios::in | std::ios::out | std::ios::binary);
+      check_fstream_good(out_path, f);
+      VectorMatrixFileHeader header;
+      header.deserialize(&f);
+      header.window = upper - lower + 1;
+      f.seekp(0);
+      header.serialize(&f);
+    }
+
+    for (size_t i=1; i<nb; i++)
+      infos[0].add(infos[i]);
+    write_infos(infos[0]);
+    return true;
   }
 
 private:
+  static constexpr size_t min_range_records = 1 << 20;
+
   uint32_t m_part_id;
   std::vector<uint32_t>& m_ab_vec;
   uint32_t m_rec_min;
@@ -820,6 +1367,7 @@ private:
   FORMAT m_format;
   HashWindow& m_win;
   uint32_t m_bw;
+  bool m_stream;
 };
 
 
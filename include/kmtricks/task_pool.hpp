@@ -19,9 +19,13 @@
 #pragma once
 
 // std
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <future>
 #include <iostream>
+#include <limits>
 #include <queue>
 #include <stdexcept>
 #include <string>
@@ -33,14 +37,30 @@
 
 namespace km
 {
+
+// Work-stealing pool with task dependencies.
+// - Tasks submitted from outside the pool go to a shared priority queue (highest level first).
+// - Tasks submitted by a worker (from a callback) or released when their last dependency
+//   completes go to the back of this worker's deque, which is consumed LIFO by its owner.
+//   Idle workers take from the shared queue first, then steal from the front of the other deques.
+// - join_all() returns once every submitted task, including the ones submitted while joining,
+//   has completed.
 class TaskPool
 {
   using size_type = std::result_of<decltype (&std::thread::hardware_concurrency)()>::type;
 
+  struct worker_queue
+  {
+    std::mutex mutex;
+    std::deque<task_t> tasks;
+  };
+
  public:
   TaskPool(size_type threads)
   {
     if (threads < m_n) m_n = threads;
+    for (size_t i = 0; i < m_n; i++)
+      m_local.push_back(std::make_unique<worker_queue>());
     for (size_t i = 0; i < m_n; i++)
     {
       m_pool.push_back(std::thread(&TaskPool::worker, this, i));
@@ -80,43 +100,220 @@ class TaskPool
     if (m_pool[i].joinable()) m_pool[i].join();
   }
 
-  void add_task(task_t task)
+  // Number of workers of the calling thread's pool that have nothing to do and are not
+  // reserved, 0 outside a pool.
+  static size_t idle_workers()
+  {
+    if (!t_pool)
+      return 0;
+    int64_t idle = t_pool->idle(t_pool->m_reserved);
+    return idle > 0 ? idle : 0;
+  }
+
+  // Reserves up to max idle workers of the calling thread's pool, none outside a pool. Used by
+  // running tasks to borrow idle cores, e.g. at the end of a phase. Concurrent tasks never
+  // get the same workers, and the pool does not start new tasks on them until the reservation
+  // is destroyed.
+  class Reservation
+  {
+   public:
+    explicit Reservation(size_t max = std::numeric_limits<size_t>::max())
+      : m_pool(t_pool)
+    {
+      if (!m_pool || max == 0)
+        return;
+      std::unique_lock<std::mutex> lock(m_pool->m_queue_mutex);
+      int64_t idle = m_pool->idle(m_pool->m_reserved);
+      if (idle <= 0)
+        return;
+      m_size = std::min<size_t>(max, idle);
+      m_pool->m_reserved += m_size;
+    }
+
+    ~Reservation()
+    {
+      if (!m_size)
+        return;
+      {
+        std::unique_lock<std::mutex> lock(m_pool->m_queue_mutex);
+        m_pool->m_reserved -= m_size;
+      }
+      m_pool->m_condition.notify_all();
+    }
+
+    Reservation(const Reservation&) = delete;
+    Reservation& operator=(const Reservation&) = delete;
+
+    size_t size() const { return m_size; }
+
+   private:
+    TaskPool* m_pool;
+    size_t m_size{0};
+  };
+
+  // The task starts once all tasks in deps are completed. Dependencies must be tasks of this pool.
+  void add_task(task_t task, const std::vector<task_t>& deps = {})
+  {
+    task->in();
+    m_outstanding++;
+    task->m_pending = 1;
+    for (auto& dep : deps)
+      add_dependency(task, dep);
+    release(task);
+  }
+
+  // Adds a dependency to an already submitted task. Only valid while the task is still waiting
+  // on another dependency, e.g. from the callback of one of its dependencies.
+  void add_dependency(task_t task, task_t dep)
+  {
+    std::unique_lock<std::mutex> lock(dep->m_deps_mutex);
+    if (!dep->m_done)
+    {
+      task->m_pending++;
+      dep->m_dependents.push_back(task);
+    }
+  }
+
+ private:
+  int64_t idle(int64_t reserved) const
   {
+    return static_cast<int64_t>(m_n) - m_busy - m_ready - reserved;
+  }
+
+  void release(const task_t& task)
+  {
+    if (--task->m_pending == 0)
+      schedule(task);
+  }
+
+  void schedule(task_t task)
+  {
+    bool local = t_pool == this;
+    if (local)
+    {
+      std::unique_lock<std::mutex> lock(m_local[t_worker]->mutex);
+      m_local[t_worker]->tasks.push_back(std::move(task));
+    }
     {
       std::unique_lock<std::mutex> lock(m_queue_mutex);
-      task->in();
-      m_queue.push(task);
+      if (!local)
+        m_queue.push(std::move(task));
+      m_ready++;
     }
     m_condition.notify_one();
   }
 
- private:
-  void worker(int i)
+  task_t pop(size_t i)
+  {
+    task_t task = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(m_local[i]->mutex);
+      if (!m_local[i]->tasks.empty())
+      {
+        task = std::move(m_local[i]->tasks.back());
+        m_local[i]->tasks.pop_back();
+      }
+    }
+
+    if (!task)
+    {
+      std::unique_lock<std::mutex> lock(m_queue_mutex);
+      if (!m_queue.empty())
+      {
+        task = m_queue.top();
+        m_queue.pop();
+      }
+    }
+
+    for (size_t k = 1; k < m_n && !task; k++)
+    {
+      worker_queue& victim = *m_local[(i + k) % m_n];
+      std::unique_lock<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+      }
+    }
+
+    if (task)
+      m_ready--;
+    return task;
+  }
+
+  // The caller holds one of the m_busy slots, see worker().
+  void run(const task_t& task)
+  {
+    task->preprocess();
+    task->exec();
+    task->postprocess();
+    task->out();
+    m_busy--;
+
+    std::vector<task_t> dependents;
+    {
+      std::unique_lock<std::mutex> lock(task->m_deps_mutex);
+      task->m_done = true;
+      dependents.swap(task->m_dependents);
+    }
+    for (auto& dep : dependents)
+      release(dep);
+
+    if (--m_outstanding == 0)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+      }
+      m_condition.notify_all();
+    }
+  }
+
+  // A worker takes a slot (m_busy) before popping a task, and only while busy and reserved
+  // workers leave one free.
+  bool has_slot() const
   {
+    return m_busy + m_reserved < static_cast<int64_t>(m_n);
+  }
+
+  void worker(size_t i)
+  {
+    t_pool = this;
+    t_worker = i;
     while (true)
     {
-      task_t task;
       {
         std::unique_lock<std::mutex> lock(this->m_queue_mutex);
-        this->m_condition.wait(lock, [this] { return this->m_stop || !this->m_queue.empty(); });
-        if (this->m_stop && this->m_queue.empty()) return;
-        task = this->m_queue.top();
-        this->m_queue.pop();
+        this->m_condition.wait(lock, [this] {
+          return (this->m_stop && this->m_outstanding == 0) ||
+                 (this->m_ready > 0 && this->has_slot());
+        });
+        if (this->m_stop && this->m_outstanding == 0) return;
+        m_busy++;
       }
-      task->preprocess();
-      task->exec();
-      task->postprocess();
-      task->out();
+
+      task_t task = pop(i);
+      if (task)
+        run(task);
+      else
+        m_busy--;
     }
   }
 
  private:
   size_type m_n{std::thread::hardware_concurrency()};
   std::vector<std::thread> m_pool;
+  std::vector<std::unique_ptr<worker_queue>> m_local;
   std::priority_queue<task_t> m_queue;
   std::mutex m_queue_mutex;
   std::condition_variable m_condition;
+  std::atomic<int64_t> m_ready{0};
+  std::atomic<int64_t> m_outstanding{0};
+  std::atomic<int64_t> m_busy{0};
+  std::atomic<int64_t> m_reserved{0};
   bool m_stop{false};
+
+  static inline thread_local TaskPool* t_pool{nullptr};
+  static inline thread_local size_t t_worker{0};
 };
 
 };
@@ -80,6 +80,47 @@ public:
         "Format bloom     ", m_nb_samples, 50, Color::white, false));
   }
 
+  // Replaces --nb-partitions, --threads and --focus by the plan, before the configuration.
+  void exec_plan()
+  {
+    if (!m_opt->from.empty())
+    {
+      spdlog::warn("--plan ignored, the partitions are given by --from.");
+      return;
+    }
+
+    // the shares of the partitions are estimated on a balanced table, the run must use it
+    if (m_opt->minim_size <= 12 && m_opt->minim_type == 0)
+    {
+      if (!m_opt->repart_balance)
+        spdlog::info("--plan implies --balanced-repart.");
+      m_opt->repart_balance = true;
+    }
+    else
+    {
+      spdlog::warn("--plan assumes a balanced repartition, which requires --minimizer-size <= 12 "
+                   "and --minimizer-type 0. The partitions may be larger than planned.");
+    }
+    spdlog::info("Plan the run...");
+    bool hash = m_opt->count_format == COUNT_FORMAT::HASH;
+    uint64_t kmer_bytes = hash ? sizeof(uint64_t) : ((MAX_K + 31) / 32) * 8;
+    // --kff-output keeps the counted k-mers until the end of the count, to compact them
+    if (m_opt->kff)
+      kmer_bytes += KffCountProcessor<MAX_K, MAX_C>::bytes_per_kmer;
+    uint64_t record_bytes = (hash ? sizeof(uint64_t) : (m_opt->kmer_size * 2 + 7) / 8)
+                            + requiredC<MAX_C>::value / 8;
+
+    PlanTask<MAX_K> plan_task(m_opt->kmer_size, m_opt->minim_size, m_opt->repart_type == 1,
+                              m_opt->nb_threads, static_cast<uint64_t>(m_opt->max_memory) << 20,
+                              m_opt->max_disk << 20, kmer_bytes, record_bytes);
+    plan_task.exec();
+
+    const Plan& plan = plan_task.plan();
+    m_opt->nb_parts = plan.nb_partitions;
+    m_opt->nb_threads = plan.nb_threads;
+    m_opt->focus = plan.focus;
+  }
+
   void exec_config()
   {
     spdlog::info("Compute configuration...");
@@ -105,7 +146,7 @@ public:
   void exec_repart()
   {
     spdlog::info("Compute minimizer repartition...");
-    RepartTask<MAX_K> repart_task(m_opt->fof, m_opt->from);
+    RepartTask<MAX_K> repart_task(m_opt->fof, m_opt->from, m_opt->repart_balance, m_opt->nb_threads);
     repart_task.exec(); repart_task.postprocess();
     m_opt->m_ab_min_vec.resize(KmDir::get().m_fof.size());
     m_hw = HashWindow(KmDir::get().m_hash_win);
@@ -253,23 +294,31 @@ public:
     if (m_is_info) m_dyn[1].mark_as_completed();
   }
 
-  void exec_superk_count()
+  // Count tasks of a sample are created by the callback of its SuperKTask, once the super-k-mers
+  // are on disk. With merge, MergeTask(p) waits on all CountTask(p) and starts as soon as they are done,
+  // so counting and merging overlap across partitions.
+  void exec_superk_count(bool with_merge = false)
   {
     if (m_is_info)
     {
       m_dyn.push_back(*m_progress[2]); m_dyn[0].set_progress(0);
       m_dyn.push_back(*m_progress[3]); m_dyn[1].set_progress(0);
+      if (with_merge)
+      {
+        m_dyn.push_back(*m_progress[4]); m_dyn[2].set_progress(0);
+      }
     }
     TaskPool pool(m_opt->nb_threads);
 
-    int max_running = std::floor(m_opt->nb_threads * m_opt->focus) > 0 ? m_opt->nb_threads * m_opt->focus : 1;
+    size_t max_running = std::floor(m_opt->nb_threads * m_opt->focus) > 0 ? m_opt->nb_threads * m_opt->focus : 1;
 
+    std::vector<task_t> merges;
     for (auto id : KmDir::get().m_fof)
     {
       task_t task = std::make_shared<SuperKTask<MAX_K>>(std::get<0>(id),
                                                         m_opt->lz4,
                                                         m_opt->restrict_to_list);
-      task->set_callback([this, id, &pool](){
+      task->set_callback([this, id, &pool, &merges](){
         if (this->m_is_info)
           this->m_dyn[0].tick();
         uint32_t a_min = std::get<2>(id) == 0 ? this->m_opt->c_ab_min : std::get<2>(id);
@@ -277,8 +326,9 @@ public:
         std::string sid = std::get<0>(id);
         sk_storage_t sk_storage = std::make_shared<SuperKStorageReader>(KmDir::get().get_superk_path(sid));
         parti_info_t pinfos = std::make_shared<PartiInfo<5>>(KmDir::get().get_superk_path(sid));
-        for (auto& p : this->m_opt->restrict_to_list)
+        for (size_t j=0; j<this->m_opt->restrict_to_list.size(); j++)
         {
+          uint32_t p = this->m_opt->restrict_to_list[j];
           std::string path;
           task_t task = nullptr;
           if (m_opt->count_format == COUNT_FORMAT::KMER)
@@ -313,7 +363,7 @@ public:
               task = std::make_shared<HashCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
                 path, m_config, sk_storage, pinfos, p, iid,
                 m_hw.get_window_size_bits(), m_config._kmerSize, a_min, m_opt->lz4,
-                get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp);
+                get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp, this->m_stream);
             }
             else
             {
@@ -331,27 +381,34 @@ public:
             ProgressBar* ptr = &this->m_dyn[1];
             task->set_callback([ptr](){ ptr->tick(); });
           }
+          if (!merges.empty())
+            pool.add_dependency(merges[j], task);
           pool.add_task(task);
         }
       });
+      task->set_level(5);
+      m_superk.push_back(task);
+    }
 
-      while (superk_in() >= max_running)
+    // Merges are submitted first, their dependencies on count tasks are added by the
+    // SuperKTask callbacks, which run before the SuperKTask is marked as completed.
+    if (with_merge)
+    {
+      for (auto& p : m_opt->restrict_to_list)
       {
-        if (max_running == m_opt->nb_threads)
-        {
-          max_running /= 2;
-          if (!(max_running > 0)) max_running = 1;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        merges.push_back(make_merge_task(p));
+        pool.add_task(merges.back(), m_superk);
       }
-      task->set_level(5);
-      m_superk.push_back(task);
-      spdlog::debug("[push] - SuperKTask - S={}", std::get<0>(id));
-      pool.add_task(task);
     }
-    while (superk_finish() != m_nb_samples)
+
+    // At most max_running SuperKTask in flight: each one waits for the one submitted max_running before.
+    for (size_t i=0; i<m_superk.size(); i++)
     {
-      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      spdlog::debug("[push] - SuperKTask - S={}", KmDir::get().m_fof.get_id(i));
+      if (i >= max_running)
+        pool.add_task(m_superk[i], {m_superk[i - max_running]});
+      else
+        pool.add_task(m_superk[i]);
     }
     pool.join_all();
 
@@ -365,35 +422,25 @@ public:
       m_dyn[0].mark_as_completed();
   }
 
-  size_t superk_finish()
-  {
-    size_t count = 0;
-    for (auto& e : m_superk)
-    {
-      if (e->finish()) count++;
-    }
-    return count;
-  }
-
-  size_t superk_running()
+  task_t make_merge_task(uint32_t p)
   {
-    size_t count = 0;
-    for (auto& e : m_superk)
+    task_t task = nullptr;
+    if (m_opt->count_format == COUNT_FORMAT::KMER)
     {
-      if (e->running()) count++;
+      spdlog::debug("[push] - KmerMergeTask - P={}", p);
+      task = std::make_shared<KmerMergeTask<MAX_K, MAX_C>>(
+        p, m_opt->m_ab_min_vec, m_config._kmerSize, m_opt->r_min, m_opt->save_if,
+        m_opt->lz4, m_opt->mode, m_opt->format, !m_opt->keep_tmp);
     }
-    return count;
-  }
-
-
-  int superk_in()
-  {
-    int count = 0;
-    for (auto& e : m_superk)
+    else if (m_opt->count_format == COUNT_FORMAT::HASH)
     {
-      if (e->in_queue()) count++;
+      spdlog::debug("[push] - HashMergeTask - P={}", p);
+      task = std::make_shared<HashMergeTask<MAX_C>>(
+        p, m_opt->m_ab_min_vec, m_opt->r_min, m_opt->save_if, m_opt->lz4, m_opt->mode,
+        m_opt->format, m_hw, !m_opt->keep_tmp, m_opt->bwidth, m_stream);
     }
-    return count;
+    if (m_is_info) task->set_callback([this](){ this->m_dyn[2].tick(); });
+    return task;
   }
 
   void exec_merge()
@@ -410,25 +457,7 @@ public:
     }
     TaskPool pool(m_opt->nb_threads);
     for (auto& p : m_opt->restrict_to_list)
-    {
-      task_t task = nullptr;
-      if (m_opt->count_format == COUNT_FORMAT::KMER)
-      {
-        spdlog::debug("[push] - KmerMergeTask - P={}", p);
-        task = std::make_shared<KmerMergeTask<MAX_K, MAX_C>>(
-          p, m_opt->m_ab_min_vec, m_config._kmerSize, m_opt->r_min, m_opt->save_if,
-          m_opt->lz4, m_opt->mode, m_opt->format, !m_opt->keep_tmp);
-      }
-      else if (m_opt->count_format == COUNT_FORMAT::HASH)
-      {
-        spdlog::debug("[push] - HashMergeTask - P={}", p);
-        task = std::make_shared<HashMergeTask<MAX_C>>(
-          p, m_opt->m_ab_min_vec, m_opt->r_min, m_opt->save_if, m_opt->lz4, m_opt->mode,
-          m_opt->format, m_hw, !m_opt->keep_tmp, m_opt->bwidth);
-      }
-      if (m_is_info) task->set_callback([this](){ this->m_dyn[2].tick(); });
-      pool.add_task(task);
-    }
+      pool.add_task(make_merge_task(p));
     pool.join_all();
     if (m_is_info)
       m_dyn[2].mark_as_completed();
@@ -502,9 +531,15 @@ public:
   {
     Timer whole_time;
 
+    if (m_opt->plan)
+      exec_plan();
     exec_config();
     exec_repart();
 
+    // Merge thresholds computed from histograms need all counts, in this case merge runs after.
+    bool overlap_merge = m_opt->until != COMMAND::COUNT && !m_opt->skip_merge && !m_opt->kff
+                         && !m_opt->m_ab_float;
+
     if (m_opt->until == COMMAND::REPART)
       goto end;
 
@@ -514,14 +549,26 @@ public:
       goto end;
     }
 
-    exec_superk_count();
+    if (m_opt->stream_mem > 0)
+    {
+      m_stream = true;
+      RunStore::get().set_budget(m_opt->stream_mem * 1024 * 1024);
+    }
+
+    exec_superk_count(overlap_merge);
 
     if (m_opt->until == COMMAND::COUNT)
       goto end;
 
     if (!m_opt->skip_merge && !m_opt->kff)
     {
-      exec_merge();
+      if (!overlap_merge)
+        exec_merge();
+      else if (m_is_info)
+        m_dyn[2].mark_as_completed();
+
+      if (m_stream)
+        spdlog::info("Streaming merge: {} run(s) spilled to disk.", RunStore::get().spilled());
 
       if (m_opt->until == COMMAND::MERGE)
         goto end;
@@ -555,6 +602,7 @@ public:
   size_t m_nb_samples;
   HashWindow m_hw;
   bool m_is_info {false};
+  bool m_stream {false};
 
   std::vector<ProgressBar*> m_progress;
   DynamicProgress<ProgressBar> m_dyn;
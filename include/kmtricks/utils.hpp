@@ -23,9 +23,11 @@
 #include <sstream>
 #include <climits>
 #include <thread>
+#include <mutex>
 #include <condition_variable>
 #include <queue>
 #include <vector>
+#include <algorithm>
 #include <unistd.h>
 #include <functional>
 #include <filesystem>
@@ -308,6 +310,61 @@ private:
   bool m_stop {false};
 };
 
+// Blocking queue between a producer and several consumers, push() waits while
+// the queue is full. After close(), push() returns false and pop() drains the
+// queue then returns false.
+template<typename T>
+class BoundedQueue
+{
+public:
+  BoundedQueue(size_t capacity) : m_capacity(std::max<size_t>(capacity, 1)) {}
+
+  bool push(T&& item)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_not_full.wait(lock, [this]{return this->m_closed || this->m_queue.size() < this->m_capacity;});
+      if (m_closed)
+        return false;
+      m_queue.push(std::move(item));
+    }
+    m_not_empty.notify_one();
+    return true;
+  }
+
+  bool pop(T& item)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_not_empty.wait(lock, [this]{return this->m_closed || !this->m_queue.empty();});
+      if (m_queue.empty())
+        return false;
+      item = std::move(m_queue.front());
+      m_queue.pop();
+    }
+    m_not_full.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_closed = true;
+    }
+    m_not_empty.notify_all();
+    m_not_full.notify_all();
+  }
+
+private:
+  size_t m_capacity;
+  std::mutex m_mutex;
+  std::condition_variable m_not_full;
+  std::condition_variable m_not_empty;
+  std::queue<T> m_queue;
+  bool m_closed {false};
+};
+
 template<size_t C>
 struct requiredC
 {
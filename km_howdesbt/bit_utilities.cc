@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <algorithm>  // (for std::min)
+#include <cstring>    // (for std::memcpy)
 
 #include "bit_utilities.h"
 
@@ -38,6 +39,688 @@ static const u8 popCount8[256] =
 	4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8
 	};
 
+//----------
+//
+// bitwise kernels --
+//	The bitwise operations and counts are written once as templates over the
+//	logical operation, and instantiated for each kernel. The kernel used is
+//	chosen at runtime, see bitwise_set_kernel().
+//
+//	  kernel   counts                          operations
+//	  ------   -----------------------------   ---------------------------
+//	  scalar   64-bit words, software popcount 64-bit words
+//	  popcnt   64-bit words, POPCNT            64-bit words
+//	  avx2     256-bit Harley-Seal carry-save  256-bit words
+//	           adder, nibble lookup popcount
+//	  bmi2     as avx2                         as avx2, and PEXT/PDEP for
+//	                                           squeeze and unsqueeze
+//
+//	Whatever the kernel, the last partial chunk of a bit array is processed
+//	byte-by-byte, so that we do not access any bytes beyond the bit arrays.
+//
+//----------
+
+#if defined(__x86_64__) || defined(__i386__)
+#define bitwise_have_x86
+#include <immintrin.h>
+#define avx2_target   __attribute__((target("avx2")))
+#define popcnt_target __attribute__((target("popcnt")))
+#define bmi2_target   __attribute__((target("bmi2,popcnt")))
+#define bmi2_flatten  __attribute__((target("bmi2,popcnt"),flatten))
+#endif
+
+static int best_kernel (void);
+
+static int activeKernel = best_kernel();
+
+// logical operations; opFirst is used to count the bits of a single array
+
+struct opFirst
+	{
+	static inline u64 apply (const u64 a, const u64) { return a; }
+#ifdef bitwise_have_x86
+	avx2_target static inline __m256i apply (const __m256i a, const __m256i) { return a; }
+#endif
+	};
+
+struct opAnd
+	{
+	static inline u64 apply (const u64 a, const u64 b) { return a & b; }
+#ifdef bitwise_have_x86
+	avx2_target static inline __m256i apply (const __m256i a, const __m256i b) { return _mm256_and_si256(a,b); }
+#endif
+	};
+
+struct opMask
+	{
+	static inline u64 apply (const u64 a, const u64 b) { return a & ~b; }
+#ifdef bitwise_have_x86
+	avx2_target static inline __m256i apply (const __m256i a, const __m256i b) { return _mm256_andnot_si256(b,a); }
+#endif
+	};
+
+struct opOr
+	{
+	static inline u64 apply (const u64 a, const u64 b) { return a | b; }
+#ifdef bitwise_have_x86
+	avx2_target static inline __m256i apply (const __m256i a, const __m256i b) { return _mm256_or_si256(a,b); }
+#endif
+	};
+
+struct opOrNot
+	{
+	static inline u64 apply (const u64 a, const u64 b) { return a | ~b; }
+#ifdef bitwise_have_x86
+	avx2_target static inline __m256i apply (const __m256i a, const __m256i b)
+		{ return _mm256_or_si256(a,_mm256_xor_si256(b,_mm256_set1_epi32(-1))); }
+#endif
+	};
+
+struct opXor
+	{
+	static inline u64 apply (const u64 a, const u64 b) { return a ^ b; }
+#ifdef bitwise_have_x86
+	avx2_target static inline __m256i apply (const __m256i a, const __m256i b) { return _mm256_xor_si256(a,b); }
+#endif
+	};
+
+struct opXnor
+	{
+	static inline u64 apply (const u64 a, const u64 b) { return ~(a ^ b); }
+#ifdef bitwise_have_x86
+	avx2_target static inline __m256i apply (const __m256i a, const __m256i b)
+		{ return _mm256_xor_si256(_mm256_xor_si256(a,b),_mm256_set1_epi32(-1)); }
+#endif
+	};
+
+//----------
+//
+// scalar kernel
+//
+//----------
+
+// word loads and stores; the bit arrays are not necessarily 64-bit aligned
+
+static inline u64 load_word (const u8* p)
+	{ u64 w;  std::memcpy(&w,p,sizeof(w));  return w; }
+
+static inline void store_word (u8* p, const u64 w)
+	{ std::memcpy(p,&w,sizeof(w)); }
+
+
+static inline u64 scalar_pop_count (u64 x)
+	{
+	x = x - ((x >> 1) & 0x5555555555555555);
+	x = (x & 0x3333333333333333) + ((x >> 2) & 0x3333333333333333);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0F;
+	return (x * 0x0101010101010101) >> 56;
+	}
+
+
+template<class op>
+static inline u64 tail_count
+   (const u8*	scan1,
+	const u8*	scan2,
+	u64			n)
+	{
+	u64			numOnes = 0;
+
+	for ( ; n>=8 ; n-=8)
+		numOnes += popCount8[(u8) op::apply(*(scan1++),*(scan2++))];
+
+	if (n == 0) return numOnes;
+
+	u8 mask = least_significant(u8,n);
+	numOnes += popCount8[((u8) op::apply(*scan1,*scan2)) & mask];
+
+	return numOnes;
+	}
+
+
+template<class op>
+static u64 scalar_count
+   (const u8*	scan1,
+	const u8*	scan2,
+	u64			n)
+	{
+	u64			numOnes = 0;
+
+	for ( ; n>=64 ; n-=64,scan1+=8,scan2+=8)
+		numOnes += scalar_pop_count(op::apply(load_word(scan1),load_word(scan2)));
+
+	return numOnes + tail_count<op>(scan1,scan2,n);
+	}
+
+
+template<class op>
+static void scalar_binary
+   (const u8*	scan1,
+	const u8*	scan2,
+	u8*			dst,
+	u64			n)
+	{
+	for ( ; n>=64 ; n-=64,scan1+=8,scan2+=8,dst+=8)
+		store_word(dst,op::apply(load_word(scan1),load_word(scan2)));
+
+	for ( ; n>=8 ; n-=8)
+		*(dst++) = (u8) op::apply(*(scan1++),*(scan2++));
+
+	if (n == 0) return;
+
+	u8 mask = least_significant(u8,n);
+	*dst = ((u8) op::apply(*scan1,*scan2)) & mask;  // leftover bits intentionally set to zero
+	}
+
+
+template<class op>
+static void scalar_binary_in_place
+   (u8*			dst,
+	const u8*	scan2,
+	u64			n)
+	{
+	for ( ; n>=64 ; n-=64,scan2+=8,dst+=8)
+		store_word(dst,op::apply(load_word(dst),load_word(scan2)));
+
+	for ( ; n>=8 ; n-=8,dst++)
+		*dst = (u8) op::apply(*dst,*(scan2++));
+
+	if (n == 0) return;
+
+	u8 mask = least_significant(u8,n);
+	*dst = (((u8) op::apply(*dst,*scan2)) & mask) | (*dst & ~mask);
+	}
+
+//----------
+//
+// popcnt and avx2 kernels
+//
+//----------
+
+#ifdef bitwise_have_x86
+
+template<class op>
+popcnt_target static u64 popcnt_count
+   (const u8*	scan1,
+	const u8*	scan2,
+	u64			n)
+	{
+	u64			numOnes = 0;
+
+	for ( ; n>=256 ; n-=256,scan1+=32,scan2+=32)
+		{
+		numOnes += __builtin_popcountll(op::apply(load_word(scan1+0),load_word(scan2+0)));
+		numOnes += __builtin_popcountll(op::apply(load_word(scan1+8),load_word(scan2+8)));
+		numOnes += __builtin_popcountll(op::apply(load_word(scan1+16),load_word(scan2+16)));
+		numOnes += __builtin_popcountll(op::apply(load_word(scan1+24),load_word(scan2+24)));
+		}
+
+	for ( ; n>=64 ; n-=64,scan1+=8,scan2+=8)
+		numOnes += __builtin_popcountll(op::apply(load_word(scan1),load_word(scan2)));
+
+	return numOnes + tail_count<op>(scan1,scan2,n);
+	}
+
+
+// avx2_pop_count--
+//	count the 1s in each byte with a nibble lookup, then sum the bytes of
+//	each 64-bit lane
+
+avx2_target static inline __m256i avx2_pop_count (const __m256i v)
+	{
+	const __m256i lookup  = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+	                                         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+	const __m256i lowMask = _mm256_set1_epi8(0x0F);
+	__m256i lo = _mm256_and_si256(v,lowMask);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v,4),lowMask);
+	__m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup,lo),
+	                                 _mm256_shuffle_epi8(lookup,hi));
+	return _mm256_sad_epu8(counts,_mm256_setzero_si256());
+	}
+
+
+// avx2_csa--
+//	carry-save adder, (h,l) = a+b+c for each bit position
+
+avx2_target static inline void avx2_csa
+   (__m256i&		h,
+	__m256i&		l,
+	const __m256i	a,
+	const __m256i	b,
+	const __m256i	c)
+	{
+	const __m256i u = _mm256_xor_si256(a,b);
+	h = _mm256_or_si256(_mm256_and_si256(a,b),_mm256_and_si256(u,c));
+	l = _mm256_xor_si256(u,c);
+	}
+
+
+template<class op>
+avx2_target static inline __m256i avx2_load
+   (const u8*	scan1,
+	const u8*	scan2,
+	const u64	block)
+	{
+	return op::apply(_mm256_loadu_si256((const __m256i*)(scan1+32*block)),
+	                 _mm256_loadu_si256((const __m256i*)(scan2+32*block)));
+	}
+
+
+// avx2_count--
+//	count the 1s in numBlocks 256-bit blocks; sixteen blocks at a time are
+//	reduced by a tree of carry-save adders (Harley-Seal) so that only one
+//	in sixteen blocks goes through the popcount
+
+template<class op>
+avx2_target static u64 avx2_count
+   (const u8*	scan1,
+	const u8*	scan2,
+	const u64	numBlocks)
+	{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i		total = zero;
+	__m256i		ones = zero, twos = zero, fours = zero, eights = zero, sixteens;
+	__m256i		twosA, twosB, foursA, foursB, eightsA, eightsB;
+	u64			i;
+
+	for (i=0 ; i+16<=numBlocks ; i+=16)
+		{
+		avx2_csa(twosA,ones,ones,avx2_load<op>(scan1,scan2,i),avx2_load<op>(scan1,scan2,i+1));
+		avx2_csa(twosB,ones,ones,avx2_load<op>(scan1,scan2,i+2),avx2_load<op>(scan1,scan2,i+3));
+		avx2_csa(foursA,twos,twos,twosA,twosB);
+		avx2_csa(twosA,ones,ones,avx2_load<op>(scan1,scan2,i+4),avx2_load<op>(scan1,scan2,i+5));
+		avx2_csa(twosB,ones,ones,avx2_load<op>(scan1,scan2,i+6),avx2_load<op>(scan1,scan2,i+7));
+		avx2_csa(foursB,twos,twos,twosA,twosB);
+		avx2_csa(eightsA,fours,fours,foursA,foursB);
+		avx2_csa(twosA,ones,ones,avx2_load<op>(scan1,scan2,i+8),avx2_load<op>(scan1,scan2,i+9));
+		avx2_csa(twosB,ones,ones,avx2_load<op>(scan1,scan2,i+10),avx2_load<op>(scan1,scan2,i+11));
+		avx2_csa(foursA,twos,twos,twosA,twosB);
+		avx2_csa(twosA,ones,ones,avx2_load<op>(scan1,scan2,i+12),avx2_load<op>(scan1,scan2,i+13));
+		avx2_csa(twosB,ones,ones,avx2_load<op>(scan1,scan2,i+14),avx2_load<op>(scan1,scan2,i+15));
+		avx2_csa(foursB,twos,twos,twosA,twosB);
+		avx2_csa(eightsB,fours,fours,foursA,foursB);
+		avx2_csa(sixteens,eights,eights,eightsA,eightsB);
+		total = _mm256_add_epi64(total,avx2_pop_count(sixteens));
+		}
+
+	total = _mm256_slli_epi64(total,4);
+	total = _mm256_add_epi64(total,_mm256_slli_epi64(avx2_pop_count(eights),3));
+	total = _mm256_add_epi64(total,_mm256_slli_epi64(avx2_pop_count(fours),2));
+	total = _mm256_add_epi64(total,_mm256_slli_epi64(avx2_pop_count(twos),1));
+	total = _mm256_add_epi64(total,avx2_pop_count(ones));
+
+	for ( ; i<numBlocks ; i++)
+		total = _mm256_add_epi64(total,avx2_pop_count(avx2_load<op>(scan1,scan2,i)));
+
+	u64 lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes,total);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+
+// avx2_binary--
+//	apply the operation to numBlocks 256-bit blocks; dst may be the same as
+//	scan1 (in place operation)
+
+template<class op>
+avx2_target static void avx2_binary
+   (const u8*	scan1,
+	const u8*	scan2,
+	u8*			dst,
+	const u64	numBlocks)
+	{
+	for (u64 i=0 ; i<numBlocks ; i++)
+		_mm256_storeu_si256((__m256i*)(dst+32*i),avx2_load<op>(scan1,scan2,i));
+	}
+
+#endif // bitwise_have_x86
+
+//----------
+//
+// kernel dispatch
+//
+//----------
+
+template<class op>
+static u64 op_count
+   (const void*	bits1,
+	const void*	bits2,
+	const u64	numBits)
+	{
+	const u8*	scan1 = (const u8*) bits1;
+	const u8*	scan2 = (const u8*) bits2;
+
+#ifdef bitwise_have_x86
+	if (activeKernel >= bitwise_kernel_avx2)
+		{
+		u64 numBlocks = numBits / 256;
+		u64 numOnes   = avx2_count<op>(scan1,scan2,numBlocks);
+		return numOnes + popcnt_count<op>(scan1+32*numBlocks,scan2+32*numBlocks,numBits-256*numBlocks);
+		}
+	if (activeKernel == bitwise_kernel_popcnt)
+		return popcnt_count<op>(scan1,scan2,numBits);
+#endif
+
+	return scalar_count<op>(scan1,scan2,numBits);
+	}
+
+
+template<class op>
+static void binary_op
+   (const void*	bits1,
+	const void*	bits2,
+	void*		dstBits,
+	const u64	numBits)
+	{
+	const u8*	scan1 = (const u8*) bits1;
+	const u8*	scan2 = (const u8*) bits2;
+	u8*			dst   = (u8*) dstBits;
+	u64			n     = numBits;
+
+#ifdef bitwise_have_x86
+	if (activeKernel >= bitwise_kernel_avx2)
+		{
+		u64 numBlocks = n / 256;
+		avx2_binary<op>(scan1,scan2,dst,numBlocks);
+		scan1 += 32*numBlocks;  scan2 += 32*numBlocks;  dst += 32*numBlocks;
+		n     -= 256*numBlocks;
+		}
+#endif
+
+	scalar_binary<op>(scan1,scan2,dst,n);
+	}
+
+
+template<class op>
+static void binary_op_in_place
+   (void*		dstBits,
+	const void*	bits2,
+	const u64	numBits)
+	{
+	const u8*	scan2 = (const u8*) bits2;
+	u8*			dst   = (u8*) dstBits;
+	u64			n     = numBits;
+
+#ifdef bitwise_have_x86
+	if (activeKernel >= bitwise_kernel_avx2)
+		{
+		u64 numBlocks = n / 256;
+		avx2_binary<op>(dst,scan2,dst,numBlocks);
+		scan2 += 32*numBlocks;  dst += 32*numBlocks;
+		n     -= 256*numBlocks;
+		}
+#endif
+
+	scalar_binary_in_place<op>(dst,scan2,n);
+	}
+
+//----------
+//
+// squeeze kernels --
+//	bitwise_squeeze and bitwise_unsqueeze process full 64-bit chunks with an
+//	extract (PEXT) or a deposit (PDEP) of the src chunk under the spec chunk.
+//	The bmi2 kernel uses the BMI2 instructions, the other kernels a loop over
+//	the 1s of the spec chunk. A chunk in which the src underruns or the dst
+//	overruns stops the chunk loop, and is left to the bit-by-bit loop of the
+//	caller.
+//
+//----------
+
+static inline u64 low_bits (const u64 numBits)
+	{ return (numBits >= 64)? ((u64) -1) : (((u64) 1) << numBits) - 1; }
+
+
+struct softBits
+	{
+	static inline u64 count (const u64 x) { return scalar_pop_count(x); }
+
+	static inline u64 extract (const u64 src, u64 mask)
+		{
+		u64 bits = 0;
+		for (u64 b=1 ; mask!=0 ; b<<=1,mask&=mask-1)
+			{ if ((src & mask & -mask) != 0) bits |= b; }
+		return bits;
+		}
+
+	static inline u64 deposit (const u64 src, u64 mask)
+		{
+		u64 bits = 0;
+		for (u64 b=1 ; mask!=0 ; b<<=1,mask&=mask-1)
+			{ if ((src & b) != 0) bits |= mask & -mask; }
+		return bits;
+		}
+	};
+
+#ifdef bitwise_have_x86
+
+struct bmi2Bits
+	{
+	bmi2_target static inline u64 count   (const u64 x)                    { return __builtin_popcountll(x); }
+	bmi2_target static inline u64 extract (const u64 src, const u64 mask) { return _pext_u64(src,mask); }
+	bmi2_target static inline u64 deposit (const u64 src, const u64 mask) { return _pdep_u64(src,mask); }
+	};
+
+#endif // bitwise_have_x86
+
+
+template<class bitOps>
+static void squeeze_chunks
+   (u64*&		src,
+	u64*&		scan,
+	u64*&		dst,
+	u64&		n,
+	u64&		dstChunk,
+	u64&		bitsInChunk,
+	u64&		bitsInDst,
+	const u64	numDstBits)
+	{
+	for ( ; n>=64 ; n-=64)
+		{
+		u64 specChunk = *scan;
+		u64 numSpec   = bitOps::count(specChunk);
+		if ((bitsInChunk+numSpec >= 64) && (bitsInDst+64 > numDstBits))
+			break;
+
+		u64 packed = bitOps::extract(*src,specChunk);
+		scan++;  src++;
+
+		dstChunk    |= packed << bitsInChunk;
+		bitsInChunk += numSpec;
+		if (bitsInChunk >= 64)
+			{
+			*(dst++) = dstChunk;
+			bitsInChunk -= 64;
+			bitsInDst   += 64;
+			dstChunk    =  (bitsInChunk == 0)? 0 : packed >> (numSpec-bitsInChunk);
+			}
+		}
+	}
+
+
+template<class bitOps>
+static void unsqueeze_chunks
+   (u64*&		src,
+	u8*&		srcb,
+	u64*&		scan,
+	u64*&		dst,
+	u64&		n,
+	u64&		srcChunk,
+	u64&		bitsInSrcChunk,
+	u64&		bitsInSrc,
+	u64&		bitsInDst,
+	const u64	numDstBits)
+	{
+	for ( ; n>=64 ; n-=64)
+		{
+		u64 specChunk = *scan;
+		u64 numSpec   = bitOps::count(specChunk);
+		if ((numSpec > bitsInSrc) || (bitsInDst+64 > numDstBits))
+			break;
+
+		// collect numSpec bits from src; src is read the same way as in the
+		// bit-by-bit loop, so that we don't read any further than it does
+
+		u64 bits = 0;
+		for (u64 got=0 ; got<numSpec ; )
+			{
+			if (bitsInSrcChunk == 0)
+				{
+				if (bitsInSrc >= 64)
+					{
+					srcChunk       = *(src++);
+					bitsInSrcChunk = 64;
+					}
+				else
+					{
+					if (srcb == nullptr) srcb = (u8*) src;
+					srcChunk = *(srcb++);
+					bitsInSrcChunk = 8;
+					}
+				}
+
+			u64 take = std::min(numSpec-got,bitsInSrcChunk);
+			bits           |= (srcChunk & low_bits(take)) << got;
+			srcChunk       =  (take == 64)? 0 : srcChunk >> take;
+			bitsInSrcChunk -= take;
+			bitsInSrc      -= take;
+			got            += take;
+			}
+
+		*(dst++) = bitOps::deposit(bits,specChunk);
+		scan++;
+		bitsInDst += 64;
+		}
+	}
+
+
+#ifdef bitwise_have_x86
+
+// (flatten, so that the bmi2Bits functions are inlined into the chunk loops)
+
+bmi2_flatten static void bmi2_squeeze_chunks
+   (u64*&		src,
+	u64*&		scan,
+	u64*&		dst,
+	u64&		n,
+	u64&		dstChunk,
+	u64&		bitsInChunk,
+	u64&		bitsInDst,
+	const u64	numDstBits)
+	{
+	squeeze_chunks<bmi2Bits>(src,scan,dst,n,dstChunk,bitsInChunk,bitsInDst,numDstBits);
+	}
+
+
+bmi2_flatten static void bmi2_unsqueeze_chunks
+   (u64*&		src,
+	u8*&		srcb,
+	u64*&		scan,
+	u64*&		dst,
+	u64&		n,
+	u64&		srcChunk,
+	u64&		bitsInSrcChunk,
+	u64&		bitsInSrc,
+	u64&		bitsInDst,
+	const u64	numDstBits)
+	{
+	unsqueeze_chunks<bmi2Bits>(src,srcb,scan,dst,n,srcChunk,bitsInSrcChunk,bitsInSrc,bitsInDst,numDstBits);
+	}
+
+#endif // bitwise_have_x86
+
+//----------
+//
+// bitwise_kernel_supported, bitwise_set_kernel, bitwise_get_kernel,
+// bitwise_kernel_name --
+//	Select the kernel used by the bitwise operations and counts.
+//
+//----------
+//
+// Arguments (bitwise_kernel_supported, bitwise_set_kernel):
+//	int		kernel:	One of bitwise_kernel_scalar, bitwise_kernel_popcnt,
+//					.. bitwise_kernel_avx2, bitwise_kernel_bmi2 or
+//					.. bitwise_kernel_auto. The auto kernel is the fastest
+//					.. one supported by the cpu.
+//
+// Returns (bitwise_set_kernel):
+//	True if the kernel is supported by the cpu (and is now the active kernel);
+//	false otherwise (the active kernel is unchanged).
+//
+//----------
+//
+// Notes:
+//	(1)	The auto kernel is selected at startup. bitwise_set_kernel() is meant
+//		for tests and benchmarks, and must not be called while other threads
+//		use the bitwise functions.
+//	(2)	PEXT and PDEP are microcoded on AMD cpus before Zen 3, and much
+//		slower than the loop over the spec bits. The auto kernel never
+//		selects bmi2 on those cpus.
+//
+//----------
+
+bool bitwise_kernel_supported
+   (const int	kernel)
+	{
+	if ((kernel == bitwise_kernel_scalar) || (kernel == bitwise_kernel_auto))
+		return true;
+
+#ifdef bitwise_have_x86
+	__builtin_cpu_init();
+	if (kernel == bitwise_kernel_popcnt)
+		return __builtin_cpu_supports("popcnt");
+	if (kernel == bitwise_kernel_avx2)
+		return __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("avx2");
+	if (kernel == bitwise_kernel_bmi2)
+		return __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("avx2")
+		    && __builtin_cpu_supports("bmi2");
+#endif
+
+	return false;
+	}
+
+
+static int best_kernel (void)
+	{
+#ifdef bitwise_have_x86
+	__builtin_cpu_init();
+	bool slowBmi2 = __builtin_cpu_is("znver1") || __builtin_cpu_is("znver2");
+	if ((!slowBmi2) && bitwise_kernel_supported(bitwise_kernel_bmi2))
+		return bitwise_kernel_bmi2;
+#endif
+	if (bitwise_kernel_supported(bitwise_kernel_avx2))   return bitwise_kernel_avx2;
+	if (bitwise_kernel_supported(bitwise_kernel_popcnt)) return bitwise_kernel_popcnt;
+	return bitwise_kernel_scalar;
+	}
+
+
+bool bitwise_set_kernel
+   (const int	kernel)
+	{
+	if (!bitwise_kernel_supported(kernel)) return false;
+	activeKernel = (kernel == bitwise_kernel_auto)? best_kernel() : kernel;
+	return true;
+	}
+
+
+int bitwise_get_kernel (void)
+	{
+	return activeKernel;
+	}
+
+
+const char* bitwise_kernel_name
+   (const int	kernel)
+	{
+	switch (kernel)
+		{
+		case bitwise_kernel_scalar: return "scalar";
+		case bitwise_kernel_popcnt: return "popcnt";
+		case bitwise_kernel_avx2:   return "avx2";
+		case bitwise_kernel_bmi2:   return "bmi2";
+		case bitwise_kernel_auto:   return "auto";
+		default:                    return "unknown";
+		}
+	}
+
 //----------
 //
 // bitwise_is_all_zeros, bitwise_is_all_ones --
@@ -184,9 +867,10 @@ void bitwise_copy
 //	(1)	The number of bytes in the bit arrays is ceil(numBits/8). When numBits
 //		is not a multiple of 8, the remaining bits are read from the least
 //		significant bits of the final byte.
-//	(2)	We process the bytes in 64-bit chunks until we get to the final chunk.
-//		The final chunk is processed byte-by-byte, so that we do not access
-//		any bytes beyond the bit arrays.
+//	(2)	We process the bytes in 256-bit or 64-bit chunks, depending on the
+//		active kernel, until we get to the final chunk. The final chunk is
+//		processed byte-by-byte, so that we do not access any bytes beyond the
+//		bit arrays.
 //	(3)	Equivalences to set operations:
 //		  function        logic operation   set operation
 //		  ------------    ---------------   --------------------
@@ -205,26 +889,7 @@ void bitwise_and
 	void*		dstBits,
 	const u64	numBits)
 	{
-	u64*		scan1 = (u64*) bits1;
-	u64*		scan2 = (u64*) bits2;
-	u64*		dst   = (u64*) dstBits;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64)
-		*(dst++) = *(scan1++) & *(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan1b = (u8*) scan1;
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8)
-		*(dstb++) = *(scan1b++) & *(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = (*scan1b & *scan2b) & mask;  // leftover bits intentionally set to zero
+	binary_op<opAnd>(bits1,bits2,dstBits,numBits);
 	}
 
 
@@ -233,24 +898,7 @@ void bitwise_and
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u64*		dst   = (u64*) dstBits;
-	u64*		scan2 = (u64*) bits2;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64,dst++)
-		*dst &= *(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8,dstb++)
-		*dstb &= *(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = ((*dstb & *scan2b) & mask) | (*dstb & ~mask);
+	binary_op_in_place<opAnd>(dstBits,bits2,numBits);
 	}
 
 
@@ -260,26 +908,7 @@ void bitwise_mask
 	void*		dstBits,
 	const u64	numBits)
 	{
-	u64*		scan1 = (u64*) bits1;
-	u64*		scan2 = (u64*) bits2;
-	u64*		dst   = (u64*) dstBits;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64)
-		*(dst++) = *(scan1++) & ~*(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan1b = (u8*) scan1;
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8)
-		*(dstb++) = *(scan1b++) & ~*(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = (*scan1b & ~*scan2b) & mask;  // leftover bits intentionally set to zero
+	binary_op<opMask>(bits1,bits2,dstBits,numBits);
 	}
 
 
@@ -288,24 +917,7 @@ void bitwise_mask
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u64*		dst   = (u64*) dstBits;
-	u64*		scan2 = (u64*) bits2;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64,dst++)
-		*dst &= ~*(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8,dstb++)
-		*dstb &= ~*(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = ((*dstb & ~*scan2b) & mask) | (*dstb & ~mask);
+	binary_op_in_place<opMask>(dstBits,bits2,numBits);
 	}
 
 
@@ -315,26 +927,7 @@ void bitwise_or
 	void*		dstBits,
 	const u64	numBits)
 	{
-	u64*		scan1 = (u64*) bits1;
-	u64*		scan2 = (u64*) bits2;
-	u64*		dst   = (u64*) dstBits;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64)
-		*(dst++) = *(scan1++) | *(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan1b = (u8*) scan1;
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8)
-		*(dstb++) = *(scan1b++) | *(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = (*scan1b | *scan2b) & mask;  // leftover bits intentionally set to zero
+	binary_op<opOr>(bits1,bits2,dstBits,numBits);
 	}
 
 
@@ -343,24 +936,7 @@ void bitwise_or
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u64*		dst   = (u64*) dstBits;
-	u64*		scan2 = (u64*) bits2;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64,dst++)
-		*dst |= *(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8,dstb++)
-		*dstb |= *(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = ((*dstb | *scan2b) & mask) | (*dstb & ~mask);
+	binary_op_in_place<opOr>(dstBits,bits2,numBits);
 	}
 
 
@@ -370,26 +946,7 @@ void bitwise_or_not
 	void*		dstBits,
 	const u64	numBits)
 	{
-	u64*		scan1 = (u64*) bits1;
-	u64*		scan2 = (u64*) bits2;
-	u64*		dst   = (u64*) dstBits;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64)
-		*(dst++) = *(scan1++) | ~*(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan1b = (u8*) scan1;
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8)
-		*(dstb++) = *(scan1b++) | ~*(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = (*scan1b | ~*scan2b) & mask;  // leftover bits intentionally set to zero
+	binary_op<opOrNot>(bits1,bits2,dstBits,numBits);
 	}
 
 
@@ -398,24 +955,7 @@ void bitwise_or_not
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u64*		dst   = (u64*) dstBits;
-	u64*		scan2 = (u64*) bits2;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64,dst++)
-		*dst |= ~*(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8,dstb++)
-		*dstb |= ~*(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = ((*dstb | ~*scan2b) & mask) | (*dstb & ~mask);
+	binary_op_in_place<opOrNot>(dstBits,bits2,numBits);
 	}
 
 
@@ -425,26 +965,7 @@ void bitwise_xor
 	void*		dstBits,
 	const u64	numBits)
 	{
-	u64*		scan1 = (u64*) bits1;
-	u64*		scan2 = (u64*) bits2;
-	u64*		dst   = (u64*) dstBits;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64)
-		*(dst++) = *(scan1++) ^ *(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan1b = (u8*) scan1;
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8)
-		*(dstb++) = *(scan1b++) ^ *(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = (*scan1b ^ *scan2b) & mask;  // leftover bits intentionally set to zero
+	binary_op<opXor>(bits1,bits2,dstBits,numBits);
 	}
 
 
@@ -453,24 +974,7 @@ void bitwise_xor
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u64*		dst   = (u64*) dstBits;
-	u64*		scan2 = (u64*) bits2;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64,dst++)
-		*dst ^= *(scan2++);
-
-	if (n == 0) return;
-
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8,dstb++)
-		*dstb ^= *(scan2b++);
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = ((*dstb ^ *scan2b) & mask) | (*dstb & ~mask);
+	binary_op_in_place<opXor>(dstBits,bits2,numBits);
 	}
 
 
@@ -480,26 +984,7 @@ void bitwise_xnor
 	void*		dstBits,
 	const u64	numBits)
 	{
-	u64*		scan1 = (u64*) bits1;
-	u64*		scan2 = (u64*) bits2;
-	u64*		dst   = (u64*) dstBits;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64)
-		*(dst++) = ~(*(scan1++) ^ *(scan2++));
-
-	if (n == 0) return;
-
-	u8*	scan1b = (u8*) scan1;
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8)
-		*(dstb++) = ~(*(scan1b++) ^ *(scan2b++));
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = ~((*scan1b ^ *scan2b)) & mask;  // leftover bits intentionally set to zero
+	binary_op<opXnor>(bits1,bits2,dstBits,numBits);
 	}
 
 
@@ -508,24 +993,7 @@ void bitwise_xnor
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u64*		dst   = (u64*) dstBits;
-	u64*		scan2 = (u64*) bits2;
-	u64			n;
-
-	for (n=numBits ; n>=64 ; n-=64,dst++)
-		*dst = ~(*dst ^ *(scan2++));
-
-	if (n == 0) return;
-
-	u8*	scan2b = (u8*) scan2;
-	u8*	dstb   = (u8*) dst;
-	for ( ; n>=8 ; n-=8,dstb++)
-		*dstb = ~(*dstb ^ *(scan2b++));
-
-	if (n == 0) return;
-
-	u8 mask = least_significant(u8,n);
-	*dstb = (~((*dstb ^ *scan2b)) & mask) | (*dstb & ~mask);
+	binary_op_in_place<opXnor>(dstBits,bits2,numBits);
 	}
 
 //----------
@@ -704,6 +1172,8 @@ void bitwise_fill
 //	(2)	We process the bytes in 64-bit chunks until we get to the final chunk.
 //		The final chunk is processed byte-by-byte, so that we do not access
 //		any bytes beyond the bit arrays.
+//	(3)	Full 64-bit chunks go through squeeze_chunks(), see the squeeze
+//		kernels above.
 //
 //----------
 
@@ -730,7 +1200,15 @@ std::uint64_t bitwise_squeeze
 	u64 dstChunk    = 0;
 	u64 bitsInChunk = 0;
 	u64 bitsInDst   = 0;
-	for (n=numBits ; n>=64 ; n-=64)
+	n = numBits;
+#ifdef bitwise_have_x86
+	if (activeKernel == bitwise_kernel_bmi2)
+		bmi2_squeeze_chunks(src,scan,dst,n,dstChunk,bitsInChunk,bitsInDst,numDstBits);
+	else
+#endif
+		squeeze_chunks<softBits>(src,scan,dst,n,dstChunk,bitsInChunk,bitsInDst,numDstBits);
+
+	for ( ; n>=64 ; n-=64)
 		{
 		u64 specChunk = *(scan++);
 		u64 srcChunk  = *(src++);
@@ -929,6 +1407,8 @@ overrun:
 //	(2)	We process the bytes in 64-bit chunks until we get to the final chunk.
 //		The final chunk is processed byte-by-byte, so that we do not access
 //		any bytes beyond the bit arrays.
+//	(3)	Full 64-bit chunks go through unsqueeze_chunks(), see the squeeze
+//		kernels above.
 //
 //----------
 
@@ -962,7 +1442,15 @@ std::uint64_t bitwise_unsqueeze
 	u64 bitsInDstChunk = 0;
 	u64 bitsInDst      = 0;
 
-	for (n=numSpecBits ; n>=64 ; n-=64)
+	n = numSpecBits;
+#ifdef bitwise_have_x86
+	if (activeKernel == bitwise_kernel_bmi2)
+		bmi2_unsqueeze_chunks(src,srcb,scan,dst,n,srcChunk,bitsInSrcChunk,bitsInSrc,bitsInDst,numDstBits);
+	else
+#endif
+		unsqueeze_chunks<softBits>(src,srcb,scan,dst,n,srcChunk,bitsInSrcChunk,bitsInSrc,bitsInDst,numDstBits);
+
+	for ( ; n>=64 ; n-=64)
 		{
 		u64 specChunk = *(scan++);
 
@@ -1179,19 +1667,7 @@ u64 bitwise_count
    (const void*	bits,
 	const u64	numBits)
 	{
-	u8*			scan = (u8*) bits;
-	u64			n;
-	u64			numOnes = 0;
-
-	for (n=numBits ; n>=8 ; n-=8)
-		numOnes += popCount8[*(scan++)];
-
-	if (n == 0) return numOnes;
-
-	u8 mask = least_significant(u8,n);
-	numOnes += popCount8[(*scan) & mask];
-
-	return numOnes;
+	return op_count<opFirst>(bits,bits,numBits);
 	}
 
 //----------
@@ -1226,20 +1702,7 @@ u64 bitwise_and_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
-	u64			n;
-	u64			numOnes = 0;
-
-	for (n=numBits ; n>=8 ; n-=8)
-		numOnes += popCount8[*(scan1++) & *(scan2++)];
-
-	if (n == 0) return numOnes;
-
-	u8 mask = least_significant(u8,n);
-	numOnes += popCount8[(*scan1 & *scan2) & mask];
-
-	return numOnes;
+	return op_count<opAnd>(bits1,bits2,numBits);
 	}
 
 u64 bitwise_mask_count
@@ -1247,20 +1710,7 @@ u64 bitwise_mask_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
-	u64			n;
-	u64			numOnes = 0;
-
-	for (n=numBits ; n>=8 ; n-=8)
-		numOnes += popCount8[*(scan1++) & ~*(scan2++)];
-
-	if (n == 0) return numOnes;
-
-	u8 mask = least_significant(u8,n);
-	numOnes += popCount8[(*scan1 & ~*scan2) & mask];
-
-	return numOnes;
+	return op_count<opMask>(bits1,bits2,numBits);
 	}
 
 u64 bitwise_or_count
@@ -1268,20 +1718,7 @@ u64 bitwise_or_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
-	u64			n;
-	u64			numOnes = 0;
-
-	for (n=numBits ; n>=8 ; n-=8)
-		numOnes += popCount8[*(scan1++) | *(scan2++)];
-
-	if (n == 0) return numOnes;
-
-	u8 mask = least_significant(u8,n);
-	numOnes += popCount8[(*scan1 | *scan2) & mask];
-
-	return numOnes;
+	return op_count<opOr>(bits1,bits2,numBits);
 	}
 
 u64 bitwise_or_not_count
@@ -1289,20 +1726,7 @@ u64 bitwise_or_not_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
-	u64			n;
-	u64			numOnes = 0;
-
-	for (n=numBits ; n>=8 ; n-=8)
-		numOnes += popCount8[*(scan1++) | ((u8)~*(scan2++))];
-
-	if (n == 0) return numOnes;
-
-	u8 mask = least_significant(u8,n);
-	numOnes += popCount8[(*scan1 | ~*scan2) & mask];
-
-	return numOnes;
+	return op_count<opOrNot>(bits1,bits2,numBits);
 	}
 
 u64 bitwise_xor_count
@@ -1310,18 +1734,5 @@ u64 bitwise_xor_count
 	const void*	bits2,
 	const u64	numBits)
 	{
-	u8*			scan1 = (u8*) bits1;
-	u8*			scan2 = (u8*) bits2;
-	u64			n;
-	u64			numOnes = 0;
-
-	for (n=numBits ; n>=8 ; n-=8)
-		numOnes += popCount8[*(scan1++) ^ *(scan2++)];
-
-	if (n == 0) return numOnes;
-
-	u8 mask = least_significant(u8,n);
-	numOnes += popCount8[(*scan1 ^ *scan2) & mask];
-
-	return numOnes;
+	return op_count<opXor>(bits1,bits2,numBits);
 	}
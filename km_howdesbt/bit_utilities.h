@@ -1,12 +1,31 @@
 #ifndef bit_utilities_H
 #define bit_utilities_H
 
+//----------
+//
+// kernels for the bitwise operations and counts, see bitwise_set_kernel()--
+//
+//----------
+
+enum
+	{
+	bitwise_kernel_scalar = 0,
+	bitwise_kernel_popcnt,
+	bitwise_kernel_avx2,
+	bitwise_kernel_bmi2,
+	bitwise_kernel_auto
+	};
+
 //----------
 //
 // prototypes for functions in this module--
 //
 //----------
 
+bool          bitwise_kernel_supported (const int kernel);
+bool          bitwise_set_kernel   (const int kernel);
+int           bitwise_get_kernel   (void);
+const char*   bitwise_kernel_name  (const int kernel);
 bool          bitwise_is_all_zeros (const void* bits, const std::uint64_t numBits);
 bool          bitwise_is_all_ones  (const void* bits, const std::uint64_t numBits);
 void          bitwise_copy         (const void* bits, void* dstBits, const std::uint64_t numBits);
@@ -495,6 +495,16 @@ void BitVector::discard_rank_select ()
 	if (selector0 != nullptr) { delete selector0;  selector0 = nullptr; }
 	}
 
+void BitVector::prepare_rank_select ()
+	{
+	// build the rank/select support ahead of time, so that rank1() and
+	// select0() don't modify the object and can be shared between threads
+
+	if (bits == nullptr) return;
+	if (ranker1   == nullptr) ranker1   = new sdslrank1(bits);
+	if (selector0 == nullptr) selector0 = new sdslselect0(bits);
+	}
+
 u64 BitVector::size () const
 	{
 	if (bits != nullptr) return bits->size();
@@ -850,6 +860,13 @@ void RrrBitVector::discard_rank_select ()
 	BitVector::discard_rank_select();
 	}
 
+void RrrBitVector::prepare_rank_select ()
+	{
+	if (rrrBits == nullptr) return;
+	if (rrrRanker1   == nullptr) rrrRanker1   = new rrrrank1(rrrBits);
+	if (rrrSelector0 == nullptr) rrrSelector0 = new rrrselect0(rrrBits);
+	}
+
 u64 RrrBitVector::size () const
 	{
 	if (bits    != nullptr) return bits->size();
@@ -1196,6 +1213,11 @@ void RoarBitVector::discard_rank_select ()
 	// do nothing
 	}
 
+void RoarBitVector::prepare_rank_select ()
+	{
+	// do nothing
+	}
+
 u64 RoarBitVector::size () const
 	{
 	if (bits != nullptr) return bits->size();
@@ -1462,6 +1484,11 @@ void ZerosBitVector::discard_rank_select ()
 	// do nothing
 	}
 
+void ZerosBitVector::prepare_rank_select ()
+	{
+	// do nothing
+	}
+
 u64 ZerosBitVector::size () const
 	{
 	return numBits;
@@ -116,6 +116,7 @@ public:
 	virtual std::uint64_t rank1(std::uint64_t pos);
 	virtual std::uint64_t select0(std::uint64_t rank);
 	virtual void discard_rank_select();
+	virtual void prepare_rank_select();
 
 	virtual std::uint64_t num_bits() const { return numBits; }
 	virtual std::uint64_t size() const;
@@ -186,6 +187,7 @@ public:
 	virtual std::uint64_t rank1(std::uint64_t pos);
 	virtual std::uint64_t select0(std::uint64_t rank);
 	virtual void discard_rank_select();
+	virtual void prepare_rank_select();
 
 	virtual std::uint64_t size() const;
 
@@ -233,6 +235,7 @@ public:
 	virtual std::uint64_t rank1(std::uint64_t pos);
 	virtual std::uint64_t select0(std::uint64_t rank);
 	virtual void discard_rank_select();
+	virtual void prepare_rank_select();
 
 	virtual std::uint64_t size() const;
 
@@ -294,6 +297,7 @@ public:
 	virtual std::uint64_t rank1(std::uint64_t pos);
 	virtual std::uint64_t select0(std::uint64_t rank);
 	virtual void discard_rank_select();
+	virtual void prepare_rank_select();
 
 	virtual std::uint64_t size() const;
 	};
@@ -11,6 +11,11 @@
 #include <cstdint>
 #include <cmath>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
 
 #include "utilities.h"
 #include "bit_utilities.h"
@@ -31,6 +36,35 @@ using std::endl;
 //
 //----------
 
+// state shared by the threads constructing a tree (see set_build_limits());
+// runningThreads counts the threads doing work, i.e. not waiting for memory or
+// for other threads, and residentBytes is the memory held by the filters
+// waiting to be combined into their parent
+
+struct buildstate
+	{
+	std::mutex				mutex;
+	std::condition_variable	changed;
+	int						spareThreads   = 0;
+	int						owedThreads    = 0;	// slots taken back while still lent
+	int						runningThreads = 1;
+	u64						budget         = 0;	// zero means no limit
+	u64						residentBytes  = 0;
+	};
+
+static buildstate builder;
+
+// return_spare_thread--
+//	Give a thread slot back, to the thread that took its slot back while it was
+//	still in use if there is one. The caller holds builder.mutex.
+
+static void return_spare_thread ()
+	{
+	if (builder.owedThreads > 0)
+		builder.owedThreads--;
+	else
+		builder.spareThreads++;
+	}
 
 //----------
 //
@@ -51,7 +85,9 @@ BloomTree::BloomTree
 		fpRateKnown(false),
 		fpRate(0.0),
 		nodesShareFiles(false),
-		queryStats(nullptr)
+		allResident(false),
+		queryStats(nullptr),
+		residentBytes(0)
 	{
 	}
 
@@ -65,7 +101,9 @@ BloomTree::BloomTree
 		isLeaf(root->isLeaf),
 		parent(nullptr),
 		nodesShareFiles(false),
-		queryStats(nullptr)
+		allResident(false),
+		queryStats(nullptr),
+		residentBytes(0)
 	{
 	// nota bene: this doesn't copy the subtree, just the root node; we expect
 	//            the caller will detach everything from the root node
@@ -127,6 +165,7 @@ void BloomTree::unloadable()
 	{
 	// $$$ eventually we will want a more sophisticated caching mechanism
 
+	release_resident();
 
 	if (bf != nullptr)
 		{
@@ -138,6 +177,41 @@ void BloomTree::unloadable()
 	}
 
 
+// load_all--
+//	Load every node's filter in the subtree and keep it resident until
+//	unload_all(); queries then only read the filters, so they can be shared
+//	between threads, and can be run repeatedly without reloading the tree.
+
+void BloomTree::load_all()
+	{
+	if (allResident) return;
+
+	vector<BloomTree*> order;
+	pre_order(order);
+	for (const auto& node : order)
+		{
+		node->load();
+		// rank/select support is otherwise built lazily, on first use
+		for (int bvIx=0 ; bvIx<node->bf->numBitVectors ; bvIx++)
+			node->bf->get_bit_vector(bvIx)->prepare_rank_select();
+		}
+
+	allResident = true;
+	}
+
+void BloomTree::unload_all()
+	{
+	if (not allResident) return;
+
+	vector<BloomTree*> order;
+	pre_order(order);
+	for (const auto& node : order)
+		node->unloadable();
+
+	allResident = false;
+	}
+
+
 void BloomTree::add_child
    (BloomTree* offspring)
 	{
@@ -249,6 +323,167 @@ void BloomTree::print_topology
 		child->print_topology (out, level+levelInc, format);
 	}
 
+//~~~~~~~~~~
+// parallel construction
+//~~~~~~~~~~
+
+//----------
+//
+// set_build_limits--
+//	Set how many threads, and how much memory, the construct_xxx_nodes()
+//	functions can use.
+//
+//----------
+//
+// Arguments:
+//	int	numThreads:		The maximum number of threads constructing nodes at
+//						once. Sibling subtrees are independent until their
+//						parent is built, so each one can be given to a thread
+//						of its own.
+//	u64	memoryBudget:	The number of bytes that can be held by resident filters
+//						(leaves or nodes that are waiting for their parent). Zero
+//						means there is no limit.
+//
+// Returns:
+//	(nothing)
+//
+//----------
+//
+// Notes:
+//	(1)	The budget is checked before a thread brings another filter into
+//		memory, so it can be exceeded by at most one filter per thread.
+//	(2)	A thread never waits for memory when all the other threads are waiting
+//		too, since nobody would release any. So the construction still
+//		completes when the budget is smaller than what a single subtree needs;
+//		it just runs on fewer threads.
+//	(3)	The nodes are built in the same way, and written to the same files,
+//		whatever the number of threads.
+//
+//----------
+
+void BloomTree::set_build_limits
+   (int	numThreads,
+	u64	memoryBudget)
+	{
+	std::lock_guard<std::mutex> lock(builder.mutex);
+	builder.spareThreads = std::max(numThreads,1) - 1;
+	builder.owedThreads  = 0;
+	builder.budget       = memoryBudget;
+	}
+
+// construct_children--
+//	Construct the subtrees of this node's children, giving them to spare
+//	threads if there are any. The last child (and any child for which no thread
+//	is available) is constructed by the calling thread.
+
+void BloomTree::construct_children
+   (void (BloomTree::*construct)(u32),
+	u32	compressor)
+	{
+	vector<std::thread> threads;
+
+	size_t numChildren = children.size();
+	for (size_t childIx=0 ; childIx<numChildren ; childIx++)
+		{
+		BloomTree* child = children[childIx];
+
+		bool spawn = false;
+		if (childIx+1 < numChildren)
+			{
+			std::lock_guard<std::mutex> lock(builder.mutex);
+			if (builder.spareThreads > 0)
+				{
+				builder.spareThreads--;
+				builder.runningThreads++;
+				spawn = true;
+				}
+			}
+
+		if (not spawn)
+			{ (child->*construct)(compressor);  continue; }
+
+		threads.emplace_back([child,construct,compressor]()
+			{
+			(child->*construct)(compressor);
+			FileManager::close_file();
+			std::lock_guard<std::mutex> lock(builder.mutex);
+			return_spare_thread();
+			builder.runningThreads--;
+			builder.changed.notify_all();
+			});
+		}
+
+	if (threads.empty()) return;
+
+	// while we wait for the other subtrees, our thread is lent to whichever
+	// subtree (maybe one of those) needs it
+
+	{
+	std::lock_guard<std::mutex> lock(builder.mutex);
+	return_spare_thread();
+	builder.runningThreads--;
+	builder.changed.notify_all();
+	}
+
+	for (auto& t : threads)
+		t.join();
+
+	// take our slot back; if it is still in use, the thread using it gives it
+	// to us when it is done, instead of making it spare
+
+	std::lock_guard<std::mutex> lock(builder.mutex);
+	if (builder.spareThreads > 0)
+		builder.spareThreads--;
+	else
+		builder.owedThreads++;
+	builder.runningThreads++;
+	}
+
+// reserve_resident--
+//	Wait until the memory budget allows one more filter to be resident.
+
+void BloomTree::reserve_resident ()
+	{
+	std::unique_lock<std::mutex> lock(builder.mutex);
+	if ((builder.budget == 0) or (builder.residentBytes < builder.budget))
+		return;
+
+	builder.runningThreads--;
+	builder.changed.notify_all();
+	builder.changed.wait(lock, []()
+		{
+		return (builder.residentBytes < builder.budget)
+		    or (builder.runningThreads == 0);
+		});
+	builder.runningThreads++;
+	}
+
+// charge_resident, release_resident--
+//	Account for this node's filter in the memory budget, while it is resident.
+//	The filter is charged as if uncompressed, which is how the construction
+//	handles it.
+
+void BloomTree::charge_resident ()
+	{
+	release_resident();
+	if (bf == nullptr) return;
+
+	std::lock_guard<std::mutex> lock(builder.mutex);
+	if (builder.budget == 0) return;
+	residentBytes = ((bf->numBits+7) / 8) * bf->numBitVectors;
+	builder.residentBytes += residentBytes;
+	}
+
+void BloomTree::release_resident ()
+	{
+	if (residentBytes == 0) return;
+
+	std::lock_guard<std::mutex> lock(builder.mutex);
+	builder.residentBytes -= std::min(residentBytes,builder.residentBytes);
+	residentBytes = 0;
+	builder.changed.notify_all();
+	}
+
 //~~~~~~~~~~
 // build union tree
 //~~~~~~~~~~
@@ -283,8 +518,10 @@ void BloomTree::construct_union_nodes (u32 compressor)
 	if (isLeaf)
 		{
 
+		reserve_resident();
 		bf = BloomFilter::bloom_filter(bfFilename);
 		bf->load();
+		charge_resident();
 
 		if (compressor != bvcomp_uncompressed)
 			{
@@ -306,8 +543,7 @@ void BloomTree::construct_union_nodes (u32 compressor)
 	// otherwise this is an internal node; first construct its descendants
 
 
-	for (const auto& child : children)
-			child->construct_union_nodes(compressor);
+	construct_children(&BloomTree::construct_union_nodes,compressor);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -333,6 +569,8 @@ void BloomTree::construct_union_nodes (u32 compressor)
 	if (bf != nullptr)
 		fatal ("internal error: unexpected non-null filter for " + bfFilename);
 
+	reserve_resident();
+
 	bool isFirstChild = true;
 	for (const auto& child : children)
 		{
@@ -371,6 +609,7 @@ void BloomTree::construct_union_nodes (u32 compressor)
 		fatal ("internal error:"
 		       " in construct_union_nodes(\"" + name + "\")"
 		     + ", non-leaf node has no children");
+	charge_resident();
 
 	// save the node;  if we're compressing we write a compressed copy to the
 	// new file
@@ -423,6 +662,7 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 	if (isLeaf)
 		{
 
+		reserve_resident();
 		BloomFilter* bfInput = BloomFilter::bloom_filter(bfFilename);
 		bfInput->load();
 
@@ -436,6 +676,7 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 		bf->copy_properties(bfInput);
 		bf->steal_bits(bfInput,/*src*/0,/*dst*/0,compressor);
 		delete bfInput;
+		charge_resident();
 
 		bf->new_bits(bvcomp_zeros,1);
 
@@ -460,8 +701,7 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 	// otherwise this is an internal node; first construct its descendants
 
 
-	for (const auto& child : children)
-		child->construct_allsome_nodes(compressor);
+	construct_children(&BloomTree::construct_allsome_nodes,compressor);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -479,6 +719,8 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 	if (bf != nullptr)
 		fatal ("internal error: unexpected non-null filter for " + bfFilename);
 
+	reserve_resident();
+
 	bool isFirstChild = true;
 	for (const auto& child : children)
 		{
@@ -522,6 +764,7 @@ void BloomTree::construct_allsome_nodes (u32 compressor)
 		fatal ("internal error:"
 		       " in construct_allsome_nodes(\"" + name + "\")"
 		     + ", non-leaf node has no children");
+	charge_resident();
 
 	// convert this node from Bcap,Bcup to B'all,B'some
 	//   bvs[0] = B'all(x)  = Bcap(x), no modification needed
@@ -586,6 +829,7 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 	if (isLeaf)
 		{
 
+		reserve_resident();
 		BloomFilter* bfInput = BloomFilter::bloom_filter(bfFilename);
 		bfInput->load();
 
@@ -599,6 +843,7 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 		bf->copy_properties(bfInput);
 		bf->steal_bits(bfInput,/*src*/0,/*dst*/1,compressor);
 		delete bfInput;
+		charge_resident();
 
 		bf->new_bits(compressor,0);
 		BitVector* bvDet = bf->get_bit_vector(0);
@@ -628,8 +873,7 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 
 	// otherwise this is an internal node; first construct its descendants
 
-	for (const auto& child : children)
-		child->construct_determined_nodes(compressor);
+	construct_children(&BloomTree::construct_determined_nodes,compressor);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -653,6 +897,8 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 	if (bf != nullptr)
 		fatal ("internal error: unexpected non-null filter for " + bfFilename);
 
+	reserve_resident();
+
 	bool isFirstChild = true;
 	for (const auto& child : children)
 		{
@@ -692,6 +938,7 @@ void BloomTree::construct_determined_nodes (u32 compressor)
 		fatal ("internal error:"
 		       " in construct_determined_nodes(\"" + name + "\")"
 		     + ", non-leaf node has no children");
+	charge_resident();
 
 	// convert this node from the temporary vectors computed in the loop
 	//   bvs[0] = Bdet(x) = Bhow(x) union z
@@ -775,6 +1022,7 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 	if (isLeaf)
 		{
 
+		reserve_resident();
 		BloomFilter* bfInput = BloomFilter::bloom_filter(bfFilename);
 		bfInput->load();
 
@@ -788,6 +1036,7 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 		bf->copy_properties(bfInput);
 		bf->steal_bits(bfInput,/*src*/0,/*dst*/1,compressor);
 		delete bfInput;
+		charge_resident();
 
 		bf->new_bits(compressor,0);
 		BitVector* bvDet = bf->get_bit_vector(0);
@@ -822,8 +1071,7 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 	// otherwise this is an internal node; first construct its descendants
 
 
-	for (const auto& child : children)
-		child->construct_determined_brief_nodes(compressor);
+	construct_children(&BloomTree::construct_determined_brief_nodes,compressor);
 
 	// if this is a dummy node, we don't need to build it, but we do mark its
 	// children as unloadable
@@ -847,6 +1095,8 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 	if (bf != nullptr)
 		fatal ("internal error: unexpected non-null filter for " + bfFilename);
 
+	reserve_resident();
+
 	bool isFirstChild = true;
 	for (const auto& child : children)
 		{
@@ -888,6 +1138,7 @@ void BloomTree::construct_determined_brief_nodes (u32 compressor)
 		fatal ("internal error:"
 		       " in construct_determined_brief_nodes(\"" + name + "\")"
 		     + ", non-leaf node has no children");
+	charge_resident();
 
 	// convert this node from the temporary vectors computed in the loop
 	//   bvs[0] = Bdet(x) = Bhow(x) union z
@@ -1069,7 +1320,8 @@ void BloomTree::construct_intersection_nodes (u32 compressor)
 
 void BloomTree::batch_query
    (vector<Query*>	queries,
-	bool			completeSmerCounts)
+	bool			completeSmerCounts,
+	int				numThreads)
 	{
 	// preload a root, and make sure that a leaf-only operation can work with
 	// the type of filter we have
@@ -1117,14 +1369,61 @@ void BloomTree::batch_query
 
 
 	u64 nbActiveQueries = localQueries.size();
-	if (nbActiveQueries > 0)
-		perform_batch_query(nbActiveQueries, localQueries, completeSmerCounts);
+	if ((numThreads > 1) and (nbActiveQueries > 1))
+		shared_batch_query(localQueries, completeSmerCounts, numThreads);
+	else if (nbActiveQueries > 0)
+		perform_batch_query(nbActiveQueries, localQueries, completeSmerCounts,
+		                    /*residentFilters*/ allResident);
+	}
+
+// shared_batch_query--
+//	Search the batch with several threads, sharing the resident filters (see
+//	load_all()). Each query is handled by a single thread, its state (stacks,
+//	smer list, matches) is never touched by another one, hence the matches are
+//	the same as with a single-threaded search.
+
+void BloomTree::shared_batch_query
+   (vector<Query*>&	queries,
+	bool			completeSmerCounts,
+	int				numThreads)
+	{
+	bool wasResident = allResident;
+	load_all();
+
+	// queries are handed out in small chunks, to balance long and short ones
+
+	u64 nbQueries = queries.size();
+	u64 chunkSize = std::max<u64>(1, nbQueries / (16*numThreads));
+	std::atomic<u64> nextQuery(0);
+
+	auto worker = [&]()
+		{
+		while (true)
+			{
+			u64 start = nextQuery.fetch_add(chunkSize);
+			if (start >= nbQueries) break;
+			u64 end = std::min(start+chunkSize, nbQueries);
+			vector<Query*> chunk(queries.begin()+start, queries.begin()+end);
+			perform_batch_query(end-start, chunk, completeSmerCounts,
+			                    /*residentFilters*/ true);
+			}
+		};
+
+	u64 nbWorkers = std::min<u64>(numThreads, (nbQueries+chunkSize-1) / chunkSize);
+	vector<std::thread> threads;
+	for (u64 tIx=0 ; tIx<nbWorkers ; tIx++)
+		threads.emplace_back(worker);
+	for (auto& t : threads)
+		t.join();
+
+	if (not wasResident) unload_all();
 	}
 
 void BloomTree::perform_batch_query
 	(u64			nbActiveQueries,
 	vector<Query*>	queries,
-	bool			completeSmerCounts)
+	bool			completeSmerCounts,
+	bool			residentFilters)
 	{
 	u64				nbIncomingQueries = nbActiveQueries;
 	u64				qIx;
@@ -1135,7 +1434,7 @@ void BloomTree::perform_batch_query
 		{
 
 		for (const auto& child : children)
-			child->perform_batch_query(nbActiveQueries,queries,completeSmerCounts);
+			child->perform_batch_query(nbActiveQueries,queries,completeSmerCounts,residentFilters);
 		return;
 		}
 
@@ -1162,9 +1461,10 @@ void BloomTree::perform_batch_query
 
 		}
 
-	// make sure this node's filter is resident
+	// make sure this node's filter is resident (with residentFilters, all
+	// filters were loaded by the caller)
 
-	load();
+	if (not residentFilters) load();
 
 	// operate on each query in the batch
 	//……… ideally, we'd like to perform this for all siblings, then unload the
@@ -1292,7 +1592,7 @@ void BloomTree::perform_batch_query
 	// filter to be resident any more
 
 	bool isPositionAdjustor = bf->is_position_adjustor();
-	if (!isPositionAdjustor) unloadable();
+	if ((!isPositionAdjustor) and (not residentFilters)) unloadable();
 
 	// sanity check: if we're at a leaf, we should have resolved all queries
 
@@ -1329,7 +1629,7 @@ void BloomTree::perform_batch_query
 	if (nbActiveQueries > 0)
 		{
 		for (const auto& child : children)
-			child->perform_batch_query(nbActiveQueries,queries,completeSmerCounts);
+			child->perform_batch_query(nbActiveQueries,queries,completeSmerCounts,residentFilters);
 		}
 
 	// restore smer/position lists as we move up the tree
@@ -1346,7 +1646,7 @@ void BloomTree::perform_batch_query
 	// if we were adjusting smers/positions, we finally don't need this node's
 	// filter to be resident any more
 
-	if (isPositionAdjustor) unloadable();
+	if ((isPositionAdjustor) and (not residentFilters)) unloadable();
 
 	// restore query state
 
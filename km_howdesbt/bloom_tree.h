@@ -47,6 +47,8 @@ public:
 	virtual void load();
 	virtual void save(bool finished=true);
 	virtual void unloadable();
+	virtual void load_all();
+	virtual void unload_all();
 
 
 	virtual void add_child(BloomTree* offspring);
@@ -67,12 +69,23 @@ public:
 	virtual void construct_determined_nodes (std::uint32_t compressor);
 	virtual void construct_determined_brief_nodes (std::uint32_t compressor);
 	virtual void construct_intersection_nodes (std::uint32_t compressor);
+private:
+	virtual void construct_children (void (BloomTree::*construct)(std::uint32_t),
+	                                 std::uint32_t compressor);
+	virtual void reserve_resident ();
+	virtual void charge_resident ();
+	virtual void release_resident ();
+public:
 
 	virtual void batch_query (std::vector<Query*> queries, 
-	                          bool completeSmerCounts=false);
+	                          bool completeSmerCounts=false,
+	                          int numThreads=1);
 private:
 	virtual void perform_batch_query (std::uint64_t activeQueries, std::vector<Query*> queries,
-	                                  bool completeSmerCounts=false);
+	                                  bool completeSmerCounts=false,
+	                                  bool residentFilters=false);
+	virtual void shared_batch_query (std::vector<Query*>& queries,
+	                                 bool completeSmerCounts, int numThreads);
 	virtual void query_matches_leaves (Query* q);
 
 public:
@@ -95,6 +108,9 @@ public:
 	bool nodesShareFiles;				// (only applicable at root)
 										// true => tree may contain nodes that
 										//         .. share files with each other
+	bool allResident;					// (only applicable at root)
+										// true => every node's filter is
+										//         .. resident, see load_all()
 
 
 public:
@@ -106,8 +122,14 @@ public:
 	std::uint32_t height;				// .. processes
 	std::uint32_t subTreeSize;
 
+public:
+	std::uint64_t residentBytes;		// memory charged to the build budget
+										// .. for this node's filter (see
+										// .. set_build_limits())
+
 public:
 	static BloomTree* read_topology(const std::string& filename);
+	static void set_build_limits(int numThreads, std::uint64_t memoryBudget=0);
 	};
 
 #endif // bloom_tree_H
@@ -59,6 +59,13 @@ void BuildSBTCommand::usage
 	s << "                       (this is the default)" << endl;
 	s << "  --rrr                create the nodes as rrr-compressed bit vector(s)" << endl;
 	s << "  --roar               create the nodes as roar-compressed bit vector(s)" << endl;
+	s << "  --threads=<N>        number of threads building the tree; sibling subtrees are" << endl;
+	s << "                       built in parallel" << endl;
+	s << "                       (default is 1)" << endl;
+	s << "  --memory=<bytes>     limit on the memory held by filters waiting for their" << endl;
+	s << "                       parent to be built, e.g. 4G; with more than one thread," << endl;
+	s << "                       threads wait while it is exceeded" << endl;
+	s << "                       (default is no limit)" << endl;
 	}
 
 void BuildSBTCommand::parse
@@ -70,8 +77,10 @@ void BuildSBTCommand::parse
 
 	// defaults
 
-	bfKind     = bfkind_simple;
-	compressor = bvcomp_uncompressed;
+	bfKind       = bfkind_simple;
+	compressor   = bvcomp_uncompressed;
+	numThreads   = 1;
+	memoryBudget = 0;
 
 	// skip command name
 
@@ -189,6 +198,22 @@ void BuildSBTCommand::parse
 		 || (arg == "--roaring"))
 			{ compressor = bvcomp_roar;  continue; }
 
+		// --threads=<N>
+
+		if (is_prefix_of (arg, "--threads="))
+			{
+			numThreads = string_to_int(argVal);
+			if (numThreads < 1)
+				chastise ("(in \"" + arg + "\") number of threads must be at least 1");
+			continue;
+			}
+
+		// --memory=<bytes>
+
+		if ((is_prefix_of (arg, "--memory="))
+		 || (is_prefix_of (arg, "--mem=")))
+			{ memoryBudget = string_to_unitized_u64(argVal,/*unitScale*/ 1024);  continue; }
+
 		// (unadvertised) --tree=<filename>, --topology=<filename>
 
 		if ((is_prefix_of (arg, "--tree="))
@@ -282,6 +307,8 @@ int BuildSBTCommand::execute()
 	if (hasOnlyChildren)
 		fatal ("error: tree contains at least one only child");
 
+	BloomTree::set_build_limits(numThreads,memoryBudget);
+
 	switch (bfKind)
 		{
 		case bfkind_simple:
@@ -22,6 +22,8 @@ public:
 	std::string outTreeFilename;
 	std::uint32_t bfKind;
 	std::uint32_t compressor;
+	int numThreads;
+	std::uint64_t memoryBudget;
 	};
 
 #endif // cmd_build_sbt_H
@@ -6,6 +6,9 @@
 #include <limits>
 #include <iostream>
 #include <queue>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 #include "utilities.h"
 #include "bit_utilities.h"
@@ -70,6 +73,16 @@ void ClusterCommand::usage
 	s << "  --nobuild         perform the clustering but don't build the tree's nodes" << endl;
 	s << "                    (this is the default)" << endl;
 	s << "  --build           perform clustering, then build the uncompressed nodes" << endl;
+	s << "  --threads=<N>     number of threads computing distances between filters" << endl;
+	s << "                    (default is 1)" << endl;
+	s << "  --neighbors=<K>   only consider merging a node with its K nearest neighbors;" << endl;
+	s << "                    memory is O(n*K) instead of O(n^2) for n filters, but the" << endl;
+	s << "                    tree may differ from the default all-vs-all clustering" << endl;
+	s << "                    (by default all pairs are considered)" << endl;
+	s << "  --sketch=<B>      with --neighbors, preselect neighbors by comparing a sample" << endl;
+	s << "                    of B bits of each filter; exact distances are only computed" << endl;
+	s << "                    for the preselected neighbors" << endl;
+	s << "                    (by default there is no preselection)" << endl;
 	}
 
 
@@ -90,6 +103,9 @@ void ClusterCommand::parse
 	cullingThreshold       = std::numeric_limits<double>::quiet_NaN();
 	renumberNodes          = true;
 	inhibitBuild           = true;
+	numThreads             = 1;
+	numNeighbors           = 0;
+	sketchBits             = 0;
 
 	// skip command name
 
@@ -272,6 +288,37 @@ void ClusterCommand::parse
 		if (arg == "--build")
 			{ inhibitBuild = false;  continue; }
 
+		// --threads=<N>
+
+		if (is_prefix_of (arg, "--threads="))
+			{
+			numThreads = string_to_int(argVal);
+			if (numThreads < 1)
+				chastise ("(in \"" + arg + "\") number of threads must be at least 1");
+			continue;
+			}
+
+		// --neighbors=<K>
+
+		if ((is_prefix_of (arg, "--neighbors="))
+		 || (is_prefix_of (arg, "--neighbours="))
+		 || (is_prefix_of (arg, "--knn=")))
+			{
+			int k = string_to_int(argVal);
+			if (k < 0)
+				chastise ("(in \"" + arg + "\") number of neighbors can't be negative");
+			numNeighbors = k;
+			continue;
+			}
+
+		// --sketch=<B>
+
+		if (is_prefix_of (arg, "--sketch="))
+			{
+			sketchBits = string_to_unitized_u64(argVal);
+			continue;
+			}
+
 		// (unadvertised) debug options
 
 		if (arg == "--debug")
@@ -318,6 +365,9 @@ void ClusterCommand::parse
 	if (listFilename.empty())
 		chastise ("you have to provide a file, listing the bloom filters for the tree");
 
+	if ((sketchBits > 0) && (numNeighbors == 0))
+		chastise ("--sketch requires --neighbors");
+
 	if (treeFilename.empty())
 		{
 		string::size_type dotIx = listFilename.find_last_of(".");
@@ -515,6 +565,22 @@ void ClusterCommand::find_leaf_vectors()
 //		of which have distance zero to each other) would cluster like a ladder.
 //		In a more general case it may keep the overall tree height shorter, but
 //		such cases are probably rare.
+//	(3)	Distances are computed by numThreads threads. The all-vs-all distances
+//		among the leaves are computed in square tiles of the distance matrix,
+//		sized so that the bit arrays of a tile's rows and columns fit in cache
+//		together. Since the comparison is a total order, the tree doesn't
+//		depend on the number of threads.
+//	(4)	With numNeighbors > 0, a node only contributes merge candidates with
+//		its numNeighbors nearest active nodes, so the queue holds O(n*K)
+//		candidates instead of O(n^2). When the last queued candidate of an
+//		active node is popped, i.e. all of its neighbors have been merged, the
+//		node is given a fresh set of candidates. The tree is not necessarily
+//		the same as with all-vs-all candidates.
+//	(5)	With sketchBits > 0 (and numNeighbors > 0), the nearest neighbors are
+//		preselected on a bit-sample sketch-- evenly spaced 64-bit words of the
+//		bit arrays-- and exact distances are only computed for the preselected
+//		ones. The sketch of a union node is the union of its children's
+//		sketches.
 //
 //----------
 
@@ -535,6 +601,286 @@ bool operator>(const MergeCandidate& lhs, const MergeCandidate& rhs)
 	return (lhs.v > rhs.v);
 	}
 
+static const u64 clusterTileBytes    = 512*1024;	// bit arrays of a tile's rows and columns
+static const u64 clusterParallelBytes = 4*1024*1024;	// below this, a node-vs-all scan uses one thread
+static const u32 sketchPreselection  = 4;			// neighbors preselected per neighbor kept
+
+// parallel_for--
+//	Call body(threadIx,ix) for every ix in [0,n); the indexes are handed out
+//	in small chunks to numThreads threads
+
+template<typename Body>
+static void parallel_for
+   (u64		n,
+	int		numThreads,
+	Body	body)
+	{
+	if ((numThreads <= 1) || (n <= 1))
+		{
+		for (u64 ix=0 ; ix<n ; ix++) body(0,ix);
+		return;
+		}
+
+	u64 chunkSize = std::max<u64>(1, n / (16*numThreads));
+	std::atomic<u64> nextIx(0);
+
+	auto worker = [&](int threadIx)
+		{
+		while (true)
+			{
+			u64 start = nextIx.fetch_add(chunkSize);
+			if (start >= n) break;
+			u64 end = std::min(start+chunkSize, n);
+			for (u64 ix=start ; ix<end ; ix++) body(threadIx,ix);
+			}
+		};
+
+	u64 nbWorkers = std::min<u64>(numThreads, (n+chunkSize-1) / chunkSize);
+	vector<std::thread> threads;
+	for (u64 tIx=0 ; tIx<nbWorkers ; tIx++)
+		threads.emplace_back(worker,(int)tIx);
+	for (auto& t : threads)
+		t.join();
+	}
+
+// ClusterDistances--
+//	Distances between the nodes being clustered, and the merge candidates
+//	derived from them; see the implementation notes of cluster_greedily()
+
+typedef std::pair<u64,u32> Neighbor;	// (distance, node)
+
+class ClusterDistances
+	{
+public:
+	ClusterDistances(vector<BinaryTree*>& _node, const u32 numNodes, const u64 _numBits,
+	                 const int _numThreads, const u32 _numNeighbors, const u64 sketchBits)
+	  :	node(_node),
+		numBits(_numBits),
+		numThreads(_numThreads),
+		numNeighbors(_numNeighbors),
+		sketchWords(0),
+		sketchStride(0)
+		{
+		u64 numWords = numBits / 64;
+		if ((numNeighbors > 0) && (sketchBits > 0) && (numWords > (sketchBits+63)/64))
+			{
+			sketchWords  = (sketchBits+63) / 64;
+			sketchStride = numWords / sketchWords;
+			sketches.assign(numNodes*sketchWords,0);
+			}
+		}
+
+	u64 distance (const u32 u, const u32 v) const
+		{ return hamming_distance (node[u]->bits, node[v]->bits, numBits); }
+
+	u64 sketch_distance (const u32 u, const u32 v) const
+		{ return hamming_distance (&sketches[u*sketchWords], &sketches[v*sketchWords], 64*sketchWords); }
+
+	// the distance used to choose neighbors, before refine()
+	u64 scan_distance (const u32 u, const u32 v) const
+		{ return (sketchWords > 0)? sketch_distance(u,v) : distance(u,v); }
+
+	u64 bytes_per_node (void) const
+		{ return (sketchWords > 0)? 8*sketchWords : (numBits+7)/8; }
+
+	u32 preselection (void) const
+		{ return (sketchWords > 0)? sketchPreselection*numNeighbors : numNeighbors; }
+
+	u32 height (const u32 u, const u32 v) const
+		{ return 1 + std::max (node[u]->height, node[v]->height); }
+
+	void make_sketch (const u32 u)
+		{
+		if (sketchWords == 0) return;
+		for (u64 ix=0 ; ix<sketchWords ; ix++)
+			sketches[u*sketchWords+ix] = node[u]->bits[ix*sketchStride];
+		}
+
+	void union_sketch (const u32 w, const u32 u, const u32 v)
+		{
+		if (sketchWords == 0) return;
+		bitwise_or (&sketches[u*sketchWords], &sketches[v*sketchWords], &sketches[w*sketchWords], 64*sketchWords);
+		}
+
+	// keep the limit nearest neighbors, in a max-heap
+
+	static void keep_nearest (vector<Neighbor>& nearest, const u32 limit, const Neighbor& n)
+		{
+		if (nearest.size() == limit)
+			{
+			if (!(n < nearest.front())) return;
+			std::pop_heap (nearest.begin(), nearest.end());
+			nearest.pop_back();
+			}
+		nearest.emplace_back(n);
+		std::push_heap (nearest.begin(), nearest.end());
+		}
+
+	// replace the preselected neighbors of u by the numNeighbors nearest ones,
+	// by exact distance, in increasing order
+
+	void refine (const u32 u, vector<Neighbor>& nearest) const
+		{
+		if (sketchWords > 0)
+			{
+			for (auto& n : nearest)
+				n.first = distance (u, n.second);
+			}
+		std::sort (nearest.begin(), nearest.end());
+		if (nearest.size() > numNeighbors)
+			nearest.resize(numNeighbors);
+		}
+
+	void leaf_candidates (const u32 numLeaves, vector<MergeCandidate>& candidates);
+	void node_candidates (const u32 y, const vector<u32>& active, vector<MergeCandidate>& candidates);
+
+private:
+	vector<BinaryTree*>& node;
+	u64 numBits;
+	int numThreads;
+	u32 numNeighbors;		// 0 means all-vs-all candidates
+	u64 sketchWords;		// 0 means no sketches
+	u64 sketchStride;		// (in 64-bit words)
+	vector<u64> sketches;	// sketchWords per node
+	};
+
+
+// leaf_candidates--
+//	Merge candidates among the leaves, [0,numLeaves)
+
+void ClusterDistances::leaf_candidates
+   (const u32				numLeaves,
+	vector<MergeCandidate>&	candidates)
+	{
+	u32 tileSize = std::max<u64> (1, clusterTileBytes / (2*bytes_per_node()));
+	u32 numTiles = (numLeaves + tileSize-1) / tileSize;
+
+	for (u32 u=0 ; u<numLeaves ; u++)
+		make_sketch (u);
+
+	// all-vs-all; tiles (I,J) with I<=J cover the upper triangle of the
+	// distance matrix
+
+	if (numNeighbors == 0)
+		{
+		vector<std::pair<u32,u32>> tiles;
+		for (u32 I=0 ; I<numTiles ; I++)
+			for (u32 J=I ; J<numTiles ; J++)
+				tiles.emplace_back(I,J);
+
+		vector<vector<MergeCandidate>> found(std::max(numThreads,1));
+		parallel_for (tiles.size(), numThreads, [&](int threadIx, u64 tileIx)
+			{
+			u32 uStart = tiles[tileIx].first  * tileSize;
+			u32 vStart = tiles[tileIx].second * tileSize;
+			u32 uEnd   = std::min (uStart+tileSize, numLeaves);
+			u32 vEnd   = std::min (vStart+tileSize, numLeaves);
+			for (u32 u=uStart ; u<uEnd ; u++)
+				{
+				for (u32 v=std::max(vStart,u+1) ; v<vEnd ; v++)
+					{
+					MergeCandidate c = { distance(u,v),2,u,v };
+					found[threadIx].emplace_back(c);
+					}
+				}
+			});
+
+		for (auto& f : found)
+			{
+			candidates.insert (candidates.end(), f.begin(), f.end());
+			vector<MergeCandidate>().swap(f);
+			}
+		return;
+		}
+
+	// nearest neighbors; a thread scans a tile-row of the distance matrix,
+	// so that the neighbors of its rows aren't shared with other threads;
+	// this computes each distance twice, but keeps the tiles cache-sized
+
+	u32 limit = preselection();
+	vector<vector<Neighbor>> nearest(numLeaves);
+
+	parallel_for (numTiles, numThreads, [&](int, u64 I)
+		{
+		u32 uStart = I * tileSize;
+		u32 uEnd   = std::min (uStart+tileSize, numLeaves);
+		for (u32 J=0 ; J<numTiles ; J++)
+			{
+			u32 vStart = J * tileSize;
+			u32 vEnd   = std::min (vStart+tileSize, numLeaves);
+			for (u32 u=uStart ; u<uEnd ; u++)
+				{
+				for (u32 v=vStart ; v<vEnd ; v++)
+					{
+					if (v == u) continue;
+					keep_nearest (nearest[u], limit, Neighbor(scan_distance(u,v),v));
+					}
+				}
+			}
+		for (u32 u=uStart ; u<uEnd ; u++)
+			refine (u, nearest[u]);
+		});
+
+	for (u32 u=0 ; u<numLeaves ; u++)
+		{
+		for (const auto& n : nearest[u])
+			{
+			u32 v = n.second;
+			MergeCandidate c = { n.first,2,std::min(u,v),std::max(u,v) };
+			candidates.emplace_back(c);
+			}
+		vector<Neighbor>().swap(nearest[u]);
+		}
+	}
+
+
+// node_candidates--
+//	Merge candidates between node y and the nodes in active (which doesn't
+//	contain y)
+
+void ClusterDistances::node_candidates
+   (const u32				y,
+	const vector<u32>&		active,
+	vector<MergeCandidate>&	candidates)
+	{
+	int threads = (active.size()*bytes_per_node() >= clusterParallelBytes)? numThreads : 1;
+
+	if (numNeighbors == 0)
+		{
+		vector<u64> d(active.size());
+		parallel_for (active.size(), threads, [&](int, u64 ix)
+			{ d[ix] = distance (active[ix], y); });
+
+		for (u64 ix=0 ; ix<active.size() ; ix++)
+			{
+			u32 x = active[ix];
+			MergeCandidate c = { d[ix],height(x,y),std::min(x,y),std::max(x,y) };
+			candidates.emplace_back(c);
+			}
+		return;
+		}
+
+	vector<Neighbor> nearest(active.size());
+	parallel_for (active.size(), threads, [&](int, u64 ix)
+		{ nearest[ix] = Neighbor(scan_distance(y,active[ix]),active[ix]); });
+
+	u32 limit = preselection();
+	if (nearest.size() > limit)
+		{
+		std::nth_element (nearest.begin(), nearest.begin()+limit, nearest.end());
+		nearest.resize(limit);
+		}
+	refine (y, nearest);
+
+	for (const auto& n : nearest)
+		{
+		u32 x = n.second;
+		MergeCandidate c = { n.first,height(x,y),std::min(x,y),std::max(x,y) };
+		candidates.emplace_back(c);
+		}
+	}
+
+
 void ClusterCommand::cluster_greedily()
 	{
 	u64 numBits = endPosition - startPosition;
@@ -548,7 +894,7 @@ void ClusterCommand::cluster_greedily()
 		fatal ("internal error: cluster_greedily() asked to cluster a single node");
 
 	u32 numNodes = 2*numLeaves - 1;  // nodes in tree, including leaves
-	BinaryTree* node[numNodes];
+	vector<BinaryTree*> node(numNodes,nullptr);
 
 	// load the bit arrays for the leaves
 
@@ -564,29 +910,59 @@ void ClusterCommand::cluster_greedily()
 			{ cerr << u << ": ";  dump_bits (cerr, node[u]->bits);  cerr << endl; }
 		}
 
-	// fill the priority queue with all-vs-all distances among the leaves
+	// fill the priority queue with distances among the leaves; all-vs-all,
+	// or only the nearest neighbors of each leaf
+
+	ClusterDistances distances(node,numNodes,numBits,numThreads,numNeighbors,sketchBits);
+	vector<u32> queued(numNodes,0);  // number of queued candidates involving each node
+
+	vector<MergeCandidate> candidates;
+	distances.leaf_candidates (numLeaves, candidates);
+
+	for (const auto& c : candidates)
+		{
+		queued[c.u]++;  queued[c.v]++;
+		if (contains(debug,"distances"))
+			cerr << "node " << c.u << " vs " << "node " << c.v << " d=" << c.d << " h=" << c.height << endl;
+		if (contains(debug,"queue"))
+			cerr << "pushing (" << c.d << "," << c.height << "," << c.u << "," << c.v << ")" << endl;
+		}
+
+	std::priority_queue<MergeCandidate, vector<MergeCandidate>, std::greater<MergeCandidate>>
+		q (std::greater<MergeCandidate>(), std::move(candidates));
 
-	std::priority_queue<MergeCandidate, vector<MergeCandidate>, std::greater<MergeCandidate>> q;
+	// push_candidates adds the candidates between node y and the active nodes
+	// below limit
 
-	for (u32 u=0 ; u<numLeaves-1 ; u++)
+	auto push_candidates = [&](u32 y, u32 limit)
 		{
-		for (u32 v=u+1 ; v<numLeaves ; v++)
+		vector<u32> active;
+		for (u32 x=0 ; x<limit ; x++)
+			{
+			if (x == y) continue;
+			if (node[x]->bits == nullptr) continue; // x isn't active
+			active.emplace_back(x);
+			}
+
+		vector<MergeCandidate> yCandidates;
+		distances.node_candidates (y, active, yCandidates);
+		for (const auto& c : yCandidates)
 			{
-			u64 d = hamming_distance (node[u]->bits, node[v]->bits, numBits);
 			if (contains(debug,"distances"))
-				cerr << "node " << u << " vs " << "node " << v << " d=" << d << " h=" << 2 << endl;
+				cerr << "node " << c.u << " vs " << "node " << c.v << " d=" << c.d << " h=" << c.height << endl;
 			if (contains(debug,"queue"))
-				cerr << "pushing (" << d << "," << 2 << "," << u << "," << v << ")" << endl;
-			MergeCandidate c = { d,2,u,v };
+				cerr << "pushing (" << c.d << "," << c.height << "," << c.u << "," << c.v << ")" << endl;
+			queued[c.u]++;  queued[c.v]++;
 			q.push (c);
 			}
-		}
+		};
 
 	// for each new node,
 	//	- pop the closest active pair (u,v) from the queue
 	//	- create a new node w = union of (u,v)
 	//	- deactivate u and v by removing their bit arrays
-	//	- add the distance to w from each active node
+	//	- add the distance to w from each active node (or from its nearest
+	//	  neighbors)
 
 	for (u32 w=numLeaves ; w<numNodes ; w++)
 		{
@@ -595,7 +971,7 @@ void ClusterCommand::cluster_greedily()
 		// the queue
 
 		u64 d;
-		u32 height, u, v;
+		u32 u, v;
 
 		while (true)
 			{
@@ -607,12 +983,25 @@ void ClusterCommand::cluster_greedily()
 			if (contains(debug,"queue"))
 				cerr << "popping (" << cand.d << "," << cand.height << "," << cand.u << "," << cand.v << ")"
 				     << " q.size()=" << q.size() << endl;
-			if (node[cand.u]->bits == nullptr) continue; // u isn't active
-			if (node[cand.v]->bits == nullptr) continue; // v isn't active
-			d      = cand.d;
-			height = cand.height;
-			u      = cand.u;
-			v      = cand.v;
+			queued[cand.u]--;  queued[cand.v]--;
+
+			bool uIsActive = (node[cand.u]->bits != nullptr);
+			bool vIsActive = (node[cand.v]->bits != nullptr);
+			if ((!uIsActive) || (!vIsActive))
+				{
+				// with nearest neighbors only, an active node that has run
+				// out of candidates gets new ones
+				if (numNeighbors > 0)
+					{
+					if ((uIsActive) && (queued[cand.u] == 0)) push_candidates (cand.u, w);
+					if ((vIsActive) && (queued[cand.v] == 0)) push_candidates (cand.v, w);
+					}
+				continue;
+				}
+
+			d = cand.d;
+			u = cand.u;
+			v = cand.v;
 			break;
 			}
 
@@ -628,6 +1017,7 @@ void ClusterCommand::cluster_greedily()
 			     + " for node " + std::to_string(w) + "'s bit array");
 
 		bitwise_or (node[u]->bits, node[v]->bits, /*dst*/ wBits, numBits);
+		distances.union_sketch (w, u, v);
 
 		node[w] = new BinaryTree(w,wBits,node[u],node[v]);
 		if (node[w] == nullptr)
@@ -685,18 +1075,7 @@ void ClusterCommand::cluster_greedily()
 
 		// add the distance to w from each active node
 
-		for (u32 x=0 ; x<w ; x++)
-			{
-			if (node[x]->bits == nullptr) continue; // x isn't active
-			u64 d = hamming_distance (node[x]->bits, wBits, numBits);
-			u32 h = 1 + std::max (height,node[x]->height);
-			if (contains(debug,"distances"))
-				cerr << "node " << x << " vs " << "node " << w << " d=" << d << " h=" << h << endl;
-			if (contains(debug,"queue"))
-				cerr << "pushing (" << d << "," << h << "," << x << "," << w << ")" << endl;
-			MergeCandidate c = { d,h,x,w };
-			q.push (c);
-			}
+		push_candidates (w, w);
 		}
 
 	// get rid of the root
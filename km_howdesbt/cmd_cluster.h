@@ -5,6 +5,7 @@
 #include <cstdlib>
 #include <cstdint>
 #include <iostream>
+#include <vector>
 
 #include "bit_vector.h"
 #include "commands.h"
@@ -95,6 +96,9 @@ public:
 	double cullingThreshold;
 	bool renumberNodes;
 	bool inhibitBuild;
+	int numThreads;
+	std::uint32_t numNeighbors;		// 0 means all-vs-all merge candidates
+	std::uint64_t sketchBits;		// 0 means no sketch preselection
 
 
 	double detRatioSum;
@@ -7,7 +7,16 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
 #include <tuple>
+#include <sstream>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <charconv>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "utilities.h"
 #include "bit_vector.h"
@@ -91,9 +100,22 @@ void QueryCommand::usage
 	s << "  --consistencycheck   before searching, check that bloom filter properties are" << endl;
 	s << "                       consistent across the tree" << endl;
 	s << "                       (not needed with --usemanager)" << endl;
+	s << "  --threads=<N>        number of threads searching the tree; with more than one" << endl;
+	s << "                       thread, all the tree's filters are kept in memory" << endl;
+	s << "                       (default is 1)" << endl;
 	s << "  --time               report wall time and node i/o time" << endl;
 	s << "  --out=<filename>     file for query results; if this is not provided, results" << endl;
 	s << "                       are written to stdout" << endl;
+	s << "  --serve=<address>    keep the tree loaded and answer requests until told to" << endl;
+	s << "                       stop; <address> is a unix socket path, or - for" << endl;
+	s << "                       stdin/stdout; query files are ignored" << endl;
+	s << "                       request: \"query <N> [<F>]\" then N bytes of sequences" << endl;
+	s << "                       reply:   \"ok <N>\" then N bytes of results, or" << endl;
+	s << "                                \"error <N>\" then N bytes of message" << endl;
+	s << "                       \"quit\" stops the server" << endl;
+	s << "  --serve-max=<MB>     largest request the server accepts, in megabytes; the" << endl;
+	s << "                       connection of a larger request is closed" << endl;
+	s << "                       (default is " << defaultServeMaxMB << ")" << endl;
 
 	}
 void QueryCommand::parse
@@ -110,6 +132,8 @@ void QueryCommand::parse
 	threshold_shared_positions 	= defaultQueryThreshold;
 	checkConsistency        	= false;
 	z							= 0;
+	numThreads					= 1;
+	serveMaxBytes				= defaultServeMaxMB << 20;
 
 
 	// skip command name
@@ -215,6 +239,16 @@ void QueryCommand::parse
 				continue;
 			}
 
+		// --threads=<N>
+
+		if (is_prefix_of (arg, "--threads="))
+			{
+			numThreads = string_to_int(argVal);
+			if (numThreads < 1)
+				chastise ("(in \"" + arg + "\") number of threads must be at least 1");
+			continue;
+			}
+
 		// --no-detail
 
 		if (arg == "--no-detail")
@@ -236,6 +270,27 @@ void QueryCommand::parse
 
 		
 	
+		// --serve=<address>
+
+		if (is_prefix_of (arg, "--serve="))
+			{
+			serveAddress = argVal;
+			if (serveAddress.empty())
+				chastise ("(in \"" + arg + "\") the server address is empty");
+			continue;
+			}
+
+		// --serve-max=<MB>
+
+		if (is_prefix_of (arg, "--serve-max="))
+			{
+			u64 serveMaxMB = string_to_u64(argVal);
+			if ((serveMaxMB < 1) or (serveMaxMB > (((u64) 1) << 32)))
+				chastise ("(in \"" + arg + "\") request limit must be from 1 to 4294967296 megabytes");
+			serveMaxBytes = serveMaxMB << 20;
+			continue;
+			}
+
 		// --out=<filename>, etc.
 
 		if ((is_prefix_of (arg, "--out="))
@@ -359,6 +414,17 @@ int QueryCommand::execute()
 		}
 	
 
+	// in server mode, queries are read from requests
+
+	if (not serveAddress.empty())
+		{
+		int status = serve (root);
+		FileManager::close_file();
+		if (manager != nullptr)
+			delete manager;
+		return status;
+		}
+
 	// read the queries
 
 	read_queries ();
@@ -366,7 +432,7 @@ int QueryCommand::execute()
 
 	// perform the query
 
-	root->batch_query(queries,completeSmerCounts);
+	root->batch_query(queries,completeSmerCounts,numThreads);
 
 
 	// get the smer size
@@ -390,7 +456,10 @@ int QueryCommand::execute()
 	std::streambuf * buf;
 	std::ofstream of;
 
-	if(!matchesFilename.empty()) {
+	if (matchesStream != nullptr) {
+		buf = matchesStream->rdbuf();
+	}
+	else if(!matchesFilename.empty()) {
     	of.open(matchesFilename);
     	buf = of.rdbuf();
 	} 
@@ -461,6 +530,258 @@ void QueryCommand::read_queries()
 
 
 
+//----------
+//
+// serve--
+//	Keep the tree resident and answer query requests, from stdin or from the
+//	connections to a unix socket (one connection at a time), until a "quit"
+//	request.
+//
+//----------
+
+// streambuf over a socket descriptor
+class FdStreambuf: public std::streambuf
+	{
+public:
+	FdStreambuf(int _fd): fd(_fd)
+		{ setg(inBuf,inBuf,inBuf);  setp(outBuf,outBuf+sizeof(outBuf)); }
+	virtual ~FdStreambuf() { sync(); }
+
+protected:
+	virtual int underflow()
+		{
+		if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+		ssize_t n;
+		do { n = ::read(fd,inBuf,sizeof(inBuf)); } while ((n < 0) and (errno == EINTR));
+		if (n <= 0) return traits_type::eof();
+		setg(inBuf,inBuf,inBuf+n);
+		return traits_type::to_int_type(*gptr());
+		}
+
+	virtual int overflow(int c)
+		{
+		if (sync() != 0) return traits_type::eof();
+		if (c != traits_type::eof()) { *pptr() = c;  pbump(1); }
+		return traits_type::not_eof(c);
+		}
+
+	virtual int sync()
+		{
+		for (char* p=pbase() ; p<pptr() ; )
+			{
+			ssize_t n = ::write(fd,p,pptr()-p);
+			if ((n < 0) and (errno == EINTR)) continue;
+			if (n < 0) return -1;
+			p += n;
+			}
+		setp(outBuf,outBuf+sizeof(outBuf));
+		return 0;
+		}
+
+private:
+	int fd;
+	char inBuf[1<<16];
+	char outBuf[1<<16];
+	};
+
+int QueryCommand::serve
+   (BloomTree* root)
+	{
+	root->load_all();
+
+	BloomFilter* bf = root->real_filter();
+	if (bf == nullptr)
+		fatal ("internal error: serve() unable to locate any bloom filter");
+	bf->preload();
+	unsigned int smerSize = bf->smerSize;
+
+	if (serveAddress == "-")
+		{
+		serve_requests (root, cin, cout, smerSize);
+		root->unload_all();
+		return EXIT_SUCCESS;
+		}
+
+	// a client leaving early must not kill the server
+	std::signal (SIGPIPE, SIG_IGN);
+
+	struct sockaddr_un addr;
+	std::memset (&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (serveAddress.length() >= sizeof(addr.sun_path))
+		fatal ("error: socket path \"" + serveAddress + "\" is too long");
+	std::strncpy (addr.sun_path, serveAddress.c_str(), sizeof(addr.sun_path)-1);
+
+	int listener = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		fatal ("error: unable to create socket \"" + serveAddress + "\": " + std::strerror(errno));
+	::unlink (serveAddress.c_str());
+	if ((bind (listener, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+	 || (listen (listener, 16) < 0))
+		fatal ("error: unable to listen on \"" + serveAddress + "\": " + std::strerror(errno));
+
+	cerr << "serving " << treeFilename << " on " << serveAddress << endl;
+
+	bool keepServing = true;
+	while (keepServing)
+		{
+		int conn = accept (listener, nullptr, nullptr);
+		if (conn < 0)
+			{
+			if (errno == EINTR) continue;
+			fatal (string("error: accept() failed: ") + std::strerror(errno));
+			}
+
+			{
+			FdStreambuf buf(conn);
+			std::iostream io(&buf);
+			keepServing = serve_requests (root, io, io, smerSize);
+			}
+		::close (conn);
+		}
+
+	::close (listener);
+	::unlink (serveAddress.c_str());
+	root->unload_all();
+	return EXIT_SUCCESS;
+	}
+
+// parse_request_size, parse_request_threshold, check_request_sequences--
+//	Validate the fields and the sequences of a request. Unlike string_to_u64
+//	and friends, these report failures instead of exiting, so that a malformed
+//	request doesn't kill the server.
+
+static bool parse_request_size
+   (const string&	s,
+	u64&			numBytes)
+	{
+	const char* end = s.data() + s.length();
+	auto [ptr,ec] = std::from_chars (s.data(), end, numBytes);
+	return (ec == std::errc()) and (ptr == end);
+	}
+
+static bool parse_request_threshold
+   (const string&	s,
+	double&			threshold)
+	{
+	// same forms as string_to_probability: "0.3", "30%" or "3/10"
+	const char* str = s.c_str();
+	char* end;
+	double v = std::strtod (str, &end);
+	if (end == str) return false;
+	if (*end == '%')
+		{ v /= 100.0;  end++; }
+	else if (*end == '/')
+		{
+		const char* denomStr = end+1;
+		double denom = std::strtod (denomStr, &end);
+		if ((end == denomStr) or (denom == 0)) return false;
+		v /= denom;
+		}
+	if ((*end != 0) or (not (v >= 0.0)) or (v > 1.0)) return false;
+	threshold = v;
+	return true;
+	}
+
+static bool check_request_sequences
+   (const string&	sequences)
+	{
+	// read_query_file exits if fasta headers follow a line-by-line sequence
+	std::istringstream in(sequences);
+	string line;
+	bool haveFastaHeaders = false, fileTypeKnown = false;
+	while (std::getline (in, line))
+		{
+		if (line.empty()) continue;
+		if (not fileTypeKnown)
+			{ haveFastaHeaders = (line[0] == '>');  fileTypeKnown = true; }
+		if ((line[0] == '>') and (not haveFastaHeaders)) return false;
+		}
+	return true;
+	}
+
+// serve_requests--
+//	Answer the requests of one client; returns false if the client asked the
+//	server to stop. A malformed request gets an error reply; if its size can't
+//	be parsed or is over serveMaxBytes, the connection is closed since the next
+//	request can't be found. The body is read in chunks, so a client announcing
+//	a large request it never sends doesn't get that memory allocated.
+
+bool QueryCommand::serve_requests
+   (BloomTree*			root,
+	std::istream&		in,
+	std::ostream&		out,
+	const unsigned int&	smerSize)
+	{
+	auto reply = [&](const string& status, const string& payload)
+		{
+		out << status << " " << payload.length() << "\n" << payload;
+		out.flush();
+		};
+
+	string line;
+	while (std::getline (in, line))
+		{
+		std::istringstream request(line);
+		string verb, numBytesStr, thresholdStr, extra;
+		request >> verb >> numBytesStr >> thresholdStr >> extra;
+
+		if (verb.empty()) continue;
+		if (verb == "quit") return false;
+
+		if ((verb != "query") or (numBytesStr.empty()) or (not extra.empty()))
+			{ reply ("error", "unrecognized request: \"" + line + "\"\n");  continue; }
+
+		u64 numBytes;
+		if (not parse_request_size (numBytesStr, numBytes))
+			{ reply ("error", "invalid request size: \"" + numBytesStr + "\"\n");  break; }
+		if (numBytes > serveMaxBytes)
+			{
+			reply ("error", "request too large: " + std::to_string(numBytes)
+			              + " bytes, the limit is " + std::to_string(serveMaxBytes) + "\n");
+			break;
+			}
+
+		const u64 chunkBytes = 1 << 20;
+		string sequences;
+		bool truncated = false;
+		while ((sequences.length() < numBytes) and (not truncated))
+			{
+			u64 start = sequences.length();
+			u64 n = std::min (chunkBytes, numBytes - start);
+			sequences.resize (start + n);
+			in.read (&sequences[start], n);
+			truncated = ((u64) in.gcount() != n);
+			}
+		if (truncated)
+			break;  // truncated request, the client is gone
+
+		double threshold = generalQueryThreshold;
+		if ((not thresholdStr.empty())
+		 && (not parse_request_threshold (thresholdStr, threshold)))
+			{ reply ("error", "invalid threshold: \"" + thresholdStr + "\"\n");  continue; }
+
+		if (not check_request_sequences (sequences))
+			{ reply ("error", "sequences precede first fasta header\n");  continue; }
+
+		std::istringstream sequencesIn(sequences);
+		Query::read_query_file (sequencesIn, /*filename*/ "", threshold, queries, repartitor, hash_win);
+		root->batch_query (queries, completeSmerCounts, numThreads);
+
+		std::ostringstream results;
+		print_matches_with_kmer_counts_and_spans (results, smerSize);
+		for (const auto& q : queries)
+			delete q;
+		queries.clear();
+
+		reply ("ok", results.str());
+		}
+
+	return true;
+	}
+
+
+
 /**
  * @brief From hash values associated to smers to a vector of Positive kmers. Code adapted from findere https://github.com/lrobidou/findere/, by Lucas Robidou
  * @param sequence: input sequence.
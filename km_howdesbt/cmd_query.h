@@ -7,6 +7,7 @@
 #include <iostream>
 
 #include "query.h"
+#include "bloom_tree.h"
 #include "commands.h"
 
 
@@ -16,6 +17,7 @@ class QueryCommand: public Command
 	{
 public:
 	static constexpr double defaultQueryThreshold = 0.7;  // 70%
+	static constexpr std::uint64_t defaultServeMaxMB = 64;
 
 public:
 	QueryCommand(const std::string& name): Command(name) {}
@@ -25,6 +27,9 @@ public:
 	virtual void parse (int _argc, char** _argv);
 	virtual int execute (void);
 	virtual void read_queries (void);
+	virtual int serve (BloomTree* root);
+	virtual bool serve_requests (BloomTree* root, std::istream& in, std::ostream& out,
+	                             const unsigned int& smerSize);
 	std::vector<bool> get_positive_kmers(const std::string& sequence, 
 											const std::unordered_set<std::size_t>& local_presentHashes, 
 											const unsigned int& smerSize) const;
@@ -40,6 +45,10 @@ public:
 	std::vector<std::string> queryFilenames;
 	std::vector<float> queryThresholds;
 	std::string matchesFilename;
+	std::ostream* matchesStream = nullptr;	// if set, results are written to
+											// .. it instead of matchesFilename
+	std::string serveAddress;		// unix socket path, or "-" for stdin/stdout
+	std::uint64_t serveMaxBytes;	// larger requests are refused
 	float generalQueryThreshold;
 	float threshold_shared_positions;
 	bool nodetail;
@@ -47,6 +56,7 @@ public:
 	bool checkConsistency;			// only meaningful if useFileManager is false
 	bool completeSmerCounts;
 	int z; 							// findere strategy
+	int numThreads;					// queries are shared between threads
 
 	// needed for findere approach: from smers to hash values when printing results
     std::shared_ptr<km::Repartition> repartitor; 
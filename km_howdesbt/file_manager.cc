@@ -28,8 +28,8 @@ using std::endl;
 //----------
 
 
-string         FileManager::openedFilename  = "";
-std::ifstream* FileManager::openedFile      = nullptr;
+thread_local string         FileManager::openedFilename  = "";
+thread_local std::ifstream* FileManager::openedFile      = nullptr;
 
 //----------
 //
@@ -217,7 +217,8 @@ void FileManager::load_content
 //----------
 //
 // CAVEAT:	Any command that reads bit vectors needs to call close_file()
-//			before exit, to avoid a memory leak.
+//			before exit, to avoid a memory leak. The same goes for any thread
+//			that reads bit vectors, before it terminates.
 //
 //----------
 
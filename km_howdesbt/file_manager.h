@@ -55,8 +55,10 @@ public:
 	static void           close_file (std::ifstream* in=nullptr, bool really=false);
 
 public:
-	static std::string    openedFilename;
-	static std::ifstream* openedFile;
+	// the opened file is kept per thread, so that threads building or
+	// searching separate subtrees don't close each other's files
+	static thread_local std::string    openedFilename;
+	static thread_local std::ifstream* openedFile;
 	};
 
 #endif // file_manager_H
@@ -85,6 +85,16 @@ void Query::smerize
 	if (seq.length() < smerSize)
 		return;
 
+	// in kmtricks mode, smers are hashed with a rolling encoder, O(L) over
+	// the sequence
+
+	if (m_repartitor)
+		{
+		smerHashes.reserve(seq.length() - smerSize + 1);
+		km::const_loop_executor<0, KMER_N>::exec<SeqHash>(smerSize, seq, smerSize, m_hash_win, m_repartitor, m_minim_size, smerHashes);
+		return;
+		}
+
 	// scan the sequence's smers, convert to hash positions, and collect the
 	// distinct positions; optionally collect the corresponding smers
 
@@ -98,15 +108,7 @@ void Query::smerize
 		if (++goodNtRunLen < smerSize) continue;
 
 		string mer = seq.substr(ix+1-smerSize,smerSize);
-        u64 hash_value = 0;
-        if (m_repartitor)
-        {
-          km::const_loop_executor<0, KMER_N>::exec<KmerHash>(smerSize, mer, m_hash_win, m_repartitor, m_minim_size, hash_value);
-        }
-        else
-        {
-		  hash_value = bf->mer_to_hash_value(mer);
-        }
+		u64 hash_value = bf->mer_to_hash_value(mer);
 		if (hash_value != BloomFilter::npos)
 			{
 			smerHashes.emplace_back(std::pair<std::uint64_t, std::size_t>(hash_value, ix - smerSize + 1));
@@ -161,14 +163,25 @@ void Query::read_query_file
     std::string& repartFileName,
     std::string& winFileName)
 	{
+    std::shared_ptr<km::Repartition> repartitor = std::make_shared<km::Repartition>(repartFileName, "");
+    std::shared_ptr<km::HashWindow> hwin = std::make_shared<km::HashWindow>(winFileName);
+	read_query_file (in, _filename, threshold, queries, repartitor, hwin);
+	}
+
+void Query::read_query_file
+   (std::istream&	in,
+	const string&	_filename,
+	double			threshold,
+	vector<Query*>&	queries,
+	std::shared_ptr<km::Repartition> repartitor,
+	std::shared_ptr<km::HashWindow> hwin)
+	{
 	bool			fileTypeKnown = false;
 	bool			haveFastaHeaders = false;
 	querydata		qd;
 
 	// derive a name to use for nameless sequences
 
-    std::shared_ptr<km::Repartition> repartitor = std::make_shared<km::Repartition>(repartFileName, "");
-    std::shared_ptr<km::HashWindow> hwin = std::make_shared<km::HashWindow>(winFileName);
 	string filename(_filename);
 	if (filename.empty())
 		filename = "(stdin)";
@@ -9,12 +9,15 @@
 #include "bloom_filter.h"
 
 #define KMTRICKS_PUBLIC
+#ifndef WITH_XXHASH
 #define WITH_XXHASH
+#endif
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/kmer_hash.hpp>
 #include <kmtricks/hash.hpp>
 #include <kmtricks/repartition.hpp>
 #include <kmtricks/loop_executor.hpp>
+#include <kmtricks/rolling_kmer.hpp>
 
 
 template<size_t KSIZE>
@@ -28,6 +31,24 @@ struct KmerHash
   }
 };
 
+// Same hashes as KmerHash on each smer of seq, in a single pass over the sequence
+template<size_t KSIZE>
+struct SeqHash
+{
+  void operator()(const std::string& seq, uint32_t smer_size, std::shared_ptr<km::HashWindow> hw, std::shared_ptr<km::Repartition> repart, uint32_t minim, std::vector<std::pair<std::uint64_t,std::size_t>>& hashes)
+  {
+    km::RollingKmer<KSIZE> roll(smer_size, minim);
+    uint64_t w = hw->get_window_size_bits();
+    for (size_t ix=0; ix<seq.length(); ix++)
+    {
+      if (!roll.push(seq[ix]))
+        continue;
+      uint32_t part = repart->get_partition(roll.minimizer());
+      hashes.emplace_back(km::KmerHashers<1>::WinHasher<KSIZE>(part, w)(roll.canonical()), ix + 1 - smer_size);
+    }
+  }
+};
+
 //----------
 //
 // classes in this module--
@@ -105,6 +126,11 @@ public:
 	                             double threshold,
 	                             std::vector<Query*>& queries,
                                  std::string& repartFileName, std::string& winFileName);
+	static void read_query_file (std::istream& in, const std::string& filename,
+	                             double threshold,
+	                             std::vector<Query*>& queries,
+	                             std::shared_ptr<km::Repartition> repartitor,
+	                             std::shared_ptr<km::HashWindow> hwin);
 	};
 
 #endif // query_H
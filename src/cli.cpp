@@ -42,6 +42,7 @@ kmtricksCli::kmtricksCli(
   index_opt = std::make_shared<struct index_options>(index_options{});
   query_opt = std::make_shared<struct query_options>(query_options{});
   combine_opt = std::make_shared<struct combine_options>(combine_options{});
+  mquery_opt = std::make_shared<struct mquery_options>(mquery_options{});
   all_cli(cli, all_opt);
 #ifdef WITH_KM_MODULES
   repart_cli(cli, repart_opt);
@@ -54,6 +55,7 @@ kmtricksCli::kmtricksCli(
   dump_cli(cli, dump_opt);
   agg_cli(cli, agg_opt);
   combine_cli(cli, combine_opt);
+  mquery_cli(cli, mquery_opt);
 #ifdef WITH_HOWDE
   index_cli(cli, index_opt);
   query_cli(cli, query_opt);
@@ -108,6 +110,8 @@ std::tuple<COMMAND, km_options_t> kmtricksCli::parse(int argc, char* argv[])
     return std::make_tuple(COMMAND::QUERY, query_opt);
   else if (cli->is("combine"))
     return std::make_tuple(COMMAND::COMBINE, combine_opt);
+  else if (cli->is("mquery"))
+    return std::make_tuple(COMMAND::MQUERY, mquery_opt);
   else
     return std::make_tuple(COMMAND::INFOS, std::make_shared<struct km_options>(km_options{}));
 }
@@ -171,6 +175,7 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
                             "hash:pa:text|"
                             "hash:pa:bin|"
                             "hash:bf:bin|"
+                            "hash:bf:blk|"
                             "hash:bft:bin|"
                             "hash:bfc:bin";
     auto s = bc::utils::split(v, ':');
@@ -185,7 +190,10 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     format = s[1];
     out = s[2];
 
-    if (out != "text" && out != "bin")
+    if (out != "text" && out != "bin" && out != "blk")
+      goto fail;
+
+    if (out == "blk" && format != "bf")
       goto fail;
 
     if (format != "count" && format != "pa" && format != "bf" && format != "bft" && format != "bfc")
@@ -316,6 +324,10 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->checker(bc::check::is_number)
     ->setter(options->nb_parts);
 
+  all_cmd->add_param("--balanced-repart", "balance partitions on distinct k-mers sampled from all samples.")
+    ->as_flag()
+    ->setter(options->repart_balance);
+
   all_cmd->add_param("--restrict-to", "Process only a fraction of partitions. [0.05, 1.0]")
     ->meta("FLOAT")
     ->def("1.0")
@@ -339,10 +351,36 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->checker(bc::check::f::range(0.0, 1.0))
     ->setter(options->focus);
 
+  all_cmd->add_param("--plan", "choose --nb-partitions, --threads and --focus from a sample of the reads, implies --balanced-repart.")
+    ->as_flag()
+    ->setter(options->plan);
+
+  all_cmd->add_param("--max-memory", "memory budget in MB, used by --plan and the configuration.")
+    ->meta("INT")
+    ->def("8000")
+    ->checker(bc::check::is_number)
+    ->setter(options->max_memory);
+
+  all_cmd->add_param("--max-disk", "disk budget in MB for --plan, 0=unlimited.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->max_disk);
+
+  all_cmd->add_param("--stream-mem", "stream counts to merge in memory (MB), spill beyond. 0=disabled, hash mode only.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->stream_mem);
+
   all_cmd->add_param("--cpr", "compression for kmtricks's tmp files.")
     ->as_flag()
     ->setter(options->lz4);
 
+  all_cmd->add_param("--cpr-async", "(de)compress on helper threads, one per open file, with --cpr.")
+    ->as_flag()
+    ->setter(options->lz4_async);
+
   all_cmd->add_group("hash mode configuration", "");
 
   all_cmd->add_param("--bloom-size", "bloom filter size")
@@ -440,6 +478,10 @@ km_options_t repart_cli(std::shared_ptr<bc::Parser<1>> cli, repart_options_t opt
     ->checker(bc::check::is_number)
     ->setter(options->nb_parts);
 
+  repart_cmd->add_param("--balanced-repart", "balance partitions on distinct k-mers sampled from all samples.")
+    ->as_flag()
+    ->setter(options->balance);
+
   repart_cmd->add_param("--bloom-size", "bloom filter size")
     ->meta("INT")
     ->def("10000000")
@@ -525,6 +567,10 @@ km_options_t count_cli(std::shared_ptr<bc::Parser<1>> cli, count_options_t optio
     ->as_flag()
     ->setter(options->lz4);
 
+  count_cmd->add_param("--cpr-async", "(de)compress on helper threads, one per open file, with --cpr.")
+    ->as_flag()
+    ->setter(options->lz4_async);
+
   add_common(count_cmd, options);
   return options;
 }
@@ -595,6 +641,7 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
                             "hash:pa:text|"
                             "hash:pa:bin|"
                             "hash:bf:bin|"
+                            "hash:bf:blk|"
                             "hash:bft:bin";
     auto s = bc::utils::split(v, ':');
     std::string mode;
@@ -608,6 +655,12 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
     format = s[1];
     out = s[2];
 
+    if (out != "text" && out != "bin" && out != "blk")
+      goto fail;
+
+    if (out == "blk" && format != "bf")
+      goto fail;
+
     if (format != "count" && format != "pa" && format != "bf" && format != "bft")
       goto fail;
 
@@ -646,6 +699,10 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
     ->as_flag()
     ->setter(options->lz4);
 
+  merge_cmd->add_param("--cpr-async", "(de)compress on helper threads, one per open file, with --cpr.")
+    ->as_flag()
+    ->setter(options->lz4_async);
+
   add_common(merge_cmd, options);
   return options;
 }
@@ -750,6 +807,43 @@ km_options_t combine_cli(std::shared_ptr<bc::Parser<1>> cli, combine_options_t o
   return options;
 }
 
+km_options_t mquery_cli(std::shared_ptr<bc::Parser<1>> cli, mquery_options_t options)
+{
+  bc::cmd_t mquery_cmd = cli->add_command(
+      "mquery", "Query the Bloom matrices of a hash:bf, hash:bf:blk or hash:bft run, without index.");
+
+  mquery_cmd->add_param("--run-dir", "kmtricks runtime directory.")
+    ->meta("DIR")
+    ->checker(bc::check::is_dir)
+    ->setter(options->dir);
+
+  mquery_cmd->add_param("--query", "query file (fasta/fastq).")
+    ->meta("FILE")
+    ->checker(bc::check::is_file)
+    ->setter(options->query);
+
+  mquery_cmd->add_param("--output", "output file.")
+    ->meta("FILE")
+    ->def("stdout")
+    ->setter(options->output);
+
+  mquery_cmd->add_param("--threshold",
+                        "fraction of query kmers that must be present in a sample to be reported.")
+    ->meta("FLOAT")
+    ->def("0.7")
+    ->checker(bc::check::f::range(0.0, 1.0))
+    ->setter(options->threshold);
+
+  mquery_cmd->add_param("--blk-cache", "decompressed blocks cached per partition (hash:bf:blk).")
+    ->meta("INT")
+    ->def("64")
+    ->checker(bc::check::is_number)
+    ->setter(options->cache_blocks);
+
+  add_common(mquery_cmd, options);
+  return options;
+}
+
 km_options_t agg_cli(std::shared_ptr<bc::Parser<1>> cli, agg_options_t options)
 {
   bc::cmd_t agg_cmd = cli->add_command("aggregate", "Aggregate partition files.");
@@ -786,10 +880,10 @@ km_options_t agg_cli(std::shared_ptr<bc::Parser<1>> cli, agg_options_t options)
     ->setter(options->matrix);
 
 
-  agg_cmd->add_param("--pa-matrix", "aggregate presence/absence matrices. [kmer|hash]")
+  agg_cmd->add_param("--pa-matrix", "aggregate presence/absence matrices, blk for hash:bf:blk. [kmer|hash|blk]")
     ->meta("TYPE:P")
     ->def("")
-    ->checker(bc::check::f::in("kmer|hash"))
+    ->checker(bc::check::f::in("kmer|hash|blk"))
     ->setter(options->pa_matrix);
 
   agg_cmd->add_group("I/O options", "");
@@ -972,6 +1066,18 @@ km_options_t index_cli(std::shared_ptr<bc::Parser<1>> cli, index_options_t optio
     ->as_flag()
     ->setter(options->keep);
 
+  index_cmd->add_param("--neighbors", "only merge nodes with their INT nearest neighbors, 0 means all pairs.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->neighbors);
+
+  index_cmd->add_param("--sketch", "with --neighbors, preselect neighbors on INT sampled bits of each filter.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->sketch);
+
   index_cmd->add_group("Build options", "");
 
   index_cmd->add_param("--howde", "equivalent to --determined,brief --rrr")
@@ -1003,6 +1109,12 @@ km_options_t index_cli(std::shared_ptr<bc::Parser<1>> cli, index_options_t optio
     ->as_flag()
     ->setter(options->roar);
 
+  index_cmd->add_param("--build-mem", "memory held by filters waiting for their parent (MB), 0=unlimited.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->build_mem);
+
   add_common(index_cmd, options);
   return options;
 }
@@ -1016,9 +1128,20 @@ km_options_t query_cli(std::shared_ptr<bc::Parser<1>> cli, query_options_t optio
 
   query_cmd->add_param("--query", "query file (fasta/fastq/txt)")
     ->meta("FILE")
+    ->def("")
     ->checker(bc::check::is_file)
     ->setter(options->query);
 
+  query_cmd->add_param("--serve",
+                       "keep the index loaded and answer queries on a unix socket, or on \n" \
+         "                                    stdin/stdout with '-', instead of querying --query. \n" \
+         "                                    A request is 'query <N> [threshold]' followed by N bytes \n" \
+         "                                    of sequences, the reply is 'ok <N>' followed by N bytes \n" \
+         "                                    of results. 'quit' stops the server.")
+    ->meta("STR")
+    ->def("")
+    ->setter(options->serve);
+
   query_cmd->add_param("--output", "output file.")
     ->meta("FILE")
     ->def("stdout")
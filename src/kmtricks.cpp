@@ -104,6 +104,10 @@ int main(int argc, char* argv[])
     {
       const_loop_executor<0, KMER_N>::exec<main_combine>(kmer_size, options);
     }
+    else if (cmd == COMMAND::MQUERY)
+    {
+      const_loop_executor<0, KMER_N>::exec<main_mquery>(kmer_size, options);
+    }
 #ifdef WITH_HOWDE
     else if (cmd == COMMAND::INDEX)
     {
@@ -3,12 +3,11 @@
 
 namespace km {
 
-void format_result_vector(const std::string& path,
+void format_result_vector(std::istream& in,
                           std::ostream& stream,
                           std::vector<std::string>& query_idx,
                           Fof& fof)
 {
-  std::ifstream in(path, std::ios::in); check_fstream_good(path, in);
   std::vector<char> res(fof.size(), '0');
   std::string name = "";
   size_t qid = 0;
@@ -41,12 +40,11 @@ void format_result_vector(const std::string& path,
   stream << "\n";
 }
 
-void format_result_list(const std::string& path,
+void format_result_list(std::istream& in,
                         std::ostream& stream,
                         std::vector<std::string>& query_idx,
                         Fof& fof)
 {
-  std::ifstream in(path, std::ios::in); check_fstream_good(path, in);
   std::vector<std::string> res;
   std::string name = "";
   size_t qid = 0;
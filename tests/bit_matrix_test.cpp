@@ -97,3 +97,59 @@ TEST(BitMatrix, bitmatrix_tranpose)
   delete trp;
   delete rev;
 }
+
+TEST(BitMatrix, bitmatrix_transpose_tail)
+{
+  // 104 rows: 32-row blocks, then a 16-row and a 8-row remainder
+  BitMatrix mat(104, 5, true);
+  for (size_t i=0; i<104; i++)
+    for (size_t j=0; j<40; j++)
+      mat.set_bit(i, j, (i * 7 + j * 3) % 5 == 0);
+
+  BitMatrix *trp = mat.transpose();
+  BitMatrix *rev = trp->transpose();
+  EXPECT_TRUE(!memcmp(mat.matrix, rev->matrix, mat.get_size_in_byte()));
+  for (size_t i=0; i<104; i++)
+    for (size_t j=0; j<40; j++)
+      EXPECT_EQ(mat.get_bit(i, j), trp->get_bit(j, i ^ 7));
+  delete trp;
+  delete rev;
+}
+
+TEST(BitMatrix, transposed_writer)
+{
+  uint32_t bits = 37;
+  uint64_t window = 203;
+  size_t nbytes = NBYTES(bits);
+  BitMatrix mat(ROUND_UP(window, 8), nbytes, true);
+  std::vector<std::vector<uint8_t>> rows;
+  for (size_t i=0; i<window; i++)
+  {
+    std::vector<uint8_t> row(nbytes, 0);
+    for (size_t j=0; j<bits; j++)
+      if ((i * 13 + j * 5) % 7 < 2)
+        BITSET(row, j);
+    std::copy(row.begin(), row.end(), mat.matrix + i * nbytes);
+    rows.push_back(row);
+  }
+  BitMatrix *trp = mat.transpose();
+
+  for (bool lz4 : {false, true})
+  {
+    std::string path = lz4 ? "./tests_tmp/2.bit_matrix.lz4" : "./tests_tmp/2.bit_matrix";
+    {
+      // small tiles to flush several times
+      TransposedVectorMatrixWriter<> tvmw(path, bits, 0, 1, 10, window, lz4, 64);
+      for (auto& row : rows)
+        tvmw.write(row);
+    }
+    BitMatrix res(ROUND_UP(bits, 8), NBYTES(window), false);
+    VectorMatrixReader<> vmr(path);
+    EXPECT_EQ(vmr.infos().bits, bits);
+    EXPECT_EQ(vmr.infos().window, window);
+    EXPECT_EQ(vmr.infos().first, 10);
+    vmr.load(res);
+    EXPECT_TRUE(!memcmp(trp->matrix, res.matrix, trp->get_size_in_byte()));
+  }
+  delete trp;
+}
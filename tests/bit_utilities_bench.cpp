@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// Throughput of the km_howdesbt bitwise kernels (scalar, popcnt, avx2, bmi2).
+// usage: kmtricks-bitwise-bench [nb_bits] [nb_rounds]
+// GB/s counts the bytes read from the input arrays, nb_bits defaults to a
+// 1M-bits filter, i.e. the arrays stay in cache.
+
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <functional>
+#include <kmtricks/timer.hpp>
+#include "bit_utilities.h"
+
+volatile uint64_t sink = 0;
+
+double gbps(size_t bytes, size_t rounds, const std::function<void()>& fn)
+{
+  fn();
+  km::Timer timer;
+  for (size_t i=0; i<rounds; i++)
+    fn();
+  double sec = timer.elapsed<std::chrono::nanoseconds>().count() / 1e9;
+  return (bytes * rounds) / sec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+  uint64_t nb_bits = argc > 1 ? std::stoull(argv[1]) : (1ULL << 20);
+  size_t rounds = argc > 2 ? std::stoull(argv[2]) : 2000;
+
+  size_t bytes = (nb_bits + 7) / 8;
+  std::mt19937_64 g(42);
+  std::vector<uint8_t> a(bytes), b(bytes), dst(bytes), spec(bytes);
+  for (size_t i=0; i<bytes; i++)
+  {
+    a[i] = g();
+    b[i] = g();
+    spec[i] = g() | g();
+  }
+  uint64_t nb_squeezed = bitwise_count(spec.data(), nb_bits);
+
+  const std::vector<std::pair<std::string, std::function<void()>>> kernels = {
+    {"count", [&](){ sink += bitwise_count(a.data(), nb_bits); }},
+    {"and_count", [&](){ sink += bitwise_and_count(a.data(), b.data(), nb_bits); }},
+    {"mask_count", [&](){ sink += bitwise_mask_count(a.data(), b.data(), nb_bits); }},
+    {"or_count", [&](){ sink += bitwise_or_count(a.data(), b.data(), nb_bits); }},
+    {"xor_count", [&](){ sink += bitwise_xor_count(a.data(), b.data(), nb_bits); }},
+    {"and", [&](){ bitwise_and(a.data(), b.data(), dst.data(), nb_bits); }},
+    {"mask", [&](){ bitwise_mask(a.data(), b.data(), dst.data(), nb_bits); }},
+    {"or", [&](){ bitwise_or(a.data(), b.data(), dst.data(), nb_bits); }},
+    {"or_inplace", [&](){ bitwise_or(dst.data(), b.data(), nb_bits); }},
+    {"squeeze", [&](){ sink += bitwise_squeeze(a.data(), spec.data(), nb_bits, dst.data()); }},
+    {"unsqueeze", [&](){ sink += bitwise_unsqueeze(a.data(), nb_squeezed, spec.data(), nb_bits, dst.data()); }},
+  };
+
+  std::vector<int> impls;
+  for (int k : {bitwise_kernel_scalar, bitwise_kernel_popcnt, bitwise_kernel_avx2, bitwise_kernel_bmi2})
+    if (bitwise_kernel_supported(k))
+      impls.push_back(k);
+
+  std::cout << "kernel";
+  for (int k : impls)
+    std::cout << "\t" << bitwise_kernel_name(k) << "_GB/s";
+  std::cout << "\n" << std::fixed << std::setprecision(2);
+
+  for (auto& [name, fn] : kernels)
+  {
+    bool count = name.find("count") != std::string::npos;
+    bool squeeze = name.find("squeeze") != std::string::npos;
+    size_t in_bytes = (name == "count") ? bytes : 2 * bytes;
+    std::cout << name;
+    for (int k : impls)
+    {
+      bitwise_set_kernel(k);
+      std::cout << "\t" << gbps(in_bytes, count ? rounds : squeeze ? rounds / 20 : rounds / 2, fn);
+    }
+    std::cout << "\n";
+  }
+  return 0;
+}
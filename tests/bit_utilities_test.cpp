@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <functional>
+#include "bit_utilities.h"
+
+namespace {
+
+using bits_t = std::vector<uint8_t>;
+using op_t = std::function<bool(bool, bool)>;
+
+const std::vector<int> kernels = {
+  bitwise_kernel_scalar, bitwise_kernel_popcnt, bitwise_kernel_avx2, bitwise_kernel_bmi2
+};
+
+// sizes around the 64-bit, 256-bit and 16 x 256-bit (Harley-Seal) boundaries
+const std::vector<uint64_t> sizes = {
+  0, 1, 7, 8, 63, 64, 65, 255, 256, 257, 1000, 4095, 4096, 4097, 8192 + 4 * 256 + 77, 40000
+};
+
+bits_t random_bits(size_t bytes, std::mt19937& g)
+{
+  bits_t bits(bytes);
+  for (auto& b : bits)
+    b = g();
+  return bits;
+}
+
+// each bit is set with probability density
+bits_t random_bits(size_t bytes, double density, std::mt19937& g)
+{
+  std::bernoulli_distribution d(density);
+  bits_t bits(bytes, 0);
+  for (size_t i = 0; i < bytes * 8; i++)
+    bits[i / 8] |= d(g) << (i % 8);
+  return bits;
+}
+
+bool bit(const bits_t& bits, uint64_t i)
+{
+  return (bits[i / 8] >> (i % 8)) & 1;
+}
+
+uint64_t ref_count(const bits_t& a, const bits_t& b, uint64_t numBits, op_t op)
+{
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < numBits; i++)
+    n += op(bit(a, i), bit(b, i));
+  return n;
+}
+
+// leftover bits of the last byte are zero for the three-operand forms, and
+// unchanged for the in-place forms
+bits_t ref_op(const bits_t& a, const bits_t& b, uint64_t numBits, op_t op, bool in_place)
+{
+  bits_t dst(a.size(), 0);
+  if (in_place)
+    dst = a;
+  for (uint64_t i = 0; i < numBits; i++)
+  {
+    uint8_t m = 1 << (i % 8);
+    dst[i / 8] = op(bit(a, i), bit(b, i)) ? dst[i / 8] | m : dst[i / 8] & ~m;
+  }
+  return dst;
+}
+
+class KernelGuard
+{
+public:
+  KernelGuard() : m_kernel(bitwise_get_kernel()) {}
+  ~KernelGuard() { bitwise_set_kernel(m_kernel); }
+private:
+  int m_kernel;
+};
+
+};
+
+TEST(bit_utilities, kernel_selection)
+{
+  KernelGuard guard;
+  EXPECT_TRUE(bitwise_kernel_supported(bitwise_kernel_scalar));
+  EXPECT_TRUE(bitwise_set_kernel(bitwise_kernel_scalar));
+  EXPECT_EQ(bitwise_get_kernel(), bitwise_kernel_scalar);
+  EXPECT_TRUE(bitwise_set_kernel(bitwise_kernel_auto));
+  EXPECT_NE(bitwise_get_kernel(), bitwise_kernel_auto);
+  EXPECT_TRUE(bitwise_kernel_supported(bitwise_get_kernel()));
+  EXPECT_STREQ(bitwise_kernel_name(bitwise_kernel_avx2), "avx2");
+}
+
+TEST(bit_utilities, counts)
+{
+  KernelGuard guard;
+  std::mt19937 g(42);
+
+  for (auto numBits : sizes)
+  {
+    // arrays start at an odd offset to exercise unaligned accesses
+    size_t bytes = (numBits + 7) / 8;
+    bits_t a = random_bits(bytes + 1, g);
+    bits_t b = random_bits(bytes + 1, g);
+    const uint8_t* pa = a.data() + 1;
+    const uint8_t* pb = b.data() + 1;
+    bits_t sa(a.begin() + 1, a.end());
+    bits_t sb(b.begin() + 1, b.end());
+
+    uint64_t count = ref_count(sa, sa, numBits, [](bool x, bool) { return x; });
+    uint64_t and_c = ref_count(sa, sb, numBits, [](bool x, bool y) { return x && y; });
+    uint64_t mask_c = ref_count(sa, sb, numBits, [](bool x, bool y) { return x && !y; });
+    uint64_t or_c = ref_count(sa, sb, numBits, [](bool x, bool y) { return x || y; });
+    uint64_t or_not_c = ref_count(sa, sb, numBits, [](bool x, bool y) { return x || !y; });
+    uint64_t xor_c = ref_count(sa, sb, numBits, [](bool x, bool y) { return x != y; });
+
+    for (auto kernel : kernels)
+    {
+      if (!bitwise_set_kernel(kernel))
+        continue;
+      SCOPED_TRACE(std::string(bitwise_kernel_name(kernel)) + " " + std::to_string(numBits));
+      EXPECT_EQ(bitwise_count(pa, numBits), count);
+      EXPECT_EQ(bitwise_and_count(pa, pb, numBits), and_c);
+      EXPECT_EQ(bitwise_mask_count(pa, pb, numBits), mask_c);
+      EXPECT_EQ(bitwise_or_count(pa, pb, numBits), or_c);
+      EXPECT_EQ(bitwise_or_not_count(pa, pb, numBits), or_not_c);
+      EXPECT_EQ(bitwise_xor_count(pa, pb, numBits), xor_c);
+      EXPECT_EQ(hamming_distance(pa, pb, numBits), xor_c);
+    }
+  }
+}
+
+TEST(bit_utilities, operations)
+{
+  using fn3_t = void (*)(const void*, const void*, void*, const uint64_t);
+  using fn2_t = void (*)(void*, const void*, const uint64_t);
+  struct operation { fn3_t fn3; fn2_t fn2; op_t op; };
+
+  const std::vector<operation> operations = {
+    { bitwise_and, bitwise_and, [](bool x, bool y) { return x && y; } },
+    { bitwise_mask, bitwise_mask, [](bool x, bool y) { return x && !y; } },
+    { bitwise_or, bitwise_or, [](bool x, bool y) { return x || y; } },
+    { bitwise_or_not, bitwise_or_not, [](bool x, bool y) { return x || !y; } },
+    { bitwise_xor, bitwise_xor, [](bool x, bool y) { return x != y; } },
+    { bitwise_xnor, bitwise_xnor, [](bool x, bool y) { return x == y; } },
+  };
+
+  KernelGuard guard;
+  std::mt19937 g(42);
+
+  for (auto numBits : sizes)
+  {
+    size_t bytes = (numBits + 7) / 8;
+    bits_t a = random_bits(bytes, g);
+    bits_t b = random_bits(bytes, g);
+
+    for (size_t o = 0; o < operations.size(); o++)
+    {
+      bits_t expected = ref_op(a, b, numBits, operations[o].op, false);
+      bits_t expected_in_place = ref_op(a, b, numBits, operations[o].op, true);
+
+      for (auto kernel : kernels)
+      {
+        if (!bitwise_set_kernel(kernel))
+          continue;
+        SCOPED_TRACE(std::string(bitwise_kernel_name(kernel)) + " op " + std::to_string(o) +
+                     " " + std::to_string(numBits));
+
+        bits_t dst(bytes, 0xAA);
+        operations[o].fn3(a.data(), b.data(), dst.data(), numBits);
+        EXPECT_EQ(dst, expected);
+
+        bits_t in_place = a;
+        operations[o].fn2(in_place.data(), b.data(), numBits);
+        EXPECT_EQ(in_place, expected_in_place);
+      }
+    }
+  }
+}
+
+TEST(bit_utilities, squeeze)
+{
+  KernelGuard guard;
+  std::mt19937 g(42);
+
+  for (auto numBits : sizes)
+  {
+    size_t bytes = (numBits + 7) / 8;
+    for (double density : {0.0, 0.1, 0.5, 0.9, 1.0})
+    {
+      bits_t src = random_bits(bytes, g);
+      bits_t spec = random_bits(bytes, density, g);
+
+      bits_t expected(bytes, 0);
+      uint64_t numSqueezed = 0;
+      for (uint64_t i = 0; i < numBits; i++)
+      {
+        if (!bit(spec, i))
+          continue;
+        expected[numSqueezed / 8] |= bit(src, i) << (numSqueezed % 8);
+        numSqueezed++;
+      }
+
+      // the default destination length, and a shorter one to go through the overrun path
+      for (uint64_t numDstBits : {numBits, numSqueezed / 2 + 3})
+      {
+        numDstBits = std::min(numDstBits, numBits);
+        uint64_t expected_ret = std::min(numSqueezed, numDstBits);
+        bits_t first;
+
+        for (auto kernel : kernels)
+        {
+          if (!bitwise_set_kernel(kernel))
+            continue;
+          SCOPED_TRACE(std::string(bitwise_kernel_name(kernel)) + " " + std::to_string(numBits) +
+                       " " + std::to_string(density) + " " + std::to_string(numDstBits));
+
+          bits_t dst(bytes, 0);
+          uint64_t ret = bitwise_squeeze(src.data(), spec.data(), numBits, dst.data(), numDstBits);
+          EXPECT_EQ(ret, expected_ret);
+          for (uint64_t i = 0; i < ret; i++)
+            ASSERT_EQ(bit(dst, i), bit(expected, i)) << i;
+          if (first.empty())
+            first = dst;
+          EXPECT_EQ(dst, first);
+
+          // unsqueeze back, positions of spec not covered by the squeezed bits are zero
+          bits_t back(bytes, 0);
+          ret = bitwise_unsqueeze(dst.data(), ret, spec.data(), numBits, back.data());
+          EXPECT_EQ(ret, numBits);
+          uint64_t k = 0;
+          for (uint64_t i = 0; i < numBits; i++)
+          {
+            bool b = bit(spec, i) && (k++ < expected_ret) && bit(src, i);
+            ASSERT_EQ(bit(back, i), b) << i;
+          }
+        }
+      }
+    }
+  }
+}
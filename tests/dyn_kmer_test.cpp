@@ -0,0 +1,87 @@
+#include <string>
+#include <gtest/gtest.h>
+#include <kmtricks/dyn_kmer.hpp>
+#include <kmtricks/utils.hpp>
+
+using namespace km;
+
+template<size_t MAX_K>
+void check_dyn_kmer(size_t kmer_size)
+{
+  for (size_t n=0; n<50; n++)
+  {
+    std::string s = random_dna_seq(kmer_size);
+    Kmer<MAX_K> kmer(s);
+    DynKmer dkmer(s);
+
+    EXPECT_EQ(dkmer.size(), kmer_size);
+    EXPECT_EQ(dkmer.to_string(), s);
+    EXPECT_TRUE(std::equal(dkmer.data(), dkmer.data() + dkmer.words(), kmer.get_data64()));
+    EXPECT_EQ(DynKmer(kmer), dkmer);
+    EXPECT_EQ(dkmer.to_kmer<MAX_K>(), kmer);
+
+    EXPECT_EQ(dkmer.rev_comp().to_string(), kmer.rev_comp().to_string());
+    EXPECT_EQ(dkmer.canonical().to_string(), kmer.canonical().to_string());
+    Kmer<MAX_K> cano = kmer.canonical();
+    EXPECT_EQ(dkmer.canonical().minimizer(10), cano.minimizer(10).value());
+    EXPECT_EQ(dkmer.minimizer(4), kmer.minimizer(4).value());
+
+    std::string t = random_dna_seq(kmer_size);
+    Kmer<MAX_K> other(t);
+    EXPECT_EQ(dkmer < DynKmer(t), kmer < other);
+    EXPECT_EQ(DynKmer(t) < dkmer, other < kmer);
+
+    // rolling
+    std::string next = s.substr(1) + "G";
+    DynKmer rolled = dkmer;
+    rolled.push(NToB[static_cast<uint8_t>('G')]);
+    EXPECT_EQ(rolled.to_string(), next);
+  }
+}
+
+TEST(dyn_kmer, same_as_kmer)
+{
+  check_dyn_kmer<32>(21);
+  check_dyn_kmer<32>(32);
+  check_dyn_kmer<64>(33);
+  check_dyn_kmer<64>(63);
+  check_dyn_kmer<64>(64);
+  check_dyn_kmer<96>(65);
+  check_dyn_kmer<96>(77);
+  check_dyn_kmer<128>(128);
+  check_dyn_kmer<256>(201);
+}
+
+TEST(dyn_kmer, sizes)
+{
+  DynKmer a(random_dna_seq(21));
+  DynKmer b(random_dna_seq(111));
+  EXPECT_EQ(a.size(), 21);
+  EXPECT_EQ(b.size(), 111);
+  EXPECT_EQ(b.words(), 4);
+  EXPECT_NE(a, b);
+  EXPECT_THROW(DynKmer(300), KSizeError);
+  EXPECT_THROW(a.to_kmer<16>(), KSizeError);
+}
+
+TEST(dyn_kmer, vector)
+{
+  for (size_t k : {15, 31, 47, 90, 121, 180})
+  {
+    DynKmerVector v(k);
+    std::vector<DynKmer> ref;
+    for (size_t i=0; i<500; i++)
+    {
+      ref.emplace_back(random_dna_seq(k));
+      v.push_back(ref.back());
+    }
+    EXPECT_EQ(v.size(), 500);
+    EXPECT_EQ(v[10], ref[10]);
+    EXPECT_THROW(v.push_back(DynKmer(k + 1)), KSizeError);
+
+    v.sort();
+    std::sort(ref.begin(), ref.end());
+    for (size_t i=0; i<ref.size(); i++)
+      EXPECT_EQ(v[i], ref[i]) << k;
+  }
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <zlib.h>
+#include <kmtricks/io/fastx_reader.hpp>
+
+using namespace km;
+
+std::string deflate_raw(const std::string& data)
+{
+  z_stream strm {};
+  deflateInit2(&strm, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&strm, data.size()), '\0');
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  strm.avail_in = data.size();
+  strm.next_out = reinterpret_cast<Bytef*>(out.data());
+  strm.avail_out = out.size();
+  deflate(&strm, Z_FINISH);
+  out.resize(strm.total_out);
+  deflateEnd(&strm);
+  return out;
+}
+
+void put_u16(std::string& s, uint16_t v) { s.push_back(v & 0xff); s.push_back(v >> 8); }
+void put_u32(std::string& s, uint32_t v) { put_u16(s, v & 0xffff); put_u16(s, v >> 16); }
+
+std::string bgzf_block(const std::string& data)
+{
+  std::string cdata = deflate_raw(data);
+  std::string block = {'\x1f', '\x8b', 8, 4, 0, 0, 0, 0, 0, '\xff', 6, 0, 'B', 'C', 2, 0};
+  put_u16(block, cdata.size() + 25);
+  block += cdata;
+  put_u32(block, crc32(0, reinterpret_cast<const Bytef*>(data.data()), data.size()));
+  put_u32(block, data.size());
+  return block;
+}
+
+// BGZF file with blocks of block_size bytes of data, ends with the empty EOF block
+void write_bgzf(const std::string& path, const std::string& data, size_t block_size)
+{
+  std::ofstream out(path, std::ios::binary);
+  for (size_t i=0; i<data.size(); i+=block_size)
+    out << bgzf_block(data.substr(i, block_size));
+  out << bgzf_block("");
+}
+
+void write_gzip(const std::string& path, const std::vector<std::string>& members)
+{
+  std::ofstream(path, std::ios::binary).close();
+  for (auto& m : members)
+  {
+    gzFile f = gzopen(path.c_str(), "ab");
+    gzwrite(f, m.data(), m.size());
+    gzclose(f);
+  }
+}
+
+std::vector<std::string> read_all(const std::vector<std::string>& paths, size_t nb_threads)
+{
+  std::vector<std::string> seqs;
+  FastxReader reader(paths, nb_threads);
+  std::string seq;
+  while (reader.next(seq))
+    seqs.push_back(seq);
+  return seqs;
+}
+
+TEST(fastx_reader, records)
+{
+  fs::create_directories("./tests_tmp");
+  std::string fasta = ">s1 desc\nACGT\nAACC\n\n>s2\r\nGGTT\r\nTT\r\n>s3\n>s4\nAAAA";
+  std::string fastq = "@r1\nACGTA\n+\n@@@II\n@r2\nTTTT\n+r2\nIIII\n";
+  write_gzip("./tests_tmp/1.fa.gz", {fasta});
+  write_gzip("./tests_tmp/2.fq.gz", {fastq.substr(0, 20), fastq.substr(20)});
+
+  std::vector<std::string> expected = {"ACGTAACC", "GGTTTT", "", "AAAA", "ACGTA", "TTTT"};
+  EXPECT_EQ(read_all({"./tests_tmp/1.fa.gz", "./tests_tmp/2.fq.gz"}, 1), expected);
+  EXPECT_TRUE(is_gzip("./tests_tmp/1.fa.gz"));
+  EXPECT_FALSE(is_bgzf("./tests_tmp/1.fa.gz"));
+}
+
+TEST(fastx_reader, bgzf)
+{
+  fs::create_directories("./tests_tmp");
+  std::string data;
+  std::vector<std::string> expected;
+  for (size_t i=0; i<20000; i++)
+  {
+    expected.push_back(random_dna_seq(50 + i % 100));
+    data += "@read\n" + expected.back() + "\n+\n" + std::string(expected.back().size(), 'I') + "\n";
+  }
+
+  write_bgzf("./tests_tmp/3.fq.gz", data, 65280);
+  write_gzip("./tests_tmp/4.fq.gz", {data});
+  EXPECT_TRUE(is_bgzf("./tests_tmp/3.fq.gz"));
+
+  for (size_t t : {1, 4})
+  {
+    GzReader gz("./tests_tmp/3.fq.gz", t);
+    EXPECT_TRUE(gz.is_bgzf());
+    std::string all, chunk;
+    while (gz.read(chunk))
+      all += chunk;
+    EXPECT_EQ(all, data);
+
+    EXPECT_EQ(read_all({"./tests_tmp/3.fq.gz"}, t), expected);
+  }
+  EXPECT_EQ(read_all({"./tests_tmp/4.fq.gz"}, 1), expected);
+
+  // stop before the end of the file
+  {
+    GzReader gz("./tests_tmp/3.fq.gz", 2);
+    std::string chunk;
+    EXPECT_TRUE(gz.read(chunk));
+  }
+}
+
+TEST(fastx_reader, bgzf_corrupted)
+{
+  fs::create_directories("./tests_tmp");
+  write_bgzf("./tests_tmp/5.fq.gz", std::string(200000, 'A'), 65280);
+  {
+    std::fstream f("./tests_tmp/5.fq.gz", std::ios::binary | std::ios::in | std::ios::out);
+    f.seekg(-36, std::ios::end); // CRC of the last data block
+    char c = f.get();
+    f.seekp(-36, std::ios::end);
+    f.put(~c);
+  }
+  EXPECT_THROW({
+    GzReader gz("./tests_tmp/5.fq.gz", 2);
+    std::string chunk;
+    while (gz.read(chunk));
+  }, IOError);
+
+  EXPECT_THROW(GzReader("./tests_tmp/missing.fq.gz"), FileNotFoundError);
+}
@@ -0,0 +1,102 @@
+#include <random>
+#include <sstream>
+#include <gtest/gtest.h>
+#include <kmtricks/io/block_matrix_file.hpp>
+#include <kmtricks/utils.hpp>
+
+using namespace km;
+
+const uint32_t blk_bits = 21;
+const uint64_t blk_rows = 10001;
+
+std::vector<std::vector<uint8_t>> blk_matrix()
+{
+  std::mt19937_64 g(42);
+  std::vector<std::vector<uint8_t>> rows(blk_rows, std::vector<uint8_t>(NBYTES(blk_bits), 0));
+  for (auto& row : rows)
+  {
+    // sparse rows, some of them empty
+    for (uint32_t s=0; s<blk_bits; s++)
+      if (g() % 8 == 0)
+        BITSET(row, s);
+  }
+  return rows;
+}
+
+TEST(block_matrix_file, BlockMatrixWriteRead)
+{
+  auto rows = blk_matrix();
+  {
+    BlockMatrixWriter bmw("tests_tmp/m.cmbf.blk", blk_bits, 0, 3, 1000, blk_rows, 300);
+    for (auto& row : rows)
+      bmw.write(row);
+  }
+
+  BlockMatrixReader bmr("tests_tmp/m.cmbf.blk", 4);
+  EXPECT_EQ(get_km_file_type("tests_tmp/m.cmbf.blk"), KM_FILE::BLOCKMATRIX);
+  EXPECT_EQ(bmr.infos().bits, blk_bits);
+  EXPECT_EQ(bmr.infos().partition, 3);
+  EXPECT_EQ(bmr.infos().first, 1000);
+  EXPECT_EQ(bmr.infos().window, blk_rows);
+  EXPECT_EQ(bmr.infos().block_rows, 100);
+  EXPECT_EQ(bmr.infos().nb_blocks, (blk_rows + 99) / 100);
+
+  std::vector<uint8_t> row(NBYTES(blk_bits));
+  for (auto& expected : rows)
+  {
+    ASSERT_TRUE(bmr.read(row));
+    EXPECT_EQ(row, expected);
+  }
+  EXPECT_FALSE(bmr.read(row));
+  // each block is decompressed once by a sequential read
+  EXPECT_EQ(bmr.decoded(), bmr.infos().nb_blocks);
+
+  std::mt19937_64 g(7);
+  for (size_t i=0; i<5000; i++)
+  {
+    uint64_t r = g() % blk_rows;
+    const uint8_t* bits = bmr.row(r);
+    ASSERT_NE(bits, nullptr);
+    EXPECT_TRUE(std::equal(rows[r].begin(), rows[r].end(), bits));
+  }
+  EXPECT_EQ(bmr.row(blk_rows), nullptr);
+}
+
+TEST(block_matrix_file, BlockMatrixCache)
+{
+  BlockMatrixReader bmr("tests_tmp/m.cmbf.blk", 2);
+  bmr.row(0); bmr.row(100); bmr.row(1);
+  EXPECT_EQ(bmr.decoded(), 2);
+  bmr.row(200); // evicts block 1, block 0 was used last
+  bmr.row(2);
+  EXPECT_EQ(bmr.decoded(), 3);
+  bmr.row(150);
+  EXPECT_EQ(bmr.decoded(), 4);
+}
+
+TEST(block_matrix_file, BlockMatrixText)
+{
+  auto rows = blk_matrix();
+  BlockMatrixReader bmr("tests_tmp/m.cmbf.blk");
+  std::stringstream ss;
+  bmr.write_as_text(ss);
+
+  std::stringstream expected;
+  for (uint64_t i=0; i<rows.size(); i++)
+  {
+    if (std::all_of(rows[i].begin(), rows[i].end(), [](uint8_t b){ return b == 0; }))
+      continue;
+    expected << 1000 + i;
+    for (uint32_t s=0; s<blk_bits; s++)
+      expected << " " << (BITCHECK(rows[i], s) ? '1' : '0');
+    expected << "\n";
+  }
+  EXPECT_EQ(ss.str(), expected.str());
+
+  BlockMatrixFileAggregator bmfa({"tests_tmp/m.cmbf.blk"});
+  bmfa.write_as_bin("tests_tmp/m.pa_hash", false);
+  PAHashMatrixReader phr("tests_tmp/m.pa_hash");
+  std::stringstream pa;
+  phr.write_as_text(pa);
+  EXPECT_EQ(pa.str(), expected.str());
+}
@@ -49,3 +49,54 @@ TEST(hash_file, HashWriteRead)
     }
   }
 }
+
+TEST(hash_file, HashIndex)
+{
+  const uint64_t n = 20000;
+  for (bool compressed : {false, true})
+  {
+    std::string path = compressed ? "tests_tmp/h3.hash.lz4" : "tests_tmp/h3.hash";
+    {
+      HashWriter<255, 4096> hw(path, 1, 1, 2, compressed);
+      hw.enable_index();
+      for (uint64_t i=0; i<n; i++)
+        hw.write(i * 3, i % 255);
+    }
+    uint64_t hash = 0;
+    uint8_t c = 0;
+    {
+      HashReader<255, 4096> hr(path);
+      EXPECT_EQ(hr.nb_records(), n);
+      uint64_t i = 0;
+      while (hr.read(hash, c))
+        ASSERT_EQ(hash, 3 * i++);
+      EXPECT_EQ(i, n);
+    }
+    for (uint64_t target : {0ul, 1ul, 1536ul, 1537ul, 30000ul, 59997ul})
+    {
+      HashReader<255, 4096> hr(path);
+      hr.seek_to(target);
+      ASSERT_TRUE(hr.read(hash, c));
+      EXPECT_EQ(hash, (target + 2) / 3 * 3);
+      EXPECT_EQ(c, (hash / 3) % 255);
+    }
+    {
+      HashReader<255, 4096> hr(path);
+      hr.seek_to(100);
+      hr.limit(40000);
+      uint64_t expected = 102;
+      while (hr.read(hash, c))
+      {
+        ASSERT_EQ(hash, expected);
+        expected += 3;
+      }
+      EXPECT_EQ(expected, 40002);
+      EXPECT_FALSE(hr.read(hash, c));
+    }
+    std::vector<uint64_t> samples;
+    EXPECT_TRUE((HashReader<255, 4096>(path).sample(samples)));
+    ASSERT_EQ(samples.size(), (n + 511) / 512);
+    for (size_t i=0; i<samples.size(); i++)
+      EXPECT_EQ(samples[i], i * 512 * 3);
+  }
+}
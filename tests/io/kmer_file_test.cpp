@@ -69,3 +69,115 @@ TEST(kmer_file, KmerWriteRead)
     KmerReader("tests_tmp/k3.kmer.lz4").write_as_text<32, 255>(out);
   }
 }
+
+TEST(kmer_file, KmerIndex)
+{
+  std::vector<Kmer<32>> kmers;
+  for (size_t i=0; i<5000; i++)
+    kmers.push_back(Kmer<32>(random_dna_seq(21)));
+  std::sort(kmers.begin(), kmers.end());
+  kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+
+  for (bool lz4 : {false, true})
+  {
+    std::string path = lz4 ? "tests_tmp/k4.kmer.lz4" : "tests_tmp/k4.kmer";
+    {
+      KmerWriter kw(path, 21, 1, 1, 2, lz4);
+      kw.enable_index(100);
+      for (auto& kmer : kmers)
+        kw.write<32, 255>(kmer, 42);
+    }
+    KeyIndex index;
+    ASSERT_TRUE(index.load(path));
+    EXPECT_EQ(index.size(), (kmers.size() + 99) / 100);
+    EXPECT_EQ(index.nb_records(), kmers.size());
+
+    Kmer<32> kmer; kmer.set_k(21);
+    uint8_t c = 0;
+    {
+      // the footer is not read as records
+      KmerReader kr(path);
+      EXPECT_EQ(kr.nb_records(), kmers.size());
+      size_t n = 0;
+      while (kr.read<32, 255>(kmer, c))
+        ASSERT_EQ(kmer, kmers[n++]);
+      EXPECT_EQ(n, kmers.size());
+    }
+    for (size_t i : {0ul, 1ul, 99ul, 100ul, 101ul, 2500ul, kmers.size() - 1})
+    {
+      KmerReader kr(path);
+      kr.seek_to(kmers[i]);
+      ASSERT_TRUE((kr.read<32, 255>(kmer, c)));
+      EXPECT_EQ(kmer, kmers[i]);
+      EXPECT_EQ(c, 42);
+    }
+    {
+      KmerReader kr(path);
+      kr.seek_to(kmers[150]);
+      kr.limit(kmers[1234]);
+      size_t n = 150;
+      while (kr.read<32, 255>(kmer, c))
+        ASSERT_EQ(kmer, kmers[n++]);
+      EXPECT_EQ(n, 1234);
+    }
+    std::vector<Kmer<32>> samples;
+    EXPECT_TRUE(KmerReader(path).sample<32>(10, samples));
+    EXPECT_EQ(samples.size(), 10);
+    EXPECT_TRUE(std::is_sorted(samples.begin(), samples.end()));
+  }
+
+  // without index, seek_to skips the records
+  {
+    KmerWriter kw("tests_tmp/k5.kmer", 21, 1, 1, 2, false);
+    for (auto& kmer : kmers)
+      kw.write<32, 255>(kmer, 42);
+  }
+  KeyIndex index;
+  EXPECT_FALSE(index.load("tests_tmp/k5.kmer"));
+  KmerReader kr("tests_tmp/k5.kmer");
+  std::vector<Kmer<32>> samples;
+  EXPECT_FALSE(kr.sample<32>(10, samples));
+  kr.seek_to(kmers[777]);
+  Kmer<32> kmer; kmer.set_k(21);
+  uint8_t c = 0;
+  ASSERT_TRUE((kr.read<32, 255>(kmer, c)));
+  EXPECT_EQ(kmer, kmers[777]);
+}
+
+TEST(kmer_file, KmerIndexAsync)
+{
+  std::vector<Kmer<32>> kmers;
+  for (size_t i=0; i<20000; i++)
+    kmers.push_back(Kmer<32>(random_dna_seq(31)));
+  std::sort(kmers.begin(), kmers.end());
+  kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+
+  // the index follows the lz4 frames, a reader decompressing ahead must not decode it
+  std::string path = "tests_tmp/k6.kmer.lz4";
+  lz4_stream::set_async(true);
+  {
+    KmerWriter kw(path, 31, 1, 1, 2, true);
+    kw.enable_index(1000);
+    for (auto& kmer : kmers)
+      kw.write<32, 255>(kmer, 42);
+  }
+
+  Kmer<32> kmer; kmer.set_k(31);
+  uint8_t c = 0;
+  {
+    KmerReader kr(path);
+    size_t n = 0;
+    while (kr.read<32, 255>(kmer, c))
+      ASSERT_EQ(kmer, kmers[n++]);
+    EXPECT_EQ(n, kmers.size());
+  }
+  {
+    KmerReader kr(path);
+    kr.seek_to(kmers[15000]);
+    size_t n = 15000;
+    while (kr.read<32, 255>(kmer, c))
+      ASSERT_EQ(kmer, kmers[n++]);
+    EXPECT_EQ(n, kmers.size());
+  }
+  lz4_stream::set_async(false);
+}
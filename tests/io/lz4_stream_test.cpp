@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <kmtricks/io/lz4_stream.hpp>
+#include <kmtricks/io/kmer_file.hpp>
+
+std::string make_data(size_t size)
+{
+  std::mt19937_64 g(42);
+  std::string data(size, 'A');
+  // compressible but not trivial
+  for (auto& c : data)
+    c = "ACGT"[g() % 4];
+  return data;
+}
+
+std::string compress(const std::string& data, bool async)
+{
+  std::stringstream sink;
+  {
+    lz4_stream::basic_ostream<8192> out(sink, async);
+    // odd sizes to cross the block boundaries
+    for (size_t i=0; i<data.size(); i+=1000)
+      out.write(data.data() + i, std::min<size_t>(1000, data.size() - i));
+  }
+  return sink.str();
+}
+
+std::string decompress(const std::string& cpr, bool async)
+{
+  std::stringstream source(cpr);
+  lz4_stream::basic_istream<8192> in(source, false, async);
+  std::string data;
+  char buf[777];
+  while (in.read(buf, sizeof(buf)) || in.gcount())
+    data.append(buf, in.gcount());
+  return data;
+}
+
+TEST(lz4_stream, async_same_frame)
+{
+  std::string data = make_data(1 << 20);
+  std::string sync_cpr = compress(data, false);
+  std::string async_cpr = compress(data, true);
+  EXPECT_EQ(sync_cpr, async_cpr);
+  EXPECT_LT(sync_cpr.size(), data.size());
+
+  EXPECT_EQ(decompress(sync_cpr, false), data);
+  EXPECT_EQ(decompress(sync_cpr, true), data);
+}
+
+TEST(lz4_stream, async_empty)
+{
+  std::string cpr = compress("", true);
+  EXPECT_EQ(cpr, compress("", false));
+  EXPECT_EQ(decompress(cpr, true), "");
+}
+
+TEST(lz4_stream, async_partial_read)
+{
+  std::string data = make_data(300000);
+  std::string cpr = compress(data, true);
+  std::stringstream source(cpr);
+  lz4_stream::basic_istream<8192> in(source, false, true);
+  std::string head(100, '\0');
+  in.read(&head[0], 100);
+  EXPECT_EQ(head, data.substr(0, 100));
+  // the worker is stopped while blocks are pending
+}
+
+TEST(lz4_stream, async_kmer_file)
+{
+  std::vector<km::Kmer<32>> kmers;
+  for (size_t i=0; i<100000; i++)
+    kmers.push_back(km::Kmer<32>(km::random_dna_seq(31)));
+
+  lz4_stream::set_async(true);
+  {
+    km::KmerWriter<8192> kw("./tests_tmp/async.kmer.lz4", 31, 1, 0, 0, true);
+    for (size_t i=0; i<kmers.size(); i++)
+      kw.write<32, 255>(kmers[i], i % 200);
+  }
+  {
+    km::KmerReader<8192> kr("./tests_tmp/async.kmer.lz4");
+    km::Kmer<32> kmer; kmer.set_k(31);
+    uint8_t count;
+    for (size_t i=0; i<kmers.size(); i++)
+    {
+      ASSERT_TRUE((kr.read<32, 255>(kmer, count)));
+      EXPECT_EQ(kmer, kmers[i]);
+      EXPECT_EQ(count, i % 200);
+    }
+    EXPECT_FALSE((kr.read<32, 255>(kmer, count)));
+  }
+  lz4_stream::set_async(false);
+}
+
+TEST(lz4_stream, decode_error)
+{
+  // garbage after the frame, the data before it is delivered then the error is raised
+  std::string data = make_data(300000);
+  std::string cpr = compress(data, true) + "not a lz4 frame";
+  for (bool async : {false, true})
+  {
+    std::stringstream source(cpr);
+    lz4_stream::basic_istream<8192> in(source, false, async);
+    std::string out;
+    char c;
+    EXPECT_THROW(while (in.get(c)) out.push_back(c), std::runtime_error);
+    EXPECT_EQ(out, data);
+  }
+}
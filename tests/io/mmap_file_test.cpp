@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/mmap_file.hpp>
+#include <kmtricks/merge.hpp>
+#include <kmtricks/utils.hpp>
+
+using namespace km;
+
+TEST(mmap_file, KmerMmapReader)
+{
+  std::vector<std::string> str_kmers(10000);
+  {
+    KmerWriter kw("tests_tmp/m1.kmer", 21, 1, 1, 2, false);
+    for (size_t i=0; i<str_kmers.size(); i++)
+    {
+      str_kmers[i] = random_dna_seq(21);
+      Kmer<32> kmer(str_kmers[i]);
+      kw.write<32, 255>(kmer, i % 255);
+    }
+  }
+  EXPECT_TRUE(is_mappable<KmerFileHeader>("tests_tmp/m1.kmer"));
+
+  KmerMmapReader kr("tests_tmp/m1.kmer");
+  EXPECT_EQ(kr.infos().kmer_size, 21);
+  EXPECT_EQ(kr.infos().id, 1);
+  EXPECT_EQ(kr.infos().partition, 2);
+  EXPECT_EQ(kr.size(), str_kmers.size());
+  EXPECT_EQ(kr.stride(), 9);
+
+  Kmer<32> kmer; kmer.set_k(21);
+  uint8_t c = 0;
+  for (size_t i=0; i<str_kmers.size(); i++)
+  {
+    ASSERT_TRUE((kr.read<32, 255>(kmer, c)));
+    EXPECT_EQ(kmer.to_string(), str_kmers[i]);
+    EXPECT_EQ(c, i % 255);
+  }
+  EXPECT_FALSE((kr.read<32, 255>(kmer, c)));
+
+  kr.rewind();
+  ASSERT_TRUE((kr.read<32, 255>(kmer, c)));
+  EXPECT_EQ(kmer.to_string(), str_kmers[0]);
+}
+
+TEST(mmap_file, compressed)
+{
+  {
+    KmerWriter kw("tests_tmp/m1.kmer.lz4", 21, 1, 1, 2, true);
+    Kmer<32> kmer(random_dna_seq(21));
+    kw.write<32, 255>(kmer, 1);
+  }
+  EXPECT_FALSE(is_mappable<KmerFileHeader>("tests_tmp/m1.kmer.lz4"));
+  EXPECT_THROW(KmerMmapReader("tests_tmp/m1.kmer.lz4"), IOError);
+}
+
+TEST(mmap_file, HashMmapReader)
+{
+  const size_t n = 20000;
+  {
+    HashWriter<65535, 4096> hw("tests_tmp/m1.hash", 2, 3, 4, false);
+    for (uint64_t i=0; i<n; i++)
+      hw.write(i * 3, i % 65535);
+  }
+  HashMmapReader<65535> hr("tests_tmp/m1.hash");
+  EXPECT_EQ(hr.infos().id, 3);
+  EXPECT_EQ(hr.infos().partition, 4);
+
+  uint64_t hash = 0; uint16_t c = 0;
+  for (uint64_t i=0; i<n; i++)
+  {
+    ASSERT_TRUE(hr.read(hash, c));
+    EXPECT_EQ(hash, i * 3);
+    EXPECT_EQ(c, i % 65535);
+  }
+  EXPECT_FALSE(hr.read(hash, c));
+
+  hr.rewind();
+  const char* hashes; const char* counts; size_t size = 0, total = 0;
+  while (hr.next_block(hashes, counts, size))
+    total += size;
+  EXPECT_EQ(total, n);
+}
+
+TEST(mmap_file, MatrixMmapReader)
+{
+  std::vector<std::string> str_kmers(1000);
+  {
+    MatrixWriter mw("tests_tmp/m1.count", 21, 2, 5, 1, 2, false);
+    for (size_t i=0; i<str_kmers.size(); i++)
+    {
+      str_kmers[i] = random_dna_seq(21);
+      Kmer<32> kmer(str_kmers[i]);
+      std::vector<uint16_t> counts(5, i);
+      mw.write<32, 65535>(kmer, counts);
+    }
+  }
+  MatrixMmapReader mr("tests_tmp/m1.count");
+  EXPECT_EQ(mr.size(), str_kmers.size());
+
+  Kmer<32> kmer; kmer.set_k(21);
+  std::vector<uint16_t> counts(5);
+  for (size_t i=0; i<str_kmers.size(); i++)
+  {
+    ASSERT_TRUE((mr.read<32, 65535>(kmer, counts)));
+    EXPECT_EQ(kmer.to_string(), str_kmers[i]);
+    EXPECT_EQ(counts, std::vector<uint16_t>(5, i));
+  }
+  EXPECT_FALSE((mr.read<32, 65535>(kmer, counts)));
+}
+
+TEST(mmap_file, PAMatrixMmapReader)
+{
+  std::vector<std::string> str_kmers(1000);
+  {
+    PAMatrixWriter pw("tests_tmp/m1.pa", 21, 12, 1, 2, false);
+    for (size_t i=0; i<str_kmers.size(); i++)
+    {
+      str_kmers[i] = random_dna_seq(21);
+      Kmer<32> kmer(str_kmers[i]);
+      std::vector<uint8_t> vec {static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8)};
+      pw.write<32>(kmer, vec);
+    }
+  }
+  PAMatrixMmapReader pr("tests_tmp/m1.pa");
+  EXPECT_EQ(pr.size(), str_kmers.size());
+
+  Kmer<32> kmer; kmer.set_k(21);
+  std::vector<uint8_t> vec(2);
+  for (size_t i=0; i<str_kmers.size(); i++)
+  {
+    ASSERT_TRUE(pr.read<32>(kmer, vec));
+    EXPECT_EQ(kmer.to_string(), str_kmers[i]);
+    EXPECT_EQ(vec[0], static_cast<uint8_t>(i));
+    EXPECT_EQ(vec[1], static_cast<uint8_t>(i >> 8));
+  }
+  EXPECT_FALSE(pr.read<32>(kmer, vec));
+}
+
+TEST(mmap_file, VectorMatrixMmapReader)
+{
+  const size_t window = 1000;
+  {
+    VectorMatrixWriter<> vmw("tests_tmp/m1.cmbf", 20, 0, 3, 5000, window, false);
+    std::vector<uint8_t> row(NBYTES(20));
+    for (size_t i=0; i<window; i++)
+    {
+      row[0] = i; row[1] = i >> 8; row[2] = 0x0f;
+      vmw.write(row);
+    }
+  }
+  EXPECT_TRUE(is_mappable<VectorMatrixFileHeader>("tests_tmp/m1.cmbf"));
+
+  VectorMatrixMmapReader vr("tests_tmp/m1.cmbf");
+  EXPECT_EQ(vr.infos().bits, 20);
+  EXPECT_EQ(vr.infos().first, 5000);
+  EXPECT_EQ(vr.infos().partition, 3);
+  EXPECT_EQ(vr.stride(), 3);
+  EXPECT_EQ(vr.size(), window);
+
+  std::vector<uint8_t> row(3);
+  for (size_t i=0; i<window; i++)
+  {
+    const uint8_t* record = reinterpret_cast<const uint8_t*>(vr.record(i));
+    EXPECT_EQ(record[0], static_cast<uint8_t>(i));
+    ASSERT_TRUE(vr.read(row));
+    EXPECT_EQ(row[1], static_cast<uint8_t>(i >> 8));
+    EXPECT_EQ(row[2], 0x0f);
+  }
+  EXPECT_FALSE(vr.read(row));
+
+  VectorMatrixMmapReader tr("tests_tmp/m1.cmbf", true);
+  EXPECT_EQ(tr.stride(), NBYTES(window));
+}
+
+TEST(mmap_file, merge)
+{
+  std::vector<std::string> paths;
+  for (size_t s=0; s<3; s++)
+  {
+    std::string path = "tests_tmp/mm" + std::to_string(s) + ".hash";
+    HashWriter<255, 4096> hw(path, 1, s, 0, false);
+    for (uint64_t i=s; i<3000; i+=s+1)
+      hw.write(i, 2);
+    paths.push_back(path);
+  }
+  std::vector<uint32_t> a(3, 1);
+  HashMerger<255, 32768, HashReader<255, 32768>> stream(paths, a, 1, 0);
+  HashMerger<255, 32768, HashMmapReader<255>> mapped(paths, a, 1, 0);
+  while (stream.next())
+  {
+    ASSERT_TRUE(mapped.next());
+    EXPECT_EQ(stream.current(), mapped.current());
+    EXPECT_EQ(stream.counts(), mapped.counts());
+  }
+  EXPECT_FALSE(mapped.next());
+}
+
+TEST(mmap_file, HashMmapReader_range)
+{
+  {
+    HashWriter<255, 4096> hw("tests_tmp/m2.hash", 1, 0, 0, false);
+    for (uint64_t i=0; i<20000; i++)
+      hw.write(i * 3, 1);
+  }
+  std::vector<uint64_t> samples;
+  HashMmapReader<255>("tests_tmp/m2.hash").sample(samples);
+  // one sample per block, 512 hashes per 4096 bytes buffer
+  ASSERT_EQ(samples.size(), (20000 + 511) / 512);
+  for (size_t i=0; i<samples.size(); i++)
+    EXPECT_EQ(samples[i], i * 512 * 3);
+
+  for (auto [lower, upper] : std::vector<std::pair<uint64_t, uint64_t>>{
+         {0, 60000}, {1, 2}, {100, 101}, {1535, 1537}, {1538, 40000}, {59997, 100000}, {70000, 80000}})
+  {
+    HashMmapReader<255> hr("tests_tmp/m2.hash");
+    hr.seek_to(lower);
+    hr.limit(upper);
+    uint64_t hash = 0; uint8_t c = 0;
+    uint64_t expected = (lower + 2) / 3 * 3;
+    while (hr.read(hash, c))
+    {
+      EXPECT_EQ(hash, expected);
+      expected += 3;
+    }
+    EXPECT_EQ(expected, std::max((lower + 2) / 3 * 3, std::min<uint64_t>((upper + 2) / 3 * 3, 60000)));
+  }
+}
+
+TEST(mmap_file, KmerMmapReader_range)
+{
+  std::vector<Kmer<32>> kmers;
+  for (size_t i=0; i<5000; i++)
+    kmers.push_back(Kmer<32>(random_dna_seq(21)));
+  std::sort(kmers.begin(), kmers.end());
+  kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+  {
+    KmerWriter kw("tests_tmp/m2.kmer", 21, 1, 1, 0, false);
+    for (auto& kmer : kmers)
+      kw.write<32, 255>(kmer, 1);
+  }
+
+  std::vector<Kmer<32>> samples;
+  KmerMmapReader("tests_tmp/m2.kmer").sample<32>(10, samples);
+  ASSERT_EQ(samples.size(), 10);
+  for (size_t i=0; i<samples.size(); i++)
+    EXPECT_EQ(samples[i], kmers[i * kmers.size() / 10]);
+
+  KmerMmapReader kr("tests_tmp/m2.kmer");
+  kr.seek_to(kmers[100]);
+  kr.limit(kmers[2000]);
+  Kmer<32> kmer; kmer.set_k(21);
+  uint8_t c = 0;
+  for (size_t i=100; i<2000; i++)
+  {
+    ASSERT_TRUE((kr.read<32, 255>(kmer, c)));
+    EXPECT_EQ(kmer, kmers[i]);
+  }
+  EXPECT_FALSE((kr.read<32, 255>(kmer, c)));
+}
+
+TEST(mmap_file, index)
+{
+  {
+    HashWriter<255, 4096> hw("tests_tmp/m3.hash", 1, 0, 0, false);
+    hw.enable_index();
+    KmerWriter kw("tests_tmp/m3.kmer", 21, 1, 0, 0, false);
+    kw.enable_index(10);
+    for (uint64_t i=0; i<5000; i++)
+    {
+      hw.write(i, 1);
+      Kmer<32> kmer; kmer.set_k(21); kmer.set64(i);
+      kw.write<32, 255>(kmer, 1);
+    }
+  }
+  // records stop before the index
+  HashMmapReader<255> hr("tests_tmp/m3.hash");
+  EXPECT_EQ(hr.nb_records(), 5000);
+  uint64_t hash = 0, expected = 0; uint8_t c = 0;
+  while (hr.read(hash, c))
+    ASSERT_EQ(hash, expected++);
+  EXPECT_EQ(expected, 5000);
+
+  KmerMmapReader kr("tests_tmp/m3.kmer");
+  EXPECT_EQ(kr.nb_records(), 5000);
+  kr.seek_to(Kmer<32>("AAAAAAAAAAAAAAAAAAATG"));
+  Kmer<32> kmer; kmer.set_k(21);
+  ASSERT_TRUE((kr.read<32, 255>(kmer, c)));
+  EXPECT_EQ(kmer.get64(), 11);
+}
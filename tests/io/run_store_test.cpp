@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/run_store.hpp>
+#include <kmtricks/merge.hpp>
+
+using namespace km;
+
+TEST(run_store, in_memory)
+{
+  RunStore::get().set_budget(1 << 20);
+  {
+    HashRunWriter<255> w("tests_tmp/r1.hash", 1, 3, 4, false);
+    for (uint64_t i=0; i<1000; i++)
+      w.write(i * 2, i % 255);
+  }
+  EXPECT_TRUE(RunStore::get().contains("tests_tmp/r1.hash"));
+  EXPECT_FALSE(fs::exists("tests_tmp/r1.hash"));
+  EXPECT_EQ(RunStore::get().used(), 1000 * 9);
+  {
+    HashRunReader<255> r("tests_tmp/r1.hash");
+    EXPECT_EQ(r.infos().id, 3);
+    EXPECT_EQ(r.infos().partition, 4);
+    uint64_t hash; uint8_t c;
+    for (uint64_t i=0; i<1000; i++)
+    {
+      ASSERT_TRUE(r.read(hash, c));
+      EXPECT_EQ(hash, i * 2);
+      EXPECT_EQ(c, i % 255);
+    }
+    EXPECT_FALSE(r.read(hash, c));
+    EXPECT_FALSE(RunStore::get().contains("tests_tmp/r1.hash"));
+  }
+  EXPECT_EQ(RunStore::get().used(), 0);
+}
+
+TEST(run_store, spill)
+{
+  RunStore::get().set_budget(100);
+  {
+    HashRunWriter<255> w("tests_tmp/r2.hash", 1, 0, 1, false);
+    for (uint64_t i=0; i<1000; i++)
+      w.write(i, 2);
+  }
+  EXPECT_FALSE(RunStore::get().contains("tests_tmp/r2.hash"));
+  EXPECT_TRUE(fs::exists("tests_tmp/r2.hash"));
+  {
+    HashRunReader<255> r("tests_tmp/r2.hash");
+    EXPECT_EQ(r.infos().partition, 1);
+    uint64_t hash; uint8_t c;
+    size_t n = 0;
+    while (r.read(hash, c))
+    {
+      EXPECT_EQ(hash, n++);
+      EXPECT_EQ(c, 2);
+    }
+    EXPECT_EQ(n, 1000);
+  }
+}
+
+TEST(run_store, merge)
+{
+  RunStore::get().set_budget(10000);
+  std::vector<std::string> paths = {"tests_tmp/r3.hash", "tests_tmp/r4.hash"};
+  {
+    HashRunWriter<255> w1(paths[0], 1, 0, 0, false);
+    HashRunWriter<255> w2(paths[1], 1, 1, 0, false);
+    for (uint64_t i=0; i<100; i++)
+    {
+      w1.write(i, 1);
+      if (i % 2) w2.write(i, 1);
+    }
+  }
+  std::vector<uint32_t> a {1, 1};
+  HashMerger<255, 32768, HashRunReader<255>> m(paths, a, 1, 0);
+  size_t rows = 0, shared = 0;
+  while (m.next())
+  {
+    rows++;
+    shared += (m.counts()[0] && m.counts()[1]);
+  }
+  EXPECT_EQ(rows, 100);
+  EXPECT_EQ(shared, 50);
+}
+
+TEST(run_store, reserve)
+{
+  RunStore::get().set_budget(100000);
+  {
+    HashRunWriter<255> w1("tests_tmp/r5.hash", 1, 0, 0, false);
+    HashRunWriter<255> w2("tests_tmp/r6.hash", 1, 1, 0, false);
+    for (uint64_t i=0; i<5000; i++)
+      w1.write(i, 1);
+    // the buffered records are reserved
+    EXPECT_GE(RunStore::get().used(), 5000 * 9);
+    EXPECT_LE(RunStore::get().used(), RunStore::get().budget());
+
+    for (uint64_t i=0; i<10000; i++)
+      w2.write(i, 1);
+    // w2 does not fit next to w1, it is written to disk and gives its reservation back
+    EXPECT_TRUE(fs::exists("tests_tmp/r6.hash"));
+    EXPECT_LE(RunStore::get().used(), RunStore::get().budget());
+  }
+  EXPECT_TRUE(RunStore::get().contains("tests_tmp/r5.hash"));
+  EXPECT_FALSE(RunStore::get().contains("tests_tmp/r6.hash"));
+  EXPECT_EQ(RunStore::get().used(), 5000 * 9);
+
+  for (auto& path : {"tests_tmp/r5.hash", "tests_tmp/r6.hash"})
+  {
+    HashRunReader<255> r(path);
+    uint64_t hash; uint8_t c;
+    size_t n = 0;
+    while (r.read(hash, c))
+      EXPECT_EQ(hash, n++);
+    EXPECT_EQ(n, std::string(path) == "tests_tmp/r5.hash" ? 5000 : 10000);
+  }
+  EXPECT_EQ(RunStore::get().used(), 0);
+}
@@ -0,0 +1,86 @@
+#include <map>
+#include <gtest/gtest.h>
+#include <kmtricks/kmer_compactor.hpp>
+#include <kmtricks/utils.hpp>
+
+using namespace km;
+
+template<size_t MAX_K>
+void check_compactor(size_t kmer_size, size_t minim_size, bool buffer = false)
+{
+  // overlapping reads, so that runs are longer than reads
+  std::string genome = random_dna_seq(5000);
+  std::map<std::string, uint8_t> expected;
+  KmerCompactor<MAX_K, uint8_t> compactor(kmer_size, minim_size, 64);
+  std::vector<char> storage(genome.size() * KmerCompactor<MAX_K, uint8_t>::bytes_per_kmer);
+  if (buffer)
+    compactor.use_buffer(storage.data(), genome.size());
+  for (size_t i=0; i + kmer_size <= genome.size(); i++)
+  {
+    std::string s = Kmer<MAX_K>(genome.substr(i, kmer_size)).canonical().to_string();
+    if (expected.count(s))
+      continue;
+    expected[s] = i % 200 + 1;
+    compactor.add(Kmer<MAX_K>(s), expected[s]);
+  }
+  EXPECT_EQ(compactor.size(), expected.size());
+
+  std::map<std::string, uint8_t> found;
+  size_t nb_superk = 0;
+  bool raw = false;
+  uint32_t last = 0;
+  compactor.compact([&](const auto& s) {
+    nb_superk++;
+    size_t nb_kmers = s.seq.size() - kmer_size + 1;
+    ASSERT_EQ(s.counts.size(), nb_kmers);
+    ASSERT_LE(nb_kmers, 64);
+
+    // grouped by minimizer, the ones without minimizer last
+    if (s.has_minimizer)
+    {
+      EXPECT_FALSE(raw);
+      EXPECT_GE(s.minimizer, last);
+      last = s.minimizer;
+      EXPECT_EQ(s.seq.substr(s.minim_pos, minim_size), Mmer(s.minimizer, minim_size).to_string());
+      EXPECT_LE(s.minim_pos + minim_size, kmer_size);
+      EXPECT_GE(s.minim_pos + kmer_size, s.seq.size());
+    }
+    else
+      raw = true;
+
+    for (size_t i=0; i<nb_kmers; i++)
+    {
+      Kmer<MAX_K> cano = Kmer<MAX_K>(s.seq.substr(i, kmer_size)).canonical();
+      if (s.has_minimizer)
+        EXPECT_EQ(cano.minimizer(minim_size).value(), s.minimizer);
+      EXPECT_EQ(found.count(cano.to_string()), 0);
+      found[cano.to_string()] = s.counts[i];
+    }
+  });
+
+  EXPECT_EQ(found, expected);
+  EXPECT_EQ(compactor.size(), 0);
+  // one super-k-mer per minimizer window, instead of one entry per k-mer
+  EXPECT_LT(nb_superk * 4, expected.size());
+}
+
+TEST(kmer_compactor, compact)
+{
+  check_compactor<32>(31, 10);
+  check_compactor<32>(21, 8);
+  check_compactor<64>(51, 11);
+  check_compactor<128>(101, 12);
+}
+
+TEST(kmer_compactor, buffer)
+{
+  check_compactor<32>(31, 10, true);
+  check_compactor<64>(51, 11, true);
+
+  std::vector<char> storage(2 * KmerCompactor<32, uint8_t>::bytes_per_kmer);
+  KmerCompactor<32, uint8_t> compactor(21, 8);
+  compactor.use_buffer(storage.data(), 2);
+  compactor.add(Kmer<32>(random_dna_seq(21)), 1);
+  compactor.add(Kmer<32>(random_dna_seq(21)), 1);
+  EXPECT_THROW(compactor.add(Kmer<32>(random_dna_seq(21)), 1), std::length_error);
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
+#ifndef WITH_XXHASH
 #define WITH_XXHASH
+#endif
 #include <kmtricks/kmer_hash.hpp>
 #include <kmtricks/utils.hpp>
 
@@ -0,0 +1,149 @@
+#include <random>
+#include <gtest/gtest.h>
+#include <kmtricks/matrix_query.hpp>
+#include <kmtricks/io/vector_matrix_file.hpp>
+#include <kmtricks/utils.hpp>
+
+using namespace km;
+
+TEST(matrix_query, sliced_counters)
+{
+  std::mt19937_64 g(42);
+  for (size_t nb_samples : {1, 7, 64, 65, 300})
+  {
+    SlicedCounters counters(nb_samples);
+    for (size_t n : {0, 1, 5, 1000})
+    {
+      counters.clear();
+      std::vector<uint32_t> expected(nb_samples, 0);
+      std::vector<uint8_t> row(NBYTES(nb_samples));
+      for (size_t r=0; r<n; r++)
+      {
+        std::fill(row.begin(), row.end(), 0);
+        for (size_t s=0; s<nb_samples; s++)
+        {
+          if (g() % 3)
+          {
+            BITSET(row, s);
+            expected[s]++;
+          }
+        }
+        counters.add(row.data());
+      }
+      std::vector<uint32_t> counts;
+      counters.counts(counts);
+      EXPECT_EQ(counts, expected) << nb_samples << " " << n;
+    }
+  }
+}
+
+TEST(matrix_query, hashes)
+{
+  Repartition repart("./data/repart_gatb/repartition.minimRepart", "");
+  HashWindow hw(100000, 4, 10);
+  std::string seq = random_dna_seq(500);
+  seq[200] = 'N';
+
+  std::vector<uint64_t> hashes;
+  matrix_query_hashes<32>(seq, 31, hw, repart, hashes);
+
+  std::vector<uint64_t> expected;
+  for (size_t i=0; i+31<=seq.size(); i++)
+  {
+    std::string s = seq.substr(i, 31);
+    if (s.find('N') != std::string::npos)
+      continue;
+    Kmer<32> cano = Kmer<32>(s).canonical();
+    uint32_t part = repart.get_partition(cano.minimizer(10).value());
+    expected.push_back(KmerHashers<1>::WinHasher<32>(part, hw.get_window_size_bits())(cano));
+  }
+  EXPECT_EQ(hashes, expected);
+}
+
+void check_matrix_query(bool transposed, bool lz4, bool blk = false)
+{
+  const size_t nb_samples = 37;
+  const uint32_t nb_parts = 4;
+  HashWindow hw(200000, nb_parts, 10);
+  Repartition repart("./data/repart_gatb/repartition.minimRepart", "");
+  uint64_t w = hw.get_window_size_bits();
+
+  std::mt19937_64 g(7);
+  std::vector<std::vector<uint8_t>> rows(hw.bloom_size(), std::vector<uint8_t>(NBYTES(nb_samples), 0));
+  for (auto& row : rows)
+    for (size_t s=0; s<nb_samples; s++)
+      if (g() % 2)
+        BITSET(row, s);
+
+  std::vector<std::string> paths;
+  for (uint32_t p=0; p<nb_parts; p++)
+  {
+    std::string path = fmt::format("tests_tmp/mq{}.{}", p, transposed ? "rmbf" : "cmbf");
+    if (blk)
+    {
+      BlockMatrixWriter<> bmw(path, nb_samples, 0, p, hw.get_lower(p), w, 1024);
+      for (uint64_t h=hw.get_lower(p); h<=hw.get_upper(p); h++)
+        bmw.write(rows[h]);
+    }
+    else if (transposed)
+    {
+      TransposedVectorMatrixWriter<> tvmw(path, nb_samples, 0, p, hw.get_lower(p), w, lz4);
+      for (uint64_t h=hw.get_lower(p); h<=hw.get_upper(p); h++)
+        tvmw.write(rows[h]);
+    }
+    else
+    {
+      VectorMatrixWriter<> vmw(path, nb_samples, 0, p, hw.get_lower(p), w, lz4);
+      for (uint64_t h=hw.get_lower(p); h<=hw.get_upper(p); h++)
+        vmw.write(rows[h]);
+    }
+    paths.push_back(path);
+  }
+
+  BloomMatrix matrix(paths, w, transposed, 4);
+  EXPECT_EQ(matrix.nb_samples(), nb_samples);
+
+  MatrixQuery<32> query(matrix, hw, repart, 31);
+  for (size_t i=0; i<5; i++)
+  {
+    std::string seq = random_dna_seq(300);
+    std::vector<uint32_t> hits;
+    uint64_t n = query.query(seq, hits);
+
+    std::vector<uint64_t> hashes;
+    matrix_query_hashes<32>(seq, 31, hw, repart, hashes);
+    std::vector<uint32_t> expected(nb_samples, 0);
+    for (auto& h : hashes)
+      for (size_t s=0; s<nb_samples; s++)
+        if (BITCHECK(rows[h], s))
+          expected[s]++;
+
+    EXPECT_EQ(n, 270);
+    EXPECT_EQ(hits, expected);
+  }
+}
+
+TEST(matrix_query, bf)
+{
+  check_matrix_query(false, false);
+}
+
+TEST(matrix_query, bf_lz4)
+{
+  check_matrix_query(false, true);
+}
+
+TEST(matrix_query, bft)
+{
+  check_matrix_query(true, false);
+}
+
+TEST(matrix_query, bft_lz4)
+{
+  check_matrix_query(true, true);
+}
+
+TEST(matrix_query, bf_blk)
+{
+  check_matrix_query(false, false, true);
+}
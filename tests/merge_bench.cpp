@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// Merge cost according to the number of samples, LINEAR vs TREE engines.
+// usage: kmtricks-merge-bench [nb_hashes_per_sample] [max_nb_samples] [density]
+// density is the expected fraction of samples sharing a row, 0 means ~1 sample per row.
+// TREE wins when rows are shared by few samples, LINEAR when most samples share each row.
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <kmtricks/merge.hpp>
+#include <kmtricks/timer.hpp>
+
+namespace fs = std::filesystem;
+
+const std::string bench_dir = "./tests_tmp/merge_bench";
+
+std::vector<std::string> make_samples(size_t nb_samples, size_t nb_hashes, double density)
+{
+  std::vector<std::string> paths;
+  std::mt19937_64 g(42);
+  uint64_t universe = density > 0 ? static_cast<uint64_t>(nb_hashes / density) : nb_hashes * nb_samples;
+  std::uniform_int_distribution<uint64_t> dist(0, universe);
+
+  for (size_t i=0; i<nb_samples; i++)
+  {
+    std::string path = bench_dir + "/S" + std::to_string(i) + ".hash";
+    std::vector<uint64_t> hashes(nb_hashes);
+    for (auto& h : hashes)
+      h = dist(g);
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    km::HashWriter<255, 32768> hw(path, 1, i, 0, false);
+    for (auto& h : hashes)
+      hw.write(h, 2);
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+double run(std::vector<std::string>& paths, km::MergeEngine engine, size_t& rows)
+{
+  std::vector<uint32_t> a(paths.size(), 1);
+  rows = 0;
+  km::Timer timer;
+  km::HashMerger<255, 32768, km::HashReader<255, 32768>> merger(paths, a, 1, 0, engine);
+  while (merger.next())
+    rows += merger.keep();
+  return timer.elapsed<std::chrono::microseconds>().count() / 1000.0;
+}
+
+int main(int argc, char* argv[])
+{
+  size_t nb_hashes = argc > 1 ? std::stoull(argv[1]) : 20000;
+  size_t max_samples = argc > 2 ? std::stoull(argv[2]) : 1024;
+  double density = argc > 3 ? std::stod(argv[3]) : 0;
+
+  auto [nofile, _] = km::get_prlimit_nofile();
+  max_samples = std::min<size_t>(max_samples, nofile > 64 ? nofile - 64 : 1);
+
+  fs::create_directories(bench_dir);
+
+  std::cout << "samples\trows\tlinear_ms\ttree_ms\tspeedup\n";
+  for (size_t n=2; n<=max_samples; n*=2)
+  {
+    std::vector<std::string> paths = make_samples(n, nb_hashes, density);
+    size_t rows_l = 0, rows_t = 0;
+    double linear = run(paths, km::MergeEngine::LINEAR, rows_l);
+    double tree = run(paths, km::MergeEngine::TREE, rows_t);
+
+    if (rows_l != rows_t)
+    {
+      std::cerr << "Mismatch for " << n << " samples: " << rows_l << " != " << rows_t << "\n";
+      return 1;
+    }
+    std::cout << n << "\t" << rows_t << "\t" << linear << "\t" << tree << "\t" << linear / tree << "\n";
+    fs::remove_all(bench_dir);
+    fs::create_directories(bench_dir);
+  }
+  fs::remove_all(bench_dir);
+  return 0;
+}
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <set>
+#include <random>
 #include <kmtricks/merge.hpp>
 
 
@@ -76,4 +78,212 @@ TEST(merge, kmer_merge)
     while (m.next()) { count++; }
     EXPECT_EQ(count, 82);
   }
-}
\ No newline at end of file
+}
+
+TEST(merge, kmer_merge_engines)
+{
+  std::vector<uint32_t> a {1, 2};
+  for (size_t i=0; i<4; i++)
+  {
+    std::vector<std::string> p = {
+      "./data/partitions/kmers/partition_" + std::to_string(i) + "/D1.kmer",
+      "./data/partitions/kmers/partition_" + std::to_string(i) + "/D2.kmer",
+    };
+    km::KmerMerger<32, std::numeric_limits<uint32_t>::max()> linear(p, a, 31, 1, 1, km::MergeEngine::LINEAR);
+    km::KmerMerger<32, std::numeric_limits<uint32_t>::max()> tree(p, a, 31, 1, 1, km::MergeEngine::TREE);
+
+    while (linear.next())
+    {
+      ASSERT_TRUE(tree.next());
+      EXPECT_EQ(linear.current(), tree.current());
+      EXPECT_EQ(linear.counts(), tree.counts());
+      EXPECT_EQ(linear.keep(), tree.keep());
+    }
+    EXPECT_FALSE(tree.next());
+
+    EXPECT_EQ(linear.get_infos()->get_non_solid(), tree.get_infos()->get_non_solid());
+    EXPECT_EQ(linear.get_infos()->get_rescued(), tree.get_infos()->get_rescued());
+    EXPECT_EQ(linear.get_infos()->get_total_w_rescue(), tree.get_infos()->get_total_w_rescue());
+  }
+}
+
+TEST(merge, hash_merge_engines)
+{
+  std::vector<uint32_t> a {1, 2};
+  for (size_t i=0; i<4; i++)
+  {
+    std::vector<std::string> p = {
+      "./data/partitions/hashes/partition_" + std::to_string(i) + "/D1.hash",
+      "./data/partitions/hashes/partition_" + std::to_string(i) + "/D2.hash",
+    };
+    km::HashMerger<255, 32768, km::HashReader<255>> linear(p, a, 1, 1, km::MergeEngine::LINEAR);
+    km::HashMerger<255, 32768, km::HashReader<255>> tree(p, a, 1, 1, km::MergeEngine::TREE);
+
+    while (linear.next())
+    {
+      ASSERT_TRUE(tree.next());
+      EXPECT_EQ(linear.current(), tree.current());
+      EXPECT_EQ(linear.counts(), tree.counts());
+      EXPECT_EQ(linear.keep(), tree.keep());
+    }
+    EXPECT_FALSE(tree.next());
+
+    EXPECT_EQ(linear.get_infos()->get_non_solid(), tree.get_infos()->get_non_solid());
+    EXPECT_EQ(linear.get_infos()->get_rescued(), tree.get_infos()->get_rescued());
+    EXPECT_EQ(linear.get_infos()->get_total_w_rescue(), tree.get_infos()->get_total_w_rescue());
+  }
+}
+
+namespace {
+std::string read_file(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+}
+
+TEST(merge, hash_merge_ranges)
+{
+  std::vector<std::string> paths;
+  std::mt19937_64 g(7);
+  for (size_t s=0; s<3; s++)
+  {
+    std::string path = "./tests_tmp/range" + std::to_string(s) + ".hash";
+    std::set<uint64_t> hashes;
+    while (hashes.size() < 20000)
+      hashes.insert(g() % 100000);
+    km::HashWriter<255, 4096> hw(path, 1, s, 0, false);
+    for (auto& h : hashes)
+      hw.write(h, (h % 3) + 1);
+    paths.push_back(path);
+  }
+  std::vector<uint32_t> a {1, 2, 3};
+
+  km::HashMerger<255, 32768, km::HashMmapReader<255>> serial(paths, a, 1, 1);
+  serial.write_as_bin("./tests_tmp/range_serial.mat", false);
+
+  std::vector<uint64_t> samples;
+  for (auto& path : paths)
+    km::HashMmapReader<255>(path).sample(samples);
+  std::vector<uint64_t> bounds {0};
+  for (auto& p : km::split_points(samples, 4))
+    bounds.push_back(p);
+  bounds.push_back(100000);
+  ASSERT_GT(bounds.size(), 3);
+
+  std::vector<std::string> range_paths(bounds.size() - 1);
+  km::MergeStatistics<255> infos(paths.size());
+  km::merge_ranges(range_paths.size(), 2, [&](size_t i) {
+    range_paths[i] = "./tests_tmp/range.mat." + std::to_string(i);
+    km::HashMerger<255, 32768, km::HashMmapReader<255>> m(paths, a, 1, 1, bounds[i], bounds[i+1]);
+    m.write_as_bin(range_paths[i], false);
+  });
+  for (size_t i=0; i<range_paths.size(); i++)
+  {
+    km::HashMerger<255, 32768, km::HashMmapReader<255>> m(paths, a, 1, 1, bounds[i], bounds[i+1]);
+    while (m.next()) {}
+    infos.add(*m.get_infos());
+  }
+  km::concat_range_outputs<km::MatrixHashFileHeader>("./tests_tmp/range.mat", range_paths);
+
+  EXPECT_EQ(read_file("./tests_tmp/range.mat"), read_file("./tests_tmp/range_serial.mat"));
+  EXPECT_EQ(infos.get_non_solid(), serial.get_infos()->get_non_solid());
+  EXPECT_EQ(infos.get_rescued(), serial.get_infos()->get_rescued());
+  EXPECT_EQ(infos.get_unique_w_rescue(), serial.get_infos()->get_unique_w_rescue());
+  EXPECT_EQ(infos.get_total_w_rescue(), serial.get_infos()->get_total_w_rescue());
+}
+
+TEST(merge, kmer_merge_ranges)
+{
+  std::vector<std::string> paths;
+  for (size_t s=0; s<3; s++)
+  {
+    std::string path = "./tests_tmp/range" + std::to_string(s) + ".kmer";
+    std::set<km::Kmer<32>> kmers;
+    while (kmers.size() < 3000)
+      kmers.insert(km::Kmer<32>(km::random_dna_seq(21)));
+    km::KmerWriter kw(path, 21, 1, s, 0, false);
+    for (auto& kmer : kmers)
+      kw.write<32, 255>(kmer, 2);
+    paths.push_back(path);
+  }
+  std::vector<uint32_t> a {1, 1, 1};
+
+  km::KmerMerger<32, 255, km::KmerMmapReader> serial(paths, a, 21, 1, 1);
+  serial.write_as_pa_text("./tests_tmp/range_serial.txt");
+
+  std::vector<km::Kmer<32>> samples;
+  for (auto& path : paths)
+    km::KmerMmapReader(path).sample<32>(100, samples);
+  std::vector<km::Kmer<32>> points = km::split_points(samples, 3);
+  ASSERT_EQ(points.size(), 2);
+
+  std::vector<km::KmerRange<32>> ranges(points.size() + 1);
+  for (size_t i=0; i<points.size(); i++)
+  {
+    ranges[i].upper = points[i]; ranges[i].has_upper = true;
+    ranges[i+1].lower = points[i]; ranges[i+1].has_lower = true;
+  }
+  std::vector<std::string> range_paths;
+  for (size_t i=0; i<ranges.size(); i++)
+  {
+    range_paths.push_back("./tests_tmp/range.txt." + std::to_string(i));
+    km::KmerMerger<32, 255, km::KmerMmapReader> m(paths, a, 21, 1, 1, ranges[i]);
+    m.write_as_pa_text(range_paths[i]);
+  }
+  km::concat_range_outputs<void>("./tests_tmp/range.txt", range_paths);
+
+  EXPECT_EQ(read_file("./tests_tmp/range.txt"), read_file("./tests_tmp/range_serial.txt"));
+}
+
+TEST(merge, kmer_merge_ranges_indexed)
+{
+  std::vector<std::string> paths;
+  for (size_t s=0; s<3; s++)
+  {
+    std::string path = "./tests_tmp/range_idx" + std::to_string(s) + ".kmer.lz4";
+    std::set<km::Kmer<32>> kmers;
+    while (kmers.size() < 3000)
+      kmers.insert(km::Kmer<32>(km::random_dna_seq(21)));
+    km::KmerWriter kw(path, 21, 1, s, 0, true);
+    kw.enable_index(256);
+    for (auto& kmer : kmers)
+      kw.write<32, 255>(kmer, s + 1);
+    paths.push_back(path);
+  }
+  std::vector<uint32_t> a {1, 1, 1};
+  using reader_t = km::KmerReader<8192>;
+
+  {
+    km::KmerMerger<32, 255, reader_t> serial(paths, a, 21, 1, 1);
+    serial.write_as_bin("./tests_tmp/range_idx_serial.mat.lz4", true);
+  }
+
+  std::vector<km::Kmer<32>> samples;
+  for (auto& path : paths)
+    ASSERT_TRUE(reader_t(path).sample<32>(100, samples));
+  std::vector<km::Kmer<32>> points = km::split_points(samples, 4);
+  ASSERT_EQ(points.size(), 3);
+
+  std::vector<km::KmerRange<32>> ranges(points.size() + 1);
+  for (size_t i=0; i<points.size(); i++)
+  {
+    ranges[i].upper = points[i]; ranges[i].has_upper = true;
+    ranges[i+1].lower = points[i]; ranges[i+1].has_lower = true;
+  }
+  std::vector<std::string> range_paths;
+  for (size_t i=0; i<ranges.size(); i++)
+    range_paths.push_back("./tests_tmp/range_idx.mat.lz4." + std::to_string(i));
+  km::merge_ranges(ranges.size(), 2, [&](size_t i) {
+    km::KmerMerger<32, 255, reader_t> m(paths, a, 21, 1, 1, ranges[i]);
+    m.write_as_bin(range_paths[i], true);
+  });
+  // lz4 frames of the ranges are concatenated
+  km::concat_range_outputs<km::MatrixFileHeader>("./tests_tmp/range_idx.mat.lz4", range_paths);
+
+  std::ostringstream serial, ranged;
+  km::MatrixReader<8192>("./tests_tmp/range_idx_serial.mat.lz4").write_as_text<32, 255>(serial);
+  km::MatrixReader<8192>("./tests_tmp/range_idx.mat.lz4").write_as_text<32, 255>(ranged);
+  EXPECT_FALSE(serial.str().empty());
+  EXPECT_EQ(ranged.str(), serial.str());
+}
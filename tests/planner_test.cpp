@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <kmtricks/planner.hpp>
+
+using namespace km;
+
+TEST(planner, memory)
+{
+  std::vector<double> weights(1 << 16, 1.0);
+  std::vector<SampleEstimate> samples {{4000000000, 1000000000, 500000000},
+                                       {2000000000, 500000000, 250000000}};
+  Planner planner(samples, weights, false);
+
+  uint64_t mem = uint64_t{1} << 30;
+  Plan plan = planner.plan(mem, 0, 4, 4096, 8, 9);
+  EXPECT_TRUE(plan.fits_memory);
+  EXPECT_TRUE(plan.fits_disk);
+  EXPECT_EQ(plan.nb_threads, 4);
+  EXPECT_LE(plan.peak_memory, mem);
+  // 4 tasks on 1/nb_partitions of 10^9 k-mers of 8 bytes
+  EXPECT_GE(plan.nb_partitions, 4 * 8000000000 / mem);
+  EXPECT_LT(plan.nb_partitions, 1.25 * 4 * 8000000000 / mem + 2);
+  EXPECT_EQ(plan.focus, 1.0);
+
+  // one SuperKTask keeps all its partition files open
+  plan = planner.plan(mem, 0, 4, 64, 8, 9);
+  EXPECT_LE(plan.nb_threads * plan.nb_partitions, 64);
+
+  plan = planner.plan(mem >> 10, 0, 4, 4096, 8, 9);
+  EXPECT_FALSE(plan.fits_memory);
+  EXPECT_EQ(plan.nb_threads, 1);
+  EXPECT_EQ(plan.nb_partitions, 4096);
+}
+
+TEST(planner, disk)
+{
+  std::vector<double> weights(1 << 8, 1.0);
+  std::vector<SampleEstimate> samples(8, {4000000000, 1000000000, 100000000});
+  Planner planner(samples, weights, true);
+
+  uint64_t counts = 8 * 100000000ULL * 9;
+  Plan plan = planner.plan(uint64_t{1} << 40, counts + 8 * 1000000000ULL, 8, 4096, 8, 9);
+  EXPECT_EQ(plan.focus, 1.0);
+  EXPECT_EQ(plan.nb_partitions, 4);
+
+  plan = planner.plan(uint64_t{1} << 40, counts + 4 * 1000000000ULL, 8, 4096, 8, 9);
+  EXPECT_EQ(plan.focus, 0.5);
+  EXPECT_TRUE(plan.fits_disk);
+
+  plan = planner.plan(uint64_t{1} << 40, counts, 8, 4096, 8, 9);
+  EXPECT_EQ(plan.focus, 0.0);
+  EXPECT_FALSE(plan.fits_disk);
+  EXPECT_EQ(plan.peak_disk, counts + 1000000000ULL);
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <kmtricks/radix_sort.hpp>
+
+using namespace km;
+
+// Minimal 128-bit integer with the LargeInt operators used by radix_traits
+struct u128
+{
+  uint64_t lo {0};
+  uint64_t hi {0};
+
+  uint64_t getVal() const { return lo; }
+
+  u128 operator>>(const int& s) const
+  {
+    if (s == 0) return *this;
+    if (s >= 64) return u128{hi >> (s - 64), 0};
+    return u128{(lo >> s) | (hi << (64 - s)), hi >> s};
+  }
+
+  u128 operator|(const u128& o) const { return u128{lo | o.lo, hi | o.hi}; }
+  bool operator<(const u128& o) const { return hi < o.hi || (hi == o.hi && lo < o.lo); }
+  bool operator==(const u128& o) const { return hi == o.hi && lo == o.lo; }
+};
+
+std::vector<uint64_t> random_vector(size_t n, uint64_t max, uint64_t seed)
+{
+  std::mt19937_64 g(seed);
+  std::uniform_int_distribution<uint64_t> dist(0, max);
+  std::vector<uint64_t> v(n);
+  for (auto& e : v)
+    e = dist(g);
+  return v;
+}
+
+TEST(radix_sort, uint64)
+{
+  for (uint64_t max : {uint64_t{0}, uint64_t{3}, uint64_t{1} << 20, std::numeric_limits<uint64_t>::max()})
+  {
+    for (size_t n : {0, 1, 50, 1000, 300000})
+    {
+      std::vector<uint64_t> v = random_vector(n, max, n);
+      std::vector<uint64_t> expected = v;
+      std::sort(expected.begin(), expected.end());
+      RadixSort<uint64_t>::sort(v.data(), v.size());
+      EXPECT_EQ(v, expected);
+    }
+  }
+}
+
+TEST(radix_sort, parallel)
+{
+  std::vector<uint64_t> v = random_vector(1 << 20, std::numeric_limits<uint64_t>::max(), 42);
+  std::vector<uint64_t> w = random_vector(1 << 12, 1 << 16, 43);
+  std::vector<uint64_t> ev = v, ew = w;
+  std::sort(ev.begin(), ev.end());
+  std::sort(ew.begin(), ew.end());
+
+  RadixSort<uint64_t> sorter;
+  sorter.add(v.data(), v.size());
+  sorter.add(w.data(), w.size());
+  sorter.sort(4);
+  EXPECT_EQ(v, ev);
+  EXPECT_EQ(w, ew);
+}
+
+TEST(radix_sort, large_int)
+{
+  std::mt19937_64 g(7);
+  std::vector<u128> v(200000);
+  for (auto& e : v)
+    e = u128{g(), g() & 0xffff};
+  std::vector<u128> expected = v;
+  std::sort(expected.begin(), expected.end());
+  RadixSort<u128>::sort(v.data(), v.size(), 3);
+  EXPECT_TRUE(v == expected);
+}
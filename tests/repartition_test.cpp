@@ -1,3 +1,6 @@
+#include <random>
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <gtest/gtest.h>
 #include <kmtricks/kmer.hpp>
@@ -16,4 +19,75 @@ TEST(repartition, repartition)
   EXPECT_EQ(1, repart.get_partition(Kmer<32>(k1).minimizer(10).value()));
   EXPECT_EQ(2, repart.get_partition(Kmer<32>(k2).minimizer(10).value()));
   EXPECT_EQ(3, repart.get_partition(Kmer<32>(k3).minimizer(10).value()));
-}
\ No newline at end of file
+}
+TEST(repartition, save)
+{
+  std::string path = "./tests_tmp/repartition.minimRepart";
+  Repartition repart("./data/repart_gatb/repartition.minimRepart", "");
+  std::vector<uint16_t> table = repart.table();
+  std::reverse(table.begin(), table.end());
+  repart.set_table(table);
+  repart.save(path);
+
+  Repartition saved(path, "");
+  EXPECT_EQ(saved.get_nb_partitions(), repart.get_nb_partitions());
+  EXPECT_EQ(saved.table(), table);
+  EXPECT_THROW(repart.set_table(std::vector<uint16_t>(10, 0)), InputError);
+}
+
+TEST(repartition, sampler)
+{
+  std::mt19937 g(42);
+  std::string seq(100000, 'A');
+  for (auto& c : seq)
+    c = "ACGT"[g() % 4];
+
+  MinimizerSampler<32> sampler(31, 8, 1000000, 0);
+  EXPECT_TRUE(sampler.push(seq.data(), seq.size()));
+  // same k-mers again, no new distinct ones
+  EXPECT_TRUE(sampler.push(seq.data(), seq.size()));
+
+  EXPECT_EQ(sampler.rate(), 1);
+  uint64_t sum = 0;
+  for (auto& c : sampler.counts())
+    sum += c;
+  EXPECT_EQ(sum, seq.size() - 30);
+  EXPECT_EQ(sampler.nb_kmers(), 2 * (seq.size() - 30));
+
+  std::string kmer = seq.substr(0, 31);
+  EXPECT_GT(sampler.counts()[Kmer<32>(kmer).minimizer(8).value()], 0);
+
+  MinimizerSampler<32> limited(31, 8, 100);
+  EXPECT_FALSE(limited.push(seq.data(), seq.size()));
+  EXPECT_EQ(limited.nb_kmers(), 100);
+}
+
+TEST(repartition, balance)
+{
+  std::mt19937 g(42);
+  std::vector<double> weights(1 << 12);
+  for (auto& w : weights)
+    w = (g() % 8 == 0) ? 0 : std::pow(g() % 100, 2);
+  weights[7] = 50000;
+
+  std::vector<double> loads;
+  std::vector<uint16_t> table = balance_minimizers(weights, 16, false, loads);
+  ASSERT_EQ(table.size(), weights.size());
+  double sum = 0, max = 0;
+  for (auto& l : loads) { sum += l; max = std::max(max, l); }
+  EXPECT_LT(max, 1.01 * sum / 16);
+
+  std::vector<double> check(16, 0);
+  for (size_t i=0; i<table.size(); i++)
+    check[table[i]] += weights[i];
+  EXPECT_EQ(check, loads);
+
+  table = balance_minimizers(weights, 16, true, loads);
+  EXPECT_EQ(table.front(), 0);
+  EXPECT_EQ(table.back(), 15);
+  for (size_t i=1; i<table.size(); i++)
+    EXPECT_LE(table[i] - table[i-1], 1);
+  max = 0;
+  for (auto& l : loads) max = std::max(max, l);
+  EXPECT_LT(max, 1.2 * sum / 16);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <kmtricks/rolling_kmer.hpp>
+#include <kmtricks/repartition.hpp>
+#include <kmtricks/utils.hpp>
+
+using namespace km;
+
+template<size_t MAX_K>
+void check_rolling(size_t kmer_size, size_t minim_size)
+{
+  std::string seq = random_dna_seq(2000);
+  seq[500] = 'N'; seq[510] = 'N'; seq[1200] = 'n';
+  for (size_t i=1500; i<1600; i++)
+    seq[i] = 'A';
+  seq[1800] = 'c'; seq[1801] = 'g';
+
+  RollingKmer<MAX_K> roll(kmer_size, minim_size);
+  size_t valid = 0;
+  for (size_t i=0; i<seq.size(); i++)
+  {
+    bool has_kmer = roll.push(seq[i]);
+    bool expected = i + 1 >= kmer_size;
+    for (size_t j=i+1-std::min(i+1, kmer_size); j<=i && expected; j++)
+      expected = is_acgt(seq[j]);
+    ASSERT_EQ(has_kmer, expected) << i;
+    if (!has_kmer)
+      continue;
+
+    valid++;
+    Kmer<MAX_K> kmer(seq.substr(i + 1 - kmer_size, kmer_size));
+    Kmer<MAX_K> cano = kmer.canonical();
+    EXPECT_EQ(roll.forward(), kmer);
+    EXPECT_EQ(roll.reverse(), kmer.rev_comp());
+    EXPECT_EQ(roll.canonical(), cano);
+    EXPECT_EQ(roll.minimizer(), cano.minimizer(minim_size).value());
+  }
+  EXPECT_GT(valid, 0);
+}
+
+TEST(rolling_kmer, k32)
+{
+  check_rolling<32>(31, 10);
+  check_rolling<32>(32, 4);
+}
+
+TEST(rolling_kmer, k64)
+{
+  check_rolling<64>(41, 11);
+  check_rolling<64>(64, 15);
+}
+
+TEST(rolling_kmer, k96)
+{
+  check_rolling<96>(75, 12);
+}
+
+TEST(rolling_kmer, k128)
+{
+  check_rolling<128>(127, 10);
+}
+
+template<size_t MAX_K>
+void check_router(size_t kmer_size, const Repartition& repart)
+{
+  std::string seq = random_dna_seq(3000);
+  seq[100] = 'N'; seq[2000] = 'n';
+
+  KmerRouter<MAX_K> router(kmer_size, 10, repart.table());
+  KmerRoutes<MAX_K> routes;
+  router.route(seq, routes);
+
+  size_t j = 0;
+  for (size_t i=0; i + kmer_size <= seq.size(); i++)
+  {
+    std::string s = seq.substr(i, kmer_size);
+    if (s.find_first_of("Nn") != std::string::npos)
+      continue;
+    ASSERT_LT(j, routes.size());
+    Kmer<MAX_K> cano = Kmer<MAX_K>(s).canonical();
+    EXPECT_EQ(routes.positions[j], i);
+    EXPECT_EQ(routes.kmers[j], cano);
+    EXPECT_EQ(routes.minimizers[j], cano.minimizer(10).value());
+    EXPECT_EQ(routes.partitions[j], repart.get_partition(Minimizer<MAX_K>(cano, 10)));
+    j++;
+  }
+  EXPECT_EQ(j, routes.size());
+
+  // reused on a shorter sequence
+  router.route(seq.substr(0, kmer_size - 1), routes);
+  EXPECT_EQ(routes.size(), 0);
+  EXPECT_TRUE(routes.partitions.empty());
+}
+
+TEST(rolling_kmer, router)
+{
+  Repartition repart("./data/repart_gatb/repartition.minimRepart", "");
+  check_router<32>(31, repart);
+  check_router<64>(63, repart);
+  check_router<128>(101, repart);
+
+  KmerRouter<32> router(31, 10);
+  KmerRoutes<32> routes;
+  router.route(random_dna_seq(100), routes);
+  EXPECT_EQ(routes.size(), 70);
+  EXPECT_TRUE(routes.partitions.empty());
+}
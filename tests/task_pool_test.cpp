@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <kmtricks/task_pool.hpp>
+
+class DummyTask : public km::ITask
+{
+public:
+  DummyTask(std::atomic<uint32_t>& clock, uint32_t level = 0)
+    : km::ITask(level), m_clock(clock) {}
+
+  void preprocess() {}
+  void postprocess() { this->m_finish = true; this->exec_callback(); }
+  void exec()
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    m_start = m_clock++;
+  }
+
+  uint32_t m_start {0};
+private:
+  std::atomic<uint32_t>& m_clock;
+};
+
+TEST(task_pool, run_all)
+{
+  std::atomic<uint32_t> clock {0};
+  std::vector<std::shared_ptr<DummyTask>> tasks;
+  {
+    km::TaskPool pool(4);
+    for (size_t i=0; i<100; i++)
+    {
+      tasks.push_back(std::make_shared<DummyTask>(clock));
+      pool.add_task(tasks.back());
+    }
+    pool.join_all();
+  }
+  EXPECT_EQ(clock, 100);
+  for (auto& t : tasks)
+    EXPECT_TRUE(t->finish());
+}
+
+TEST(task_pool, dependencies)
+{
+  std::atomic<uint32_t> clock {0};
+  km::TaskPool pool(4);
+
+  std::vector<std::shared_ptr<DummyTask>> first;
+  std::vector<km::task_t> deps;
+  for (size_t i=0; i<16; i++)
+  {
+    first.push_back(std::make_shared<DummyTask>(clock));
+    deps.push_back(first.back());
+  }
+
+  auto last = std::make_shared<DummyTask>(clock);
+  pool.add_task(last, deps);
+  for (auto& t : first)
+    pool.add_task(t);
+  pool.join_all();
+
+  EXPECT_EQ(clock, 17);
+  EXPECT_EQ(last->m_start, 16);
+}
+
+TEST(task_pool, dependencies_from_callback)
+{
+  std::atomic<uint32_t> clock {0};
+  km::TaskPool pool(4);
+
+  auto root = std::make_shared<DummyTask>(clock);
+  auto last = std::make_shared<DummyTask>(clock);
+  std::vector<std::shared_ptr<DummyTask>> children;
+
+  root->set_callback([&](){
+    for (size_t i=0; i<8; i++)
+    {
+      children.push_back(std::make_shared<DummyTask>(clock));
+      pool.add_dependency(last, children.back());
+      pool.add_task(children.back());
+    }
+  });
+
+  pool.add_task(root);
+  pool.add_task(last, {root});
+  pool.join_all();
+
+  EXPECT_EQ(clock, 10);
+  EXPECT_EQ(root->m_start, 0);
+  EXPECT_EQ(last->m_start, 9);
+  for (auto& c : children)
+    EXPECT_TRUE(c->finish());
+}
+
+TEST(task_pool, idle_workers)
+{
+  EXPECT_EQ(km::TaskPool::idle_workers(), 0);
+
+  std::atomic<uint32_t> clock {0};
+  km::TaskPool pool(4);
+  size_t idle = 0;
+  auto task = std::make_shared<DummyTask>(clock);
+  task->set_callback([&](){ idle = km::TaskPool::idle_workers(); });
+  pool.add_task(task);
+  pool.join_all();
+  // the pool is capped to the number of cores
+  EXPECT_EQ(idle, std::min(4u, std::thread::hardware_concurrency()) - 1);
+}
+
+TEST(task_pool, reservation)
+{
+  {
+    km::TaskPool::Reservation outside;
+    EXPECT_EQ(outside.size(), 0);
+  }
+
+  std::atomic<uint32_t> clock {0};
+  km::TaskPool pool(4);
+  size_t n = std::min(4u, std::thread::hardware_concurrency());
+  size_t first = 0, second = 0, idle = 0, after = 0;
+  auto task = std::make_shared<DummyTask>(clock);
+  task->set_callback([&](){
+    {
+      km::TaskPool::Reservation a(1);
+      km::TaskPool::Reservation b;
+      first = a.size();
+      second = b.size();
+      idle = km::TaskPool::idle_workers();
+    }
+    after = km::TaskPool::idle_workers();
+  });
+  pool.add_task(task);
+  pool.join_all();
+  // the workers are given to a single reservation, and back when it ends
+  EXPECT_EQ(first, std::min<size_t>(1, n - 1));
+  EXPECT_EQ(first + second, n - 1);
+  EXPECT_EQ(idle, 0);
+  EXPECT_EQ(after, n - 1);
+}
+
+TEST(task_pool, reserved_workers_do_not_pop)
+{
+  std::atomic<uint32_t> clock {0};
+  km::TaskPool pool(4);
+  std::atomic<bool> started {false};
+  bool during = true;
+  auto child = std::make_shared<DummyTask>(clock);
+  child->set_callback([&](){ started = true; });
+  auto task = std::make_shared<DummyTask>(clock);
+  task->set_callback([&](){
+    km::TaskPool::Reservation all;
+    pool.add_task(child);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    during = started;
+  });
+  pool.add_task(task);
+  pool.join_all();
+  // the child waits for the reservation to end, then runs
+  EXPECT_FALSE(during);
+  EXPECT_TRUE(started);
+}
@@ -3,6 +3,7 @@
 #define KMER_N 3
 
 #include <kmtricks/loop_executor.hpp>
+#include <kmtricks/utils.hpp>
 
 template<size_t M>
 struct TestFunctor
@@ -22,4 +23,31 @@ TEST(kmer_selector, kmer_size_selector)
   EXPECT_EQ(value, 64);
   km::const_loop_executor<0, KMER_N>::exec<TestFunctor>(90, 42, value);
   EXPECT_EQ(value, 96);
-}
\ No newline at end of file
+}
+TEST(bounded_queue, producer_consumers)
+{
+  km::BoundedQueue<std::vector<int>> queue(2);
+  std::vector<size_t> sums(4, 0);
+  std::vector<std::thread> consumers;
+  for (size_t i=0; i<sums.size(); i++)
+    consumers.emplace_back([&, i](){
+      std::vector<int> batch;
+      while (queue.pop(batch))
+        for (auto v : batch)
+          sums[i] += v;
+    });
+
+  for (int i=0; i<1000; i++)
+    queue.push(std::vector<int>(10, i));
+  queue.close();
+  for (auto& t : consumers)
+    t.join();
+
+  size_t total = 0;
+  for (auto s : sums)
+    total += s;
+  EXPECT_EQ(total, 10 * (999 * 1000 / 2));
+
+  std::vector<int> batch;
+  EXPECT_FALSE(queue.pop(batch));
+}